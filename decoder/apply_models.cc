@@ -8,6 +8,16 @@
 
 #include <vector>
 #include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstring>
+#include <deque>
+#include <functional>
+#include <limits>
+#include <mutex>
+#include <queue>
+#include <thread>
+#include <type_traits>
 #ifndef HAVE_OLD_CPP
 # include <unordered_map>
 # include <unordered_set>
@@ -23,10 +33,12 @@ namespace std { using std::tr1::unordered_map; using std::tr1::unordered_set; }
 #include "hg.h"
 #include "ff.h"
 #include "ffset.h"
+#include "murmur_hash.h"
 
 #define NORMAL_CP 1
 #define FAST_CP 2
 #define FAST_CP_2 3
+#define PARALLEL_CP 4
 
 using namespace std;
 
@@ -38,6 +50,38 @@ typedef vector<Candidate*> CandidateList;
 // default vector size (* sizeof string is memory used)
 static const size_t kRESERVE_NUM_NODES = 500000ul;
 
+// sets (*features)[e] to the features of -LM edge e plus those of the
+// stateless models, which do not depend on the +LM antecedents, so they are
+// computed once per -LM edge, and by each model for all edges in one call.
+// edges into the goal node only get final features, so theirs are copied.
+// leaves features empty if there are no stateless models
+static void AddStatelessFeatures(const Hypergraph& in,
+                                 const SentenceMetadata& smeta,
+                                 const ModelSet& models,
+                                 vector<SparseVector<double> >* features) {
+  features->clear();
+  if (!models.has_stateless()) return;
+  features->resize(in.edges_.size());
+  vector<const Hypergraph::Edge*> edges;
+  vector<SparseVector<double> > batch;
+  edges.reserve(in.edges_.size());
+  const int goal_id = in.nodes_.size() - 1;
+  for (int i = 0; i < in.edges_.size(); ++i) {
+    const Hypergraph::Edge& edge = in.edges_[i];
+    if (edge.head_node_ == goal_id)
+      (*features)[i] = edge.feature_values_;
+    else
+      edges.push_back(&edge);
+  }
+  batch.resize(edges.size());
+  for (int i = 0; i < edges.size(); ++i)
+    batch[i] = edges[i]->feature_values_;
+  if (!edges.empty())
+    models.AddStatelessFeatures(smeta, &edges[0], edges.size(), &batch[0]);
+  for (int i = 0; i < edges.size(); ++i)
+    (*features)[edges[i]->id_].swap(batch[i]);
+}
+
 // life cycle: candidates are created, placed on the heap
 // and retrieved by their estimated cost, when they're
 // retrieved, they're incorporated into the +LM hypergraph
@@ -54,64 +98,76 @@ struct Candidate {
                                        // into the +LM forest
   const Hypergraph::Edge* in_edge_;    // in -LM forest
   Hypergraph::Edge out_edge_;
-  FFState state_;
+  uint32_t state_;                     // id in the FFStateInterner of the node
+  const uint8_t* node_state_;          // residual context of the +LM node, set
+                                       // when it is incorporated; the memory
+                                       // is owned by the rescorer
   const JVector j_;
   prob_t vit_prob_;            // these are fixed until the cand
                                // is popped, then they may be updated
   prob_t est_prob_;
 
+  // scratch is where the feature functions write the residual state before
+  // it is interned in states
   Candidate(const Hypergraph::Edge& e,
             const JVector& j,
-            const Hypergraph& out_hg,
             const vector<CandidateList>& D,
-            const FFStates& node_states,
             const SentenceMetadata& smeta,
             const ModelSet& models,
-            bool is_goal) :
+            bool is_goal,
+            FFState* scratch,
+            FFStateInterner* states,
+            const vector<SparseVector<double> >& edge_features) :
       node_index_(-1),
       in_edge_(&e),
+      node_state_(NULL),
       j_(j) {
-    InitializeCandidate(out_hg, smeta, D, node_states, models, is_goal);
+    InitializeCandidate(smeta, D, models, is_goal, scratch, states, edge_features);
   }
 
-  // used to query uniqueness
-  Candidate(const Hypergraph::Edge& e,
-            const JVector& j) : in_edge_(&e), j_(j) {}
-
   bool IsIncorporatedIntoHypergraph() const {
     return node_index_ >= 0;
   }
 
-  void InitializeCandidate(const Hypergraph& out_hg,
-                           const SentenceMetadata& smeta,
+  void InitializeCandidate(const SentenceMetadata& smeta,
                            const vector<vector<Candidate*> >& D,
-                           const FFStates& node_states,
                            const ModelSet& models,
-                           const bool is_goal) {
+                           const bool is_goal,
+                           FFState* scratch,
+                           FFStateInterner* states,
+                           const vector<SparseVector<double> >& edge_features) {
     const Hypergraph::Edge& in_edge = *in_edge_;
     out_edge_.rule_ = in_edge.rule_;
-    out_edge_.feature_values_ = in_edge.feature_values_;
+    // with stateless models, edge_features has their features (see AddStatelessFeatures)
+    out_edge_.feature_values_ = edge_features.empty() ? in_edge.feature_values_ : edge_features[in_edge.id_];
     out_edge_.i_ = in_edge.i_;
     out_edge_.j_ = in_edge.j_;
     out_edge_.prev_i_ = in_edge.prev_i_;
     out_edge_.prev_j_ = in_edge.prev_j_;
     Hypergraph::TailNodeVector& tail = out_edge_.tail_nodes_;
     tail.resize(j_.size());
+    SmallVector<const uint8_t*, 4> ant_states(j_.size());
     prob_t p = prob_t::One();
     // cerr << "\nEstimating application of " << in_edge.rule_->AsString() << endl;
     for (int i = 0; i < tail.size(); ++i) {
       const Candidate& ant = *D[in_edge.tail_nodes_[i]][j_[i]];
       assert(ant.IsIncorporatedIntoHypergraph());
       tail[i] = ant.node_index_;
+      ant_states[i] = ant.node_state_;
       p *= ant.vit_prob_;
     }
     prob_t edge_estimate = prob_t::One();
     if (is_goal) {
       assert(tail.size() == 1);
-      const FFState& ant_state = node_states[tail.front()];
-      models.AddFinalFeatures(ant_state, &out_edge_, smeta);
+      models.AddFinalFeatures(ant_states[0], &out_edge_, smeta);
+      // all goal candidates share a state of zeros
+      if (scratch->size() != models.StateSize()) scratch->resize(models.StateSize());
+      fill(scratch->begin(), scratch->end(), 0);
+      state_ = states->Intern(scratch->begin(), models.StateSignature(scratch->begin()));
     } else {
-      models.AddFeaturesToEdge(smeta, out_hg, node_states, &out_edge_, &state_, &edge_estimate);
+      uint64_t signature;
+      models.AddStatefulFeaturesToEdge(smeta, ant_states.begin(), &out_edge_, scratch, &edge_estimate, &signature);
+      state_ = states->Intern(scratch->begin(), signature);
     }
     vit_prob_ = out_edge_.edge_prob_ * p;
     est_prob_ = vit_prob_ * edge_estimate;
@@ -143,29 +199,192 @@ struct EstProbSorter {
   }
 };
 
+// allocates candidates in blocks and reuses the memory of the ones that
+// are freed.  New is only called by the thread that owns the pool, Free may
+// also be called by others (PARALLEL_CP commits nodes on another thread
+// than the one that created their candidates).  all blocks are released
+// when the pool is destroyed, the candidates must have been destroyed by then
+class CandidatePool {
+ public:
+  CandidatePool() : free_(), returned_(NULL), used_(kBLOCK_SIZE) {}
+  ~CandidatePool() {
+    for (int i = 0; i < blocks_.size(); ++i)
+      delete[] blocks_[i];
+  }
+
+  void* New() {
+    if (!free_ && returned_.load(memory_order_relaxed))
+      free_ = returned_.exchange(NULL, memory_order_acquire);
+    if (free_) {
+      Slot* s = free_;
+      free_ = s->next;
+      return s;
+    }
+    if (used_ == kBLOCK_SIZE) {
+      blocks_.push_back(new Slot[kBLOCK_SIZE]);
+      used_ = 0;
+    }
+    return &blocks_.back()[used_++];
+  }
+
+  // destroys the candidates and makes their memory available again
+  void Free(const CandidateList& cands) {
+    if (cands.empty()) return;
+    Slot* head = NULL;
+    Slot* tail = NULL;
+    for (int i = 0; i < cands.size(); ++i) {
+      cands[i]->~Candidate();
+      Slot* s = reinterpret_cast<Slot*>(cands[i]);
+      s->next = head;
+      head = s;
+      if (!tail) tail = s;
+    }
+    tail->next = returned_.load(memory_order_relaxed);
+    while (!returned_.compare_exchange_weak(tail->next, head, memory_order_release, memory_order_relaxed)) {}
+  }
+
+ private:
+  static const int kBLOCK_SIZE = 1024;
+  union Slot {
+    Slot* next;
+    typename aligned_storage<sizeof(Candidate), alignof(Candidate)>::type cand;
+  };
+  Slot* free_;                // only used by the owner
+  atomic<Slot*> returned_;    // freed by Free since the owner last looked
+  vector<Slot*> blocks_;
+  int used_;                  // slots handed out from blocks_.back()
+};
+
+// open addressing (linear probing) hash table of candidates that finds the
+// candidate equal to a key, where Traits defines the key of a candidate and
+// how keys are hashed and compared.  slots are stamped with the generation
+// they were filled in, so Clear() is O(1)
+template <class Traits>
+class CandidateTable {
+ public:
+  typedef typename Traits::Key Key;
+
+  explicit CandidateTable(const Traits& traits = Traits()) :
+      traits_(traits), slots_(kINITIAL_SIZE), size_(), generation_(1) {}
+
+  // the candidate whose key is k, or NULL
+  Candidate* Find(const Key& k) const {
+    const uint32_t h = traits_.Hash(k);
+    const size_t mask = slots_.size() - 1;
+    for (size_t i = h & mask; ; i = (i + 1) & mask) {
+      const Slot& s = slots_[i];
+      if (s.generation != generation_) return NULL;
+      if (s.hash == h && traits_.Equal(traits_.KeyOf(s.cand), k)) return s.cand;
+    }
+  }
+
+  // the candidate with the same key as c, after adding c if there was none
+  Candidate* Insert(Candidate* c) {
+    if (2 * (size_ + 1) > slots_.size()) Grow();
+    const Key k = traits_.KeyOf(c);
+    const uint32_t h = traits_.Hash(k);
+    const size_t mask = slots_.size() - 1;
+    for (size_t i = h & mask; ; i = (i + 1) & mask) {
+      Slot& s = slots_[i];
+      if (s.generation != generation_) {
+        s.generation = generation_;
+        s.hash = h;
+        s.cand = c;
+        ++size_;
+        return c;
+      }
+      if (s.hash == h && traits_.Equal(traits_.KeyOf(s.cand), k)) return s.cand;
+    }
+  }
+
+  void Clear() {
+    size_ = 0;
+    if (++generation_ == 0) {
+      for (int i = 0; i < slots_.size(); ++i) slots_[i].generation = 0;
+      generation_ = 1;
+    }
+  }
+
+ private:
+  static const size_t kINITIAL_SIZE = 64;  // power of 2
+  struct Slot {
+    Slot() : generation(), hash(), cand() {}
+    uint32_t generation;
+    uint32_t hash;
+    Candidate* cand;
+  };
+
+  void Grow() {
+    vector<Slot> old(slots_.size() * 2);
+    old.swap(slots_);
+    const size_t mask = slots_.size() - 1;
+    for (int i = 0; i < old.size(); ++i) {
+      if (old[i].generation != generation_) continue;
+      size_t j = old[i].hash & mask;
+      while (slots_[j].generation == generation_) j = (j + 1) & mask;
+      slots_[j] = old[i];
+    }
+  }
+
+  Traits traits_;
+  vector<Slot> slots_;
+  size_t size_;
+  uint32_t generation_;
+};
+
 // the same candidate <edge, j> can be added multiple times if
 // j is multidimensional (if you're going NW in Manhattan, you
 // can first go north, then west, or you can go west then north)
 // this is a hash function on the relevant variables from
 // Candidate to enforce this.
-struct CandidateUniquenessHash {
-  size_t operator()(const Candidate* c) const {
+struct CandidateUniqueness {
+  struct Key {
+    Key(const Hypergraph::Edge* e, const JVector* jv) : edge(e), j(jv) {}
+    const Hypergraph::Edge* edge;
+    const JVector* j;
+  };
+  Key KeyOf(const Candidate* c) const { return Key(c->in_edge_, &c->j_); }
+  uint32_t Hash(const Key& k) const {
     size_t x = 5381;
-    x = ((x << 5) + x) ^ c->in_edge_->id_;
-    for (int i = 0; i < c->j_.size(); ++i)
-      x = ((x << 5) + x) ^ c->j_[i];
+    x = ((x << 5) + x) ^ k.edge->id_;
+    for (int i = 0; i < k.j->size(); ++i)
+      x = ((x << 5) + x) ^ (*k.j)[i];
     return x;
   }
+  bool Equal(const Key& a, const Key& b) const {
+    return (a.edge == b.edge) && (*a.j == *b.j);
+  }
 };
 
-struct CandidateUniquenessEquals {
-  bool operator()(const Candidate* a, const Candidate* b) const {
-    return (a->in_edge_ == b->in_edge_) && (a->j_ == b->j_);
+typedef CandidateTable<CandidateUniqueness> UniqueCandidateSet;
+
+// everything the heap phase of a node allocates.  there is one per thread,
+// and it is reset in O(1) when a node starts
+struct NodeWorkspace {
+  explicit NodeWorkspace(int state_size) : states(state_size) {}
+  void Clear() {
+    states.Clear();
+    unique.Clear();
+    accepted.Clear();
+    state2node.clear();
   }
+  CandidatePool pool;
+  FFState scratch;
+  FFStateInterner states;       // of the candidates created for the node
+  UniqueCandidateSet unique;    // candidates created for the node
+  UniqueCandidateSet accepted;  // FAST_CP_2: candidates popped for the node
+  CandidateList state2node;     // "buf" in Figure 2, by state id (NULL if none popped)
 };
 
-typedef unordered_set<const Candidate*, CandidateUniquenessHash, CandidateUniquenessEquals> UniqueCandidateSet;
-typedef unordered_map<FFState, Candidate*, boost::hash<FFState> > State2Node;
+// what the heap phase of a node passes to the commit phase
+struct PoppedCandidates {
+  PoppedCandidates() : pool() {}
+  CandidateList items;     // in the order they were popped
+  CandidateList recomb;    // recomb[i] is the first popped item with items[i]'s state
+  vector<uint8_t> states;  // states of the distinct recomb items, in order
+  CandidateList unused;    // left on the heap
+  CandidatePool* pool;     // that items and unused came from
+};
 
 class CubePruningRescorer {
 
@@ -175,24 +394,37 @@ public:
                       const Hypergraph& i,
                       int pop_limit,
                       Hypergraph* o,
-                      int s = NORMAL_CP ) :
+                      int s = NORMAL_CP,
+                      int threads = 1) :
       models(m),
       smeta(sm),
       in(i),
       out(*o),
       D(in.nodes_.size()),
+      node_states_(in.nodes_.size()),
       pop_limit_(pop_limit),
-      strategy_(s){
+      strategy_(s),
+      threads_(threads) {
     if (!SILENT) cerr << "  Applying feature functions (cube pruning, pop_limit = " << pop_limit_ << ')' << endl;
-    node_states_.reserve(kRESERVE_NUM_NODES);
+    AddStatelessFeatures(in, smeta, models, &edge_features_);
+  }
+
+  ~CubePruningRescorer() {
+    for (int i = 0; i < workspaces_.size(); ++i)
+      delete workspaces_[i];
   }
 
   void Apply() {
+    if (strategy_ == PARALLEL_CP) {
+      ApplyParallel();
+      return;
+    }
     int num_nodes = in.nodes_.size();
     assert(num_nodes >= 2);
     int goal_id = num_nodes - 1;
     int pregoal = goal_id - 1;
     assert(in.nodes_[pregoal].out_edges_.size() == 1);
+    workspaces_.push_back(new NodeWorkspace(models.StateSize()));
     if (!SILENT) cerr << "    ";
     int has = 0;
     for (int i = 0; i < in.nodes_.size(); ++i) {
@@ -200,15 +432,17 @@ public:
         int needs = (50 * i / in.nodes_.size());
         while (has < needs) { cerr << '.'; ++has; }
       }
+      PoppedCandidates popped;
       if (strategy_==NORMAL_CP){
-        KBest(i, i == goal_id);
+        KBest(i, i == goal_id, workspaces_[0], &popped);
       }
       if (strategy_==FAST_CP){
-        KBestFast(i, i == goal_id);
+        KBestFast(i, i == goal_id, workspaces_[0], &popped);
       }
       if (strategy_==FAST_CP_2){
-        KBestFast2(i, i == goal_id);
+        KBestFast2(i, i == goal_id, workspaces_[0], &popped);
       }
+      CommitCandidates(i, &popped);
     }
     if (!SILENT) {
       cerr << endl;
@@ -220,110 +454,242 @@ public:
   }
 
  private:
+  // runs the heap phase (KBest) for all nodes whose antecedents are in the
+  // +LM forest on threads_ threads, and commits the results in node order
+  // on this thread, so the +LM forest is the same as the one NORMAL_CP
+  // builds. nodes become ready in the order of the highest antecedent they
+  // use and are handed out lowest id first from a shared queue; the
+  // committing thread takes work from it while it waits
+  void ApplyParallel() {
+    const int num_nodes = in.nodes_.size();
+    assert(num_nodes >= 2);
+    const int goal_id = num_nodes - 1;
+    assert(in.nodes_[goal_id - 1].out_edges_.size() == 1);
+    vector<int> needs(num_nodes, 0);  // number of nodes that must be committed first
+    for (int i = 0; i < num_nodes; ++i) {
+      const Hypergraph::EdgesVector& in_edges = in.nodes_[i].in_edges_;
+      for (int j = 0; j < in_edges.size(); ++j) {
+        const Hypergraph::TailNodeVector& tail = in.edges_[in_edges[j]].tail_nodes_;
+        for (int k = 0; k < tail.size(); ++k)
+          needs[i] = max(needs[i], static_cast<int>(tail[k]) + 1);
+      }
+    }
+    vector<int> by_needs(num_nodes);
+    for (int i = 0; i < num_nodes; ++i) by_needs[i] = i;
+    stable_sort(by_needs.begin(), by_needs.end(),
+                [&needs](int a, int b) { return needs[a] < needs[b]; });
+
+    int threads = threads_;
+    if (threads <= 0) threads = max(1u, thread::hardware_concurrency());
+    if (threads > 1 && !models.IsThreadSafe()) {
+      if (!SILENT) cerr << "  Note: some feature functions are not thread safe, using one thread for cube pruning\n";
+      threads = 1;
+    }
+    for (int i = 0; i < threads; ++i)
+      workspaces_.push_back(new NodeWorkspace(models.StateSize()));
+
+    vector<PoppedCandidates> popped(num_nodes);
+    vector<char> done(num_nodes, 0);
+    priority_queue<int, vector<int>, greater<int> > ready;
+    int released = 0;
+    bool finished = false;
+    mutex m;
+    condition_variable cv;
+    auto pop = [&](int node, NodeWorkspace* ws) {
+      KBest(node, node == goal_id, ws, &popped[node]);
+    };
+    auto work = [&](NodeWorkspace* ws) {
+      unique_lock<mutex> lock(m);
+      while (true) {
+        while (ready.empty() && !finished) cv.wait(lock);
+        if (finished) return;
+        const int node = ready.top();
+        ready.pop();
+        lock.unlock();
+        pop(node, ws);
+        lock.lock();
+        done[node] = 1;
+        cv.notify_all();
+      }
+    };
+    vector<thread> workers;
+    for (int i = 1; i < threads; ++i)
+      workers.push_back(thread(work, workspaces_[i]));
+
+    if (!SILENT) cerr << "    ";
+    int has = 0;
+    for (int i = 0; i < num_nodes; ++i) {
+      unique_lock<mutex> lock(m);
+      while (released < num_nodes && needs[by_needs[released]] <= i) {
+        ready.push(by_needs[released++]);
+        cv.notify_one();
+      }
+      while (!done[i]) {
+        if (ready.empty()) {
+          cv.wait(lock);
+          continue;
+        }
+        const int node = ready.top();
+        ready.pop();
+        lock.unlock();
+        pop(node, workspaces_[0]);
+        lock.lock();
+        done[node] = 1;
+      }
+      lock.unlock();
+      if (!SILENT) {
+        int dots = (50 * i / num_nodes);
+        while (has < dots) { cerr << '.'; ++has; }
+      }
+      CommitCandidates(i, &popped[i]);
+      popped[i] = PoppedCandidates();
+    }
+    {
+      lock_guard<mutex> lock(m);
+      finished = true;
+    }
+    cv.notify_all();
+    for (int i = 0; i < workers.size(); ++i)
+      workers[i].join();
+
+    if (!SILENT) {
+      cerr << endl;
+      cerr << "  Best path: " << log(D[goal_id].front()->vit_prob_)
+           << "\t" << log(D[goal_id].front()->est_prob_) << endl;
+    }
+    out.PruneUnreachable(D[goal_id].front()->node_index_);
+    FreeAll();
+  }
+
   void FreeAll() {
+    // the pools release the memory when the workspaces are deleted
     for (int i = 0; i < D.size(); ++i) {
       CandidateList& D_i = D[i];
       for (int j = 0; j < D_i.size(); ++j)
-        delete D_i[j];
+        D_i[j]->~Candidate();
     }
     D.clear();
   }
 
-  void IncorporateIntoPlusLMForest(Candidate* item, State2Node* s2n, CandidateList* freelist) {
-    Hypergraph::Edge* new_edge = out.AddEdge(item->out_edge_);
-    new_edge->edge_prob_ = item->out_edge_.edge_prob_;
-    Candidate*& o_item = (*s2n)[item->state_];
-    if (!o_item) o_item = item;
+  Candidate* NewCandidate(const Hypergraph::Edge& edge, const JVector& j, const bool is_goal, NodeWorkspace* ws) {
+    return new (ws->pool.New()) Candidate(edge, j, D, smeta, models, is_goal, &ws->scratch, &ws->states, edge_features_);
+  }
 
-    int& node_id = o_item->node_index_;
-    if (node_id < 0) {
-      Hypergraph::Node* new_node = out.AddNode(in.nodes_[item->in_edge_->head_node_].cat_);
-      node_states_.push_back(item->state_);
-      node_id = new_node->id_;
-    }
-#if 0
-    Hypergraph::Node* node = &out.nodes_[node_id];
-    out.ConnectEdgeToHeadNode(new_edge, node);
-#else
-    out.ConnectEdgeToHeadNode(new_edge, node_id);
-#endif
-    // update candidate if we have a better derivation
-    // note: the difference between the vit score and the estimated
-    // score is the same for all items with a common residual DP
-    // state
-    if (item->vit_prob_ > o_item->vit_prob_) {
-      assert(o_item->state_ == item->state_);    // sanity check!
-      o_item->est_prob_ = item->est_prob_;
-      o_item->vit_prob_ = item->vit_prob_;
+  // starts the heap phase of a node
+  void StartNode(NodeWorkspace* ws, PoppedCandidates* popped) {
+    ws->Clear();
+    popped->pool = &ws->pool;
+  }
+
+  // records that item was popped, and which popped item with the same
+  // state it will be recombined with
+  void RecordPop(Candidate* item, NodeWorkspace* ws, PoppedCandidates* popped) {
+    if (item->state_ >= ws->state2node.size())
+      ws->state2node.resize(ws->states.size(), NULL);
+    Candidate*& o_item = ws->state2node[item->state_];
+    if (!o_item) {
+      o_item = item;
+      const uint8_t* state = ws->states.Get(item->state_);
+      popped->states.insert(popped->states.end(), state, state + ws->states.StateSize());
     }
-    if (item != o_item) freelist->push_back(item);
+    popped->items.push_back(item);
+    popped->recomb.push_back(o_item);
   }
 
-  void KBest(const int vert_index, const bool is_goal) {
-    // cerr << "KBest(" << vert_index << ")\n";
+  // adds the popped candidates of vert_index to the +LM forest, fills in
+  // D[vert_index] and frees the candidates that are not needed any more.
+  // this is the only part of processing a node that modifies the +LM forest
+  // or the state of other nodes, so it must be called in node order, but
+  // the heap phase (KBest) of a node only depends on the commit phases of
+  // its antecedents
+  void CommitCandidates(const int vert_index, PoppedCandidates* popped) {
     CandidateList& D_v = D[vert_index];
     assert(D_v.empty());
+    const int state_size = models.StateSize();
+    // the states of the new nodes are kept with vert_index, so they do not
+    // move when other nodes are committed
+    node_states_[vert_index].swap(popped->states);
+    const uint8_t* next_state = node_states_[vert_index].data();
+    for (int i = 0; i < popped->items.size(); ++i) {
+      Candidate* item = popped->items[i];
+      Candidate* o_item = popped->recomb[i];
+      // out_edge_ is not needed once it is in the forest
+      Hypergraph::Edge* new_edge = out.AddEdge(std::move(item->out_edge_));
+      int& node_id = o_item->node_index_;
+      if (node_id < 0) {
+        Hypergraph::Node* new_node = out.AddNode(in.nodes_[item->in_edge_->head_node_].cat_);
+        o_item->node_state_ = next_state;
+        next_state += state_size;
+        node_id = new_node->id_;
+        D_v.push_back(o_item);
+      }
+      out.ConnectEdgeToHeadNode(new_edge, node_id);
+      // update candidate if we have a better derivation
+      // note: the difference between the vit score and the estimated
+      // score is the same for all items with a common residual DP
+      // state
+      if (item->vit_prob_ > o_item->vit_prob_) {
+        o_item->est_prob_ = item->est_prob_;
+        o_item->vit_prob_ = item->vit_prob_;
+      }
+      // even after an item merged, it stays in the uniqueness set of the
+      // heap phase, so it is only freed now
+      if (item != o_item) popped->unused.push_back(item);
+    }
+    sort(D_v.begin(), D_v.end(), EstProbSorter());
+    // cerr << "  expanded to " << D_v.size() << " nodes\n";
+    if (popped->pool) popped->pool->Free(popped->unused);
+  }
+
+  // heap phase of a node: pops up to pop_limit_ candidates off the heap.
+  // this only reads D and node_states_ of vert_index's antecedents, so it
+  // can run concurrently for nodes whose antecedents have been committed:
+  // the heap order does not depend on how popped candidates are merged
+  void KBest(const int vert_index, const bool is_goal, NodeWorkspace* ws, PoppedCandidates* popped) {
+    // cerr << "KBest(" << vert_index << ")\n";
+    StartNode(ws, popped);
     const Hypergraph::Node& v = in.nodes_[vert_index];
     // cerr << "  has " << v.in_edges_.size() << " in-coming edges\n";
-    const vector<int>& in_edges = v.in_edges_;
-    CandidateHeap cand;
-    CandidateList freelist;
+    const Hypergraph::EdgesVector& in_edges = v.in_edges_;
+    CandidateHeap& cand = popped->unused;
     cand.reserve(in_edges.size());
-    UniqueCandidateSet unique_cands;
     for (int i = 0; i < in_edges.size(); ++i) {
       const Hypergraph::Edge& edge = in.edges_[in_edges[i]];
       const JVector j(edge.tail_nodes_.size(), 0);
-      cand.push_back(new Candidate(edge, j, out, D, node_states_, smeta, models, is_goal));
-      bool is_new = unique_cands.insert(cand.back()).second;
+      cand.push_back(NewCandidate(edge, j, is_goal, ws));
+      bool is_new = ws->unique.Insert(cand.back()) == cand.back();
       assert(is_new);  // these should all be unique!
     }
 //    cerr << "  making heap of " << cand.size() << " candidates\n";
     make_heap(cand.begin(), cand.end(), HeapCandCompare());
-    State2Node state2node;   // "buf" in Figure 2
     int pops = 0;
     while(!cand.empty() && pops < pop_limit_) {
       pop_heap(cand.begin(), cand.end(), HeapCandCompare());
       Candidate* item = cand.back();
       cand.pop_back();
       // cerr << "POPPED: " << *item << endl;
-      PushSucc(*item, is_goal, &cand, &unique_cands);
-      IncorporateIntoPlusLMForest(item, &state2node, &freelist);
+      PushSucc(*item, is_goal, ws, &cand);
+      RecordPop(item, ws, popped);
       ++pops;
     }
-    D_v.resize(state2node.size());
-    int c = 0;
-    for (State2Node::iterator i = state2node.begin(); i != state2node.end(); ++i)
-      D_v[c++] = i->second;
-    sort(D_v.begin(), D_v.end(), EstProbSorter());
-    // cerr << "  expanded to " << D_v.size() << " nodes\n";
-
-    for (int i = 0; i < cand.size(); ++i)
-      delete cand[i];
-    // freelist is necessary since even after an item merged, it still stays in
-    // the unique set so it can't be deleted til now
-    for (int i = 0; i < freelist.size(); ++i)
-      delete freelist[i];
   }
 
-  void KBestFast(const int vert_index, const bool is_goal) {
+  void KBestFast(const int vert_index, const bool is_goal, NodeWorkspace* ws, PoppedCandidates* popped) {
 	  // cerr << "KBest(" << vert_index << ")\n";
-	  CandidateList& D_v = D[vert_index];
-	  assert(D_v.empty());
+	  StartNode(ws, popped);
 	  const Hypergraph::Node& v = in.nodes_[vert_index];
 	  // cerr << " has " << v.in_edges_.size() << " in-coming edges\n";
-	  const vector<int>& in_edges = v.in_edges_;
-	  CandidateHeap cand;
-	  CandidateList freelist;
+	  const Hypergraph::EdgesVector& in_edges = v.in_edges_;
+	  CandidateHeap& cand = popped->unused;
 	  cand.reserve(in_edges.size());
 	  //init with j<0,0> for all rules-edges that lead to node-(NT-span)
 	  for (int i = 0; i < in_edges.size(); ++i) {
 		  const Hypergraph::Edge& edge = in.edges_[in_edges[i]];
 		  const JVector j(edge.tail_nodes_.size(), 0);
-		  cand.push_back(new Candidate(edge, j, out, D, node_states_, smeta, models, is_goal));
+		  cand.push_back(NewCandidate(edge, j, is_goal, ws));
 	  }
 	  // cerr << " making heap of " << cand.size() << " candidates\n";
 	  make_heap(cand.begin(), cand.end(), HeapCandCompare());
-	  State2Node state2node; // "buf" in Figure 2
 	  int pops = 0;
 	  while(!cand.empty() && pops < pop_limit_) {
 		  pop_heap(cand.begin(), cand.end(), HeapCandCompare());
@@ -331,101 +697,64 @@ public:
 		  cand.pop_back();
 		  // cerr << "POPPED: " << *item << endl;
 
-		  PushSuccFast(*item, is_goal, &cand);
-		  IncorporateIntoPlusLMForest(item, &state2node, &freelist);
+		  PushSuccFast(*item, is_goal, ws, &cand);
+		  RecordPop(item, ws, popped);
 		  ++pops;
 	  }
-	  D_v.resize(state2node.size());
-	  int c = 0;
-	  for (State2Node::iterator i = state2node.begin(); i != state2node.end(); ++i){
-		  D_v[c++] = i->second;
-		  // cerr << "MERGED: " << *i->second << endl;
-	  }
 	  //cerr <<"Node id: "<< vert_index<< endl;
 	  //#ifdef MEASURE_CA
 	  // cerr << "countInProcess (pop/tot): node id: " << vert_index << " (" << count_in_process_pop << "/" << count_in_process_tot << ")"<<endl;
 	  // cerr << "countAtEnd (pop/tot): node id: " << vert_index << " (" << count_at_end_pop << "/" << count_at_end_tot << ")"<<endl;
 	  //#endif
-	  sort(D_v.begin(), D_v.end(), EstProbSorter());
-
-	  // cerr << " expanded to " << D_v.size() << " nodes\n";
-
-	  for (int i = 0; i < cand.size(); ++i)
-		  delete cand[i];
-	  // freelist is necessary since even after an item merged, it still stays in
-	  // the unique set so it can't be deleted til now
-	  for (int i = 0; i < freelist.size(); ++i)
-		  delete freelist[i];
   }
 
-  void KBestFast2(const int vert_index, const bool is_goal) {
+  void KBestFast2(const int vert_index, const bool is_goal, NodeWorkspace* ws, PoppedCandidates* popped) {
 	  // cerr << "KBest(" << vert_index << ")\n";
-	  CandidateList& D_v = D[vert_index];
-	  assert(D_v.empty());
+	  StartNode(ws, popped);
 	  const Hypergraph::Node& v = in.nodes_[vert_index];
 	  // cerr << " has " << v.in_edges_.size() << " in-coming edges\n";
-	  const vector<int>& in_edges = v.in_edges_;
-	  CandidateHeap cand;
-	  CandidateList freelist;
+	  const Hypergraph::EdgesVector& in_edges = v.in_edges_;
+	  CandidateHeap& cand = popped->unused;
 	  cand.reserve(in_edges.size());
-	  UniqueCandidateSet unique_accepted;
 	  //init with j<0,0> for all rules-edges that lead to node-(NT-span)
 	  for (int i = 0; i < in_edges.size(); ++i) {
 		  const Hypergraph::Edge& edge = in.edges_[in_edges[i]];
 		  const JVector j(edge.tail_nodes_.size(), 0);
-		  cand.push_back(new Candidate(edge, j, out, D, node_states_, smeta, models, is_goal));
+		  cand.push_back(NewCandidate(edge, j, is_goal, ws));
 	  }
 	  // cerr << " making heap of " << cand.size() << " candidates\n";
 	  make_heap(cand.begin(), cand.end(), HeapCandCompare());
-	  State2Node state2node; // "buf" in Figure 2
 	  int pops = 0;
 	  while(!cand.empty() && pops < pop_limit_) {
 		  pop_heap(cand.begin(), cand.end(), HeapCandCompare());
 		  Candidate* item = cand.back();
 		  cand.pop_back();
-                  bool is_new = unique_accepted.insert(item).second;
+                  bool is_new = ws->accepted.Insert(item) == item;
 		  assert(is_new); // these should all be unique!
 		  // cerr << "POPPED: " << *item << endl;
 
-		  PushSuccFast2(*item, is_goal, &cand, &unique_accepted);
-		  IncorporateIntoPlusLMForest(item, &state2node, &freelist);
+		  PushSuccFast2(*item, is_goal, ws, &cand);
+		  RecordPop(item, ws, popped);
 		  ++pops;
 	  }
-	  D_v.resize(state2node.size());
-	  int c = 0;
-	  for (State2Node::iterator i = state2node.begin(); i != state2node.end(); ++i){
-		  D_v[c++] = i->second;
-		  // cerr << "MERGED: " << *i->second << endl;
-	  }
 	  //cerr <<"Node id: "<< vert_index<< endl;
 	  //#ifdef MEASURE_CA
 	  // cerr << "countInProcess (pop/tot): node id: " << vert_index << " (" << count_in_process_pop << "/" << count_in_process_tot << ")"<<endl;
 	  // cerr << "countAtEnd (pop/tot): node id: " << vert_index << " (" << count_at_end_pop << "/" << count_at_end_tot << ")"<<endl;
 	  //#endif
-	  sort(D_v.begin(), D_v.end(), EstProbSorter());
-
-	  // cerr << " expanded to " << D_v.size() << " nodes\n";
-
-	  for (int i = 0; i < cand.size(); ++i)
-		  delete cand[i];
-	  // freelist is necessary since even after an item merged, it still stays in
-	  // the unique set so it can't be deleted til now
-	  for (int i = 0; i < freelist.size(); ++i)
-		  delete freelist[i];
   }
 
-  void PushSucc(const Candidate& item, const bool is_goal, CandidateHeap* pcand, UniqueCandidateSet* cs) {
+  void PushSucc(const Candidate& item, const bool is_goal, NodeWorkspace* ws, CandidateHeap* pcand) {
     CandidateHeap& cand = *pcand;
     for (int i = 0; i < item.j_.size(); ++i) {
       JVector j = item.j_;
       ++j[i];
       if (j[i] < D[item.in_edge_->tail_nodes_[i]].size()) {
-        Candidate query_unique(*item.in_edge_, j);
-        if (cs->count(&query_unique) == 0) {
-          Candidate* new_cand = new Candidate(*item.in_edge_, j, out, D, node_states_, smeta, models, is_goal);
+        if (!ws->unique.Find(CandidateUniqueness::Key(item.in_edge_, &j))) {
+          Candidate* new_cand = NewCandidate(*item.in_edge_, j, is_goal, ws);
           cand.push_back(new_cand);
           push_heap(cand.begin(), cand.end(), HeapCandCompare());
-          bool is_new = cs->insert(new_cand).second;
+          bool is_new = ws->unique.Insert(new_cand) == new_cand;
           assert(is_new);  // insert into uniqueness set, sanity check
         }
       }
@@ -433,13 +762,13 @@ public:
   }
 
   //PushSucc following unique ancestor generation function
-  void PushSuccFast(const Candidate& item, const bool is_goal, CandidateHeap* pcand){
+  void PushSuccFast(const Candidate& item, const bool is_goal, NodeWorkspace* ws, CandidateHeap* pcand){
 	  CandidateHeap& cand = *pcand;
 	  for (int i = 0; i < item.j_.size(); ++i) {
 		  JVector j = item.j_;
 		  ++j[i];
 		  if (j[i] < D[item.in_edge_->tail_nodes_[i]].size()) {
-			  Candidate* new_cand = new Candidate(*item.in_edge_, j, out, D, node_states_, smeta, models, is_goal);
+			  Candidate* new_cand = NewCandidate(*item.in_edge_, j, is_goal, ws);
 			  cand.push_back(new_cand);
 			  push_heap(cand.begin(), cand.end(), HeapCandCompare());
 		  }
@@ -450,15 +779,14 @@ public:
   }
 
   //PushSucc only if all ancest Cand are added
-  void PushSuccFast2(const Candidate& item, const bool is_goal, CandidateHeap* pcand, UniqueCandidateSet* ps){
+  void PushSuccFast2(const Candidate& item, const bool is_goal, NodeWorkspace* ws, CandidateHeap* pcand){
 	  CandidateHeap& cand = *pcand;
 	  for (int i = 0; i < item.j_.size(); ++i) {
 		  JVector j = item.j_;
 		  ++j[i];
 		  if (j[i] < D[item.in_edge_->tail_nodes_[i]].size()) {
-			  Candidate query_unique(*item.in_edge_, j);
-			  if (HasAllAncestors(&query_unique,ps)) {
-				  Candidate* new_cand = new Candidate(*item.in_edge_, j, out, D, node_states_, smeta, models, is_goal);
+			  if (HasAllAncestors(*item.in_edge_, j, ws->accepted)) {
+				  Candidate* new_cand = NewCandidate(*item.in_edge_, j, is_goal, ws);
 				  cand.push_back(new_cand);
 				  push_heap(cand.begin(), cand.end(), HeapCandCompare());
 			  }
@@ -466,13 +794,12 @@ public:
 	  }
   }
 
-  bool HasAllAncestors(const Candidate* item, UniqueCandidateSet* cs){
-	  for (int i = 0; i < item->j_.size(); ++i) {
-		  JVector j = item->j_;
+  bool HasAllAncestors(const Hypergraph::Edge& edge, const JVector& item_j, const UniqueCandidateSet& cs){
+	  for (int i = 0; i < item_j.size(); ++i) {
+		  JVector j = item_j;
 		  --j[i];
 		  if (j[i] >=0) {
-			  Candidate query_unique(*item->in_edge_, j);
-			  if (cs->count(&query_unique) == 0) {
+			  if (!cs.Find(CandidateUniqueness::Key(&edge, &j))) {
 				  return false;
 			  }
 		  }
@@ -488,10 +815,322 @@ public:
   vector<CandidateList> D;   // maps nodes in in-HG to the
                              // equivalent nodes (many due to state
                              // splits) in the out-HG.
-  FFStates node_states_;  // for each node in the out-HG what is
-                             // its q function value?
+  vector<vector<uint8_t> > node_states_;  // for each node in the in-HG, the
+                                          // q function values of its nodes in
+                                          // the out-HG (see Candidate::node_state_)
+  vector<SparseVector<double> > edge_features_;  // see AddStatelessFeatures
+  const int pop_limit_;
+ const int strategy_;       //switch Cube Pruning strategy: 1 normal, 2 fast (alg 2), 3 fast_2 (alg 3). (see: Gesmundo A., Henderson J,. Faster Cube Pruning, IWSLT 2010), 4 normal with the heap phase of independent nodes run in parallel
+  const int threads_;       // PARALLEL_CP only, <= 0 = one per core
+  vector<NodeWorkspace*> workspaces_;  // one per thread
+};
+
+// cube growing interns the states of all nodes in one table, so only
+// candidates of the same -LM node with the same state id are recombined
+struct SameNodeAndState {
+  typedef const Candidate* Key;
+  Key KeyOf(const Candidate* c) const { return c; }
+  uint32_t Hash(Key c) const {
+    return (c->state_ * 0x9e3779b9u) ^ c->in_edge_->head_node_;
+  }
+  bool Equal(Key a, Key b) const {
+    return a->state_ == b->state_ && a->in_edge_->head_node_ == b->in_edge_->head_node_;
+  }
+};
+
+// a candidate <edge, j> of cube growing.  it is only scored by the models
+// when it is popped, until then est_prob_ is a heuristic: the Viterbi scores
+// of its antecedents times the (LM and future cost) factor that the models
+// gave to the corner candidate <edge, 0...0>
+struct PendingCandidate {
+  PendingCandidate(const Hypergraph::Edge& e, const JVector& jv, const prob_t& est, Candidate* c = NULL) :
+      edge(&e), j(jv), est_prob_(est), scored(c) {}
+  const Hypergraph::Edge* edge;
+  JVector j;
+  prob_t est_prob_;
+  Candidate* scored;  // corner candidates are scored when they are created
+};
+
+struct PendingUniquenessHash {
+  size_t operator()(const PendingCandidate* p) const {
+    size_t x = 5381;
+    x = ((x << 5) + x) ^ p->edge->id_;
+    for (int i = 0; i < p->j.size(); ++i)
+      x = ((x << 5) + x) ^ p->j[i];
+    return x;
+  }
+};
+struct PendingUniquenessEquals {
+  bool operator()(const PendingCandidate* a, const PendingCandidate* b) const {
+    return (a->edge == b->edge) && (a->j == b->j);
+  }
+};
+
+struct HeapPendingCompare {
+  bool operator()(const PendingCandidate* l, const PendingCandidate* r) const {
+    return l->est_prob_ < r->est_prob_;
+  }
+};
+
+// cube growing (Algorithm 3 of Huang and Chiang, Forest Rescoring, ACL 2007):
+// nodes are explored top-down from the goal, and only as many derivations
+// of a node are built as its consumers ask for.  candidates are kept on the
+// heap with a heuristic score and scored by the models only when they are
+// popped, so most of the successors cube pruning would score are never
+// scored.  popped candidates wait in a buffer until no candidate left on the
+// heap is expected to be better, and at most pop_limit candidates are popped
+// at each node (the goal pops exactly that many if it can, so there are
+// pop_limit goal edges for k-best extraction).  the -LM outside scores are
+// the same for all candidates of a node, so they would not change the order
+// in which a node's candidates are popped and are not used
+class CubeGrowingRescorer {
+ public:
+  CubeGrowingRescorer(const ModelSet& m,
+                      const SentenceMetadata& sm,
+                      const Hypergraph& i,
+                      int pop_limit,
+                      Hypergraph* o) :
+      models(m),
+      smeta(sm),
+      in(i),
+      out(*o),
+      D(in.nodes_.size()),
+      nodes_(in.nodes_.size()),
+      edge_factor_(in.edges_.size()),
+      states_(m.StateSize()),
+      pop_limit_(pop_limit),
+      scored_count_() {
+    if (!SILENT) cerr << "  Applying feature functions (cube growing, pop_limit = " << pop_limit_ << ')' << endl;
+    AddStatelessFeatures(in, smeta, models, &edge_features_);
+  }
+
+  void Apply() {
+    const int num_nodes = in.nodes_.size();
+    assert(num_nodes >= 2);
+    const int goal_id = num_nodes - 1;
+    assert(in.nodes_[goal_id - 1].out_edges_.size() == 1);
+    // all goal candidates recombine into one node, so asking for more
+    // derivations than can exist just pops all the goal may pop
+    Grow(goal_id, numeric_limits<unsigned>::max());
+    if (D[goal_id].empty()) {
+      // only possible if the pop limit leaves some node without derivations
+      cerr << "  Cube growing found no derivation of the goal (pop_limit = " << pop_limit_ << ")\n";
+      abort();
+    }
+    if (!SILENT) {
+      cerr << "  Scored " << scored_count_ << " candidates at "
+           << count_if(nodes_.begin(), nodes_.end(), [](const GrowingNode& n) { return n.started; })
+           << " of " << num_nodes << " nodes" << endl;
+      cerr << "  Best path: " << log(D[goal_id].front()->vit_prob_)
+           << "\t" << log(D[goal_id].front()->est_prob_) << endl;
+    }
+    out.PruneUnreachable(D[goal_id].front()->node_index_);
+    pool_.Free(scored_);
+    D.clear();
+  }
+
+ private:
+  struct GrowingNode {
+    GrowingNode() : started(false), ready(false), pops(), next_edge(), popped(), popped_item(), next_succ() {}
+    bool started;                    // scoring of the corners has begun
+    bool ready;                      // all corners are scored and cand is a heap
+    int pops;
+    unsigned next_edge;              // in-edge whose corner is scored next
+    const PendingCandidate* popped;  // popped candidate whose successors are pushed
+    Candidate* popped_item;          //   and its scored candidate
+    unsigned next_succ;              //   and the antecedent of the next successor
+    vector<PendingCandidate*> cand;  // heap of candidates to pop
+    CandidateHeap buf;               // popped, not yet in D, by est_prob_
+  };
+
+  // a node needs derivations of its antecedents to score a corner or push a
+  // successor.  Grow asks for them with an explicit stack rather than by
+  // recursion, which would go as deep as the forest.  each step works on the
+  // node on top of the stack until it is done or needs another derivation;
+  // it keeps its progress in nodes_ and is simply run again once the
+  // derivation it needs is there.  forests are acyclic, so a node is never
+  // on the stack twice
+
+  // makes sure that D[v] has at least j + 1 derivations if v has that many.
+  // returns false if it has not
+  bool Grow(const int v, const unsigned j) {
+    vector<pair<int, unsigned> > stack(1, make_pair(v, j));
+    while (!stack.empty()) {
+      pair<int, unsigned> need;
+      if (Step(stack.back().first, stack.back().second, &need))
+        stack.pop_back();
+      else
+        stack.push_back(need);
+    }
+    return D[v].size() > j;
+  }
+
+  // true once D[v] has j + 1 derivations or v can have no more.  false if
+  // *need, a derivation of an antecedent, has to be grown first
+  bool Step(const int v, const unsigned j, pair<int, unsigned>* need) {
+    GrowingNode& n = nodes_[v];
+    if (!n.ready && !StartStep(v, need)) return false;
+    CandidateList& D_v = D[v];
+    while (D_v.size() <= j) {
+      if (n.popped) {
+        if (!PushSucc(v, need)) return false;
+        FinishPop(v);
+      } else if (!n.buf.empty() && (n.cand.empty() || n.pops >= pop_limit_ ||
+                                    n.buf.front()->est_prob_ >= n.cand.front()->est_prob_)) {
+        // a buffered candidate is final once it is at least as good as every
+        // candidate that can still be popped
+        pop_heap(n.buf.begin(), n.buf.end(), HeapCandCompare());
+        D_v.push_back(n.buf.back());
+        n.buf.pop_back();
+      } else if (!n.cand.empty() && n.pops < pop_limit_) {
+        Pop(v);
+      } else {
+        break;
+      }
+    }
+    return true;
+  }
+
+  // true if v is ready and has no derivations beyond D[v]
+  bool Exhausted(const int v) const {
+    const GrowingNode& n = nodes_[v];
+    return n.ready && !n.popped && n.buf.empty() && (n.cand.empty() || n.pops >= pop_limit_);
+  }
+
+  // scores the corner candidates of v's in-edges, once the best derivations
+  // of their antecedents are built.  an in-edge with an antecedent that has
+  // no derivation has no corner
+  bool StartStep(const int v, pair<int, unsigned>* need) {
+    GrowingNode& n = nodes_[v];
+    const Hypergraph::EdgesVector& in_edges = in.nodes_[v].in_edges_;
+    if (!n.started) {
+      n.started = true;
+      n.cand.reserve(in_edges.size());
+    }
+    const bool is_goal = (v == in.nodes_.size() - 1);
+    for (; n.next_edge < in_edges.size(); ++n.next_edge) {
+      const Hypergraph::Edge& edge = in.edges_[in_edges[n.next_edge]];
+      const JVector j(edge.tail_nodes_.size(), 0);
+      prob_t ants = prob_t::One();
+      bool usable = true;
+      for (int k = 0; k < j.size() && usable; ++k) {
+        const int tail = edge.tail_nodes_[k];
+        if (D[tail].empty()) {
+          if (!Exhausted(tail)) {
+            *need = make_pair(tail, 0u);
+            return false;
+          }
+          usable = false;
+        } else {
+          ants *= D[tail][0]->vit_prob_;
+        }
+      }
+      if (!usable) continue;
+      Candidate* c = Score(edge, j, is_goal);
+      // with a zero antecedent all successors are estimated at zero too
+      edge_factor_[edge.id_] = ants.is_0() ? prob_t::Zero() : c->est_prob_ / ants;
+      n.cand.push_back(NewPending(edge, j, c->est_prob_, c));
+    }
+    make_heap(n.cand.begin(), n.cand.end(), HeapPendingCompare());
+    n.ready = true;
+    return true;
+  }
+
+  // pops the best candidate of v and scores it if it is not yet.  its
+  // successors are pushed next, then it is added to the +LM forest
+  void Pop(const int v) {
+    GrowingNode& n = nodes_[v];
+    pop_heap(n.cand.begin(), n.cand.end(), HeapPendingCompare());
+    const PendingCandidate& p = *n.cand.back();
+    n.cand.pop_back();
+    ++n.pops;
+    n.popped = &p;
+    n.popped_item = p.scored ? p.scored : Score(*p.edge, p.j, v == in.nodes_.size() - 1);
+    n.next_succ = 0;
+  }
+
+  // pushes the successors of the popped candidate of v with their heuristic
+  // scores, once the antecedents have the derivations they need
+  bool PushSucc(const int v, pair<int, unsigned>* need) {
+    GrowingNode& n = nodes_[v];
+    const PendingCandidate& p = *n.popped;
+    const Hypergraph::Edge& edge = *p.edge;
+    for (; n.next_succ < p.j.size(); ++n.next_succ) {
+      const int i = n.next_succ;
+      PendingCandidate query(edge, p.j, prob_t::Zero());
+      ++query.j[i];
+      if (seen_.count(&query)) continue;
+      const int tail = edge.tail_nodes_[i];
+      if (D[tail].size() <= query.j[i]) {
+        if (Exhausted(tail)) continue;
+        *need = make_pair(tail, static_cast<unsigned>(query.j[i]));
+        return false;
+      }
+      prob_t est = edge_factor_[edge.id_];
+      for (int k = 0; k < query.j.size(); ++k)
+        est *= D[edge.tail_nodes_[k]][query.j[k]]->vit_prob_;
+      n.cand.push_back(NewPending(edge, query.j, est));
+      push_heap(n.cand.begin(), n.cand.end(), HeapPendingCompare());
+    }
+    return true;
+  }
+
+  // adds the popped candidate of v to the +LM forest
+  void FinishPop(const int v) {
+    GrowingNode& n = nodes_[v];
+    Candidate* item = n.popped_item;
+    n.popped = NULL;
+    n.popped_item = NULL;
+
+    Hypergraph::Edge* new_edge = out.AddEdge(std::move(item->out_edge_));
+    Candidate* o_item = recomb_.Insert(item);
+    if (o_item == item) {
+      Hypergraph::Node* new_node = out.AddNode(in.nodes_[v].cat_);
+      const uint8_t* state = states_.Get(item->state_);
+      node_states_.push_back(FFState(state, state + states_.StateSize()));
+      item->node_state_ = node_states_.back().begin();
+      item->node_index_ = new_node->id_;
+      n.buf.push_back(item);
+      push_heap(n.buf.begin(), n.buf.end(), HeapCandCompare());
+    }
+    // unlike cube pruning, a better derivation found later does not update
+    // o_item's scores, since it may already be used by other nodes
+    out.ConnectEdgeToHeadNode(new_edge, o_item->node_index_);
+  }
+
+  PendingCandidate* NewPending(const Hypergraph::Edge& edge, const JVector& j, const prob_t& est, Candidate* c = NULL) {
+    pending_.push_back(PendingCandidate(edge, j, est, c));
+    seen_.insert(&pending_.back());
+    return &pending_.back();
+  }
+
+  Candidate* Score(const Hypergraph::Edge& edge, const JVector& j, const bool is_goal) {
+    ++scored_count_;
+    scored_.push_back(new (pool_.New()) Candidate(edge, j, D, smeta, models, is_goal, &scratch_, &states_, edge_features_));
+    return scored_.back();
+  }
+
+  const ModelSet& models;
+  const SentenceMetadata& smeta;
+  const Hypergraph& in;
+  Hypergraph& out;
+
+  vector<CandidateList> D;       // derivations of the nodes found so far, best first
+  deque<FFState> node_states_;   // for each node in the out-HG what is
+                                 // its q function value? (a deque, since
+                                 // Candidate::node_state_ points into it)
+  vector<GrowingNode> nodes_;
+  vector<prob_t> edge_factor_;   // by in-edge id, est_prob_ / antecedent scores of its corner
+  vector<SparseVector<double> > edge_features_;  // see AddStatelessFeatures
+  deque<PendingCandidate> pending_;
+  unordered_set<const PendingCandidate*, PendingUniquenessHash, PendingUniquenessEquals> seen_;
+  CandidatePool pool_;
+  CandidateList scored_;
+  FFState scratch_;
+  FFStateInterner states_;       // never cleared, every node may still grow
+  CandidateTable<SameNodeAndState> recomb_;
   const int pop_limit_;
- const int strategy_;       //switch Cube Pruning strategy: 1 normal, 2 fast (alg 2), 3 fast_2 (alg 3). (see: Gesmundo A., Henderson J,. Faster Cube Pruning, IWSLT 2010)
+  int scored_count_;
 };
 
 struct NoPruningRescorer {
@@ -500,14 +1139,14 @@ struct NoPruningRescorer {
       smeta(sm),
       in(i),
       out(*o),
-      nodemap(i.nodes_.size()) {
+      nodemap(i.nodes_.size()),
+      states_(m.StateSize()) {
     if (!SILENT) cerr << "  Rescoring forest (full intersection)\n";
     node_states_.reserve(kRESERVE_NUM_NODES);
+    AddStatelessFeatures(in, smeta, models, &edge_features_);
   }
 
-  typedef unordered_map<FFState, int, boost::hash<FFState> > State2NodeIndex;
-
-  void ExpandEdge(const Hypergraph::Edge& in_edge, bool is_goal, State2NodeIndex* state2node) {
+  void ExpandEdge(const Hypergraph::Edge& in_edge, bool is_goal) {
     const int arity = in_edge.Arity();
     Hypergraph::TailNodeVector ends(arity);
     for (int i = 0; i < arity; ++i)
@@ -520,22 +1159,33 @@ struct NoPruningRescorer {
       for (int i = 0; i < arity; ++i)
         tail[i] = nodemap[in_edge.tail_nodes_[i]][tail_iter[i]];
       Hypergraph::Edge* new_edge = out.AddEdge(in_edge, tail);
-      FFState head_state;
+      uint64_t signature;
       if (is_goal) {
         assert(tail.size() == 1);
         const FFState& ant_state = node_states_[tail.front()];
         models.AddFinalFeatures(ant_state, new_edge,smeta);
+        // all goal edges share a state of zeros
+        if (head_state_.size() != models.StateSize()) head_state_.resize(models.StateSize());
+        fill(head_state_.begin(), head_state_.end(), 0);
+        signature = models.StateSignature(head_state_.begin());
       } else {
+        if (!edge_features_.empty()) {
+          // without state, each -LM edge has one +LM edge, so its features are not needed again
+          if (models.stateless())
+            new_edge->feature_values_.swap(edge_features_[in_edge.id_]);
+          else
+            new_edge->feature_values_ = edge_features_[in_edge.id_];
+        }
         prob_t edge_estimate; // this is a full intersection, so we disregard this
-        models.AddFeaturesToEdge(smeta, out, node_states_, new_edge, &head_state, &edge_estimate);
+        models.AddStatefulFeaturesToEdge(smeta, out, node_states_, new_edge, &head_state_, &edge_estimate, &signature);
       }
-      int& head_plus1 = (*state2node)[head_state];
-      if (!head_plus1) {
-        head_plus1 = out.AddNode(in_edge.rule_->GetLHS())->id_ + 1;
-        node_states_.push_back(head_state);
-        nodemap[in_edge.head_node_].push_back(head_plus1 - 1);
+      const uint32_t state = states_.Intern(head_state_.begin(), signature);
+      if (state == state2node_.size()) {
+        state2node_.push_back(out.AddNode(in_edge.rule_->GetLHS())->id_);
+        node_states_.push_back(head_state_);
+        nodemap[in_edge.head_node_].push_back(state2node_.back());
       }
-      const int head_index = head_plus1 - 1;
+      const int head_index = state2node_[state];
       out.ConnectEdgeToHeadNode(new_edge->id_, head_index);
 
       int ii = 0;
@@ -549,11 +1199,12 @@ struct NoPruningRescorer {
   }
 
   void ProcessOneNode(const int node_num, const bool is_goal) {
-    State2NodeIndex state2node;
+    states_.Clear();
+    state2node_.clear();
     const Hypergraph::Node& node = in.nodes_[node_num];
     for (int i = 0; i < node.in_edges_.size(); ++i) {
       const Hypergraph::Edge& edge = in.edges_[node.in_edges_[i]];
-      ExpandEdge(edge, is_goal, &state2node);
+      ExpandEdge(edge, is_goal);
     }
   }
 
@@ -583,6 +1234,10 @@ struct NoPruningRescorer {
   vector<vector<int> > nodemap;
   FFStates node_states_;  // for each node in the out-HG what is
                              // its q function value?
+  vector<SparseVector<double> > edge_features_;  // see AddStatelessFeatures
+  FFState head_state_;       // written by the models for each new edge
+  FFStateInterner states_;   // of the node being processed
+  vector<int> state2node_;   // by state id, the +LM node with that state
 };
 
 // each node in the graph has one of these, it keeps track of
@@ -597,7 +1252,9 @@ void ApplyModelSet(const Hypergraph& in,
     ma.Apply();
   } else if (config.algorithm == IntersectionConfiguration::CUBE 
              || config.algorithm == IntersectionConfiguration::FAST_CUBE_PRUNING
-             || config.algorithm == IntersectionConfiguration::FAST_CUBE_PRUNING_2) {
+             || config.algorithm == IntersectionConfiguration::FAST_CUBE_PRUNING_2
+             || config.algorithm == IntersectionConfiguration::PARALLEL_CUBE_PRUNING
+             || config.algorithm == IntersectionConfiguration::CUBE_GROWING) {
     int pl = config.pop_limit;
     const int max_pl_for_large=50;
     if (pl > max_pl_for_large && in.nodes_.size() > 80000) {
@@ -616,6 +1273,14 @@ void ApplyModelSet(const Hypergraph& in,
     	CubePruningRescorer ma(models, smeta, in, pl, out, FAST_CP_2);
         ma.Apply();
     }
+    else if (config.algorithm == IntersectionConfiguration::PARALLEL_CUBE_PRUNING){
+    	CubePruningRescorer ma(models, smeta, in, pl, out, PARALLEL_CP, config.threads);
+        ma.Apply();
+    }
+    else if (config.algorithm == IntersectionConfiguration::CUBE_GROWING){
+    	CubeGrowingRescorer ma(models, smeta, in, pl, out);
+        ma.Apply();
+    }
 
   } else {
     cerr << "Don't understand intersection algorithm " << config.algorithm << endl;
@@ -4,8 +4,14 @@
 
 #include "bottom_up_parser.h"
 
+#include <atomic>
+#include <condition_variable>
+#include <functional>
 #include <iostream>
 #include <map>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
 
 #include "hg.h"
 #include "array2d.h"
@@ -16,9 +22,13 @@ using namespace std;
 
 static WordID kEPS = 0;
 
-class ActiveChart;
+static void TopoSortUnaries(const WordID goal_cat, vector<TRulePtr>* unaries);
+
+template <class Passive> class ActiveChart;
 class PassiveChart {
  public:
+  typedef const vector<int>& Cell;
+
   PassiveChart(const string& goal,
                const vector<GrammarPtr>& grammars,
                const Lattice& input,
@@ -45,7 +55,6 @@ class PassiveChart {
                  const float lattice_cost);
 
   void ApplyUnaryRules(const int i, const int j);
-  void TopoSortUnaries();
 
   const vector<GrammarPtr>& grammars_;
   const Lattice& input_;
@@ -53,7 +62,7 @@ class PassiveChart {
   Array2D<vector<int> > chart_;   // chart_(i,j) is the list of nodes derived spanning i,j
   typedef map<int, int> Cat2NodeMap;
   Array2D<Cat2NodeMap> nodemap_;
-  vector<ActiveChart*> act_chart_;
+  vector<ActiveChart<PassiveChart>*> act_chart_;
   const WordID goal_cat_;    // category that is being searched for at [0,n]
   TRulePtr goal_rule_;
   int goal_idx_;             // index of goal node, if found
@@ -65,43 +74,47 @@ class PassiveChart {
 
 WordID PassiveChart::kGOAL = 0;
 
+// a rule prefix matched over some span: the grammar trie node reached and
+// the nodes of the nonterminals matched so far
+struct ActiveItem {
+  ActiveItem(const GrammarIter* g, const Hypergraph::TailNodeVector& a, float lcost) :
+    gptr_(g), ant_nodes_(a), lattice_cost(lcost) {}
+  explicit ActiveItem(const GrammarIter* g) :
+    gptr_(g), ant_nodes_(), lattice_cost(0.0) {}
+
+  void ExtendTerminal(int symbol, float src_cost, vector<ActiveItem>* out_cell) const {
+    if (symbol == kEPS) {
+      out_cell->push_back(ActiveItem(gptr_, ant_nodes_, lattice_cost + src_cost));
+    } else {
+      const GrammarIter* ni = gptr_->Extend(symbol);
+      if (ni)
+        out_cell->push_back(ActiveItem(ni, ant_nodes_, lattice_cost + src_cost));
+    }
+  }
+  void ExtendNonTerminal(const Hypergraph* hg, int node_index, vector<ActiveItem>* out_cell) const {
+    int symbol = hg->nodes_[node_index].cat_;
+    const GrammarIter* ni = gptr_->Extend(symbol);
+    if (!ni) return;
+    out_cell->push_back(ActiveItem(ni, ant_nodes_, lattice_cost));
+    out_cell->back().ant_nodes_.push_back(node_index);
+  }
+
+  const GrammarIter* gptr_;
+  Hypergraph::TailNodeVector ant_nodes_;
+  float lattice_cost;  // TODO? use SparseVector<double>
+};
+
+// Passive(k,j) are the nodes spanning k,j (a Passive::Cell, indexable like
+// a vector<int>). all the items ending at j of an active chart's row i are
+// only written when cell (i,j) is processed, so the cells of a span width
+// can be processed in parallel
+template <class Passive>
 class ActiveChart {
  public:
-  ActiveChart(const Hypergraph* hg, const PassiveChart& psv_chart) :
+  ActiveChart(const Hypergraph* hg, const Passive& psv_chart) :
     hg_(hg),
     act_chart_(psv_chart.size(), psv_chart.size()), psv_chart_(psv_chart) {}
 
-  struct ActiveItem {
-    ActiveItem(const GrammarIter* g, const Hypergraph::TailNodeVector& a, float lcost) :
-      gptr_(g), ant_nodes_(a), lattice_cost(lcost) {}
-    explicit ActiveItem(const GrammarIter* g) :
-      gptr_(g), ant_nodes_(), lattice_cost(0.0) {}
-
-    void ExtendTerminal(int symbol, float src_cost, vector<ActiveItem>* out_cell) const {
-      if (symbol == kEPS) {
-        out_cell->push_back(ActiveItem(gptr_, ant_nodes_, lattice_cost + src_cost));
-      } else {
-        const GrammarIter* ni = gptr_->Extend(symbol);
-        if (ni)
-          out_cell->push_back(ActiveItem(ni, ant_nodes_, lattice_cost + src_cost));
-      }
-    }
-    void ExtendNonTerminal(const Hypergraph* hg, int node_index, vector<ActiveItem>* out_cell) const {
-      int symbol = hg->nodes_[node_index].cat_;
-      const GrammarIter* ni = gptr_->Extend(symbol);
-      if (!ni) return;
-      Hypergraph::TailNodeVector na(ant_nodes_.size() + 1);
-      for (unsigned i = 0; i < ant_nodes_.size(); ++i)
-        na[i] = ant_nodes_[i];
-      na[ant_nodes_.size()] = node_index;
-      out_cell->push_back(ActiveItem(ni, na, lattice_cost));
-    }
-
-    const GrammarIter* gptr_;
-    Hypergraph::TailNodeVector ant_nodes_;
-    float lattice_cost;  // TODO? use SparseVector<double>
-  };
-
   inline const vector<ActiveItem>& operator()(int i, int j) const { return act_chart_(i,j); }
   void SeedActiveChart(const Grammar& g) {
     int size = act_chart_.width();
@@ -114,11 +127,11 @@ class ActiveChart {
     //cerr << "  LOOK(" << i << "," << k << ") for completed items in (" << k << "," << j << ")\n";
     vector<ActiveItem>& cell = act_chart_(i,j);
     const vector<ActiveItem>& icell = act_chart_(i,k);
-    const vector<int>& idxs = psv_chart_(k, j);
+    typename Passive::Cell idxs = psv_chart_(k, j);
     //if (!idxs.empty()) { cerr << "FOUND IN (" << k << "," << j << ")\n"; }
-    for (vector<ActiveItem>::const_iterator di = icell.begin(); di != icell.end(); ++di) {
-      for (vector<int>::const_iterator ni = idxs.begin(); ni != idxs.end(); ++ni) {
-         di->ExtendNonTerminal(hg_, *ni, &cell);
+    for (typename vector<ActiveItem>::const_iterator di = icell.begin(); di != icell.end(); ++di) {
+      for (unsigned ni = 0; ni < idxs.size(); ++ni) {
+         di->ExtendNonTerminal(hg_, idxs[ni], &cell);
       }
     }
   }
@@ -146,7 +159,7 @@ class ActiveChart {
  private:
   const Hypergraph* hg_;
   Array2D<vector<ActiveItem> > act_chart_;
-  const PassiveChart& psv_chart_;
+  const Passive& psv_chart_;
 };
 
 PassiveChart::PassiveChart(const string& goal,
@@ -165,12 +178,12 @@ PassiveChart::PassiveChart(const string& goal,
     unaries_() {
   act_chart_.resize(grammars_.size());
   for (unsigned i = 0; i < grammars_.size(); ++i) {
-    act_chart_[i] = new ActiveChart(forest, *this);
+    act_chart_[i] = new ActiveChart<PassiveChart>(forest, *this);
     const vector<TRulePtr>& u = grammars_[i]->GetAllUnaryRules();
     for (unsigned j = 0; j < u.size(); ++j)
       unaries_.push_back(u[j]);
   }
-  TopoSortUnaries();
+  TopoSortUnaries(goal_cat_, &unaries_);
   if (!kGOAL) kGOAL = TD::Convert("Goal") * -1;
   if (!SILENT) cerr << "  Goal category: [" << goal << ']' << endl;
 }
@@ -202,17 +215,21 @@ static bool TopoSortVisit(int node, vector<TRulePtr>& u, const map<int, vector<T
   return true;
 }
 
-void PassiveChart::TopoSortUnaries() {
-  vector<TRulePtr> u(unaries_.size()); u.clear();
+// orders the unary rules so that the rules rewriting a category come before
+// the rules that rewrite the categories they produce, and removes rules that
+// would form cycles
+static void TopoSortUnaries(const WordID goal_cat, vector<TRulePtr>* unaries) {
+  vector<TRulePtr>& rules = *unaries;
+  vector<TRulePtr> u(rules.size()); u.clear();
   map<int, vector<TRulePtr> > g;
   map<int, int> mark;
-  //cerr << "GOAL=" << TD::Convert(-goal_cat_) << endl;
-  mark[goal_cat_] = 2;
-  for (unsigned i = 0; i < unaries_.size(); ++i) {
-    //cerr << "Adding: " << unaries_[i]->AsString() << endl;
-    g[unaries_[i]->f()[0]].push_back(unaries_[i]);
+  //cerr << "GOAL=" << TD::Convert(-goal_cat) << endl;
+  mark[goal_cat] = 2;
+  for (unsigned i = 0; i < rules.size(); ++i) {
+    //cerr << "Adding: " << rules[i]->AsString() << endl;
+    g[rules[i]->f()[0]].push_back(rules[i]);
   }
-    //m[unaries_[i]->lhs_].push_back(unaries_[i]);
+    //m[rules[i]->lhs_].push_back(rules[i]);
   for (map<int, vector<TRulePtr> >::iterator it = g.begin(); it != g.end(); ++it) {
     //cerr << "PROC: " << TD::Convert(-it->first) << endl;
     if (mark[it->first] > 0) {
@@ -221,9 +238,9 @@ void PassiveChart::TopoSortUnaries() {
       TopoSortVisit(it->first, u, g, mark);
     }
   }
-  unaries_.clear();
+  rules.clear();
   for (int i = u.size() - 1; i >= 0; --i)
-    unaries_.push_back(u[i]);
+    rules.push_back(u[i]);
 }
 
 void PassiveChart::ApplyRule(const int i,
@@ -306,8 +323,8 @@ bool PassiveChart::Parse() {
         if (g.HasRuleForSpan(i, j, input_.Distance(i, j))) {
           act_chart_[gi]->AdvanceDotsForAllItemsInCell(i, j, input_);
 
-          const vector<ActiveChart::ActiveItem>& cell = (*act_chart_[gi])(i,j);
-          for (vector<ActiveChart::ActiveItem>::const_iterator ai = cell.begin();
+          const vector<ActiveItem>& cell = (*act_chart_[gi])(i,j);
+          for (vector<ActiveItem>::const_iterator ai = cell.begin();
                ai != cell.end(); ++ai) {
             const RuleBin* rules = (ai->gptr_->GetRules());
             if (!rules) continue;
@@ -345,15 +362,356 @@ PassiveChart::~PassiveChart() {
     delete act_chart_[i];
 }
 
+// runs f(0), ..., f(n-1) on the calling thread and the pool's helper
+// threads, and returns when all have finished
+class CellThreadPool {
+ public:
+  explicit CellThreadPool(int threads) : f_(NULL), n_(0), next_(0), generation_(0), busy_(0), quit_(false) {
+    for (int i = 1; i < threads; ++i)
+      helpers_.push_back(thread(&CellThreadPool::Help, this));
+  }
+
+  ~CellThreadPool() {
+    {
+      lock_guard<mutex> lock(mutex_);
+      quit_ = true;
+    }
+    start_.notify_all();
+    for (unsigned i = 0; i < helpers_.size(); ++i) helpers_[i].join();
+  }
+
+  void Run(int n, const function<void(int)>& f) {
+    if (helpers_.empty() || n < 2) {
+      for (int i = 0; i < n; ++i) f(i);
+      return;
+    }
+    unique_lock<mutex> lock(mutex_);
+    f_ = &f;
+    n_ = n;
+    next_ = 0;
+    busy_ = helpers_.size();
+    ++generation_;
+    start_.notify_all();
+    lock.unlock();
+    Work();
+    lock.lock();
+    while (busy_ > 0) done_.wait(lock);
+  }
+
+ private:
+  void Work() {
+    for (int i = next_++; i < n_; i = next_++)
+      (*f_)(i);
+  }
+
+  void Help() {
+    int seen = 0;
+    unique_lock<mutex> lock(mutex_);
+    while (true) {
+      while (generation_ == seen && !quit_) start_.wait(lock);
+      if (quit_) return;
+      seen = generation_;
+      lock.unlock();
+      Work();
+      lock.lock();
+      if (--busy_ == 0) done_.notify_one();
+    }
+  }
+
+  const function<void(int)>* f_;
+  int n_;
+  atomic<int> next_;
+  int generation_;
+  int busy_;
+  bool quit_;
+  mutex mutex_;
+  condition_variable start_;
+  condition_variable done_;
+  vector<thread> helpers_;
+};
+
+// builds the same forest as PassiveChart, but processes all the cells of a
+// span width in parallel. the work for a width is done in two steps:
+//  1. every cell advances its active items and collects the edges that its
+//     rules (and then the unary rules) build, and the categories of its new
+//     nodes (with a hash table from category to node);
+//  2. the nodes and edges get the ids PassiveChart would have given them,
+//     and every cell fills in its part of the forest and extends its active
+//     items with its new nodes.
+// the nodes of all cells are kept in one array: cell (i,j) is the range
+// cells_(i,j) of cell_nodes_
+class FlatChart {
+ public:
+  // the nodes spanning some i,j
+  struct Cell {
+    Cell(const int* b, const int* e) : begin_(b), end_(e) {}
+    unsigned size() const { return end_ - begin_; }
+    int operator[](unsigned n) const { return begin_[n]; }
+    const int* begin_;
+    const int* end_;
+  };
+
+  FlatChart(const string& goal,
+            const vector<GrammarPtr>& grammars,
+            const Lattice& input,
+            Hypergraph* forest,
+            int threads);
+  ~FlatChart();
+
+  inline Cell operator()(int i, int j) const {
+    const pair<unsigned, unsigned>& r = cells_(i,j);
+    return Cell(cell_nodes_.data() + r.first, cell_nodes_.data() + r.second);
+  }
+  bool Parse();
+  inline int size() const { return cells_.width(); }
+  inline bool GoalFound() const { return goal_idx_ >= 0; }
+
+ private:
+  // an edge of a cell that is not in the forest yet
+  struct NewEdge {
+    NewEdge(int h, int g, int it, int r) : head(h), grammar(g), item(it), rule(r) {}
+    int head;     // index of the head among the cell's new nodes
+    int grammar;  // -1 for unary rules
+    int item;     // the active item in the grammar's chart, or the index
+                  // of the tail among the cell's new nodes (unary rules)
+    int rule;     // index in the item's rule bin, or in unaries_
+  };
+
+  struct CellWork {
+    vector<WordID> cats;    // categories of the cell's new nodes
+    vector<NewEdge> edges;
+    unsigned first_node;
+    unsigned first_edge;
+  };
+
+  int NodeFor(WordID cat, CellWork* work) const;
+  void CollectEdges(int i, int j, CellWork* work) const;
+  void AddToForest(int i, int j, const CellWork& work);
+  void ApplyGoalRule(const Hypergraph::TailNodeVector& ant);
+
+  const vector<GrammarPtr>& grammars_;
+  const Lattice& input_;
+  Hypergraph* forest_;
+  CellThreadPool pool_;
+  vector<ActiveChart<FlatChart>*> act_chart_;
+  Array2D<pair<unsigned, unsigned> > cells_;
+  vector<int> cell_nodes_;
+  const WordID goal_cat_;
+  TRulePtr goal_rule_;
+  int goal_idx_;
+  const int lc_fid_;
+  vector<TRulePtr> unaries_;                          // topologically sorted
+  unordered_map<WordID, vector<int> > cat2unaries_;   // indices in unaries_
+  const WordID kGOAL;
+  // category -> node map of the cell that a thread is working on
+  static thread_local unordered_map<WordID, int> cat2node_;
+};
+
+thread_local unordered_map<WordID, int> FlatChart::cat2node_;
+
+FlatChart::FlatChart(const string& goal,
+                     const vector<GrammarPtr>& grammars,
+                     const Lattice& input,
+                     Hypergraph* forest,
+                     int threads) :
+    grammars_(grammars),
+    input_(input),
+    forest_(forest),
+    pool_(threads),
+    cells_(input.size()+1, input.size()+1),
+    goal_cat_(TD::Convert(goal) * -1),
+    goal_rule_(new TRule("[Goal] ||| [" + goal + ",1] ||| [" + goal + ",1]")),
+    goal_idx_(-1),
+    lc_fid_(FD::Convert("LatticeCost")),
+    kGOAL(TD::Convert("Goal") * -1) {
+  act_chart_.resize(grammars_.size());
+  for (unsigned i = 0; i < grammars_.size(); ++i) {
+    act_chart_[i] = new ActiveChart<FlatChart>(forest, *this);
+    const vector<TRulePtr>& u = grammars_[i]->GetAllUnaryRules();
+    for (unsigned j = 0; j < u.size(); ++j)
+      unaries_.push_back(u[j]);
+  }
+  TopoSortUnaries(goal_cat_, &unaries_);
+  for (unsigned i = 0; i < unaries_.size(); ++i)
+    cat2unaries_[unaries_[i]->f()[0]].push_back(i);
+  if (!SILENT) cerr << "  Goal category: [" << goal << ']' << endl;
+}
+
+FlatChart::~FlatChart() {
+  for (unsigned i = 0; i < act_chart_.size(); ++i)
+    delete act_chart_[i];
+}
+
+// the cell's node for category cat (cat2node_ is the cell's map)
+inline int FlatChart::NodeFor(WordID cat, CellWork* work) const {
+  unordered_map<WordID, int>::const_iterator it = cat2node_.find(cat);
+  if (it != cat2node_.end()) return it->second;
+  const int node = work->cats.size();
+  cat2node_[cat] = node;
+  work->cats.push_back(cat);
+  return node;
+}
+
+// the same steps as PassiveChart::Parse for cell (i,j), up to the unary rules
+void FlatChart::CollectEdges(int i, int j, CellWork* work) const {
+  cat2node_.clear();
+  work->cats.clear();
+  work->edges.clear();
+  for (unsigned gi = 0; gi < grammars_.size(); ++gi) {
+    const Grammar& g = *grammars_[gi];
+    if (!g.HasRuleForSpan(i, j, input_.Distance(i, j))) continue;
+    act_chart_[gi]->AdvanceDotsForAllItemsInCell(i, j, input_);
+    const vector<ActiveItem>& cell = (*act_chart_[gi])(i,j);
+    for (unsigned ai = 0; ai < cell.size(); ++ai) {
+      const RuleBin* rules = cell[ai].gptr_->GetRules();
+      if (!rules) continue;
+      const int n = rules->GetNumRules();
+      for (int k = 0; k < n; ++k) {
+        work->edges.push_back(NewEdge(NodeFor(rules->GetIthRule(k)->GetLHS(), work), gi, ai, k));
+      }
+    }
+  }
+  // the goal node is not in the chart, so no rules apply to it
+  for (unsigned di = 0; di < work->cats.size(); ++di) {
+    if (work->cats[di] == kGOAL) continue;
+    const unordered_map<WordID, vector<int> >::const_iterator ui = cat2unaries_.find(work->cats[di]);
+    if (ui == cat2unaries_.end()) continue;
+    for (unsigned k = 0; k < ui->second.size(); ++k) {
+      work->edges.push_back(NewEdge(NodeFor(unaries_[ui->second[k]]->GetLHS(), work), -1, di, ui->second[k]));
+    }
+  }
+}
+
+// fills in the nodes and edges of cell (i,j), whose ids were assigned in
+// work, then extends the active items with the new nodes
+void FlatChart::AddToForest(int i, int j, const CellWork& work) {
+  for (unsigned k = 0; k < work.cats.size(); ++k) {
+    Hypergraph::Node& node = forest_->nodes_[work.first_node + k];
+    node.cat_ = work.cats[k];
+    node.id_ = work.first_node + k;
+  }
+  for (unsigned k = 0; k < work.edges.size(); ++k) {
+    const NewEdge& ne = work.edges[k];
+    Hypergraph::Edge& edge = forest_->edges_[work.first_edge + k];
+    float lattice_cost = 0;
+    if (ne.grammar >= 0) {
+      const ActiveItem& item = (*act_chart_[ne.grammar])(i,j)[ne.item];
+      edge.rule_ = item.gptr_->GetRules()->GetIthRule(ne.rule);
+      edge.tail_nodes_ = item.ant_nodes_;
+      lattice_cost = item.lattice_cost;
+    } else {
+      edge.rule_ = unaries_[ne.rule];
+      edge.tail_nodes_ = Hypergraph::TailNodeVector(1, work.first_node + ne.item);
+    }
+    edge.id_ = work.first_edge + k;
+    edge.prev_i_ = edge.rule_->prev_i;
+    edge.prev_j_ = edge.rule_->prev_j;
+    edge.i_ = i;
+    edge.j_ = j;
+    edge.feature_values_ = edge.rule_->GetFeatureValues();
+    if (lattice_cost && lc_fid_)
+      edge.feature_values_.set_value(lc_fid_, lattice_cost);
+    forest_->ConnectEdgeToHeadNode(&edge, work.first_node + ne.head);
+  }
+  for (unsigned gi = 0; gi < grammars_.size(); ++gi) {
+    const Grammar& g = *grammars_[gi];
+    if (g.HasRuleForSpan(i, j, input_.Distance(i,j)))
+      act_chart_[gi]->ExtendActiveItems(i, i, j);
+  }
+}
+
+void FlatChart::ApplyGoalRule(const Hypergraph::TailNodeVector& ant) {
+  const int n = input_.size();
+  Hypergraph::Edge* new_edge = forest_->AddEdge(goal_rule_, ant);
+  new_edge->prev_i_ = goal_rule_->prev_i;
+  new_edge->prev_j_ = goal_rule_->prev_j;
+  new_edge->i_ = 0;
+  new_edge->j_ = n;
+  new_edge->feature_values_ = goal_rule_->GetFeatureValues();
+  if (goal_idx_ < 0) goal_idx_ = forest_->AddNode(kGOAL)->id_;
+  forest_->ConnectEdgeToHeadNode(new_edge, goal_idx_);
+}
+
+bool FlatChart::Parse() {
+  const unsigned n = input_.size();
+  size_t in_size_2 = n * n;
+  forest_->nodes_.reserve(in_size_2 * 2);
+  size_t res = min(static_cast<size_t>(2000000), static_cast<size_t>(in_size_2 * 1000));
+  forest_->edges_.reserve(res);
+  goal_idx_ = -1;
+  for (unsigned gi = 0; gi < grammars_.size(); ++gi)
+    act_chart_[gi]->SeedActiveChart(*grammars_[gi]);
+
+  vector<CellWork> work(n);
+  if (!SILENT) cerr << "    ";
+  for (unsigned l=1; l<n+1; ++l) {
+    if (!SILENT) cerr << '.';
+    const unsigned num_cells = n + 1 - l;
+    pool_.Run(num_cells, [&](int i) { CollectEdges(i, i + l, &work[i]); });
+
+    // ids are given out cell by cell, as PassiveChart does
+    unsigned num_nodes = forest_->nodes_.size();
+    const unsigned first_edge = forest_->edges_.size();
+    unsigned num_edges = first_edge;
+    for (unsigned i = 0; i < num_cells; ++i) {
+      CellWork& w = work[i];
+      w.first_node = num_nodes;
+      w.first_edge = num_edges;
+      const unsigned begin = cell_nodes_.size();
+      for (unsigned k = 0; k < w.cats.size(); ++k) {
+        if (w.cats[k] == kGOAL) {
+          assert(goal_idx_ == -1);
+          goal_idx_ = num_nodes + k;
+        } else {
+          cell_nodes_.push_back(num_nodes + k);
+        }
+      }
+      cells_(i, i + l) = make_pair(begin, static_cast<unsigned>(cell_nodes_.size()));
+      num_nodes += w.cats.size();
+      num_edges += w.edges.size();
+    }
+    forest_->nodes_.resize(num_nodes);
+    forest_->edges_.resize(num_edges);
+    pool_.Run(num_cells, [&](int i) { AddToForest(i, i + l, work[i]); });
+    // tails are shared between cells, so they learn about their new out
+    // edges here, in edge order
+    for (unsigned e = first_edge; e < num_edges; ++e) {
+      const Hypergraph::Edge& edge = forest_->edges_[e];
+      for (unsigned k = 0; k < edge.tail_nodes_.size(); ++k)
+        forest_->nodes_[edge.tail_nodes_[k]].out_edges_.push_back(e);
+    }
+
+    const Cell dh = (*this)(0, n);
+    for (unsigned di = 0; di < dh.size(); ++di) {
+      const Hypergraph::Node& node = forest_->nodes_[dh[di]];
+      if (node.cat_ == goal_cat_) {
+        Hypergraph::TailNodeVector ant(1, node.id_);
+        ApplyGoalRule(ant);
+      }
+    }
+  }
+  if (!SILENT) cerr << endl;
+
+  if (GoalFound())
+    forest_->PruneUnreachable(forest_->nodes_.size() - 1);
+  return GoalFound();
+}
+
 ExhaustiveBottomUpParser::ExhaustiveBottomUpParser(
     const string& goal_sym,
-    const vector<GrammarPtr>& grammars) :
+    const vector<GrammarPtr>& grammars,
+    int threads) :
   goal_sym_(goal_sym),
-  grammars_(grammars) {}
+  grammars_(grammars),
+  threads_(threads) {}
 
 bool ExhaustiveBottomUpParser::Parse(const Lattice& input,
                                      Hypergraph* forest) const {
   kEPS = TD::Convert("*EPS*");
+  if (threads_ > 0) {
+    FlatChart chart(goal_sym_, grammars_, input, forest, threads_);
+    return chart.Parse();
+  }
   PassiveChart chart(goal_sym_, grammars_, input, forest);
   const bool result = chart.Parse();
   return result;
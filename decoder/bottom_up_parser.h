@@ -11,8 +11,11 @@ class Hypergraph;
 
 class ExhaustiveBottomUpParser {
  public:
+  // with threads > 0, the cells of each span width are filled in parallel
+  // by that many threads (the forest is the same as with threads = 0)
   ExhaustiveBottomUpParser(const std::string& goal_sym,
-                           const std::vector<GrammarPtr>& grammars);
+                           const std::vector<GrammarPtr>& grammars,
+                           int threads = 0);
 
   // returns true if goal reached spanning the full input
   // forest contains the full (i.e., unpruned) parse forest
@@ -22,6 +25,7 @@ class ExhaustiveBottomUpParser {
  private:
   const std::string goal_sym_;
   const std::vector<GrammarPtr> grammars_;
+  const int threads_;
 };
 
 #endif
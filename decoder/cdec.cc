@@ -1,20 +1,82 @@
 #include <iostream>
+#include <map>
+#include <mutex>
+#include <sstream>
+#include <thread>
+#include <vector>
+#include <boost/shared_ptr.hpp>
 
 #include "filelib.h"
 #include "decoder.h"
 #include "ff_register.h"
 #include "verbose.h"
 #include "timing_stats.h"
+#include "tdict.h"
+#include "fdict.h"
 #include "util/usage.hh"
 
 using namespace std;
 
+// hands out input lines to the worker threads and writes their
+// translations back to STDOUT in the order the input was read
+class SentenceQueue {
+ public:
+  explicit SentenceQueue(istream* in) : in_(in), next_in_(), next_out_() {}
+
+  // returns false when the input is exhausted
+  bool Next(string* line, int* id) {
+    lock_guard<mutex> lock(in_mutex_);
+    while(*in_) {
+      getline(*in_, *line);
+      if (line->empty()) continue;
+      *id = next_in_++;
+      return true;
+    }
+    return false;
+  }
+
+  void Write(int id, const string& output) {
+    lock_guard<mutex> lock(out_mutex_);
+    pending_[id] = output;
+    map<int, string>::iterator it;
+    while ((it = pending_.find(next_out_)) != pending_.end()) {
+      cout << it->second;
+      pending_.erase(it);
+      ++next_out_;
+    }
+    cout << flush;
+  }
+
+ private:
+  istream* in_;
+  int next_in_;
+  int next_out_;
+  map<int, string> pending_;
+  mutex in_mutex_;
+  mutex out_mutex_;
+};
+
+static void DecodeWorker(Decoder* decoder, SentenceQueue* queue) {
+  string buf;
+  int id;
+  while (queue->Next(&buf, &id)) {
+    ostringstream out;
+    decoder->SetOutputStream(&out);
+    decoder->SetId(id);
+    decoder->Decode(buf);
+    queue->Write(id, out.str());
+  }
+  decoder->SetOutputStream(&cout);
+  Timer::Summarize();
+}
+
 int main(int argc, char** argv) {
   register_feature_functions();
   Decoder decoder(argc, argv);
 
   const string input = decoder.GetConf()["input"].as<string>();
   const bool show_feature_dictionary = decoder.GetConf().count("show_feature_dictionary");
+  const int threads = decoder.GetConf()["threads"].as<int>();
   if (!SILENT) cerr << "Reading input from " << ((input == "-") ? "STDIN" : input.c_str()) << endl;
   ReadFile in_read(input);
   istream *in = in_read.stream();
@@ -24,10 +86,36 @@ int main(int argc, char** argv) {
 #ifdef CP_TIME
     clock_t time_cp(0);//, end_cp;
 #endif
-  while(*in) {
-    getline(*in, buf);
-    if (buf.empty()) continue;
-    decoder.Decode(buf);
+  if (threads > 1) {
+    if (decoder.GetConf().count("coarse_to_fine_beam_prune")) {
+      cerr << "--threads cannot be used with --coarse_to_fine_beam_prune (rule refinement modifies the shared grammar)\n";
+      return 1;
+    }
+    TD::SetThreadSafe(true);
+    FD::SetThreadSafe(true);
+    // each worker gets its own decoder (feature functions keep per-sentence
+    // state), but static grammars are loaded only once per process
+    vector<boost::shared_ptr<Decoder> > extra;
+    vector<Decoder*> decoders(1, &decoder);
+    for (int i = 1; i < threads; ++i) {
+      extra.push_back(boost::shared_ptr<Decoder>(new Decoder(argc, argv)));
+      decoders.push_back(extra.back().get());
+    }
+    if (!SILENT) cerr << "Decoding with " << threads << " threads\n";
+    SentenceQueue queue(in);
+    vector<thread> workers;
+    for (int i = 0; i < threads; ++i)
+      workers.push_back(thread(DecodeWorker, decoders[i], &queue));
+    for (int i = 0; i < threads; ++i)
+      workers[i].join();
+    for (int i = 1; i < threads; ++i)
+      decoder.TakeTrainingVector(decoders[i]);
+  } else {
+    while(*in) {
+      getline(*in, buf);
+      if (buf.empty()) continue;
+      decoder.Decode(buf);
+    }
   }
   Timer::Summarize();
 #ifdef CP_TIME
@@ -0,0 +1,110 @@
+// a long-lived decoder that translates requests sent over a local (UNIX
+// domain) socket, so models are loaded once and many clients can share them
+//   usage: cdec_server --socket PATH [--batch_size N] [cdec options, e.g. -c cdec.ini -w weights --threads 4]
+//
+// a connection carries any number of requests and results, one field per line:
+//   request ID                     starts a request; ID is any string without spaces
+//   weight NAME VALUE              (optional, repeated) overrides a feature weight in
+//                                  the weights of every pass (-w, --weights2, ...);
+//                                  features the decoder has never seen are ignored
+//   grammar N                      (optional) the next N lines are SCFG rules that
+//                                  are only used for this request
+//   input SENTENCE                 the input, in the format cdec reads (SGML markup
+//                                  such as <seg grammar="file.gz"> is allowed); ends
+//                                  the request
+// for every request the server sends back, as soon as it is decoded,
+//   result ID N SECONDS            followed by the N lines cdec would have written to
+//                                  STDOUT (1-best or k-best list, with features if
+//                                  configured), or
+//   error ID MESSAGE
+// results of different requests may arrive in any order. requests from all
+// connections go into one queue that --threads decoders take them from, up to
+// --batch_size (default 1) at a time (see TranslationServer).
+#include <sys/socket.h>
+#include <unistd.h>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <thread>
+#include <vector>
+#include <boost/shared_ptr.hpp>
+
+#include "decoder.h"
+#include "fdict.h"
+#include "ff_register.h"
+#include "line_socket.h"
+#include "tdict.h"
+#include "timing_stats.h"
+#include "translation_server.h"
+#include "verbose.h"
+
+using namespace std;
+
+int main(int argc, char** argv) {
+  // --socket and --batch_size are the server's own options, everything else
+  // goes to the decoder
+  string socket_path;
+  int batch_size = 1;
+  vector<char*> args(1, argv[0]);
+  for (int i = 1; i < argc; ++i) {
+    if (!strcmp(argv[i], "--socket") && i + 1 < argc)
+      socket_path = argv[++i];
+    else if (!strncmp(argv[i], "--socket=", 9))
+      socket_path = argv[i] + 9;
+    else if (!strcmp(argv[i], "--batch_size") && i + 1 < argc)
+      batch_size = atoi(argv[++i]);
+    else if (!strncmp(argv[i], "--batch_size=", 13))
+      batch_size = atoi(argv[i] + 13);
+    else
+      args.push_back(argv[i]);
+  }
+  if (socket_path.empty() || batch_size < 1) {
+    cerr << "Usage: " << argv[0] << " --socket PATH [--batch_size N] [decoder options]\n";
+    return 1;
+  }
+  int dargc = args.size();
+  args.push_back(NULL);
+  char** dargv = &args[0];
+
+  register_feature_functions();
+  TD::SetThreadSafe(true);
+  FD::SetThreadSafe(true);
+  Decoder decoder(dargc, dargv);
+  if (decoder.GetConf().count("coarse_to_fine_beam_prune")) {
+    cerr << "cdec_server cannot be used with --coarse_to_fine_beam_prune (rule refinement modifies the shared grammar)\n";
+    return 1;
+  }
+  const int threads = max(1, decoder.GetConf()["threads"].as<int>());
+  // each worker gets its own decoder (feature functions keep per-sentence
+  // state), but static grammars are loaded only once per process
+  vector<boost::shared_ptr<Decoder> > extra;
+  vector<Decoder*> decoders(1, &decoder);
+  for (int i = 1; i < threads; ++i) {
+    extra.push_back(boost::shared_ptr<Decoder>(new Decoder(dargc, dargv)));
+    decoders.push_back(extra.back().get());
+  }
+
+  string error;
+  int listen_fd = LineSocket::Listen(socket_path, &error);
+  if (listen_fd < 0) {
+    cerr << error << endl;
+    return 1;
+  }
+
+  TranslationServer server(decoders, batch_size);
+  if (!SILENT) cerr << "Listening on " << socket_path << " with " << threads << " decoder threads\n";
+  while (true) {
+    int fd = accept(listen_fd, NULL, NULL);
+    if (fd < 0) {
+      if (errno == EINTR || errno == ECONNABORTED) continue;
+      cerr << "accept failed: " << strerror(errno) << endl;
+      break;
+    }
+    thread(&TranslationServer::Serve, &server, fd).detach();
+  }
+  close(listen_fd);
+  unlink(socket_path.c_str());
+  Timer::Summarize();
+  return 1;
+}
@@ -0,0 +1,18 @@
+// converts a text SCFG into the memory-mapped format read by CompiledGrammar;
+// cdec loads a compiled grammar when it is given as --grammar
+#include <iostream>
+
+#include "compiled_grammar.h"
+#include "filelib.h"
+
+using namespace std;
+
+int main(int argc, char** argv) {
+  if (argc != 3) {
+    cerr << "Usage: " << argv[0] << " grammar.txt[.gz] grammar.bin\n";
+    return 1;
+  }
+  ReadFile in(argv[1]);
+  CompiledGrammar::Compile(in.stream(), argv[2]);
+  return 0;
+}
@@ -0,0 +1,520 @@
+#include "compiled_grammar.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "fdict.h"
+#include "hash.h"
+#include "rule_lexer.h"
+#include "tdict.h"
+
+using namespace std;
+
+// File layout (native byte order, every section starts at a multiple of 8):
+//   Header
+//   vocabulary:     uint64 offsets[num_symbols + 1], then the characters
+//   feature names:  uint64 offsets[num_features + 1], then the characters
+//   trie nodes:     Node[num_nodes], node 0 is the root
+//   trie edges:     Edge[num_edges], sorted by symbol within each node
+//   rules:          uint64 offsets[num_rules + 1] into the rule data, rules
+//                   of a node are contiguous; unary rules come last
+//   rule data:      one packed record per rule (see WriteRule)
+namespace {
+
+const char kMagic[8] = { 'c', 'd', 'e', 'c', 'S', 'C', 'F', 'G' };
+const uint32_t kVersion = 1;
+
+struct Header {
+  char magic[8];
+  uint32_t version;
+  uint32_t unused;
+  uint64_t num_symbols, symbols_offset;
+  uint64_t num_features, features_offset;
+  uint64_t num_nodes, nodes_offset;
+  uint64_t num_edges, edges_offset;
+  uint64_t num_rules, rules_offset, rule_data_offset;
+  uint64_t num_unaries;
+};
+
+struct RecordHeader {
+  int32_t lhs;
+  uint8_t arity;
+  uint8_t unused;
+  uint16_t f_len, e_len, num_feats, num_als;
+};
+
+template <typename T> inline void Append(string* out, const T& x) {
+  out->append(reinterpret_cast<const char*>(&x), sizeof(T));
+}
+
+template <typename T> inline const char* Read(const char* p, T* x) {
+  memcpy(x, p, sizeof(T));
+  return p + sizeof(T);
+}
+
+struct GrammarCompiler {
+  GrammarCompiler() { HASH_MAP_EMPTY(symbols, 0); HASH_MAP_EMPTY(features, 0); }
+
+  // file vocabulary index + 1
+  int32_t Symbol(WordID w) {
+    int32_t& s = symbols[w];
+    if (!s) {
+      symbol_list.push_back(w);
+      s = symbol_list.size();
+    }
+    return s;
+  }
+
+  uint32_t Feature(int fid) {
+    HASH_MAP<int, uint32_t>::iterator it = features.find(fid);
+    if (it != features.end()) return it->second;
+    feature_list.push_back(fid);
+    return features[fid] = feature_list.size() - 1;
+  }
+
+  void WriteRule(const TRule& r) {
+    offsets.push_back(data.size());
+    RecordHeader h;
+    h.lhs = -Symbol(-r.GetLHS());
+    h.arity = r.Arity();
+    h.unused = 0;
+    h.f_len = r.f_.size();
+    h.e_len = r.e_.size();
+    h.num_feats = r.scores_.size();
+    h.num_als = r.a_.size();
+    Append(&data, h);
+    for (unsigned i = 0; i < r.f_.size(); ++i)
+      Append(&data, r.f_[i] > 0 ? Symbol(r.f_[i]) : -Symbol(-r.f_[i]));
+    for (unsigned i = 0; i < r.e_.size(); ++i)
+      Append(&data, r.e_[i] > 0 ? Symbol(r.e_[i]) : static_cast<int32_t>(r.e_[i]));
+    for (SparseVector<double>::const_iterator it = r.scores_.begin(); it != r.scores_.end(); ++it)
+      Append(&data, Feature(it->first));
+    for (SparseVector<double>::const_iterator it = r.scores_.begin(); it != r.scores_.end(); ++it)
+      Append(&data, it->second);
+    for (unsigned i = 0; i < r.a_.size(); ++i) {
+      Append(&data, static_cast<int16_t>(r.a_[i].s_));
+      Append(&data, static_cast<int16_t>(r.a_[i].t_));
+    }
+  }
+
+  void AddRule(const TRulePtr& r, unsigned ctf_level) {
+    if (ctf_level > 0) {
+      cerr << "Compiled grammars do not support coarse-to-fine rules\n";
+      abort();
+    }
+    if (r->IsUnary()) unaries.push_back(offsets.size());
+    else trie_rules.push_back(offsets.size());
+    WriteRule(*r);
+  }
+
+  // source side of rule i, as file symbols
+  const int32_t* F(uint32_t i, unsigned* len) const {
+    RecordHeader h;
+    const char* p = Read(&data[offsets[i]], &h);
+    *len = h.f_len;
+    return reinterpret_cast<const int32_t*>(p);
+  }
+
+  int32_t FSymbol(uint32_t i, unsigned k) const {
+    unsigned len;
+    int32_t s;
+    memcpy(&s, F(i, &len) + k, sizeof(s));
+    return s;
+  }
+
+  bool FLess(uint32_t a, uint32_t b) const {
+    unsigned la, lb;
+    const int32_t* fa = F(a, &la);
+    const int32_t* fb = F(b, &lb);
+    for (unsigned k = 0; k < la && k < lb; ++k) {
+      int32_t x, y;
+      memcpy(&x, fa + k, sizeof(x));
+      memcpy(&y, fb + k, sizeof(y));
+      if (x != y) return x < y;
+    }
+    return la < lb;
+  }
+
+  // rules[lo, hi) share a prefix of length depth, which leads to node
+  void Build(size_t lo, size_t hi, unsigned depth, uint32_t node) {
+    unsigned len;
+    nodes[node].first_rule = ordered.size();
+    while (lo < hi && (F(trie_rules[lo], &len), len == depth))
+      ordered.push_back(trie_rules[lo++]);
+    nodes[node].num_rules = ordered.size() - nodes[node].first_rule;
+
+    vector<size_t> starts;
+    for (size_t i = lo; i < hi; ++i)
+      if (i == lo || FSymbol(trie_rules[i], depth) != FSymbol(trie_rules[i - 1], depth))
+        starts.push_back(i);
+    starts.push_back(hi);
+    nodes[node].first_edge = edges.size();
+    nodes[node].num_edges = starts.size() - 1;
+    const uint32_t first_child = nodes.size();
+    for (unsigned g = 0; g + 1 < starts.size(); ++g) {
+      CompiledGrammar::Edge e;
+      e.symbol = FSymbol(trie_rules[starts[g]], depth);
+      e.node = nodes.size();
+      edges.push_back(e);
+      nodes.push_back(CompiledGrammar::Node());
+    }
+    for (unsigned g = 0; g + 1 < starts.size(); ++g)
+      Build(starts[g], starts[g + 1], depth + 1, first_child + g);
+  }
+
+  void Write(const string& file) {
+    // keep the input order of rules that share a source side
+    stable_sort(trie_rules.begin(), trie_rules.end(),
+                [this](uint32_t a, uint32_t b) { return FLess(a, b); });
+    nodes.resize(1);
+    Build(0, trie_rules.size(), 0, 0);
+    ordered.insert(ordered.end(), unaries.begin(), unaries.end());
+    offsets.push_back(data.size());
+
+    ofstream out(file.c_str(), ios::binary);
+    if (!out) {
+      cerr << "Failed to open " << file << " for writing\n";
+      abort();
+    }
+    Header h;
+    memset(&h, 0, sizeof(h));
+    memcpy(h.magic, kMagic, sizeof(kMagic));
+    h.version = kVersion;
+    out.write(reinterpret_cast<const char*>(&h), sizeof(h));
+
+    vector<string> strings;
+    for (unsigned i = 0; i < symbol_list.size(); ++i)
+      strings.push_back(TD::Convert(symbol_list[i]));
+    h.num_symbols = strings.size();
+    h.symbols_offset = WriteStrings(strings, &out);
+    strings.clear();
+    for (unsigned i = 0; i < feature_list.size(); ++i)
+      strings.push_back(FD::Convert(feature_list[i]));
+    h.num_features = strings.size();
+    h.features_offset = WriteStrings(strings, &out);
+
+    h.num_nodes = nodes.size();
+    h.nodes_offset = WriteArray(nodes, &out);
+    h.num_edges = edges.size();
+    h.edges_offset = WriteArray(edges, &out);
+
+    vector<uint64_t> rule_offsets(1, 0);
+    for (unsigned i = 0; i < ordered.size(); ++i)
+      rule_offsets.push_back(rule_offsets.back() + offsets[ordered[i] + 1] - offsets[ordered[i]]);
+    h.num_rules = ordered.size();
+    h.num_unaries = unaries.size();
+    h.rules_offset = WriteArray(rule_offsets, &out);
+    h.rule_data_offset = Pad(&out);
+    for (unsigned i = 0; i < ordered.size(); ++i)
+      out.write(&data[offsets[ordered[i]]], offsets[ordered[i] + 1] - offsets[ordered[i]]);
+
+    out.seekp(0);
+    out.write(reinterpret_cast<const char*>(&h), sizeof(h));
+    if (!out) {
+      cerr << "Error writing " << file << endl;
+      abort();
+    }
+  }
+
+  static uint64_t Pad(ofstream* out) {
+    static const char zeros[8] = { 0 };
+    const uint64_t pos = out->tellp();
+    if (pos % 8) out->write(zeros, 8 - pos % 8);
+    return out->tellp();
+  }
+
+  template <typename T>
+  static uint64_t WriteArray(const vector<T>& v, ofstream* out) {
+    const uint64_t start = Pad(out);
+    if (!v.empty()) out->write(reinterpret_cast<const char*>(&v[0]), v.size() * sizeof(T));
+    return start;
+  }
+
+  static uint64_t WriteStrings(const vector<string>& v, ofstream* out) {
+    vector<uint64_t> offsets(1, 0);
+    for (unsigned i = 0; i < v.size(); ++i)
+      offsets.push_back(offsets.back() + v[i].size());
+    const uint64_t start = WriteArray(offsets, out);
+    for (unsigned i = 0; i < v.size(); ++i)
+      out->write(v[i].data(), v[i].size());
+    return start;
+  }
+
+  HASH_MAP<WordID, int32_t> symbols;
+  vector<WordID> symbol_list;
+  HASH_MAP<int, uint32_t> features;
+  vector<int> feature_list;
+  string data;               // packed rules, in input order
+  vector<uint64_t> offsets;  // start of each rule in data
+  vector<uint32_t> trie_rules;
+  vector<uint32_t> unaries;
+  vector<uint32_t> ordered;  // rules in file order
+  vector<CompiledGrammar::Node> nodes;
+  vector<CompiledGrammar::Edge> edges;
+};
+
+void AddRuleHelper(const TRulePtr& new_rule, const unsigned int ctf_level, const TRulePtr&, void* extra) {
+  static_cast<GrammarCompiler*>(extra)->AddRule(new_rule, ctf_level);
+}
+
+bool EdgeLess(const CompiledGrammar::Edge& e, int32_t symbol) {
+  return e.symbol < symbol;
+}
+
+}  // namespace
+
+class CompiledGrammarIter : public GrammarIter, public RuleBin {
+ public:
+  CompiledGrammarIter(const CompiledGrammar* g, uint32_t node) :
+    g_(g), node_(g->GetNode(node)) {}
+
+  const RuleBin* GetRules() const {
+    return node_.num_rules ? this : NULL;
+  }
+
+  const GrammarIter* Extend(int symbol) const {
+    const int32_t s = symbol > 0 ? g_->FileSymbol(symbol) : -g_->FileSymbol(-symbol);
+    if (!s) return NULL;
+    const CompiledGrammar::Edge* begin = g_->Edges() + node_.first_edge;
+    const CompiledGrammar::Edge* end = begin + node_.num_edges;
+    const CompiledGrammar::Edge* e = lower_bound(begin, end, s, EdgeLess);
+    if (e == end || e->symbol != s) return NULL;
+    return g_->Iter(e->node);
+  }
+
+  int GetNumRules() const { return node_.num_rules; }
+  int Arity() const { return g_->RuleArity(node_.first_rule); }
+
+  // the rules of a bin are built the first time one of them is needed and
+  // then kept, so that all edges using a rule share a single TRule
+  TRulePtr GetIthRule(int i) const {
+    call_once(built_, [this]() {
+      rules_.resize(node_.num_rules);
+      for (unsigned r = 0; r < node_.num_rules; ++r)
+        rules_[r] = g_->GetRule(node_.first_rule + r);
+    });
+    return rules_[i];
+  }
+
+ private:
+  const CompiledGrammar* g_;
+  const CompiledGrammar::Node& node_;
+  mutable once_flag built_;
+  mutable vector<TRulePtr> rules_;
+};
+
+bool CompiledGrammar::IsCompiledGrammar(const string& file) {
+  ifstream in(file.c_str(), ios::binary);
+  char magic[sizeof(kMagic)];
+  return in.read(magic, sizeof(magic)) && memcmp(magic, kMagic, sizeof(kMagic)) == 0;
+}
+
+void CompiledGrammar::Compile(istream* in, const string& out_file) {
+  GrammarCompiler c;
+  RuleLexer::ReadRules(in, &AddRuleHelper, "UNKNOWN", &c);
+  c.Write(out_file);
+}
+
+CompiledGrammar::CompiledGrammar(const string& file) :
+    file_(file), max_span_(10), data_(NULL), size_(0), iters_(NULL) {
+  const int fd = open(file.c_str(), O_RDONLY);
+  struct stat st;
+  if (fd < 0 || fstat(fd, &st) != 0) {
+    cerr << "Failed to open " << file << endl;
+    abort();
+  }
+  size_ = st.st_size;
+  data_ = mmap(NULL, size_, PROT_READ, MAP_SHARED, fd, 0);
+  close(fd);
+  if (data_ == MAP_FAILED) {
+    cerr << "Failed to map " << file << endl;
+    abort();
+  }
+  const char* base = static_cast<const char*>(data_);
+  Header h;
+  if (size_ < sizeof(h)) {
+    cerr << file << " is not a compiled grammar\n";
+    abort();
+  }
+  memcpy(&h, base, sizeof(h));
+  if (memcmp(h.magic, kMagic, sizeof(kMagic)) != 0 || h.version != kVersion) {
+    cerr << file << " is not a compiled grammar (or was written by a different version)\n";
+    abort();
+  }
+
+  const uint64_t* offsets = Strings(h.symbols_offset, h.num_symbols);
+  if (!offsets) Corrupt("vocabulary");
+  const char* chars = reinterpret_cast<const char*>(offsets + h.num_symbols + 1);
+  f2w_.resize(h.num_symbols);
+  for (unsigned i = 0; i < h.num_symbols; ++i)
+    f2w_[i] = TD::Convert(string(chars + offsets[i], offsets[i + 1] - offsets[i]));
+  w2f_.resize(TD::NumWords() + 1);
+  for (unsigned i = 0; i < f2w_.size(); ++i)
+    w2f_[f2w_[i]] = i + 1;
+
+  offsets = Strings(h.features_offset, h.num_features);
+  if (!offsets) Corrupt("feature names");
+  chars = reinterpret_cast<const char*>(offsets + h.num_features + 1);
+  fids_.resize(h.num_features);
+  for (unsigned i = 0; i < h.num_features; ++i)
+    fids_[i] = FD::Convert(string(chars + offsets[i], offsets[i + 1] - offsets[i]));
+
+  // the root must exist; node ids and rule indexes are 32 bit
+  if (h.num_nodes == 0 || h.num_nodes > UINT32_MAX || !InFile(h.nodes_offset, h.num_nodes, sizeof(Node)))
+    Corrupt("trie nodes");
+  if (!InFile(h.edges_offset, h.num_edges, sizeof(Edge)))
+    Corrupt("trie edges");
+  if (h.num_rules >= UINT32_MAX || !InFile(h.rules_offset, h.num_rules + 1, sizeof(uint64_t)))
+    Corrupt("rule offsets");
+  if (h.rule_data_offset > size_)
+    Corrupt("rule data");
+  if (h.num_unaries > h.num_rules)
+    Corrupt("number of unary rules");
+  num_nodes_ = h.num_nodes;
+  num_edges_ = h.num_edges;
+  num_rules_ = h.num_rules;
+  rule_data_size_ = size_ - h.rule_data_offset;
+  nodes_ = reinterpret_cast<const Node*>(base + h.nodes_offset);
+  edges_ = reinterpret_cast<const Edge*>(base + h.edges_offset);
+  rule_offsets_ = reinterpret_cast<const uint64_t*>(base + h.rules_offset);
+  rule_data_ = base + h.rule_data_offset;
+  // catches truncation; each record is checked when it is read
+  if (rule_offsets_[num_rules_] > rule_data_size_)
+    Corrupt("rule data");
+  iters_ = static_cast<atomic<CompiledGrammarIter*>*>(calloc(num_nodes_, sizeof(atomic<CompiledGrammarIter*>)));
+
+  for (uint64_t r = h.num_rules - h.num_unaries; r < h.num_rules; ++r) {
+    TRulePtr rule = GetRule(r);
+    if (!rule->IsUnary()) Corrupt("unary rules");
+    rhs2unaries_[rule->f().front()].push_back(rule);
+    unaries_.push_back(rule);
+  }
+}
+
+CompiledGrammar::~CompiledGrammar() {
+  for (unsigned i = 0; i < created_.size(); ++i)
+    delete created_[i];
+  free(iters_);
+  munmap(data_, size_);
+}
+
+const GrammarIter* CompiledGrammar::GetRoot() const {
+  return Iter(0);
+}
+
+bool CompiledGrammar::HasRuleForSpan(int /* i */, int /* j */, int distance) const {
+  return (max_span_ >= distance);
+}
+
+const GrammarIter* CompiledGrammar::Iter(uint32_t node) const {
+  if (node >= num_nodes_) Corrupt("trie edge to a missing node");
+  CompiledGrammarIter* it = iters_[node].load(memory_order_acquire);
+  if (!it) {
+    const Node& n = nodes_[node];
+    if (uint64_t(n.first_edge) + n.num_edges > num_edges_ ||
+        uint64_t(n.first_rule) + n.num_rules > num_rules_)
+      Corrupt("trie node");
+    CompiledGrammarIter* fresh = new CompiledGrammarIter(this, node);
+    if (iters_[node].compare_exchange_strong(it, fresh, memory_order_acq_rel)) {
+      lock_guard<mutex> lock(created_mutex_);
+      created_.push_back(fresh);
+      it = fresh;
+    } else {
+      delete fresh;  // another thread got there first
+    }
+  }
+  return it;
+}
+
+bool CompiledGrammar::InFile(uint64_t offset, uint64_t count, uint64_t elem_size) const {
+  return offset % 8 == 0 && offset <= size_ && count <= (size_ - offset) / elem_size;
+}
+
+const uint64_t* CompiledGrammar::Strings(uint64_t offset, uint64_t n) const {
+  if (n >= size_ || !InFile(offset, n + 1, sizeof(uint64_t))) return NULL;
+  const uint64_t* offsets = reinterpret_cast<const uint64_t*>(static_cast<const char*>(data_) + offset);
+  for (uint64_t i = 0; i < n; ++i)
+    if (offsets[i] > offsets[i + 1]) return NULL;
+  if (offsets[n] > size_ - offset - (n + 1) * sizeof(uint64_t)) return NULL;
+  return offsets;
+}
+
+const char* CompiledGrammar::RuleRecord(uint32_t rule) const {
+  if (rule >= num_rules_) Corrupt("rule index");
+  const uint64_t begin = rule_offsets_[rule];
+  const uint64_t end = rule_offsets_[rule + 1];
+  if (begin > end || end > rule_data_size_ || end - begin < sizeof(RecordHeader))
+    Corrupt("rule offsets");
+  RecordHeader h;
+  Read(rule_data_ + begin, &h);
+  const uint64_t size = sizeof(RecordHeader) + (uint64_t(h.f_len) + h.e_len) * sizeof(int32_t) +
+      uint64_t(h.num_feats) * (sizeof(uint32_t) + sizeof(double)) + uint64_t(h.num_als) * 2 * sizeof(int16_t);
+  if (size > end - begin) Corrupt("rule record");
+  return rule_data_ + begin;
+}
+
+void CompiledGrammar::Corrupt(const string& what) const {
+  cerr << file_ << " is truncated or corrupt (bad " << what << ")\n";
+  abort();
+}
+
+int CompiledGrammar::RuleArity(uint32_t rule) const {
+  RecordHeader h;
+  Read(RuleRecord(rule), &h);
+  return h.arity;
+}
+
+TRulePtr CompiledGrammar::GetRule(uint32_t rule) const {
+  RecordHeader h;
+  const char* p = Read(RuleRecord(rule), &h);
+  const int32_t num_symbols = f2w_.size();
+  if (h.lhs >= 0 || h.lhs < -num_symbols) Corrupt("rule LHS");
+  vector<WordID> f(h.f_len), e(h.e_len);
+  unsigned arity = 0;
+  for (unsigned i = 0; i < h.f_len; ++i) {
+    int32_t s;
+    p = Read(p, &s);
+    if (s == 0 || s > num_symbols || s < -num_symbols) Corrupt("rule source symbol");
+    if (s < 0) ++arity;
+    f[i] = s > 0 ? f2w_[s - 1] : -f2w_[-s - 1];
+  }
+  if (arity != h.arity) Corrupt("rule arity");
+  for (unsigned i = 0; i < h.e_len; ++i) {
+    int32_t s;
+    p = Read(p, &s);
+    // target nonterminals are 0, -1, ... for the 1st, 2nd, ... antecedent
+    if (s > num_symbols || s <= -static_cast<int32_t>(h.arity)) Corrupt("rule target symbol");
+    e[i] = s > 0 ? f2w_[s - 1] : s;
+  }
+  vector<int> fids;
+  vector<double> vals;
+  const char* vp = p + h.num_feats * sizeof(uint32_t);
+  for (unsigned i = 0; i < h.num_feats; ++i) {
+    uint32_t fi;
+    double v;
+    p = Read(p, &fi);
+    vp = Read(vp, &v);
+    if (fi >= fids_.size()) Corrupt("rule feature");
+    if (fids_[fi]) {  // 0 if the feature set is frozen and fi is unknown
+      fids.push_back(fids_[fi]);
+      vals.push_back(v);
+    }
+  }
+  p = vp;
+  vector<AlignmentPoint> als(h.num_als);
+  for (unsigned i = 0; i < h.num_als; ++i) {
+    int16_t s, t;
+    p = Read(p, &s);
+    p = Read(p, &t);
+    als[i] = AlignmentPoint(s, t);
+  }
+  return TRulePtr(new TRule(-f2w_[-h.lhs - 1], f.data(), f.size(), e.data(), e.size(),
+                            fids.data(), vals.data(), fids.size(), h.arity, als.data(), als.size()));
+}
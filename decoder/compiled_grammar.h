@@ -0,0 +1,96 @@
+#ifndef COMPILED_GRAMMAR_H_
+#define COMPILED_GRAMMAR_H_
+
+#include <atomic>
+#include <mutex>
+#include <string>
+#include <vector>
+#include <stdint.h>
+
+#include "grammar.h"
+
+// A read-only SCFG backed by a memory-mapped binary file written by
+// CompiledGrammar::Compile (see compile_grammar.cc). The file contains a
+// trie over source symbols whose nodes and (sorted) edges are stored in flat
+// arrays, and packed rule records (LHS, source, target, features,
+// alignment). Loading maps the file and converts its vocabulary and feature
+// names to TD/FD ids; everything else is only touched when the parser
+// visits it, so startup is fast, pages are shared between processes using
+// the same file, and TRules are only built for rule bins the parser uses.
+// Every section is checked against the file size when the file is loaded,
+// and trie nodes and rule records when they are first used; a truncated or
+// corrupt file is reported and the program aborts.
+// Coarse-to-fine grammars are not supported.
+class CompiledGrammarIter;
+class CompiledGrammar : public Grammar {
+ public:
+  explicit CompiledGrammar(const std::string& file);
+  ~CompiledGrammar();
+  void SetMaxSpan(int m) { max_span_ = m; }
+
+  virtual const GrammarIter* GetRoot() const;
+  virtual bool HasRuleForSpan(int i, int j, int distance) const;
+
+  // true if file starts with the compiled grammar magic number
+  static bool IsCompiledGrammar(const std::string& file);
+
+  // reads a text grammar from in and writes its compiled form to out_file
+  static void Compile(std::istream* in, const std::string& out_file);
+
+  struct Node {
+    uint32_t first_edge;
+    uint32_t num_edges;
+    uint32_t first_rule;
+    uint32_t num_rules;
+  };
+  struct Edge {
+    int32_t symbol;  // > 0 terminal, < 0 nonterminal, file vocabulary index + 1
+    uint32_t node;
+  };
+
+  const GrammarIter* Iter(uint32_t node) const;
+  const Node& GetNode(uint32_t node) const { return nodes_[node]; }
+  const Edge* Edges() const { return edges_; }
+  // file vocabulary index + 1 of a TD id, 0 if the word is not in the grammar
+  int32_t FileSymbol(WordID w) const {
+    return (w > 0 && w < static_cast<int>(w2f_.size())) ? w2f_[w] : 0;
+  }
+  TRulePtr GetRule(uint32_t rule) const;
+  int RuleArity(uint32_t rule) const;
+
+ private:
+  // true if count elements of elem_size bytes starting at offset lie within
+  // the file (and offset is 8 byte aligned)
+  bool InFile(uint64_t offset, uint64_t count, uint64_t elem_size) const;
+  // the offsets of the string table at offset, which holds n strings whose
+  // characters follow the offsets; NULL if it does not fit in the file
+  const uint64_t* Strings(uint64_t offset, uint64_t n) const;
+  // the packed record of rule, after checking that it lies within the rule
+  // data and is as long as its header says
+  const char* RuleRecord(uint32_t rule) const;
+  void Corrupt(const std::string& what) const;
+
+  std::string file_;
+  int max_span_;
+  void* data_;
+  size_t size_;
+  uint32_t num_nodes_;
+  uint64_t num_edges_;
+  uint64_t num_rules_;
+  uint64_t rule_data_size_;
+  const Node* nodes_;
+  const Edge* edges_;
+  const uint64_t* rule_offsets_;
+  const char* rule_data_;
+  std::vector<WordID> f2w_;    // file vocabulary index -> TD id
+  std::vector<int32_t> w2f_;   // TD id -> file vocabulary index + 1
+  std::vector<int> fids_;      // file feature index -> FD id (0 if frozen)
+
+  // iterators are created the first time a node is visited; slots live in
+  // zero-filled memory that the OS only backs once it is touched
+  std::atomic<CompiledGrammarIter*>* iters_;
+  mutable std::mutex created_mutex_;
+  mutable std::vector<CompiledGrammarIter*> created_;
+};
+
+#endif
@@ -0,0 +1,44 @@
+// converts forests between the JSON format and the binary format that is
+// faster to read (see HypergraphIO::WriteToBinary). the input format is
+// detected automatically; the output is binary if its name ends in .hg or
+// .hg.gz (compressed, which is small but cannot be memory mapped)
+//   usage: convert_forest [--json|--binary] in.json.gz|in.hg out.hg|out.json.gz
+#include <cstring>
+#include <iostream>
+#include <string>
+
+#include "filelib.h"
+#include "hg.h"
+#include "hg_io.h"
+
+using namespace std;
+
+int main(int argc, char** argv) {
+  int format = 0;  // 1 = JSON, 2 = binary
+  int arg = 1;
+  if (argc > 1 && !strcmp(argv[1], "--json")) { format = 1; ++arg; }
+  else if (argc > 1 && !strcmp(argv[1], "--binary")) { format = 2; ++arg; }
+  if (argc - arg != 2) {
+    cerr << "Usage: " << argv[0] << " [--json|--binary] in.json.gz|in.hg out.hg|out.json.gz\n";
+    return 1;
+  }
+  const string out_file = argv[arg + 1];
+  if (!format) {
+    string name = out_file;
+    if (name.size() > 3 && name.compare(name.size() - 3, 3, ".gz") == 0) name.resize(name.size() - 3);
+    format = (name.size() > 3 && name.compare(name.size() - 3, 3, ".hg") == 0) ? 2 : 1;
+  }
+  Hypergraph hg;
+  if (!HypergraphIO::ReadFromFile(argv[arg], &hg)) {
+    cerr << "Failed to read forest from " << argv[arg] << endl;
+    return 1;
+  }
+  WriteFile wf(out_file);
+  const bool succeeded = format == 2 ? HypergraphIO::WriteToBinary(hg, false, wf.stream())
+                                     : HypergraphIO::WriteToJSON(hg, false, wf.stream());
+  if (!succeeded) {
+    cerr << "Failed to write forest to " << out_file << endl;
+    return 1;
+  }
+  return 0;
+}
@@ -158,7 +158,7 @@ bool CompoundSplit::TranslateImpl(const string& input,
 
 int CompoundSplit::GetFullWordEdgeIndex(const Hypergraph& forest) {
   assert(forest.nodes_.size() > 0);
-  const vector<int> out_edges = forest.nodes_[0].out_edges_;
+  const Hypergraph::EdgesVector& out_edges = forest.nodes_[0].out_edges_;
   int max_edge = -1;
   int max_j = -1;
   for (int i = 0; i < out_edges.size(); ++i) {
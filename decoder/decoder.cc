@@ -166,7 +166,21 @@ struct DecoderImpl {
   vector<weight_t>& CurrentWeightVector() {
     return (rescoring_passes.empty() ? *init_weights : *rescoring_passes.back().weight_vector);
   }
+  void WeightVectors(vector<vector<weight_t>*>* v) {
+    // passes without their own weights share the previous pass's vector
+    v->assign(1, init_weights.get());
+    for (int i = 0; i < rescoring_passes.size(); ++i)
+      if (rescoring_passes[i].weight_vector.get() != v->back())
+        v->push_back(rescoring_passes[i].weight_vector.get());
+  }
   void SetId(int next_sent_id) { sent_id = next_sent_id - 1; }
+  void SetOutputStream(ostream* o) { out = o; }
+  void TakeTrainingVector(DecoderImpl* other) {
+    acc_vec += other->acc_vec;
+    acc_obj += other->acc_obj;
+    other->acc_vec.clear();
+    other->acc_obj = 0;
+  }
 
   void forest_stats(Hypergraph &forest,string name,bool show_tree,bool show_deriv=false, bool extract_rules=false, boost::shared_ptr<WriteFile> extract_file = boost::make_shared<WriteFile>()) {
     cerr << viterbi_stats(forest,name,true,show_tree,show_deriv,extract_rules, extract_file);
@@ -229,7 +243,7 @@ struct DecoderImpl {
     vector<SampleSet<prob_t> > ss(num_nodes);
     for (int i = 0; i < num_nodes; ++i) {
       SampleSet<prob_t>& s = ss[i];
-      const vector<int>& in_edges = hg->nodes_[i].in_edges_;
+      const Hypergraph::EdgesVector& in_edges = hg->nodes_[i].in_edges_;
       for (int j = 0; j < in_edges.size(); ++j) {
         s.add(hg->edges_[in_edges[j]].edge_prob_);
       }
@@ -248,9 +262,9 @@ struct DecoderImpl {
     sort(dist.begin(), dist.end(), SampleSort());
     if (k) {
       for (int i = 0; i < k; ++i)
-        cout << dist[i].first << " ||| " << dist[i].second << endl;
+        *out << dist[i].first << " ||| " << dist[i].second << endl;
     } else {
-      cout << dist[0].second << endl;
+      *out << dist[0].second << endl;
     }
   }
 
@@ -301,7 +315,10 @@ struct DecoderImpl {
   bool feature_expectations; // TODO Observer
   bool output_training_vector; // TODO Observer
   bool remove_intersected_rule_annotations;
+  bool binary_forests;
+  bool forest_arena;
   boost::scoped_ptr<IncrementalBase> incremental;
+  ostream* out;   // where translations, k-best lists, etc. are written
 
 
   static void ConvertSV(const SparseVector<prob_t>& src, SparseVector<double>* trg) {
@@ -313,17 +330,17 @@ struct DecoderImpl {
 DecoderImpl::~DecoderImpl() {
   if (output_training_vector && !acc_vec.empty()) {
     if (encode_b64) {
-      cout << "0\t";
+      *out << "0\t";
       SparseVector<double> dav; ConvertSV(acc_vec, &dav);
-      B64::Encode(acc_obj, dav, &cout);
-      cout << endl << flush;
+      B64::Encode(acc_obj, dav, out);
+      *out << endl << flush;
     } else {
-      cout << "0\t**OBJ**=" << acc_obj << ';' << acc_vec << endl << flush;
+      *out << "0\t**OBJ**=" << acc_obj << ';' << acc_vec << endl << flush;
     }
   }
 }
 
-DecoderImpl::DecoderImpl(po::variables_map& conf, int argc, char** argv, istream* cfg) : conf(conf) {
+DecoderImpl::DecoderImpl(po::variables_map& conf, int argc, char** argv, istream* cfg) : conf(conf), out(&cout) {
   if (cfg) { if (argc || argv) { cerr << "DecoderImpl() can only take a file or command line options, not both\n"; exit(1); } }
   bool show_config;
   bool show_weights;
@@ -333,17 +350,22 @@ DecoderImpl::DecoderImpl(po::variables_map& conf, int argc, char** argv, istream
   opts.add_options()
         ("formalism,f",po::value<string>(),"Decoding formalism; values include SCFG, FST, PB, LexTrans (lexical translation model, also disc training), CSplit (compound splitting), Tagger (sequence labeling), LexAlign (alignment only, or EM training)")
         ("input,i",po::value<string>()->default_value("-"),"Source file")
+        ("threads",po::value<int>()->default_value(1),"Number of sentences to decode in parallel (workers share static grammars; output is written in input order)")
         ("grammar,g",po::value<vector<string> >()->composing(),"Either SCFG grammar file(s) or phrase tables file(s)")
-        ("per_sentence_grammar_file", po::value<string>(), "Optional (and possibly not implemented) per sentence grammar file enables all per sentence grammars to be stored in a single large file and accessed by offset")
+        ("per_sentence_grammar_file", po::value<string>(), "Optional per sentence grammar file enables all per sentence grammars to be stored in a single large file and accessed by offset (given by the psg=\"@OFFSET\" SGML attribute); with the SCFG formalism, grammars may be binary (as written by extract/run_extractor --per_sentence_grammar_file) or text terminated by ###EOS###")
+        ("grammar_server", po::value<string>(), "Optional UNIX socket of a grammar server (started with extract --socket PATH) that is asked for the SCFG grammar of each sentence")
         ("list_feature_functions,L","List available feature functions")
 #ifdef HAVE_CMPH
         ("cmph_perfect_feature_hash,h", po::value<string>(), "Load perfect hash function for features")
 #endif
 
+        ("feature_hashing",po::value<int>(), "Map feature names to 2^arg ids by hashing them instead of keeping a dictionary of names")
+        ("feature_hashing_names", "With --feature_hashing, also remember the names of sparse features (e.g. rule and n-gram features) so that they can be written; otherwise they are written as @id")
         ("weights,w",po::value<string>(),"Feature weights file (initial forest / pass 1)")
         ("feature_function,F",po::value<vector<string> >()->composing(), "Pass 1 additional feature function(s) (-L for list)")
-        ("intersection_strategy,I",po::value<string>()->default_value("cube_pruning"), "Pass 1 intersection strategy for incorporating finite-state features; values include Cube_pruning, Full, Fast_cube_pruning, Fast_cube_pruning_2")
-        ("cubepruning_pop_limit,K",po::value<unsigned>()->default_value(200), "Max number of pops from the candidate heap at each node")
+        ("intersection_strategy,I",po::value<string>()->default_value("cube_pruning"), "Pass 1 intersection strategy for incorporating finite-state features; values include Cube_pruning, Full, Fast_cube_pruning, Fast_cube_pruning_2, Parallel_cube_pruning (same output as Cube_pruning, with independent nodes processed by --cubepruning_threads threads), Cube_growing (lazy, scores fewer candidates than Cube_pruning for the same pop limit)")
+        ("cubepruning_pop_limit,K",po::value<unsigned>()->default_value(200), "Max number of pops from the candidate heap at each node (also used by Cube_growing)")
+        ("cubepruning_threads",po::value<int>()->default_value(0), "Number of threads used by Parallel_cube_pruning (0 = one per core)")
         ("summary_feature", po::value<string>(), "Compute a 'summary feature' at the end of the pass (before any pruning) with name=arg and value=inside-outside/Z")
         ("summary_feature_type", po::value<string>()->default_value("node_risk"), "Summary feature types: node_risk, edge_risk, edge_prob")
         ("density_prune", po::value<double>(), "Pass 1 pruning: keep no more than this many times the number of edges used in the best derivation tree (>=1.0)")
@@ -377,6 +399,7 @@ DecoderImpl::DecoderImpl(po::variables_map& conf, int argc, char** argv, istream
         ("scfg_no_hiero_glue_grammar,n", "No Hiero glue grammar (nb. by default the SCFG decoder adds Hiero glue rules)")
         ("scfg_default_nt,d",po::value<string>()->default_value("X"),"Default non-terminal symbol in SCFG")
         ("scfg_max_span_limit,S",po::value<int>()->default_value(10),"Maximum non-terminal span limit (except \"glue\" grammar)")
+        ("scfg_parse_threads",po::value<int>()->default_value(0),"Fill the cells of each span width of the SCFG parse chart in parallel with this many threads (0 = the original sequential parser; the forest is the same)")
         ("quiet", "Disable verbose output")
         ("show_config", po::bool_switch(&show_config), "show contents of loaded -c config files.")
         ("show_weights", po::bool_switch(&show_weights), "show effective feature weights")
@@ -385,6 +408,7 @@ DecoderImpl::DecoderImpl(po::variables_map& conf, int argc, char** argv, istream
         ("show_tree_structure", "Show the Viterbi derivation structure")
         ("show_expected_length", "Show the expected translation length under the model")
         ("show_partition,z", "Compute and show the partition (inside score)")
+        ("show_feature_profile", "Show the time spent in stateless and stateful features in each rescoring pass")
         ("show_conditional_prob", "Output the conditional log prob to STDOUT instead of a translation")
         ("show_cfg_search_space", "Show the search space as a CFG")
         ("show_cfg_alignment_space", "Show the alignment hypergraph as a CFG")
@@ -413,6 +437,8 @@ DecoderImpl::DecoderImpl(po::variables_map& conf, int argc, char** argv, istream
         ("vector_format",po::value<string>()->default_value("b64"), "Sparse vector serialization format for feature expectations or gradients, includes (text or b64)")
         ("combine_size,C",po::value<int>()->default_value(1), "When option -G is used, process this many sentence pairs before writing the gradient (1=emit after every sentence pair)")
         ("forest_output,O",po::value<string>(),"Directory to write forests to")
+        ("forest_format",po::value<string>()->default_value("json"),"Format of the forests written with -O: json (N.json.gz) or binary (N.hg, faster to read, see convert_forest)")
+        ("forest_arena","Build each sentence's forests in arena mode: node edge lists come from one allocation per forest, laid out in node order, and are freed with the forest after the sentence")
         ("remove_intersected_rule_annotations", "After forced decoding is completed, remove nonterminal annotations (i.e., the source side spans)");
 
   // ob.AddOptions(&opts);
@@ -525,6 +551,8 @@ DecoderImpl::DecoderImpl(po::variables_map& conf, int argc, char** argv, istream
     FD::EnableHash(conf["cmph_perfect_feature_hash"].as<string>());
     cerr << "  " << FD::NumFeats() << " features in map\n";
   }
+  if (conf.count("feature_hashing"))
+    FD::EnableFeatureHashing(conf["feature_hashing"].as<int>(), conf.count("feature_hashing_names"));
 
   // load initial feature weights (and possibly freeze feature set)
   init_weights.reset(new vector<weight_t>);
@@ -588,7 +616,13 @@ DecoderImpl::DecoderImpl(po::variables_map& conf, int argc, char** argv, istream
         palg = 3;
         cerr << "Using Fast Cube Pruning 2 intersection (see Algorithm 3 described in: Gesmundo A., Henderson J,. Faster Cube Pruning, IWSLT 2010).\n";
       }
-      rp.inter_conf.reset(new IntersectionConfiguration(palg, pop_limit));
+      if (LowercaseString(str(isn.c_str(),conf)) == "parallel_cube_pruning") {
+        palg = 4;
+      }
+      if (LowercaseString(str(isn.c_str(),conf)) == "cube_growing") {
+        palg = 5;
+      }
+      rp.inter_conf.reset(new IntersectionConfiguration(palg, pop_limit, conf["cubepruning_threads"].as<int>()));
     } else {
       break;  // TODO alert user if there are any future configurations
     }
@@ -661,6 +695,12 @@ DecoderImpl::DecoderImpl(po::variables_map& conf, int argc, char** argv, istream
   get_oracle_forest = conf.count("get_oracle_forest");
   oracle.show_derivation=conf.count("show_derivations");
   remove_intersected_rule_annotations = conf.count("remove_intersected_rule_annotations");
+  binary_forests = str("forest_format",conf) == "binary";
+  forest_arena = conf.count("forest_arena");
+  if (!binary_forests && str("forest_format",conf) != "json") {
+    cerr << "--forest_format must be json or binary\n";
+    exit(1);
+  }
 
   combine_size = conf["combine_size"].as<int>();
   if (combine_size < 1) combine_size = 1;
@@ -677,6 +717,8 @@ Decoder::Decoder(istream* cfg) { pimpl_.reset(new DecoderImpl(conf,0,0,cfg)); }
 Decoder::Decoder(int argc, char** argv) { pimpl_.reset(new DecoderImpl(conf,argc, argv, 0)); }
 Decoder::~Decoder() {}
 void Decoder::SetId(int next_sent_id) { pimpl_->SetId(next_sent_id); }
+void Decoder::SetOutputStream(ostream* out) { pimpl_->SetOutputStream(out); }
+void Decoder::TakeTrainingVector(Decoder* other) { pimpl_->TakeTrainingVector(other->pimpl_.get()); }
 bool Decoder::Decode(const string& input, DecoderObserver* o) {
   bool del = false;
   if (!o) { o = new DecoderObserver; del = true; }
@@ -686,6 +728,7 @@ bool Decoder::Decode(const string& input, DecoderObserver* o) {
 }
 vector<weight_t>& Decoder::CurrentWeightVector() { return pimpl_->CurrentWeightVector(); }
 const vector<weight_t>& Decoder::CurrentWeightVector() const { return pimpl_->CurrentWeightVector(); }
+void Decoder::WeightVectors(vector<vector<weight_t>*>* v) { pimpl_->WeightVectors(v); }
 void Decoder::AddSupplementalGrammar(GrammarPtr gp) {
   static_cast<SCFGTranslator&>(*pimpl_->translator).AddSupplementalGrammar(gp);
 }
@@ -730,6 +773,7 @@ bool DecoderImpl::Decode(const string& input, DecoderObserver* o) {
   smeta.sgml_.swap(sgml);
   o->NotifyDecodingStart(smeta);
   Hypergraph forest;          // -LM forest
+  if (forest_arena) forest.UseArena();
   translator->ProcessMarkupHints(smeta.sgml_);
   Timer t("Translation");
   const bool translation_successful =
@@ -741,9 +785,9 @@ bool DecoderImpl::Decode(const string& input, DecoderObserver* o) {
     o->NotifySourceParseFailure(smeta);
     o->NotifyDecodingComplete(smeta);
     if (conf.count("show_conditional_prob")) {
-      cout << "-Inf" << endl << flush;
+      *out << "-Inf" << endl << flush;
     } else if (!SILENT) {
-      cout << endl;
+      *out << endl;
     }
     return false;
   }
@@ -796,7 +840,10 @@ bool DecoderImpl::Decode(const string& input, DecoderObserver* o) {
     if (has_rescoring_models) {
       Timer t("Forest rescoring:");
       rp.models->PrepareForInput(smeta);
+      FeatureProfile profile;
+      if (conf.count("show_feature_profile")) rp.models->SetProfile(&profile);
       Hypergraph rescored_forest;
+      if (forest_arena) rescored_forest.UseArena();
 #ifdef CP_TIME
       CpTime::Sub(clock());
 #endif
@@ -808,6 +855,12 @@ bool DecoderImpl::Decode(const string& input, DecoderObserver* o) {
 #ifdef CP_TIME
       CpTime::Add(clock());
 #endif
+      if (conf.count("show_feature_profile")) {
+        rp.models->SetProfile(NULL);
+        cerr << "  " << passtr << " feature time: stateless " << profile.StatelessSeconds()
+             << " secs (" << profile.stateless_edges << " edges), stateful " << profile.StatefulSeconds()
+             << " secs (" << profile.stateful_edges << " edges)\n";
+      }
       forest.swap(rescored_forest);
       forest.Reweight(cur_weights);
       if (!SILENT) forest_stats(forest,"  " + passtr +" forest",show_tree_structure,oracle.show_derivation, conf.count("extract_rules"), extract_file);
@@ -903,13 +956,12 @@ bool DecoderImpl::Decode(const string& input, DecoderObserver* o) {
 
   // TODO I think this should probably be handled by an Observer
   if (conf.count("forest_output") && !has_ref) {
-    ForestWriter writer(str("forest_output",conf), sent_id);
+    ForestWriter writer(str("forest_output",conf), sent_id, binary_forests);
     if (FileExists(writer.fname_)) {
       if (!SILENT) cerr << "  Unioning...\n";
       Hypergraph new_hg;
       {
-        ReadFile rf(writer.fname_);
-        bool succeeded = HypergraphIO::ReadFromJSON(rf.stream(), &new_hg);
+        bool succeeded = HypergraphIO::ReadFromFile(writer.fname_, &new_hg);
         if (!succeeded) abort();
       }
       HG::Union(forest, &new_hg);
@@ -928,17 +980,17 @@ bool DecoderImpl::Decode(const string& input, DecoderObserver* o) {
     if (kbest && !has_ref) {
       //TODO: does this work properly?
       const string deriv_fname = conf.count("show_derivations") ? str("show_derivations",conf) : "-";
-      oracle.DumpKBest(sent_id, forest, conf["k_best"].as<int>(), unique_kbest,"-", deriv_fname);
+      oracle.DumpKBest(sent_id, forest, conf["k_best"].as<int>(), unique_kbest, *out, deriv_fname);
     } else if (csplit_output_plf) {
-      cout << HypergraphIO::AsPLF(forest, false) << endl;
+      *out << HypergraphIO::AsPLF(forest, false) << endl;
     } else {
       if (!graphviz && !has_ref && !joshua_viz && !SILENT) {
         vector<WordID> trans;
         ViterbiESentence(forest, &trans);
-        cout << TD::GetString(trans) << endl << flush;
+        *out << TD::GetString(trans) << endl << flush;
       }
       if (joshua_viz) {
-        cout << sent_id << " ||| " << JoshuaVisualizationString(forest) << " ||| 1.0 ||| " << -1.0 << endl << flush;
+        *out << sent_id << " ||| " << JoshuaVisualizationString(forest) << " ||| 1.0 ||| " << -1.0 << endl << flush;
       }
     }
   }
@@ -992,13 +1044,12 @@ bool DecoderImpl::Decode(const string& input, DecoderObserver* o) {
       if (conf.count("show_cfg_alignment_space"))
         HypergraphIO::WriteAsCFG(forest);
       if (conf.count("forest_output")) {
-        ForestWriter writer(str("forest_output",conf), sent_id);
+        ForestWriter writer(str("forest_output",conf), sent_id, binary_forests);
         if (FileExists(writer.fname_)) {
           if (!SILENT) cerr << "  Unioning...\n";
           Hypergraph new_hg;
           {
-            ReadFile rf(writer.fname_);
-            bool succeeded = HypergraphIO::ReadFromJSON(rf.stream(), &new_hg);
+            bool succeeded = HypergraphIO::ReadFromFile(writer.fname_, &new_hg);
             if (!succeeded) abort();
           }
           HG::Union(forest, &new_hg);
@@ -1010,7 +1061,7 @@ bool DecoderImpl::Decode(const string& input, DecoderObserver* o) {
         }
       }
       if (aligner_mode && !output_training_vector)
-        AlignerTools::WriteAlignment(smeta.GetSourceLattice(), smeta.GetReference(), forest, &cout, 0 == conf.count("aligner_use_viterbi"), kbest ? conf["k_best"].as<int>() : 0);
+        AlignerTools::WriteAlignment(smeta.GetSourceLattice(), smeta.GetReference(), forest, out, 0 == conf.count("aligner_use_viterbi"), kbest ? conf["k_best"].as<int>() : 0);
       if (write_gradient) {
         const prob_t ref_z = InsideOutside<prob_t, EdgeProb, SparseVector<prob_t>, EdgeFeaturesAndProbWeightFunction>(forest, &ref_exp);
         ref_exp /= ref_z;
@@ -1041,12 +1092,12 @@ bool DecoderImpl::Decode(const string& input, DecoderObserver* o) {
         ++g_count;
         if (g_count % combine_size == 0) {
           if (encode_b64) {
-            cout << "0\t";
+            *out << "0\t";
             SparseVector<double> dav; ConvertSV(acc_vec, &dav);
-            B64::Encode(acc_obj, dav, &cout);
-            cout << endl << flush;
+            B64::Encode(acc_obj, dav, out);
+            *out << endl << flush;
           } else {
-            cout << "0\t**OBJ**=" << acc_obj << ';' <<  acc_vec << endl << flush;
+            *out << "0\t**OBJ**=" << acc_obj << ';' <<  acc_vec << endl << flush;
           }
           acc_vec.clear();
           acc_obj = 0;
@@ -1055,20 +1106,20 @@ bool DecoderImpl::Decode(const string& input, DecoderObserver* o) {
       if (conf.count("graphviz")) forest.PrintGraphviz();
       if (kbest) {
         const string deriv_fname = conf.count("show_derivations") ? str("show_derivations",conf) : "-";
-        oracle.DumpKBest(sent_id, forest, conf["k_best"].as<int>(), unique_kbest,"-", deriv_fname);
+        oracle.DumpKBest(sent_id, forest, conf["k_best"].as<int>(), unique_kbest, *out, deriv_fname);
       }
       if (conf.count("show_conditional_prob")) {
         const prob_t ref_z = Inside<prob_t, EdgeProb>(forest);
-        cout << (log(ref_z) - log(first_z)) << endl << flush;
+        *out << (log(ref_z) - log(first_z)) << endl << flush;
       }
     } else {
       o->NotifyAlignmentFailure(smeta);
       if (!SILENT) cerr << "  REFERENCE UNREACHABLE.\n";
       if (write_gradient) {
-        cout << endl << flush;
+        *out << endl << flush;
       }
       if (conf.count("show_conditional_prob")) {
-        cout << "-Inf" << endl << flush;
+        *out << "-Inf" << endl << flush;
       }
     }
   }
@@ -51,8 +51,21 @@ class Decoder {
   std::vector<weight_t>& CurrentWeightVector();
   const std::vector<weight_t>& CurrentWeightVector() const;
 
+  // the distinct weight vectors of the initial parse and of every rescoring
+  // pass, first pass first (passes without their own weights share a vector)
+  void WeightVectors(std::vector<std::vector<weight_t>*>* vectors);
+
   // this sets the current sentence ID
   void SetId(int id);
+
+  // translations (and k-best lists, gradients, etc.) are written to out,
+  // which is std::cout by default
+  void SetOutputStream(std::ostream* out);
+
+  // adds the gradient and objective that other has accumulated so far
+  // (--output_training_vector) to this decoder's and clears them in other,
+  // so that --threads writes a single training vector at the end
+  void TakeTrainingVector(Decoder* other);
   ~Decoder();
   const boost::program_options::variables_map& GetConf() const { return conf; }
 
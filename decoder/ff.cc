@@ -1,5 +1,7 @@
 #include "ff.h"
 
+#include <cassert>
+
 #include "tdict.h"
 #include "hg.h"
 
@@ -12,6 +14,19 @@ void FeatureFunction::PrepareForInput(const SentenceMetadata&) {}
 void FeatureFunction::FinalTraversalFeatures(const void* /* ant_state */,
                                              SparseVector<double>* /* features */) const {}
 
+void FeatureFunction::TraversalFeaturesBatch(const SentenceMetadata& smeta,
+                                             const HG::Edge* const* edges,
+                                             int n,
+                                             SparseVector<double>* features) const {
+  assert(!IsStateful());
+  vector<const void*> ants;
+  SparseVector<double> est_vals;  // stateless features have no estimates
+  for (int i = 0; i < n; ++i) {
+    ants.resize(edges[i]->tail_nodes_.size());
+    TraversalFeaturesImpl(smeta, *edges[i], ants, &features[i], &est_vals, NULL);
+  }
+}
+
 string FeatureFunction::usage_helper(std::string const& name,std::string const& params,std::string const& details,bool sp,bool sd) {
   string r=name;
   if (sp) {
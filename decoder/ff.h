@@ -50,12 +50,27 @@ class FeatureFunction {
     // barrier between the blocks reserved for the residual contexts
   }
 
+  // stateless features only: adds the features of edges[i] to features[i]
+  // for i < n.  the intersection strategies score the edges of the whole
+  // -LM forest with one call, so features that override this save a virtual
+  // call and the setup of TraversalFeaturesImpl per edge.  the default
+  // calls TraversalFeaturesImpl for each edge
+  virtual void TraversalFeaturesBatch(const SentenceMetadata& smeta,
+                                      const HG::Edge* const* edges,
+                                      int n,
+                                      SparseVector<double>* features) const;
+
   // if there's some state left when you transition to the goal state, score
   // it here.  For example, a language model might the cost of adding
   // <s> and </s>.
   virtual void FinalTraversalFeatures(const void* residual_state,
                                       SparseVector<double>* final_features) const;
 
+  // return true if TraversalFeatures and FinalTraversalFeatures may be called
+  // from several threads at once for the same input (the parallel cube
+  // pruning intersection strategy does this)
+  virtual bool IsThreadSafe() const { return false; }
+
  protected:
   // context is a pointer to a buffer of size NumBytesContext() that the
   // feature function can write its state to.  It's up to the feature function
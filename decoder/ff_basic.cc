@@ -27,6 +27,14 @@ void WordPenalty::TraversalFeaturesImpl(const SentenceMetadata& smeta,
   features->set_value(fid_, edge.rule_->EWords() * value_);
 }
 
+void WordPenalty::TraversalFeaturesBatch(const SentenceMetadata& /* smeta */,
+                                         const Hypergraph::Edge* const* edges,
+                                         int n,
+                                         SparseVector<double>* features) const {
+  for (int i = 0; i < n; ++i)
+    features[i].set_value(fid_, edges[i]->rule_->EWords() * value_);
+}
+
 
 SourceWordPenalty::SourceWordPenalty(const string& param) :
     fid_(FD::Convert("SourceWordPenalty")),
@@ -49,6 +57,14 @@ void SourceWordPenalty::TraversalFeaturesImpl(const SentenceMetadata& smeta,
   features->set_value(fid_, edge.rule_->FWords() * value_);
 }
 
+void SourceWordPenalty::TraversalFeaturesBatch(const SentenceMetadata& /* smeta */,
+                                               const Hypergraph::Edge* const* edges,
+                                               int n,
+                                               SparseVector<double>* features) const {
+  for (int i = 0; i < n; ++i)
+    features[i].set_value(fid_, edges[i]->rule_->FWords() * value_);
+}
+
 
 ArityPenalty::ArityPenalty(const std::string& param) :
     value_(-1.0 / log(10)) {
@@ -78,3 +94,13 @@ void ArityPenalty::TraversalFeaturesImpl(const SentenceMetadata& smeta,
   features->set_value(a<fids_.size()?fids_[a]:0, value_);
 }
 
+void ArityPenalty::TraversalFeaturesBatch(const SentenceMetadata& /* smeta */,
+                                          const Hypergraph::Edge* const* edges,
+                                          int n,
+                                          SparseVector<double>* features) const {
+  for (int i = 0; i < n; ++i) {
+    unsigned a=edges[i]->Arity();
+    features[i].set_value(a<fids_.size()?fids_[a]:0, value_);
+  }
+}
+
@@ -3,15 +3,18 @@
 #include <cstring>
 #include <cstdlib>
 #include <iostream>
+#include <mutex>
 
 #include <boost/scoped_ptr.hpp>
 
 #include "filelib.h"
 #include "stringlib.h"
 #include "hg.h"
+#include "klm_registry.h"
+#include "murmur_hash.h"
+#include "timing_stats.h"
 #include "tdict.h"
 #include "lm/model.hh"
-#include "lm/enumerate_vocab.hh"
 #include "utils/verbose.h"
 
 #include "lm/left.hh"
@@ -20,9 +23,15 @@ using namespace std;
 
 // -x : rules include <s> and </s>
 // -n NAME : feature id is NAME
-bool ParseLMArgs(string const& in, string* filename, string* mapfile, bool* explicit_markers, string* featname) {
+// -l : map LM words to cdec ids when they are first seen, instead of adding
+//      the whole LM vocabulary to TD when the model is loaded
+// -c N : remember the scores of about N (rule, antecedent states) pairs per
+//        sentence; N is rounded up to a power of 2, each takes ~150 bytes
+bool ParseLMArgs(string const& in, string* filename, string* mapfile, bool* explicit_markers, string* featname, bool* lazy_vocab, int* cache_size) {
   vector<string> const& argv=SplitOnWhitespace(in);
   *explicit_markers = false;
+  *lazy_vocab = false;
+  *cache_size = 0;
   *featname="LanguageModel";
   *mapfile = "";
 #define LMSPEC_NEXTARG if (i==argv.end()) {            \
@@ -37,12 +46,18 @@ bool ParseLMArgs(string const& in, string* filename, string* mapfile, bool* expl
       case 'x':
         *explicit_markers = true;
         break;
+      case 'l':
+        *lazy_vocab = true;
+        break;
       case 'm':
         LMSPEC_NEXTARG; *mapfile=*i;
         break;
       case 'n':
         LMSPEC_NEXTARG; *featname=*i;
         break;
+      case 'c':
+        LMSPEC_NEXTARG; *cache_size=atoi(i->c_str());
+        break;
 #undef LMSPEC_NEXTARG
       default:
       fail:
@@ -72,18 +87,6 @@ string KLanguageModel<Model>::usage(bool /*param*/,bool /*verbose*/) {
 
 namespace {
 
-struct VMapper : public lm::EnumerateVocab {
-  VMapper(vector<lm::WordIndex>* out) : out_(out), kLM_UNKNOWN_TOKEN(0) { out_->clear(); }
-  void Add(lm::WordIndex index, const StringPiece &str) {
-    const WordID cdec_id = TD::Convert(str.as_string());
-    if (cdec_id >= out_->size())
-      out_->resize(cdec_id + 1, kLM_UNKNOWN_TOKEN);
-    (*out_)[cdec_id] = index;
-  }
-  vector<lm::WordIndex>* out_;
-  const lm::WordIndex kLM_UNKNOWN_TOKEN;
-};
-
 #pragma pack(push)
 #pragma pack(1)
 
@@ -147,16 +150,66 @@ template <class Model> class BoundaryRuleScore {
     lm::WordIndex end_sentence_;
 };
 
+Counter cache_hits("KLanguageModel cache hits");
+Counter cache_misses("KLanguageModel cache misses");
+
 } // namespace
 
 template <class Model>
 class KLanguageModelImpl {
  public:
   double LookupWords(const TRule& rule, const vector<const void*>& ant_states, double* oovs, double* emit, void* remnant) {
+    if (cache_.empty()) return ScoreWords(rule, ant_states, oovs, emit, remnant);
+    const vector<WordID>& e = rule.e();
+    // the score of a rule only depends on its target side and the states of
+    // the antecedents it uses. an entry is found by a 64-bit hash of those
+    // and only used if they are equal
+    uint64_t key = MurmurHash64(e.data(), e.size() * sizeof(WordID));
+    for (unsigned i = 0; i < e.size(); ++i)
+      if (e[i] <= 0)
+        key = key * 0x9e3779b97f4a7c15ULL + HashState(AntState(ant_states, e[i]));
+    const unsigned slot = (key >> 32) & (cache_.size() - 1);
+    CacheEntry& entry = cache_[slot];
+    mutex& lock = cache_locks_[slot % kCacheLocks];
+    {
+      lock_guard<mutex> guard(lock);
+      if (entry.generation == generation_ && entry.key == key && entry.e == e && SameAntStates(entry, ant_states)) {
+        *oovs = entry.oovs;
+        *emit = entry.emit;
+        *static_cast<BoundaryAnnotatedState*>(remnant) = entry.state;
+        cache_hits.Add();
+        return entry.score;
+      }
+    }
+    cache_misses.Add();
+    const double score = ScoreWords(rule, ant_states, oovs, emit, remnant);
+    lock_guard<mutex> guard(lock);
+    entry.generation = generation_;
+    entry.key = key;
+    entry.e = e;
+    entry.ants.clear();
+    for (unsigned i = 0; i < e.size(); ++i)
+      if (e[i] <= 0) entry.ants.push_back(AntState(ant_states, e[i]));
+    entry.score = score;
+    entry.oovs = *oovs;
+    entry.emit = *emit;
+    entry.state = *static_cast<const BoundaryAnnotatedState*>(remnant);
+    return score;
+  }
+
+  // forgets the scores of the previous sentence
+  void ClearCache() {
+    if (++generation_ == 0) {
+      for (unsigned i = 0; i < cache_.size(); ++i) cache_[i].generation = 0;
+      generation_ = 1;
+    }
+  }
+
+  double ScoreWords(const TRule& rule, const vector<const void*>& ant_states, double* oovs, double* emit, void* remnant) {
     *oovs = 0;
     *emit = 0;
     const vector<WordID>& e = rule.e();
-    BoundaryRuleScore<Model> ruleScore(*ngram_, *static_cast<BoundaryAnnotatedState*>(remnant));
+    BoundaryRuleScore<Model> ruleScore(lm_->model(), *static_cast<BoundaryAnnotatedState*>(remnant));
     unsigned i = 0;
     if (e.size()) {
       if (e[i] == kCDEC_SOS) {
@@ -193,7 +246,7 @@ class KLanguageModelImpl {
       assert(!annotated.seen_bos);
       assert(!annotated.seen_eos);
       lm::ngram::ChartState cstate;
-      lm::ngram::RuleScore<Model> ruleScore(*ngram_, cstate);
+      lm::ngram::RuleScore<Model> ruleScore(lm_->model(), cstate);
       ruleScore.BeginSentence();
       ruleScore.NonTerminal(annotated.state, 0.0f);
       ruleScore.Terminal(kEOS_);
@@ -221,26 +274,22 @@ class KLanguageModelImpl {
 
   // converts to cdec word id's to KenLM's id space, OOVs and <unk> end up at 0
   lm::WordIndex MapWord(WordID w) const {
-    if (w >= cdec2klm_map_.size())
-      return 0;
-    else
-      return cdec2klm_map_[w];
+    return lm_->MapWord(w);
   }
 
  public:
-  KLanguageModelImpl(const string& filename, const string& mapfile, bool explicit_markers) :
+  KLanguageModelImpl(const string& filename, const string& mapfile, bool explicit_markers, bool lazy_vocab, int cache_size) :
       kCDEC_UNK(TD::Convert("<unk>")) ,
       kCDEC_SOS(TD::Convert("<s>")) ,
-      add_sos_eos_(!explicit_markers) {
-    {
-      VMapper vm(&cdec2klm_map_);
-      lm::ngram::Config conf;
-      conf.enumerate_vocab = &vm;
-      ngram_ = new Model(filename.c_str(), conf);
+      lm_(SharedKLM<Model>::Get(filename, lazy_vocab)),
+      add_sos_eos_(!explicit_markers),
+      generation_(1) {
+    order_ = lm_->model().Order();
+    if (cache_size > 0) {
+      unsigned size = 1;
+      while (size < cache_size) size *= 2;
+      cache_.resize(size);
     }
-    order_ = ngram_->Order();
-    if (!SILENT)
-      cerr << "Loaded " << order_ << "-gram KLM from " << filename << " (MapSize=" << cdec2klm_map_.size() << ")\n";
 
     // special handling of beginning / ending sentence markers
     kSOS_ = MapWord(kCDEC_SOS);
@@ -290,10 +339,6 @@ class KLanguageModelImpl {
     word2class_map_[word].second = emit;
   }
 
-  ~KLanguageModelImpl() {
-    delete ngram_;
-  }
-
   int ReserveStateSize() const { return sizeof(BoundaryAnnotatedState); }
 
  private:
@@ -301,7 +346,7 @@ class KLanguageModelImpl {
   const WordID kCDEC_SOS;
   lm::WordIndex kSOS_;  // <s> - requires special handling.
   lm::WordIndex kEOS_;  // </s>
-  Model* ngram_;
+  boost::shared_ptr<SharedKLM<Model> > lm_;  // shared with other features using the same file
   const bool add_sos_eos_; // flag indicating whether the hypergraph produces <s> and </s>
                      // if this is true, FinalTransitionFeatures will "add" <s> and </s>
                      // if false, FinalTransitionFeatures will score anything with the
@@ -309,7 +354,45 @@ class KLanguageModelImpl {
                      // the sentence) with 0, and anything else with -100
 
   int order_;
-  vector<lm::WordIndex> cdec2klm_map_;
+
+  struct CacheEntry {
+    CacheEntry() : generation() {}
+    unsigned generation;
+    uint64_t key;
+    vector<WordID> e;                     // the full key: the target side and
+    vector<BoundaryAnnotatedState> ants;  // the states of its nonterminals, in order
+    double score, oovs, emit;
+    BoundaryAnnotatedState state;
+  };
+
+  static const BoundaryAnnotatedState& AntState(const vector<const void*>& ant_states, WordID nt) {
+    return *static_cast<const BoundaryAnnotatedState*>(ant_states[-nt]);
+  }
+
+  // KenLM's equality and hash only look at the used part of a ChartState
+  static bool SameState(const BoundaryAnnotatedState& a, const BoundaryAnnotatedState& b) {
+    return a.state == b.state && a.seen_bos == b.seen_bos && a.seen_eos == b.seen_eos;
+  }
+
+  static uint64_t HashState(const BoundaryAnnotatedState& s) {
+    return hash_value(s.state) * 4 + s.seen_bos * 2 + s.seen_eos;
+  }
+
+  // entry.e must equal the rule's target side
+  static bool SameAntStates(const CacheEntry& entry, const vector<const void*>& ant_states) {
+    unsigned k = 0;
+    for (unsigned i = 0; i < entry.e.size(); ++i)
+      if (entry.e[i] <= 0 && !SameState(entry.ants[k++], AntState(ant_states, entry.e[i])))
+        return false;
+    return true;
+  }
+  // an entry is overwritten by a later pair that hashes to the same slot.
+  // slots are locked in stripes since parallel cube pruning looks up words
+  // from several threads
+  static const unsigned kCacheLocks = 64;
+  vector<CacheEntry> cache_;
+  mutex cache_locks_[kCacheLocks];
+  unsigned generation_;
   vector<pair<WordID,float> > word2class_map_; // if this is a class-based LM,
           // .first is the word->class mapping
           // .second is the emission log probability
@@ -318,12 +401,13 @@ class KLanguageModelImpl {
 template <class Model>
 KLanguageModel<Model>::KLanguageModel(const string& param) {
   string filename, mapfile, featname;
-  bool explicit_markers;
-  if (!ParseLMArgs(param, &filename, &mapfile, &explicit_markers, &featname)) {
+  bool explicit_markers, lazy_vocab;
+  int cache_size;
+  if (!ParseLMArgs(param, &filename, &mapfile, &explicit_markers, &featname, &lazy_vocab, &cache_size)) {
     abort();
   }
   try {
-    pimpl_ = new KLanguageModelImpl<Model>(filename, mapfile, explicit_markers);
+    pimpl_ = new KLanguageModelImpl<Model>(filename, mapfile, explicit_markers, lazy_vocab, cache_size);
   } catch (std::exception &e) {
     std::cerr << e.what() << std::endl;
     abort();
@@ -340,6 +424,11 @@ KLanguageModel<Model>::~KLanguageModel() {
   delete pimpl_;
 }
 
+template <class Model>
+void KLanguageModel<Model>::PrepareForInput(const SentenceMetadata& /* smeta */) {
+  pimpl_->ClearCache();
+}
+
 template <class Model>
 void KLanguageModel<Model>::TraversalFeaturesImpl(const SentenceMetadata& /* smeta */,
                                           const Hypergraph::Edge& edge,
@@ -375,9 +464,10 @@ template <class Model> boost::shared_ptr<FeatureFunction> CreateModel(const std:
 boost::shared_ptr<FeatureFunction> KLanguageModelFactory::Create(std::string param) const {
   using namespace lm::ngram;
   std::string filename, ignored_map;
-  bool ignored_markers;
+  bool ignored_markers, ignored_lazy;
+  int ignored_cache_size;
   std::string ignored_featname;
-  ParseLMArgs(param, &filename, &ignored_map, &ignored_markers, &ignored_featname);
+  ParseLMArgs(param, &filename, &ignored_map, &ignored_markers, &ignored_featname, &ignored_lazy, &ignored_cache_size);
   ModelType m;
   if (!RecognizeBinary(filename.c_str(), m)) m = HASH_PROBING;
 
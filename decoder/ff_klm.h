@@ -14,11 +14,13 @@ template <class Model> struct KLanguageModelImpl;
 template <class Model>
 class KLanguageModel : public FeatureFunction {
  public:
-  // param = "filename.lm [-o n]"
+  // param = "filename.lm [-x] [-m classes.txt] [-n FeatureName] [-l] [-c cache_size]"
   KLanguageModel(const std::string& param);
   ~KLanguageModel();
+  virtual void PrepareForInput(const SentenceMetadata& smeta);
   virtual void FinalTraversalFeatures(const void* context,
                                       SparseVector<double>* features) const;
+  virtual bool IsThreadSafe() const { return true; }
   static std::string usage(bool param,bool verbose);
  protected:
   virtual void TraversalFeaturesImpl(const SentenceMetadata& smeta,
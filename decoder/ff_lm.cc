@@ -77,7 +77,7 @@ namespace NgramCache {
     float prob;
     Cache() : prob() {}
   };
-  static Cache cache_;
+  static thread_local Cache cache_;
   void Clear() { cache_.tree.clear(); }
 }
 
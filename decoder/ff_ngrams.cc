@@ -229,15 +229,15 @@ class NgramDetectorImpl {
       int& fid = ft->fids[curword];
       ++n;
       if (!fid) {
-        ostringstream os;
-        os << featname_;
-        os << prefixes_[n];
+        FeatureName name;
+        name << featname_;
+        name << prefixes_[n];
         for (int i = n-1; i >= 0; --i) {
-          os << (i != n-1 ? target_separator_ : "");
+          name << (i != n-1 ? target_separator_ : "");
           const string& tok = TD::Convert(buf[i]);
-	  os << Escape(tok);
+	  name << Escape(tok);
         }
-        fid = FD::Convert(os.str());
+        fid = name.Id();
       }
       feats->set_value(fid, 1);
       ft = &ft->levels[curword];
@@ -25,6 +25,62 @@ namespace {
     }
     return y;
   }
+
+  // adds Escape(x) to name
+  void AddEscaped(const string& x, FeatureName* name) {
+    for (unsigned i = 0; i < x.size(); ++i)
+      *name << ((x[i] == '=' || x[i] == ';') ? '_' : x[i]);
+  }
+
+  int RuleIdentityFid(const TRule& rule) {
+    FeatureName name;
+    name << "R:";
+    if (rule.lhs_ < 0) { AddEscaped(TD::Convert(-rule.lhs_), &name); name << ':'; }
+    for (unsigned i = 0; i < rule.f_.size(); ++i) {
+      if (i > 0) name << '_';
+      WordID w = rule.f_[i];
+      if (w < 0) { name << 'N'; w = -w; }
+      assert(w > 0);
+      AddEscaped(TD::Convert(w), &name);
+    }
+    name << ':';
+    for (unsigned i = 0; i < rule.e_.size(); ++i) {
+      if (i > 0) name << '_';
+      WordID w = rule.e_[i];
+      if (w <= 0) {
+        name << 'N' << (1-w);
+      } else {
+        AddEscaped(TD::Convert(w), &name);
+      }
+    }
+    return name.Id();
+  }
+
+  // adds the RBS:prev_cur features of the source side of rule to f
+  void AddSourceBigrams(const TRule& rule, SparseVector<double>* f) {
+    static const string kStart = "<r>";
+    static const string kEnd = "</r>";
+    FeatureName name;
+    const string* prev = &kStart;
+    for (int i = 0; i <= rule.f_.size(); ++i) {
+      const string* cur = &kEnd;
+      if (i < rule.f_.size()) {
+        WordID w = rule.f_[i];
+        if (w < 0) w = -w;
+        assert(w > 0);
+        cur = &TD::Convert(w);
+      }
+      name.Clear();
+      name << "RBS:";
+      AddEscaped(*prev, &name);
+      name << '_';
+      AddEscaped(*cur, &name);
+      const int fid = name.Id();
+      if (fid <= 0) return;
+      f->add_value(fid, 1.0);
+      prev = cur;
+    }
+  }
 }
 
 RuleIdentityFeatures::RuleIdentityFeatures(const std::string& param) {
@@ -41,32 +97,40 @@ void RuleIdentityFeatures::TraversalFeaturesImpl(const SentenceMetadata& smeta,
                                          SparseVector<double>* features,
                                          SparseVector<double>* estimated_features,
                                          void* context) const {
+  // hashing the name is cheaper than looking it up
+  if (FD::UsingFeatureHashing()) {
+    features->add_value(RuleIdentityFid(*edge.rule_), 1);
+    return;
+  }
   map<const TRule*, int>::iterator it = rule2_fid_.find(edge.rule_.get());
-  if (it == rule2_fid_.end()) {
-    const TRule& rule = *edge.rule_;
-    ostringstream os;
-    os << "R:";
-    if (rule.lhs_ < 0) os << TD::Convert(-rule.lhs_) << ':';
-    for (unsigned i = 0; i < rule.f_.size(); ++i) {
-      if (i > 0) os << '_';
-      WordID w = rule.f_[i];
-      if (w < 0) { os << 'N'; w = -w; }
-      assert(w > 0);
-      os << TD::Convert(w);
-    }
-    os << ':';
-    for (unsigned i = 0; i < rule.e_.size(); ++i) {
-      if (i > 0) os << '_';
-      WordID w = rule.e_[i];
-      if (w <= 0) {
-        os << 'N' << (1-w);
+  if (it == rule2_fid_.end())
+    it = rule2_fid_.insert(make_pair(edge.rule_.get(), RuleIdentityFid(*edge.rule_))).first;
+  features->add_value(it->second, 1);
+}
+
+void RuleIdentityFeatures::TraversalFeaturesBatch(const SentenceMetadata& smeta,
+                                                  const Hypergraph::Edge* const* edges,
+                                                  int n,
+                                                  SparseVector<double>* features) const {
+  // edges of the same rule are usually next to each other, so the feature
+  // id is only looked up (or hashed) when the rule changes
+  const TRule* prev = NULL;
+  int fid = 0;
+  for (int i = 0; i < n; ++i) {
+    const TRule* rule = edges[i]->rule_.get();
+    if (rule != prev) {
+      prev = rule;
+      if (FD::UsingFeatureHashing()) {
+        fid = RuleIdentityFid(*rule);
       } else {
-        os << TD::Convert(w);
+        map<const TRule*, int>::iterator it = rule2_fid_.find(rule);
+        if (it == rule2_fid_.end())
+          it = rule2_fid_.insert(make_pair(rule, RuleIdentityFid(*rule))).first;
+        fid = it->second;
       }
     }
-    it = rule2_fid_.insert(make_pair(&rule, FD::Convert(Escape(os.str())))).first;
+    features[i].add_value(fid, 1);
   }
-  features->add_value(it->second, 1);
 }
 
 RuleWordAlignmentFeatures::RuleWordAlignmentFeatures(const std::string& param) {
@@ -105,27 +169,14 @@ void RuleSourceBigramFeatures::TraversalFeaturesImpl(const SentenceMetadata& sme
                                          SparseVector<double>* features,
                                          SparseVector<double>* estimated_features,
                                          void* context) const {
+  if (FD::UsingFeatureHashing()) {
+    AddSourceBigrams(*edge.rule_, features);
+    return;
+  }
   map<const TRule*, SparseVector<double> >::iterator it = rule2_feats_.find(edge.rule_.get());
   if (it == rule2_feats_.end()) {
-    const TRule& rule = *edge.rule_;
-    it = rule2_feats_.insert(make_pair(&rule, SparseVector<double>())).first;
-    SparseVector<double>& f = it->second;
-    string prev = "<r>";
-    for (int i = 0; i < rule.f_.size(); ++i) {
-      WordID w = rule.f_[i];
-      if (w < 0) w = -w;
-      assert(w > 0);
-      const string& cur = TD::Convert(w);
-      ostringstream os;
-      os << "RBS:" << prev << '_' << cur;
-      const int fid = FD::Convert(Escape(os.str()));
-      if (fid <= 0) return;
-      f.add_value(fid, 1.0);
-      prev = cur;
-    }
-    ostringstream os;
-    os << "RBS:" << prev << '_' << "</r>";
-    f.set_value(FD::Convert(Escape(os.str())), 1.0);
+    it = rule2_feats_.insert(make_pair(edge.rule_.get(), SparseVector<double>())).first;
+    AddSourceBigrams(*edge.rule_, &it->second);
   }
   (*features) += it->second;
 }
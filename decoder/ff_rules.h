@@ -12,6 +12,10 @@
 class RuleIdentityFeatures : public FeatureFunction {
  public:
   RuleIdentityFeatures(const std::string& param);
+  virtual void TraversalFeaturesBatch(const SentenceMetadata& smeta,
+                                      const HG::Edge* const* edges,
+                                      int n,
+                                      SparseVector<double>* features) const;
  protected:
   virtual void TraversalFeaturesImpl(const SentenceMetadata& smeta,
                                      const HG::Edge& edge,
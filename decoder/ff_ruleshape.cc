@@ -49,8 +49,25 @@ void RuleShapeFeatures::TraversalFeaturesImpl(const SentenceMetadata& /* smeta *
                                               SparseVector<double>* features,
                                               SparseVector<double>* /* estimated_features */,
                                               void* /* context */) const {
+  features->set_value(ShapeFid(*edge.rule_), 1.0);
+}
+
+void RuleShapeFeatures::TraversalFeaturesBatch(const SentenceMetadata& /* smeta */,
+                                               const Hypergraph::Edge* const* edges,
+                                               int n,
+                                               SparseVector<double>* features) const {
+  // edges of the same rule are usually next to each other
+  const TRule* prev = NULL;
+  int fid = 0;
+  for (int i = 0; i < n; ++i) {
+    const TRule* rule = edges[i]->rule_.get();
+    if (rule != prev) { fid = ShapeFid(*rule); prev = rule; }
+    features[i].set_value(fid, 1.0);
+  }
+}
+
+int RuleShapeFeatures::ShapeFid(const TRule& rule) const {
   const Node* cur = &fidtree_;
-  TRule& rule = *edge.rule_;
   int pos = 0;  // feature position
   int i = 0;
   while(i < rule.f_.size()) {
@@ -104,7 +121,7 @@ void RuleShapeFeatures::TraversalFeaturesImpl(const SentenceMetadata& /* smeta *
     cur = Advance(cur, false);
   assert(pos == 10);  // this will fail if you are using using > binary rules!
 
-  features->set_value(cur->fid_, 1.0);
+  return cur->fid_;
 }
 
 namespace {
@@ -5,9 +5,15 @@
 #include <map>
 #include "ff.h"
 
+class TRule;
+
 class RuleShapeFeatures : public FeatureFunction {
  public:
   RuleShapeFeatures(const std::string& param);
+  virtual void TraversalFeaturesBatch(const SentenceMetadata& smeta,
+                                      const HG::Edge* const* edges,
+                                      int n,
+                                      SparseVector<double>* features) const;
  protected:
   virtual void TraversalFeaturesImpl(const SentenceMetadata& smeta,
                                      const HG::Edge& edge,
@@ -16,6 +22,7 @@ class RuleShapeFeatures : public FeatureFunction {
                                      SparseVector<double>* estimated_features,
                                      void* context) const;
  private:
+  int ShapeFid(const TRule& rule) const;
   struct Node {
     int fid_;
     Node() : fid_(-1) {}
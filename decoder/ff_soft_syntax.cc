@@ -99,7 +99,7 @@ struct SoftSyntaxFeaturesImpl {
 	  //cerr << "RULE :"<< rule << endl;
     int& fid_ef = fids_ef(i,j)[&rule];
     for (unsigned int i = 0; i < feat_labels.size(); i++) {
-      ostringstream os;
+      FeatureName name;
       string label = feat_labels.at(i).first;
       //cerr << "This Label: " << label << endl;
       char feat_type = (char) feat_labels.at(i).second.c_str()[0];
@@ -107,20 +107,20 @@ struct SoftSyntaxFeaturesImpl {
       switch(feat_type) {
         case '2':
           if (lhs_str.compare(label) == 0) {
-            os << "SOFT:" << label << "_conform";
+            name << "SOFT:" << label << "_conform";
           }
           else {
-            os << "SOFT:" << label << "_cross";
+            name << "SOFT:" << label << "_cross";
           }
-          fid_ef = FD::Convert(os.str());
+          fid_ef = name.Id();
           if (fid_ef > 0) {
             //cerr << "Feature :" << os.str() << endl;
             feats->set_value(fid_ef, 1.0);
           }
           break;
         case '_':
-          os << "SOFT:" << label;
-          fid_ef = FD::Convert(os.str());
+          name << "SOFT:" << label;
+          fid_ef = name.Id();
           if (lhs_str.compare(label) == 0) {
             if (fid_ef > 0) {
               //cerr << "Feature: " << os.str() << endl;
@@ -136,8 +136,8 @@ struct SoftSyntaxFeaturesImpl {
           break;
         case '+':
           if (lhs_str.compare(label) == 0) {
-            os << "SOFT:" << label << "_conform";
-            fid_ef = FD::Convert(os.str());
+            name << "SOFT:" << label << "_conform";
+            fid_ef = name.Id();
             if (fid_ef > 0) {
               //cerr << "Feature: " << os.str() << endl;
               feats->set_value(fid_ef, 1.0);
@@ -147,16 +147,14 @@ struct SoftSyntaxFeaturesImpl {
         case '-':
           //cerr << "-" << endl;
           if (lhs_str.compare(label) != 0) {
-            os << "SOFT:" << label << "_cross";
-            fid_ef = FD::Convert(os.str());
+            name << "SOFT:" << label << "_cross";
+            fid_ef = name.Id();
             if (fid_ef > 0) {
               //cerr << "Feature :" << os.str() << endl;
               feats->set_value(fid_ef, 1.0);
             }
           }
           break;
-        os.clear();
-        os.str("");
       }
       //cerr << "Feature: " << os.str() << endl;
       //cerr << endl;
@@ -107,32 +107,32 @@ struct SourceSyntaxFeaturesImpl {
     //int& fid_cat = fids_cat(i,j);
     int& fid_ef = fids_ef(i,j)[&rule];
     if (fid_ef <= 0) {
-      ostringstream os;
+      FeatureName name;
       //ostringstream os2;
-      os << "SSYN:" << TD::Convert(lhs);
+      name << "SSYN:" << TD::Convert(lhs);
       //os2 << "SYN:" << TD::Convert(lhs) << '_' << SpanSizeTransform(j - i);
       //fid_cat = FD::Convert(os2.str());
-      os << ':';
+      name << ':';
       unsigned ntc = 0;
       for (unsigned k = 0; k < rule.f_.size(); ++k) {
-        if (k > 0) os << '_';
+        if (k > 0) name << '_';
         int fj = rule.f_[k];
         if (fj <= 0) {
-          os << '[' << TD::Convert(ants[ntc++]) << ']';
+          name << '[' << TD::Convert(ants[ntc++]) << ']';
         } else {
-          os << TD::Convert(fj);
+          name << TD::Convert(fj);
         }
       }
-      os << ':';
+      name << ':';
       for (unsigned k = 0; k < rule.e_.size(); ++k) {
         const int ei = rule.e_[k];
-        if (k > 0) os << '_';
+        if (k > 0) name << '_';
         if (ei <= 0)
-          os << '[' << (1-ei) << ']';
+          name << '[' << (1-ei) << ']';
         else
-          os << TD::Convert(ei);
+          name << TD::Convert(ei);
       }
-      fid_ef = FD::Convert(os.str());
+      fid_ef = name.Id();
     }
     if (fid_ef > 0) {
       if (feature_filter.size()>0) {
@@ -196,28 +196,28 @@ struct SourceSpanSizeFeaturesImpl {
     if (rule.Arity() > 0) {
       int& fid = fids(i,j)[&rule];
       if (fid <= 0) {
-        ostringstream os;
-        os << "SSS:";
+        FeatureName name;
+        name << "SSS:";
         unsigned ntc = 0;
         for (unsigned k = 0; k < rule.f_.size(); ++k) {
-          if (k > 0) os << '_';
+          if (k > 0) name << '_';
           int fj = rule.f_[k];
           if (fj <= 0) {
-            os << '[' << TD::Convert(-fj) << ants[ntc++] << ']';
+            name << '[' << TD::Convert(-fj) << ants[ntc++] << ']';
           } else {
-            os << TD::Convert(fj);
+            name << TD::Convert(fj);
           }
         }
-        os << ':';
+        name << ':';
         for (unsigned k = 0; k < rule.e_.size(); ++k) {
           const int ei = rule.e_[k];
-          if (k > 0) os << '_';
+          if (k > 0) name << '_';
           if (ei <= 0)
-            os << '[' << (1-ei) << ']';
+            name << '[' << (1-ei) << ']';
           else
-            os << TD::Convert(ei);
+            name << TD::Convert(ei);
         }
-        fid = FD::Convert(os.str());
+        fid = name.Id();
       }
       if (fid > 0)
         feats->set_value(fid, 1.0);
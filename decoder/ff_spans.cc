@@ -94,6 +94,18 @@ void SpanFeatures::TraversalFeaturesImpl(const SentenceMetadata& smeta,
                                          SparseVector<double>* features,
                                          SparseVector<double>* estimated_features,
                                          void* context) const {
+  AddFeatures(edge, features);
+}
+
+void SpanFeatures::TraversalFeaturesBatch(const SentenceMetadata& smeta,
+                                          const Hypergraph::Edge* const* edges,
+                                          int n,
+                                          SparseVector<double>* features) const {
+  for (int i = 0; i < n; ++i)
+    AddFeatures(*edges[i], &features[i]);
+}
+
+inline void SpanFeatures::AddFeatures(const Hypergraph::Edge& edge, SparseVector<double>* features) const {
   assert(edge.j_ < end_span_ids_.size());
   assert(edge.j_ >= 0);
   assert(edge.i_ < beg_span_ids_.size());
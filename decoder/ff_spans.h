@@ -10,6 +10,10 @@
 class SpanFeatures : public FeatureFunction {
  public:
   SpanFeatures(const std::string& param);
+  virtual void TraversalFeaturesBatch(const SentenceMetadata& smeta,
+                                      const HG::Edge* const* edges,
+                                      int n,
+                                      SparseVector<double>* features) const;
  protected:
   virtual void TraversalFeaturesImpl(const SentenceMetadata& smeta,
                                      const HG::Edge& edge,
@@ -20,6 +24,7 @@ class SpanFeatures : public FeatureFunction {
   virtual void PrepareForInput(const SentenceMetadata& smeta);
  private:
   WordID MapIfNecessary(const WordID& w) const;
+  void AddFeatures(const HG::Edge& edge, SparseVector<double>* features) const;
   const int kS;
   const int kX;
   Array2D<std::pair<int,int> > span_feats_; // first for X, second for S
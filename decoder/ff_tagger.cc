@@ -130,7 +130,7 @@ void OutputIndicator::FireFeature(WordID trg,
                                  SparseVector<double>* features) const {
   int& fid = fmap_[trg];
   if (!fid) {
-    static map<WordID, WordID> escape;
+    static thread_local map<WordID, WordID> escape;
     if (escape.empty()) {
       escape[TD::Convert("=")] = TD::Convert("__EQ");
       escape[TD::Convert(";")] = TD::Convert("__SC");
@@ -254,7 +254,7 @@ void NewJump::FireFeature(const SentenceMetadata& smeta,
   if (fp1_)   get<6>(key) = GetSourceWord(id, cur_src_index + 1);
   if (fprev_) get<7>(key) = GetSourceWord(id, prev_src_index);
 
-  static std::unordered_map<NewJumpFeatureKey, int, KeyHash> fids;
+  static thread_local std::unordered_map<NewJumpFeatureKey, int, KeyHash> fids;
   int& fid = fids[key];
   if (!fid) {
     ostringstream os;
@@ -582,7 +582,7 @@ void InputIndicator::FireFeature(WordID src,
                                  SparseVector<double>* features) const {
   int& fid = fmap_[src];
   if (!fid) {
-    static map<WordID, WordID> escape;
+    static thread_local map<WordID, WordID> escape;
     if (escape.empty()) {
       escape[TD::Convert("=")] = TD::Convert("__EQ");
       escape[TD::Convert(";")] = TD::Convert("__SC");
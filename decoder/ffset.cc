@@ -1,19 +1,39 @@
 #include "ffset.h"
 
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+
 #include "ff.h"
 #include "tdict.h"
 #include "hg.h"
+#include "murmur_hash.h"
 
 using namespace std;
 
+static inline uint64_t NowNs() {
+  return chrono::duration_cast<chrono::nanoseconds>(
+      chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+void FeatureProfile::Reset() {
+  stateless_ns = 0;
+  stateless_edges = 0;
+  stateful_ns = 0;
+  stateful_edges = 0;
+}
+
 ModelSet::ModelSet(const vector<double>& w, const vector<const FeatureFunction*>& models) :
     models_(models),
     weights_(w),
     state_size_(0),
-    model_state_pos_(models.size()) {
+    has_stateless_(false),
+    model_state_pos_(models.size()),
+    profile_(NULL) {
   for (int i = 0; i < models_.size(); ++i) {
     model_state_pos_[i] = state_size_;
     state_size_ += models_[i]->StateSize();
+    if (!models_[i]->IsStateful()) has_stateless_ = true;
   }
 }
 
@@ -22,41 +42,137 @@ void ModelSet::PrepareForInput(const SentenceMetadata& smeta) {
     const_cast<FeatureFunction*>(models_[i])->PrepareForInput(smeta);
 }
 
+bool ModelSet::IsThreadSafe() const {
+  for (int i = 0; i < models_.size(); ++i)
+    if (!models_[i]->IsThreadSafe()) return false;
+  return true;
+}
+
 void ModelSet::AddFeaturesToEdge(const SentenceMetadata& smeta,
                                  const Hypergraph& /* hg */,
                                  const FFStates& node_states,
                                  HG::Edge* edge,
                                  FFState* context,
-                                 prob_t* combination_cost_estimate) const {
+                                 prob_t* combination_cost_estimate,
+                                 uint64_t* state_signature) const {
+  ApplyToEdge(smeta, node_states, edge, context, combination_cost_estimate, state_signature, false);
+}
+
+void ModelSet::AddStatefulFeaturesToEdge(const SentenceMetadata& smeta,
+                                         const Hypergraph& /* hg */,
+                                         const FFStates& node_states,
+                                         HG::Edge* edge,
+                                         FFState* context,
+                                         prob_t* combination_cost_estimate,
+                                         uint64_t* state_signature) const {
+  ApplyToEdge(smeta, node_states, edge, context, combination_cost_estimate, state_signature, true);
+}
+
+void ModelSet::AddStatefulFeaturesToEdge(const SentenceMetadata& smeta,
+                                         const uint8_t* const* ant_contexts,
+                                         HG::Edge* edge,
+                                         FFState* context,
+                                         prob_t* combination_cost_estimate,
+                                         uint64_t* state_signature) const {
+  ApplyToEdge(smeta, ant_contexts, edge, context, combination_cost_estimate, state_signature, true);
+}
+
+void ModelSet::AddStatelessFeatures(const SentenceMetadata& smeta,
+                                    const HG::Edge* const* edges,
+                                    int n,
+                                    SparseVector<double>* features) const {
+  const uint64_t start = profile_ ? NowNs() : 0;
+  for (int i = 0; i < models_.size(); ++i)
+    if (!models_[i]->IsStateful())
+      models_[i]->TraversalFeaturesBatch(smeta, edges, n, features);
+  if (profile_) {
+    profile_->stateless_ns += NowNs() - start;
+    profile_->stateless_edges += n;
+  }
+}
+
+void ModelSet::ApplyToEdge(const SentenceMetadata& smeta,
+                           const FFStates& node_states,
+                           HG::Edge* edge,
+                           FFState* context,
+                           prob_t* combination_cost_estimate,
+                           uint64_t* state_signature,
+                           bool stateful_only) const {
+  SmallVector<const uint8_t*, 4> ant_contexts(edge->tail_nodes_.size(), NULL);
+  if (state_size_ > 0) {
+    for (int i = 0; i < ant_contexts.size(); ++i)
+      ant_contexts[i] = node_states[edge->tail_nodes_[i]].begin();
+  }
+  ApplyToEdge(smeta, ant_contexts.begin(), edge, context, combination_cost_estimate, state_signature, stateful_only);
+}
+
+void ModelSet::ApplyToEdge(const SentenceMetadata& smeta,
+                           const uint8_t* const* ant_contexts,
+                           HG::Edge* edge,
+                           FFState* context,
+                           prob_t* combination_cost_estimate,
+                           uint64_t* state_signature,
+                           bool stateful_only) const {
   //edge->reset_info();
-  context->resize(state_size_);
+  // ValueArray::resize always reallocates, so reuse a context of the right size
+  if (context->size() != state_size_) context->resize(state_size_);
   if (state_size_ > 0) {
     memset(&(*context)[0], 0, state_size_);
   }
   SparseVector<double> est_vals;  // only computed if combination_cost_estimate is non-NULL
   if (combination_cost_estimate) *combination_cost_estimate = prob_t::One();
+  vector<const void*> ants(edge->tail_nodes_.size());
+  uint64_t sig = 0;
+  // with a profile, each model's time goes to the counter of its kind
+  uint64_t last = profile_ ? NowNs() : 0;
+  uint64_t stateless_ns = 0, stateful_ns = 0;
   for (int i = 0; i < models_.size(); ++i) {
     const FeatureFunction& ff = *models_[i];
     void* cur_ff_context = NULL;
-    vector<const void*> ants(edge->tail_nodes_.size());
     bool has_context = ff.StateSize() > 0;
+    if (stateful_only && !has_context) continue;
     if (has_context) {
       int spos = model_state_pos_[i];
       cur_ff_context = &(*context)[spos];
       for (int i = 0; i < ants.size(); ++i) {
-        ants[i] = &node_states[edge->tail_nodes_[i]][spos];
+        ants[i] = ant_contexts[i] + spos;
       }
+    } else {
+      fill(ants.begin(), ants.end(), static_cast<const void*>(NULL));
     }
     ff.TraversalFeatures(smeta, *edge, ants, &edge->feature_values_, &est_vals, cur_ff_context);
+    if (state_signature && has_context)
+      sig = (sig ^ MurmurHash(cur_ff_context, ff.StateSize())) * 0x9e3779b97f4a7c15ull;
+    if (profile_) {
+      const uint64_t now = NowNs();
+      (has_context ? stateful_ns : stateless_ns) += now - last;
+      last = now;
+    }
+  }
+  if (profile_) {
+    if (has_stateless_ && !stateful_only) {
+      profile_->stateless_ns += stateless_ns;
+      ++profile_->stateless_edges;
+    }
+    if (state_size_) {
+      profile_->stateful_ns += stateful_ns;
+      ++profile_->stateful_edges;
+    }
   }
+  if (state_signature) *state_signature = sig;
   if (combination_cost_estimate)
     combination_cost_estimate->logeq(est_vals.dot(weights_));
   edge->edge_prob_.logeq(edge->feature_values_.dot(weights_));
 }
 
 void ModelSet::AddFinalFeatures(const FFState& state, HG::Edge* edge,SentenceMetadata const& smeta) const {
+  AddFinalFeatures(state.begin(), edge, smeta);
+}
+
+void ModelSet::AddFinalFeatures(const uint8_t* state, HG::Edge* edge,SentenceMetadata const& smeta) const {
   assert(1 == edge->rule_->Arity());
   //edge->reset_info();
+  const uint64_t start = profile_ ? NowNs() : 0;
   for (int i = 0; i < models_.size(); ++i) {
     const FeatureFunction& ff = *models_[i];
     const void* ant_state = NULL;
@@ -67,6 +183,55 @@ void ModelSet::AddFinalFeatures(const FFState& state, HG::Edge* edge,SentenceMet
     }
     ff.FinalTraversalFeatures(ant_state, &edge->feature_values_);
   }
+  if (profile_) profile_->stateful_ns += NowNs() - start;
   edge->edge_prob_.logeq(edge->feature_values_.dot(weights_));
 }
 
+uint64_t ModelSet::StateSignature(const uint8_t* state) const {
+  uint64_t sig = 0;
+  for (int i = 0; i < models_.size(); ++i) {
+    const int size = models_[i]->StateSize();
+    if (size > 0)
+      sig = (sig ^ MurmurHash(state + model_state_pos_[i], size)) * 0x9e3779b97f4a7c15ull;
+  }
+  return sig;
+}
+
+uint32_t FFStateInterner::Intern(const uint8_t* state, uint64_t signature) {
+  if (2 * (signatures_.size() + 1) > slots_.size()) Grow();
+  const size_t mask = slots_.size() - 1;
+  for (size_t i = signature & mask; ; i = (i + 1) & mask) {
+    Slot& slot = slots_[i];
+    if (slot.generation != generation_) {
+      const uint32_t id = signatures_.size();
+      signatures_.push_back(signature);
+      data_.insert(data_.end(), state, state + state_size_);
+      slot.generation = generation_;
+      slot.id = id;
+      return id;
+    }
+    if (signatures_[slot.id] == signature &&
+        (!state_size_ || !memcmp(Get(slot.id), state, state_size_)))
+      return slot.id;
+  }
+}
+
+void FFStateInterner::Clear() {
+  data_.clear();
+  signatures_.clear();
+  if (++generation_ == 0) {  // wrapped around, old stamps could match again
+    fill(slots_.begin(), slots_.end(), Slot());
+    generation_ = 1;
+  }
+}
+
+void FFStateInterner::Grow() {
+  slots_.assign(slots_.size() * 2, Slot());
+  const size_t mask = slots_.size() - 1;
+  for (uint32_t id = 0; id < signatures_.size(); ++id) {
+    size_t i = signatures_[id] & mask;
+    while (slots_[i].generation == generation_) i = (i + 1) & mask;
+    slots_[i].generation = generation_;
+    slots_[i].id = id;
+  }
+}
@@ -1,9 +1,12 @@
 #ifndef _FFSET_H_
 #define _FFSET_H_
 
+#include <atomic>
 #include <vector>
+#include <stdint.h>
 #include "value_array.h"
 #include "prob.h"
+#include "sparse_vector.h"
 
 namespace HG { struct Edge; struct Node; }
 class Hypergraph;
@@ -17,6 +20,20 @@ typedef ValueArray<uint8_t> FFState; // this is a fixed array, but about 10% fas
 //FIXME: only context.data() is required to be contiguous, and it becomes invalid after next string operation.  use ValueArray instead? (higher performance perhaps, save a word due to fixed size)
 typedef std::vector<FFState> FFStates;
 
+// time spent in the stateless and the stateful feature functions of a
+// ModelSet, summed over all threads that use it (see ModelSet::SetProfile)
+struct FeatureProfile {
+  FeatureProfile() { Reset(); }
+  void Reset();
+  double StatelessSeconds() const { return stateless_ns * 1e-9; }
+  double StatefulSeconds() const { return stateful_ns * 1e-9; }
+
+  std::atomic<uint64_t> stateless_ns;
+  std::atomic<uint64_t> stateless_edges;  // edges passed to AddStatelessFeatures
+  std::atomic<uint64_t> stateful_ns;      // includes AddFinalFeatures
+  std::atomic<uint64_t> stateful_edges;   // edges scored by the stateful models
+};
+
 // this class is a set of FeatureFunctions that can be used to score, rescore,
 // etc. a (translation?) forest
 class ModelSet {
@@ -27,17 +44,57 @@ class ModelSet {
   // sets edge->feature_values_ and edge->edge_prob_
   // NOTE: edge must not necessarily be in hg.edges_ but its TAIL nodes
   // must be.  edge features are supposed to be overwritten, not added to (possibly because rule features aren't in ModelSet so need to be left alone
+  // if state_signature is non-NULL, it is set to StateSignature(*residual_context),
+  // computed as each feature function finishes writing its part of the state
   void AddFeaturesToEdge(const SentenceMetadata& smeta,
                          const Hypergraph& hg,
                          const FFStates& node_states,
                          HG::Edge* edge,
                          FFState* residual_context,
-                         prob_t* combination_cost_estimate = NULL) const;
+                         prob_t* combination_cost_estimate = NULL,
+                         uint64_t* state_signature = NULL) const;
+
+  // like AddFeaturesToEdge, but only the stateful models are applied: the
+  // features of the stateless ones must already be in edge->feature_values_
+  // (see AddStatelessFeatures)
+  void AddStatefulFeaturesToEdge(const SentenceMetadata& smeta,
+                                 const Hypergraph& hg,
+                                 const FFStates& node_states,
+                                 HG::Edge* edge,
+                                 FFState* residual_context,
+                                 prob_t* combination_cost_estimate = NULL,
+                                 uint64_t* state_signature = NULL) const;
+
+  // like the above, but ant_contexts[i] is the residual context of
+  // edge->tail_nodes_[i], so the contexts need not be in an FFStates vector
+  // indexed by node
+  void AddStatefulFeaturesToEdge(const SentenceMetadata& smeta,
+                                 const uint8_t* const* ant_contexts,
+                                 HG::Edge* edge,
+                                 FFState* residual_context,
+                                 prob_t* combination_cost_estimate = NULL,
+                                 uint64_t* state_signature = NULL) const;
+
+  // adds the features of the stateless models of edges[i] to features[i]
+  // for i < n, passing all edges to each model at once. they only depend on
+  // the -LM edge, so the intersection strategies compute them once per edge
+  // instead of once per +LM edge
+  void AddStatelessFeatures(const SentenceMetadata& smeta,
+                            const HG::Edge* const* edges,
+                            int n,
+                            SparseVector<double>* features) const;
+
+  // 64 bit hash of a residual context, combined from the hashes of the
+  // parts written by each feature function
+  uint64_t StateSignature(const uint8_t* state) const;
 
   //this is called INSTEAD of above when result of edge is goal (must be a unary rule - i.e. one variable, but typically it's assumed that there are no target terminals either (e.g. for LM))
   void AddFinalFeatures(const FFState& residual_context,
                         HG::Edge* edge,
                         SentenceMetadata const& smeta) const;
+  void AddFinalFeatures(const uint8_t* residual_context,
+                        HG::Edge* edge,
+                        SentenceMetadata const& smeta) const;
 
   // this is called once before any feature functions apply to a hypergraph
   // it can be used to initialize sentence-specific data structures
@@ -47,11 +104,80 @@ class ModelSet {
 
   bool stateless() const { return !state_size_; }
 
+  // true if some models are stateless
+  bool has_stateless() const { return has_stateless_; }
+
+  // size of the residual contexts written by AddFeaturesToEdge
+  int StateSize() const { return state_size_; }
+
+  // true if every model may be used from several threads at once
+  bool IsThreadSafe() const;
+
+  // if profile is non-NULL, the time spent in the feature functions is added
+  // to it until SetProfile(NULL) is called.  this reads the clock around
+  // each feature function call, so it is off by default
+  void SetProfile(FeatureProfile* profile) { profile_ = profile; }
+
  private:
+  void ApplyToEdge(const SentenceMetadata& smeta,
+                   const FFStates& node_states,
+                   HG::Edge* edge,
+                   FFState* residual_context,
+                   prob_t* combination_cost_estimate,
+                   uint64_t* state_signature,
+                   bool stateful_only) const;
+  void ApplyToEdge(const SentenceMetadata& smeta,
+                   const uint8_t* const* ant_contexts,
+                   HG::Edge* edge,
+                   FFState* residual_context,
+                   prob_t* combination_cost_estimate,
+                   uint64_t* state_signature,
+                   bool stateful_only) const;
+
   std::vector<const FeatureFunction*> models_;
   const std::vector<double>& weights_;
   int state_size_;
+  bool has_stateless_;
   std::vector<int> model_state_pos_;
+  FeatureProfile* profile_;
+};
+
+// per-sentence (or per-node) table of the distinct residual contexts written
+// by a ModelSet.  each context is stored once and gets a dense id, so two
+// contexts are equal iff their ids are and recombining hypotheses only
+// needs an integer compare.  lookups compare the signatures computed by
+// ModelSet::AddFeaturesToEdge first, and the bytes only if those are equal
+class FFStateInterner {
+ public:
+  explicit FFStateInterner(int state_size) : state_size_(state_size), slots_(kINITIAL_SLOTS), generation_(1) {}
+
+  // the id of state, after adding it if it is new.  signature must be
+  // ModelSet::StateSignature(state)
+  uint32_t Intern(const uint8_t* state, uint64_t signature);
+
+  const uint8_t* Get(uint32_t id) const { return &data_[id * state_size_]; }
+  int StateSize() const { return state_size_; }
+  // number of distinct states, ids are 0 to size() - 1
+  uint32_t size() const { return signatures_.size(); }
+  // forgets all states.  O(1): the slots are not touched, only the
+  // generation they must carry to count as used is advanced
+  void Clear();
+
+ private:
+  static const size_t kINITIAL_SLOTS = 64;  // power of 2
+  struct Slot {
+    Slot() : generation(), id() {}
+    uint32_t generation;
+    uint32_t id;
+  };
+  void Grow();
+
+  const int state_size_;
+  std::vector<uint8_t> data_;
+  std::vector<uint64_t> signatures_;  // by id
+  std::vector<Slot> slots_;           // open addressing table of ids, a slot is
+                                      // empty unless its generation is generation_
+  uint32_t generation_;
 };
 
 #endif
@@ -10,14 +10,16 @@
 
 using namespace std;
 
-ForestWriter::ForestWriter(const std::string& path, int num) :
-  fname_(path + '/' + boost::lexical_cast<string>(num) + ".json.gz"), used_(false) {}
+ForestWriter::ForestWriter(const std::string& path, int num, bool binary) :
+  binary_(binary),
+  fname_(path + '/' + boost::lexical_cast<string>(num) + (binary ? ".hg" : ".json.gz")), used_(false) {}
 
 bool ForestWriter::Write(const Hypergraph& forest, bool minimal_rules) {
   assert(!used_);
   used_ = true;
   cerr << "  Writing forest to " << fname_ << endl;
   WriteFile wf(fname_);
+  if (binary_) return HypergraphIO::WriteToBinary(forest, minimal_rules, wf.stream());
   return HypergraphIO::WriteToJSON(forest, minimal_rules, wf.stream());
 }
 
@@ -5,10 +5,13 @@
 
 class Hypergraph;
 
+// writes forest num to path/num.json.gz, or to path/num.hg in the binary
+// format (see HypergraphIO::WriteToBinary)
 struct ForestWriter {
-  ForestWriter(const std::string& path, int num);
+  ForestWriter(const std::string& path, int num, bool binary = false);
   bool Write(const Hypergraph& forest, bool minimal_rules);
 
+  const bool binary_;
   const std::string fname_;
   bool used_;
 };
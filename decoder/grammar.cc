@@ -1,8 +1,11 @@
 #include "grammar.h"
 
 #include <algorithm>
+#include <cstring>
 #include <utility>
 #include <map>
+#include <mutex>
+#include <sstream>
 #ifndef HAVE_OLD_CPP
 # include <unordered_map>
 # include <unordered_set>
@@ -15,6 +18,7 @@ namespace std { using std::tr1::unordered_map; using std::tr1::unordered_set; }
 #include "rule_lexer.h"
 #include "filelib.h"
 #include "tdict.h"
+#include "fdict.h"
 
 using namespace std;
 
@@ -74,10 +78,84 @@ struct TextGrammarNode : public GrammarIter {
   TextRuleBin* rb_;
 };
 
+// the trie of a frozen grammar. nodes are stored breadth first, so the
+// children of a node are the range [first_child_, first_child_ + num_children_)
+// of nodes_, sorted by the symbols in syms_ (syms_[n] is the symbol that
+// leads to node n). the rules of all bins are stored contiguously in rules_
+struct FrozenTrie;
+
+struct FrozenNode : public GrammarIter, public RuleBin {
+  const GrammarIter* Extend(int symbol) const;
+  const RuleBin* GetRules() const { return num_rules_ ? this : NULL; }
+  int GetNumRules() const { return num_rules_; }
+  TRulePtr GetIthRule(int i) const;
+  int Arity() const;
+
+  const FrozenTrie* trie_;
+  unsigned first_child_;
+  unsigned num_children_;
+  unsigned first_rule_;
+  unsigned num_rules_;
+};
+
+struct FrozenTrie {
+  vector<FrozenNode> nodes_;
+  vector<WordID> syms_;
+  vector<TRulePtr> rules_;
+};
+
+const GrammarIter* FrozenNode::Extend(int symbol) const {
+  const WordID* begin = &trie_->syms_[first_child_];
+  const WordID* end = begin + num_children_;
+  const WordID* it = begin;
+  if (num_children_ <= 8) {
+    while (it != end && *it < symbol) ++it;
+  } else {
+    it = lower_bound(begin, end, symbol);
+  }
+  if (it == end || *it != symbol) return NULL;
+  return &trie_->nodes_[first_child_ + (it - begin)];
+}
+
+TRulePtr FrozenNode::GetIthRule(int i) const {
+  return trie_->rules_[first_rule_ + i];
+}
+
+int FrozenNode::Arity() const {
+  return trie_->rules_[first_rule_]->Arity();
+}
+
 struct TGImpl {
   TextGrammarNode root_;
+  // rules that are not in root_ yet. they are added when the trie is first
+  // used, so a grammar that is frozen right after loading never builds it
+  vector<TRulePtr> pending_;
+  mutex pending_mutex_;
+  boost::shared_ptr<FrozenTrie> frozen_;
 };
 
+static void AddToTrie(const TRulePtr& rule, TextGrammarNode* root) {
+  TextGrammarNode* cur = root;
+  for (int i = 0; i < rule->f_.size(); ++i)
+    cur = &cur->tree_[rule->f_[i]];
+  if (cur->rb_ == NULL)
+    cur->rb_ = new TextRuleBin;
+  cur->rb_->AddRule(rule);
+}
+
+// appends the rules of the trie below node, bin by bin
+static void CollectRules(const TextGrammarNode& node, vector<TRulePtr>* rules) {
+  if (node.rb_)
+    for (int i = 0; i < node.rb_->GetNumRules(); ++i)
+      rules->push_back(node.rb_->GetIthRule(i));
+  for (map<WordID, TextGrammarNode>::const_iterator it = node.tree_.begin(); it != node.tree_.end(); ++it)
+    CollectRules(it->second, rules);
+}
+
+static bool SourceLess(const TRulePtr& a, const TRulePtr& b) {
+  return a->f_ < b->f_;
+}
+
 TextGrammar::TextGrammar() : max_span_(10), pimpl_(new TGImpl) {}
 TextGrammar::TextGrammar(const string& file) :
     max_span_(10),
@@ -92,9 +170,58 @@ TextGrammar::TextGrammar(istream* in) :
 }
 
 const GrammarIter* TextGrammar::GetRoot() const {
+  if (pimpl_->frozen_) return &pimpl_->frozen_->nodes_[0];
+  lock_guard<mutex> lock(pimpl_->pending_mutex_);
+  for (unsigned i = 0; i < pimpl_->pending_.size(); ++i)
+    AddToTrie(pimpl_->pending_[i], &pimpl_->root_);
+  pimpl_->pending_.clear();
   return &pimpl_->root_;
 }
 
+void TextGrammar::Freeze() {
+  if (pimpl_->frozen_) return;
+  boost::shared_ptr<FrozenTrie> trie(new FrozenTrie);
+  vector<TRulePtr>& rules = trie->rules_;
+  CollectRules(pimpl_->root_, &rules);
+  rules.insert(rules.end(), pimpl_->pending_.begin(), pimpl_->pending_.end());
+  vector<TRulePtr>().swap(pimpl_->pending_);
+  pimpl_->root_.tree_.clear();
+  delete pimpl_->root_.rb_;
+  pimpl_->root_.rb_ = NULL;
+  // sorting by source side puts the rules of each bin next to each other (in
+  // the order they were added) and the bins in the order of a depth first
+  // walk of the trie. the node of a range of rules that share their first
+  // depth symbols has the rules with exactly depth symbols as its bin, and a
+  // child for each run of rules with the same next symbol
+  stable_sort(rules.begin(), rules.end(), SourceLess);
+  struct Range { unsigned begin, end, depth; };
+  vector<Range> queue;
+  Range root = { 0, static_cast<unsigned>(rules.size()), 0 };
+  queue.push_back(root);
+  trie->syms_.push_back(0);
+  for (unsigned n = 0; n < queue.size(); ++n) {
+    const Range r = queue[n];
+    FrozenNode out;
+    out.trie_ = trie.get();
+    out.first_rule_ = r.begin;
+    unsigned k = r.begin;
+    while (k < r.end && rules[k]->f_.size() == r.depth) ++k;
+    out.num_rules_ = k - r.begin;
+    out.first_child_ = queue.size();
+    while (k < r.end) {
+      const WordID sym = rules[k]->f_[r.depth];
+      Range child = { k, k + 1, r.depth + 1 };
+      while (child.end < r.end && rules[child.end]->f_[r.depth] == sym) ++child.end;
+      queue.push_back(child);
+      trie->syms_.push_back(sym);
+      k = child.end;
+    }
+    out.num_children_ = queue.size() - out.first_child_;
+    trie->nodes_.push_back(out);
+  }
+  pimpl_->frozen_ = trie;
+}
+
 void TextGrammar::AddRule(const TRulePtr& rule, const unsigned int ctf_level, const TRulePtr& coarse_rule) {
   if (ctf_level > 0) {
     // assume that coarse_rule is already in tree (would be safer to check)
@@ -106,12 +233,11 @@ void TextGrammar::AddRule(const TRulePtr& rule, const unsigned int ctf_level, co
     rhs2unaries_[rule->f().front()].push_back(rule);
     unaries_.push_back(rule);
   } else {
-    TextGrammarNode* cur = &pimpl_->root_;
-    for (int i = 0; i < rule->f_.size(); ++i)
-      cur = &cur->tree_[rule->f_[i]];
-    if (cur->rb_ == NULL)
-      cur->rb_ = new TextRuleBin;
-    cur->rb_->AddRule(rule);
+    if (pimpl_->frozen_) {
+      cerr << "Cannot add rules to a frozen grammar: " << rule->AsString() << endl;
+      abort();
+    }
+    pimpl_->pending_.push_back(rule);
   }
 }
 
@@ -120,14 +246,148 @@ static void AddRuleHelper(const TRulePtr& new_rule, const unsigned int ctf_level
 }
 
 void TextGrammar::ReadFromFile(const string& filename) {
+  if (filename != "-") {
+    ReadFile in(filename);
+    if (ReadFromBinaryStream(in.stream())) return;
+  }
   ReadFile in(filename);
   RuleLexer::ReadRules(in.stream(), &AddRuleHelper, filename, this);
 }
 
+static void CorruptBinaryGrammar() {
+  cerr << "Truncated or corrupt binary grammar\n";
+  abort();
+}
+
+template <typename T> static inline const char* ReadBinary(const char* p, const char* end, T* x) {
+  if (static_cast<size_t>(end - p) < sizeof(T)) CorruptBinaryGrammar();
+  memcpy(x, p, sizeof(T));
+  return p + sizeof(T);
+}
+
+static const char* ReadBinaryString(const char* p, const char* end, string* s) {
+  uint32_t len;
+  p = ReadBinary(p, end, &len);
+  if (static_cast<size_t>(end - p) < len) CorruptBinaryGrammar();
+  s->assign(p, len);
+  return p + len;
+}
+
+// maps a (1-based) index into the word table of a binary grammar
+static inline WordID BinaryGrammarWord(const vector<WordID>& words, int64_t i) {
+  if (i < 1 || static_cast<uint64_t>(i) > words.size()) CorruptBinaryGrammar();
+  return words[i - 1];
+}
+
+bool TextGrammar::ReadFromBinaryStream(istream* in) {
+  static const char kMagic[8] = { 'c', 'd', 'e', 'c', 'P', 'S', 'G', '1' };
+  char magic[sizeof(kMagic)];
+  if (!in->read(magic, sizeof(magic)) || memcmp(magic, kMagic, sizeof(kMagic)) != 0)
+    return false;
+  uint64_t size;
+  if (!in->read(reinterpret_cast<char*>(&size), sizeof(size))) CorruptBinaryGrammar();
+  // read in chunks, so a corrupt size fails at the end of the data rather
+  // than allocating size bytes up front
+  static const uint64_t kChunk = 1 << 20;
+  string buf;
+  while (buf.size() < size) {
+    const size_t done = buf.size();
+    const size_t n = min(kChunk, size - done);
+    buf.resize(done + n);
+    if (!in->read(&buf[done], n)) CorruptBinaryGrammar();
+  }
+  const char* p = buf.data();
+  const char* end = p + buf.size();
+  uint32_t num_words, num_feats, num_rules;
+  p = ReadBinary(p, end, &num_words);
+  p = ReadBinary(p, end, &num_feats);
+  p = ReadBinary(p, end, &num_rules);
+  // every word and feature name takes at least 4 bytes
+  if (static_cast<uint64_t>(num_words) + num_feats > size / 4) CorruptBinaryGrammar();
+  string tmp;
+  vector<WordID> words(num_words);
+  for (unsigned i = 0; i < num_words; ++i) {
+    p = ReadBinaryString(p, end, &tmp);
+    words[i] = TD::Convert(tmp);
+  }
+  vector<int> fids(num_feats);
+  for (unsigned i = 0; i < num_feats; ++i) {
+    p = ReadBinaryString(p, end, &tmp);
+    fids[i] = FD::Convert(tmp);  // 0 if the feature set is frozen
+  }
+
+  vector<WordID> f, e;
+  vector<int> rule_fids;
+  vector<double> vals;
+  vector<AlignmentPoint> als;
+  for (unsigned r = 0; r < num_rules; ++r) {
+    int32_t lhs;
+    uint16_t f_len, e_len, num_als;
+    p = ReadBinary(p, end, &lhs);
+    p = ReadBinary(p, end, &f_len);
+    p = ReadBinary(p, end, &e_len);
+    p = ReadBinary(p, end, &num_als);
+    f.resize(f_len);
+    e.resize(e_len);
+    int arity = 0;
+    for (unsigned i = 0; i < f_len; ++i) {
+      int32_t s;
+      p = ReadBinary(p, end, &s);
+      if (s > 0) {
+        f[i] = BinaryGrammarWord(words, s);
+      } else {
+        f[i] = -BinaryGrammarWord(words, -static_cast<int64_t>(s));
+        ++arity;
+      }
+    }
+    for (unsigned i = 0; i < e_len; ++i) {
+      int32_t s;
+      p = ReadBinary(p, end, &s);
+      e[i] = s > 0 ? BinaryGrammarWord(words, s) : s;
+    }
+    rule_fids.clear();
+    vals.clear();
+    for (unsigned i = 0; i < num_feats; ++i) {
+      double v;
+      p = ReadBinary(p, end, &v);
+      if (fids[i]) {
+        rule_fids.push_back(fids[i]);
+        vals.push_back(v);
+      }
+    }
+    als.resize(num_als);
+    for (unsigned i = 0; i < num_als; ++i) {
+      int16_t s, t;
+      p = ReadBinary(p, end, &s);
+      p = ReadBinary(p, end, &t);
+      als[i] = AlignmentPoint(s, t);
+    }
+    AddRule(TRulePtr(new TRule(-BinaryGrammarWord(words, -static_cast<int64_t>(lhs)), f.data(), f_len, e.data(), e_len,
+                               rule_fids.data(), vals.data(), rule_fids.size(),
+                               arity, als.data(), num_als)));
+  }
+  return true;
+}
+
 void TextGrammar::ReadFromStream(istream* in) {
   RuleLexer::ReadRules(in, &AddRuleHelper, "UNKNOWN", this);
 }
 
+void TextGrammar::ReadFromIndexedStream(istream* in, unsigned long long offset) {
+  in->clear();
+  in->seekg(offset, ios::beg);
+  if (ReadFromBinaryStream(in)) return;
+  in->clear();
+  in->seekg(offset, ios::beg);
+  string line, rules;
+  while (getline(*in, line) && line != "###EOS###") {
+    rules += line;
+    rules += '\n';
+  }
+  istringstream text(rules);
+  ReadFromStream(&text);
+}
+
 bool TextGrammar::HasRuleForSpan(int /* i */, int /* j */, int distance) const {
   return (max_span_ >= distance);
 }
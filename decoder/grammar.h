@@ -72,6 +72,20 @@ struct TextGrammar : public Grammar {
   void AddRule(const TRulePtr& rule, const unsigned int ctf_level=0, const TRulePtr& coarse_parent=TRulePtr());
   void ReadFromFile(const std::string& filename);
   void ReadFromStream(std::istream* in);
+  // reads one grammar in the binary format written by the extractor (see
+  // extractor/grammar.h); rules are built directly from the packed records,
+  // without going through the rule lexer. Returns false (having consumed a
+  // few bytes) if in is not positioned at a binary grammar.
+  // ReadFromFile accepts both formats
+  bool ReadFromBinaryStream(std::istream* in);
+  // reads the grammar starting at offset in a per sentence grammar file (see
+  // --per_sentence_grammar_file), either binary or text rules followed by a
+  // ###EOS### line
+  void ReadFromIndexedStream(std::istream* in, unsigned long long offset);
+  // stores the rule trie in sorted arrays, which are faster to search when
+  // parsing than the map-based trie (which is then never built, if Freeze is
+  // called before the grammar is used). afterwards only unary rules can be added
+  void Freeze();
   virtual bool HasRuleForSpan(int i, int j, int distance) const;
   const std::vector<TRulePtr>& GetUnaryRules(const WordID& cat) const;
 
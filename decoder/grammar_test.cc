@@ -3,18 +3,29 @@
 #include <boost/test/floating_point_comparison.hpp>
 
 #include <cassert>
+#include <csignal>
+#include <cstring>
 #include <iostream>
 #include <fstream>
+#include <iterator>
+#include <sstream>
 #include <vector>
 #include "trule.h"
 #include "tdict.h"
+#include "fdict.h"
 #include "grammar.h"
+#include "compiled_grammar.h"
+#include "filelib.h"
 #include "bottom_up_parser.h"
 #include "hg.h"
 #include "ff.h"
 #include "ffset.h"
 #include "weights.h"
 
+#include <fcntl.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
 using namespace std;
 
 struct GrammarTest {
@@ -57,5 +68,246 @@ BOOST_AUTO_TEST_CASE(TestTextGrammarFile) {
   parser.Parse(lattice, &forest);
   forest.PrintGraphviz();
 }
+BOOST_AUTO_TEST_CASE(TestCompiledGrammar) {
+  std::string path(boost::unit_test::framework::master_test_suite().argc == 2 ? boost::unit_test::framework::master_test_suite().argv[1] : TEST_DATA);
+  const string bin = "grammar_test.compiled";
+  {
+    ReadFile in(path + "/grammar.prune");
+    CompiledGrammar::Compile(in.stream(), bin);
+  }
+  BOOST_CHECK(CompiledGrammar::IsCompiledGrammar(bin));
+  BOOST_CHECK(!CompiledGrammar::IsCompiledGrammar(path + "/grammar.prune"));
+
+  Lattice lattice(3);
+  lattice[0].push_back(LatticeArc(TD::Convert("ein"), 0.0, 1));
+  lattice[1].push_back(LatticeArc(TD::Convert("haus"), 0.0, 1));
+  lattice[2].push_back(LatticeArc(TD::Convert("ist"), 0.0, 1));
+  Hypergraph text_forest, compiled_forest;
+  {
+    vector<GrammarPtr> grammars(1, GrammarPtr(new TextGrammar(path + "/grammar.prune")));
+    ExhaustiveBottomUpParser parser("PHRASE", grammars);
+    parser.Parse(lattice, &text_forest);
+  }
+  {
+    vector<GrammarPtr> grammars(1, GrammarPtr(new CompiledGrammar(bin)));
+    ExhaustiveBottomUpParser parser("PHRASE", grammars);
+    parser.Parse(lattice, &compiled_forest);
+  }
+  remove(bin.c_str());
+  BOOST_CHECK_EQUAL(text_forest.nodes_.size(), compiled_forest.nodes_.size());
+  BOOST_REQUIRE_EQUAL(text_forest.edges_.size(), compiled_forest.edges_.size());
+  BOOST_CHECK(text_forest.edges_.size() > 0);
+  for (unsigned i = 0; i < text_forest.edges_.size(); ++i) {
+    const Hypergraph::Edge& a = text_forest.edges_[i];
+    const Hypergraph::Edge& b = compiled_forest.edges_[i];
+    BOOST_CHECK_EQUAL(a.rule_->AsString(), b.rule_->AsString());
+    BOOST_CHECK_EQUAL(a.rule_->Arity(), b.rule_->Arity());
+    BOOST_CHECK(a.tail_nodes_ == b.tail_nodes_);
+  }
+}
+
+// runs f in a child process, without its error messages; returns the wait
+// status
+template <typename F> static int StatusInChild(F f) {
+  const pid_t pid = fork();
+  if (pid == 0) {
+    signal(SIGABRT, SIG_DFL);  // not the test framework's handler
+    const int null = open("/dev/null", O_WRONLY);
+    dup2(null, 2);
+    f();
+    _exit(0);
+  }
+  int status = 0;
+  waitpid(pid, &status, 0);
+  return status;
+}
+
+static bool Aborted(int status) {
+  return WIFSIGNALED(status) && WTERMSIG(status) == SIGABRT;
+}
+
+static string ReadBytes(const string& file) {
+  ifstream in(file.c_str(), ios::binary);
+  return string(istreambuf_iterator<char>(in), istreambuf_iterator<char>());
+}
+
+// the rules of g with the given source side, as strings
+static vector<string> RulesFor(const TextGrammar& g, const vector<WordID>& f) {
+  const GrammarIter* it = g.GetRoot();
+  for (unsigned i = 0; it && i < f.size(); ++i)
+    it = it->Extend(f[i]);
+  vector<string> rules;
+  const RuleBin* bin = it ? it->GetRules() : NULL;
+  for (int i = 0; bin && i < bin->GetNumRules(); ++i)
+    rules.push_back(bin->GetIthRule(i)->AsString());
+  return rules;
+}
+
+BOOST_AUTO_TEST_CASE(TestCorruptCompiledGrammar) {
+  std::string path(boost::unit_test::framework::master_test_suite().argc == 2 ? boost::unit_test::framework::master_test_suite().argv[1] : TEST_DATA);
+  const string bin = "grammar_test.compiled";
+  const string bad = "grammar_test.corrupt";
+  {
+    ReadFile in(path + "/grammar.prune");
+    CompiledGrammar::Compile(in.stream(), bin);
+  }
+  const string data = ReadBytes(bin);
+  remove(bin.c_str());
+  Lattice lattice(3);
+  lattice[0].push_back(LatticeArc(TD::Convert("ein"), 0.0, 1));
+  lattice[1].push_back(LatticeArc(TD::Convert("haus"), 0.0, 1));
+  lattice[2].push_back(LatticeArc(TD::Convert("ist"), 0.0, 1));
+
+  vector<string> corrupt;
+  // truncated copies
+  for (unsigned k = 1; k < 16; ++k)
+    corrupt.push_back(data.substr(0, 120 + (data.size() - 120) * k / 16));
+  // every count and offset in the header (after magic and version) set huge
+  for (unsigned field = 16; field < 112; field += 8) {
+    string d = data;
+    const uint64_t huge = 1ull << 62;
+    memcpy(&d[field], &huge, sizeof(huge));
+    corrupt.push_back(d);
+  }
+  // garbage in the trie and the rule data
+  for (unsigned k = 1; k < 8; ++k) {
+    string d = data;
+    for (unsigned i = data.size() * k / 8; i < data.size() * k / 8 + 64 && i < d.size(); ++i)
+      d[i] = '\xff';
+    corrupt.push_back(d);
+  }
+
+  unsigned aborted = 0;
+  for (unsigned i = 0; i < corrupt.size(); ++i) {
+    {
+      ofstream out(bad.c_str(), ios::binary);
+      out.write(corrupt[i].data(), corrupt[i].size());
+    }
+    const int status = StatusInChild([&bad, &lattice]() {
+      vector<GrammarPtr> grammars(1, GrammarPtr(new CompiledGrammar(bad)));
+      ExhaustiveBottomUpParser parser("PHRASE", grammars);
+      Hypergraph forest;
+      parser.Parse(lattice, &forest);
+    });
+    // either the damage went unnoticed by this lattice, or it was reported
+    BOOST_CHECK_MESSAGE((WIFEXITED(status) && WEXITSTATUS(status) == 0) || Aborted(status),
+                        "corrupt copy " << i << " crashed with status " << status);
+    if (Aborted(status)) ++aborted;
+  }
+  remove(bad.c_str());
+  // all truncated copies and bad headers are caught when the file is loaded
+  BOOST_CHECK(aborted >= 15 + 12);
+}
+
+// extractor_grammar.bin is written by the extractor's Grammar::WriteBinary
+// (its grammar_test checks that it still is)
+BOOST_AUTO_TEST_CASE(TestExtractorBinaryGrammar) {
+  std::string path(boost::unit_test::framework::master_test_suite().argc == 2 ? boost::unit_test::framework::master_test_suite().argv[1] : TEST_DATA);
+  ifstream in((path + "/extractor_grammar.bin").c_str(), ios::binary);
+  TextGrammar g;
+  BOOST_REQUIRE(g.ReadFromBinaryStream(&in));
+  const vector<WordID> f = { TD::Convert("a"), -TD::Convert("X"), TD::Convert("b") };
+  const vector<string> rules = RulesFor(g, f);
+  BOOST_REQUIRE_EQUAL(rules.size(), 1);
+  BOOST_CHECK_EQUAL(rules[0], "[X] ||| a [X,1] b ||| [1] A B ||| f1=0.5 f2=2 ||| 0-1 2-2");
+  const TRulePtr r = g.GetRoot()->Extend(f[0])->Extend(f[1])->Extend(f[2])->GetRules()->GetIthRule(0);
+  BOOST_CHECK_EQUAL(r->Arity(), 1);
+  BOOST_CHECK_CLOSE(r->scores_.value(FD::Convert("f1")), 0.5, 1e-9);
+  BOOST_CHECK_CLOSE(r->scores_.value(FD::Convert("f2")), 2.0, 1e-9);
+}
+
+// a per sentence grammar file holds grammars in either format, each loaded
+// from its psg="@OFFSET"
+BOOST_AUTO_TEST_CASE(TestPerSentenceGrammarFile) {
+  std::string path(boost::unit_test::framework::master_test_suite().argc == 2 ? boost::unit_test::framework::master_test_suite().argv[1] : TEST_DATA);
+  const string binary = ReadBytes(path + "/extractor_grammar.bin");
+  const string text = "[X] ||| c ||| C ||| f1=1\n[X] ||| c d ||| C D ||| f1=2\n###EOS###\n";
+  const string psg_file = "grammar_test.psg";
+  vector<unsigned long long> offsets;
+  {
+    ofstream out(psg_file.c_str(), ios::binary);
+    offsets.push_back(0);
+    out << text;
+    offsets.push_back(text.size());
+    out << binary;
+    offsets.push_back(offsets.back() + binary.size());
+    out << text;
+    offsets.push_back(offsets.back() + text.size());
+    out << binary;
+  }
+  const vector<WordID> f_bin = { TD::Convert("a"), -TD::Convert("X"), TD::Convert("b") };
+  const vector<WordID> f_text(1, TD::Convert("c"));
+  const vector<WordID> f_text2 = { TD::Convert("c"), TD::Convert("d") };
+  ifstream in(psg_file.c_str(), ios::binary);
+  // out of order, like a decoder with several threads
+  const unsigned order[] = { 3, 0, 2, 1 };
+  for (unsigned i = 0; i < 4; ++i) {
+    const unsigned k = order[i];
+    TextGrammar g;
+    g.ReadFromIndexedStream(&in, offsets[k]);
+    if (k % 2 == 0) {
+      BOOST_CHECK_EQUAL(RulesFor(g, f_text).size(), 1);
+      BOOST_CHECK_EQUAL(RulesFor(g, f_text2).size(), 1);
+      // the text grammar ends at ###EOS###, before the binary grammar
+      BOOST_CHECK(RulesFor(g, f_bin).empty());
+    } else {
+      BOOST_CHECK_EQUAL(RulesFor(g, f_bin).size(), 1);
+      BOOST_CHECK(RulesFor(g, f_text).empty());
+    }
+  }
+  remove(psg_file.c_str());
+
+  // a text grammar cut off before ###EOS### ends at the end of the file
+  {
+    istringstream cut(text.substr(0, text.find("###EOS###")));
+    TextGrammar g;
+    g.ReadFromIndexedStream(&cut, 0);
+    BOOST_CHECK_EQUAL(RulesFor(g, f_text2).size(), 1);
+  }
+  // a binary grammar cut off anywhere after its magic number is reported
+  for (unsigned len = 8; len < binary.size(); ++len) {
+    const string cut = text + binary.substr(0, len);
+    const unsigned long long offset = text.size();
+    const int status = StatusInChild([&cut, offset]() {
+      istringstream in(cut);
+      TextGrammar g;
+      g.ReadFromIndexedStream(&in, offset);
+    });
+    BOOST_CHECK_MESSAGE(Aborted(status), "grammar cut at " << len << " gave status " << status);
+  }
+}
+
+BOOST_AUTO_TEST_CASE(TestFrozenTextGrammar) {
+  std::string path(boost::unit_test::framework::master_test_suite().argc == 2 ? boost::unit_test::framework::master_test_suite().argv[1] : TEST_DATA);
+  Lattice lattice(3);
+  lattice[0].push_back(LatticeArc(TD::Convert("ein"), 0.0, 1));
+  lattice[1].push_back(LatticeArc(TD::Convert("haus"), 0.0, 1));
+  lattice[2].push_back(LatticeArc(TD::Convert("ist"), 0.0, 1));
+  Hypergraph text_forest, frozen_forest;
+  {
+    vector<GrammarPtr> grammars(1, GrammarPtr(new TextGrammar(path + "/grammar.prune")));
+    ExhaustiveBottomUpParser parser("PHRASE", grammars);
+    parser.Parse(lattice, &text_forest);
+  }
+  {
+    TextGrammar* g = new TextGrammar(path + "/grammar.prune");
+    g->Freeze();
+    BOOST_CHECK(!g->GetRoot()->Extend(TD::Convert("not_in_the_grammar")));
+    BOOST_REQUIRE(g->GetRoot()->Extend(TD::Convert("haus")));
+    vector<GrammarPtr> grammars(1, GrammarPtr(g));
+    ExhaustiveBottomUpParser parser("PHRASE", grammars);
+    parser.Parse(lattice, &frozen_forest);
+  }
+  BOOST_CHECK_EQUAL(text_forest.nodes_.size(), frozen_forest.nodes_.size());
+  BOOST_REQUIRE_EQUAL(text_forest.edges_.size(), frozen_forest.edges_.size());
+  BOOST_CHECK(text_forest.edges_.size() > 0);
+  for (unsigned i = 0; i < text_forest.edges_.size(); ++i) {
+    const Hypergraph::Edge& a = text_forest.edges_[i];
+    const Hypergraph::Edge& b = frozen_forest.edges_[i];
+    BOOST_CHECK_EQUAL(a.rule_->AsString(), b.rule_->AsString());
+    BOOST_CHECK(a.tail_nodes_ == b.tail_nodes_);
+  }
+}
+
 BOOST_AUTO_TEST_SUITE_END()
 
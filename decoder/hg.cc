@@ -571,7 +571,10 @@ void Hypergraph::TopologicallySortNodesAndEdges(int goal_index,
     if (reloc_node[i] != static_cast<int>(i)) no_op = false;
   for (unsigned i = 0; i < reloc_edge.size() && no_op; ++i)
     if (reloc_edge[i] != static_cast<int>(i)) no_op = false;
-  if (no_op) return;
+  if (no_op) {
+    if (arena_) CompactEdgeLists();
+    return;
+  }
   for (unsigned i = 0; i < reloc_node.size(); ++i) {
     Node& node = nodes_[i];
     node.id_ = reloc_node[i];
@@ -603,6 +606,28 @@ void Hypergraph::TopologicallySortNodesAndEdges(int goal_index,
 #ifndef HG_EDGES_TOPO_SORTED
   sort(edges_.begin(), edges_.end(), IdCompare<Edge>());
 #endif
+  if (arena_) CompactEdgeLists();
+}
+
+// copies the edge lists into a new arena, all in edge lists in node order
+// followed by all out edge lists, and drops the old arena (which holds the
+// lists as they grew, and those of removed nodes)
+void Hypergraph::CompactEdgeLists() {
+  size_t size = 0;
+  for (unsigned i = 0; i < nodes_.size(); ++i)
+    size += nodes_[i].in_edges_.size() + nodes_[i].out_edges_.size();
+  boost::shared_ptr<HG::Arena> arena(new HG::Arena);
+  arena->Reserve(size * sizeof(int));
+  const HG::ArenaAllocator<int> alloc(arena.get());
+  for (unsigned i = 0; i < nodes_.size(); ++i) {
+    EdgesVector in(nodes_[i].in_edges_.begin(), nodes_[i].in_edges_.end(), alloc);
+    nodes_[i].in_edges_.swap(in);
+  }
+  for (unsigned i = 0; i < nodes_.size(); ++i) {
+    EdgesVector out(nodes_[i].out_edges_.begin(), nodes_[i].out_edges_.end(), alloc);
+    nodes_[i].out_edges_.swap(out);
+  }
+  arena_.swap(arena);
 }
 
 struct EdgeWeightSorter {
@@ -17,9 +17,11 @@
 #include <sstream>
 #include <string>
 #include <vector>
+#include <utility>
 #include <boost/shared_ptr.hpp>
 
 #include "feature_vector.h"
+#include "hg_arena.h"
 #include "small_vector.h"
 #include "wordid.h"
 #include "tdict.h"
@@ -35,7 +37,7 @@
 
 // SmallVector is a fast, small vector<int> implementation for sizes <= 2
 typedef SmallVectorUnsigned TailNodeVector; // indices in nodes_
-typedef std::vector<int> EdgesVector; // indices in edges_
+typedef std::vector<int, HG::ArenaAllocator<int> > EdgesVector; // indices in edges_
 
 enum {
   NONE=0,CATEGORY=1,SPAN=2,PROB=4,FEATURES=8,RULE=16,RULE_LHS=32,PREV_SPAN=64,ALL=0xFFFFFFFF
@@ -142,6 +144,7 @@ namespace HG {
   // TODO keep cat_ and add span and/or state? :)
   struct Node {
     Node() : id_(), cat_() {}
+    explicit Node(const HG::ArenaAllocator<int>& a) : id_(), cat_(), in_edges_(a), out_edges_(a) {}
     int id_; // equal to this object's position in the nodes_ vector
     WordID cat_;  // non-terminal category if <0, 0 if not set
     WordID NT() const { return -cat_; }
@@ -167,10 +170,20 @@ typedef boost::shared_ptr<Hypergraph> HypergraphP;
 class Hypergraph {
 public:
   Hypergraph() : is_linear_chain_(false) {}
+  Hypergraph(const Hypergraph&) = default;
+  Hypergraph(Hypergraph&&) = default;
+  // copy and swap, so the nodes never keep edge lists in an arena that this
+  // forest has let go of
+  Hypergraph& operator=(const Hypergraph& other) {
+    Hypergraph copy(other);
+    swap(copy);
+    return *this;
+  }
+  Hypergraph& operator=(Hypergraph&&) = default;
   typedef HG::Node Node;
   typedef HG::Edge Edge;
   typedef SmallVectorUnsigned TailNodeVector; // indices in nodes_
-  typedef std::vector<int> EdgesVector; // indices in edges_
+  typedef ::EdgesVector EdgesVector; // indices in edges_
   enum {
     NONE=0,CATEGORY=1,SPAN=2,PROB=4,FEATURES=8,RULE=16,RULE_LHS=32,PREV_SPAN=64,ALL=0xFFFFFFFF
   };
@@ -248,6 +261,7 @@ public:
   prob_t ComputeEdgeViterbi(NodeProbs const&np,EdgeProbs *ev) const;
 
   void swap(Hypergraph& other) {
+    other.arena_.swap(arena_);
     other.nodes_.swap(nodes_);
     std::swap(is_linear_chain_, other.is_linear_chain_);
     other.edges_.swap(edges_);
@@ -257,10 +271,29 @@ public:
   }
 
   void ResizeNodes(int size) {
-    nodes_.resize(size);
+    if (arena_ && size > static_cast<int>(nodes_.size())) {
+      nodes_.reserve(size);
+      while (static_cast<int>(nodes_.size()) < size) nodes_.push_back(Node(EdgeListAllocator()));
+    } else {
+      nodes_.resize(size);
+    }
     for (int i = 0; i < size; ++i) nodes_[i].id_ = i;
   }
 
+  // arena mode: the in and out edge lists of the nodes added from now on are
+  // allocated from an arena that belongs to this forest (and is shared with
+  // its copies), and TopologicallySortNodesAndEdges lays them all out one
+  // after another (CSR style). the arena is freed all at once with the
+  // forest, which saves most of the allocations and frees of building and
+  // destroying a large forest. nodes must not be moved out of the forest
+  // (copies are fine)
+  void UseArena() {
+    if (!arena_) arena_.reset(new HG::Arena);
+  }
+  bool UsesArena() const { return static_cast<bool>(arena_); }
+  // bytes of edge lists allocated from the arena (0 if there is none)
+  size_t ArenaBytes() const { return arena_ ? arena_->Allocated() : 0; }
+
   // reserves space in the nodes vector to prevent memory locations
   // from changing
   void ReserveNodes(size_t n, size_t e = 0) {
@@ -286,6 +319,16 @@ public:
     return edge;
   }
 
+  // as above, but takes over nedge's rule and feature vector instead of copying them
+  Edge* AddEdge(Edge&& nedge) {
+    int eid=edges_.size();
+    edges_.push_back(std::move(nedge));
+    Edge* edge = &edges_.back();
+    edge->id_ = eid;
+    index_tails(*edge);
+    return edge;
+  }
+
   // also copies feature vector
   Edge* AddEdge(Edge const& in_edge, const TailNodeVector& tail) {
     edges_.push_back(Edge(edges_.size(),in_edge));
@@ -310,7 +353,7 @@ public:
   }
 
   Node* AddNode(const WordID& cat) {
-    nodes_.push_back(Node());
+    nodes_.push_back(Node(EdgeListAllocator()));
     nodes_.back().cat_ = cat;
     nodes_.back().id_ = nodes_.size() - 1;
     return &nodes_.back();
@@ -438,6 +481,7 @@ public:
   void clear() {
     nodes_.clear();
     edges_.clear();
+    if (arena_) arena_.reset(new HG::Arena);
   }
 
   inline size_t NumberOfEdges() const { return edges_.size(); }
@@ -447,6 +491,10 @@ public:
   // linear chains can be represented in a number of ways in a hypergraph,
   // we define them to consist only of lexical translations and monotonic rules
   inline bool IsLinearChain() const { return is_linear_chain_; }
+ private:
+  // declared before nodes_, so that it is destroyed after them
+  boost::shared_ptr<HG::Arena> arena_;
+ public:
   bool is_linear_chain_;
 
   // nodes_ is sorted in topological order
@@ -482,6 +530,11 @@ public:
   void check_ids() const; // assert that .id_ have been kept in sync
 
 private:
+  HG::ArenaAllocator<int> EdgeListAllocator() const {
+    return HG::ArenaAllocator<int>(arena_.get());
+  }
+  void CompactEdgeLists();
+
   Hypergraph(int num_nodes, int num_edges, bool is_lc) : is_linear_chain_(is_lc), nodes_(num_nodes), edges_(num_edges),edges_topo_(true) {}
 };
 
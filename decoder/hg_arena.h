@@ -0,0 +1,110 @@
+#ifndef _HG_ARENA_H_
+#define _HG_ARENA_H_
+
+#include <cstddef>
+#include <cstdlib>
+#include <new>
+#include <type_traits>
+#include <vector>
+
+namespace HG {
+
+// bump allocator for the storage of one forest (see Hypergraph::UseArena).
+// memory is handed out from large blocks and only given back all at once, when
+// the arena is destroyed. not thread safe
+class Arena {
+ public:
+  Arena() : next_(NULL), end_(NULL), allocated_() {}
+  ~Arena() {
+    for (unsigned i = 0; i < blocks_.size(); ++i)
+      std::free(blocks_[i]);
+  }
+
+  void* Allocate(size_t bytes, size_t align) {
+    size_t pad = Padding(align);
+    if (pad + bytes > static_cast<size_t>(end_ - next_)) {
+      NewBlock(bytes + align);
+      pad = Padding(align);
+    }
+    char* p = next_ + pad;
+    next_ = p + bytes;
+    allocated_ += bytes;
+    return p;
+  }
+
+  // makes sure the next allocations of up to bytes bytes in total come from
+  // one block, i.e. are contiguous if they need no alignment padding
+  void Reserve(size_t bytes) {
+    if (bytes > static_cast<size_t>(end_ - next_)) NewBlock(bytes);
+  }
+
+  // bytes handed out so far
+  size_t Allocated() const { return allocated_; }
+
+ private:
+  Arena(const Arena&);
+  void operator=(const Arena&);
+
+  size_t Padding(size_t align) const {
+    return (align - reinterpret_cast<size_t>(next_) % align) % align;
+  }
+
+  void NewBlock(size_t min_bytes) {
+    const size_t size = min_bytes > kBlockSize ? min_bytes : kBlockSize;
+    char* block = static_cast<char*>(std::malloc(size));
+    if (!block) throw std::bad_alloc();
+    blocks_.push_back(block);
+    next_ = block;
+    end_ = block + size;
+  }
+
+  static const size_t kBlockSize = 1 << 16;
+  std::vector<char*> blocks_;
+  char* next_;
+  char* end_;
+  size_t allocated_;
+};
+
+// allocates from an arena, or from the heap if it has none. deallocating
+// arena memory does nothing. copies of a container get heap storage, so only
+// the containers a forest builds itself ever point into its arena; moves and
+// swaps take the storage along with the arena, which must outlive it
+template <typename T>
+struct ArenaAllocator {
+  typedef T value_type;
+  typedef std::true_type propagate_on_container_move_assignment;
+  typedef std::true_type propagate_on_container_swap;
+  typedef std::false_type propagate_on_container_copy_assignment;
+
+  ArenaAllocator() : arena(NULL) {}
+  explicit ArenaAllocator(Arena* a) : arena(a) {}
+  template <typename U>
+  ArenaAllocator(const ArenaAllocator<U>& o) : arena(o.arena) {}
+
+  T* allocate(size_t n) {
+    if (arena) return static_cast<T*>(arena->Allocate(n * sizeof(T), alignof(T)));
+    return static_cast<T*>(::operator new(n * sizeof(T)));
+  }
+  void deallocate(T* p, size_t) {
+    if (!arena) ::operator delete(p);
+  }
+  ArenaAllocator select_on_container_copy_construction() const {
+    return ArenaAllocator();
+  }
+
+  Arena* arena;
+};
+
+template <typename T, typename U>
+inline bool operator==(const ArenaAllocator<T>& a, const ArenaAllocator<U>& b) {
+  return a.arena == b.arena;
+}
+
+template <typename T, typename U>
+inline bool operator!=(const ArenaAllocator<T>& a, const ArenaAllocator<U>& b) {
+  return a.arena != b.arena;
+}
+
+} // namespace HG
+
+#endif
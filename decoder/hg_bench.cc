@@ -0,0 +1,198 @@
+// measures how long it takes to read, build, topologically sort, reweight, run
+// Inside over and find the Viterbi derivation of forests read from JSON or binary
+// files (e.g. ones written by cdec --forest_output), and how much memory the forests use.
+// with -a, the forests are built in arena mode (see Hypergraph::UseArena); run
+// it with and without -a to compare the two.
+// with -k, also how long it takes to extract unique k-best lists with
+// KBestDerivations and StreamingKBest, and how much memory they use
+//   usage: hg_bench [-a] [-r repetitions] [-w weights] [-k size] forest.json.gz|forest.hg ...
+#include <sys/resource.h>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "filelib.h"
+#include "hg.h"
+#include "hg_features.h"
+#include "hg_io.h"
+#include "inside_outside.h"
+#include "kbest.h"
+#include "kbest_stream.h"
+#include "viterbi.h"
+#include "weights.h"
+
+using namespace std;
+
+static double Seconds(const chrono::steady_clock::time_point& start) {
+  return chrono::duration<double>(chrono::steady_clock::now() - start).count();
+}
+
+static long PeakRSSKb() {
+  struct rusage r;
+  getrusage(RUSAGE_SELF, &r);
+  return r.ru_maxrss;
+}
+
+// builds a copy of in the way forest rescoring builds forests: node by node,
+// filling in a candidate edge (rule, features, tails) and adding it to the
+// forest, without knowing the final size in advance
+static void Build(const Hypergraph& in, bool arena, Hypergraph* out) {
+  if (arena) out->UseArena();
+  for (unsigned i = 0; i < in.nodes_.size(); ++i) {
+    const Hypergraph::Node& node = in.nodes_[i];
+    Hypergraph::Node* new_node = out->AddNode(node.cat_);
+    for (unsigned j = 0; j < node.in_edges_.size(); ++j) {
+      const HG::Edge& edge = in.edges_[node.in_edges_[j]];
+      HG::Edge candidate(0, edge, edge.tail_nodes_);
+      candidate.edge_prob_ = edge.edge_prob_;
+      HG::Edge* new_edge = out->AddEdge(std::move(candidate));
+      out->ConnectEdgeToHeadNode(new_edge, new_node->id_);
+    }
+  }
+}
+
+int main(int argc, char** argv) {
+  bool arena = false;
+  int reps = 10;
+  int kbest_size = 0;
+  vector<string> files;
+  vector<weight_t> weights;
+  for (int i = 1; i < argc; ++i) {
+    if (!strcmp(argv[i], "-a"))
+      arena = true;
+    else if (!strcmp(argv[i], "-r") && i + 1 < argc)
+      reps = atoi(argv[++i]);
+    else if (!strcmp(argv[i], "-k") && i + 1 < argc)
+      kbest_size = atoi(argv[++i]);
+    else if (!strcmp(argv[i], "-w") && i + 1 < argc)
+      Weights::InitFromFile(argv[++i], &weights);
+    else
+      files.push_back(argv[i]);
+  }
+  if (files.empty()) {
+    cerr << "Usage: " << argv[0] << " [-a] [-r repetitions] [-w weights] [-k size] forest.json.gz|forest.hg ...\n";
+    return 1;
+  }
+
+  vector<Hypergraph> forests(files.size());
+  size_t nodes = 0, edges = 0;
+  chrono::steady_clock::time_point start = chrono::steady_clock::now();
+  for (unsigned i = 0; i < files.size(); ++i) {
+    if (!HypergraphIO::ReadFromFile(files[i], &forests[i])) {
+      cerr << "Failed to read forest from " << files[i] << endl;
+      return 1;
+    }
+  }
+  const double read = Seconds(start);
+  for (unsigned i = 0; i < files.size(); ++i) {
+    forests[i].Reweight(weights);
+    nodes += forests[i].nodes_.size();
+    edges += forests[i].edges_.size();
+  }
+  const long rss_loaded = PeakRSSKb();
+  cout << "forests: " << forests.size() << "  nodes: " << nodes << "  edges: " << edges
+       << "  repetitions: " << reps << "  mode: " << (arena ? "arena" : "heap") << endl;
+
+  double total = 0;
+  if (kbest_size > 0) {
+    // the streaming lists go first: both increases of the peak RSS are measured
+    // from the same starting point, which is right if they use less memory
+    const long rss_before = PeakRSSKb();
+    size_t streamed = 0;
+    start = chrono::steady_clock::now();
+    for (unsigned i = 0; i < forests.size(); ++i) {
+      KBest::StreamingKBest<> kbest(forests[i], kbest_size, true);
+      streamed += kbest.Stream([&](const vector<WordID>& yield, const SparseVector<double>&, const prob_t&) {
+        total += yield.size();
+        return true;
+      });
+    }
+    const double stream_time = Seconds(start);
+    const long rss_stream = PeakRSSKb();
+    size_t listed = 0;
+    start = chrono::steady_clock::now();
+    for (unsigned i = 0; i < forests.size(); ++i) {
+      typedef KBest::KBestDerivations<vector<WordID>, ESentenceTraversal, KBest::FilterUnique> K;
+      K kbest(forests[i], kbest_size);
+      for (int j = 0; j < kbest_size; ++j) {
+        const K::Derivation* d = kbest.LazyKthBest(forests[i].nodes_.size() - 1, j);
+        if (!d) break;
+        total += d->yield.size();
+        ++listed;
+      }
+    }
+    const double list_time = Seconds(start);
+    cout << "unique " << kbest_size << "-best: " << listed << " / " << streamed << " derivations" << endl
+         << "  KBestDerivations: " << list_time * 1000 << " ms, peak RSS +" << PeakRSSKb() - rss_before << " kB" << endl
+         << "  StreamingKBest:   " << stream_time * 1000 << " ms, peak RSS +" << rss_stream - rss_before << " kB" << endl;
+  }
+
+  // keep every copy alive so the peak RSS reflects the size of the forests
+  vector<Hypergraph> copies(reps * forests.size());
+  start = chrono::steady_clock::now();
+  for (int r = 0; r < reps; ++r)
+    for (unsigned i = 0; i < forests.size(); ++i)
+      Build(forests[i], arena, &copies[r * forests.size() + i]);
+  const double build = Seconds(start);
+  const long rss_built = PeakRSSKb();
+
+  // in arena mode, this also lays out the edge lists in node order
+  start = chrono::steady_clock::now();
+  for (unsigned i = 0; i < copies.size(); ++i)
+    copies[i].TopologicallySortNodesAndEdges(copies[i].nodes_.size() - 1);
+  const double sort = Seconds(start);
+  size_t arena_bytes = 0;
+  for (unsigned i = 0; i < copies.size(); ++i)
+    arena_bytes += copies[i].ArenaBytes();
+
+  start = chrono::steady_clock::now();
+  for (unsigned i = 0; i < copies.size(); ++i)
+    copies[i].Reweight(weights);
+  const double reweight = Seconds(start);
+
+  start = chrono::steady_clock::now();
+  vector<FlatEdgeFeatures> flat;
+  for (unsigned i = 0; i < copies.size(); ++i)
+    flat.push_back(FlatEdgeFeatures(copies[i]));
+  const double flatten = Seconds(start);
+  start = chrono::steady_clock::now();
+  for (unsigned i = 0; i < copies.size(); ++i)
+    flat[i].Reweight(weights, &copies[i]);
+  const double flat_reweight = Seconds(start);
+  flat.clear();
+
+  start = chrono::steady_clock::now();
+  for (unsigned i = 0; i < copies.size(); ++i)
+    total += log(Inside<prob_t, EdgeProb>(copies[i]));
+  const double inside = Seconds(start);
+
+  vector<WordID> trans;
+  start = chrono::steady_clock::now();
+  for (unsigned i = 0; i < copies.size(); ++i)
+    total += log(ViterbiESentence(copies[i], &trans));
+  const double viterbi = Seconds(start);
+
+  start = chrono::steady_clock::now();
+  copies.clear();
+  const double destroy = Seconds(start);
+
+  const double m = 1000.0 / reps;
+  cout << "reading:      " << read * 1000 << " ms (once)" << endl
+       << "construction: " << build * m << " ms/rep" << endl
+       << "topo sort:    " << sort * m << " ms/rep" << endl
+       << "destruction:  " << destroy * m << " ms/rep" << endl
+       << "Reweight:     " << reweight * m << " ms/rep" << endl
+       << "  flattening features: " << flatten * m << " ms/rep, Reweight from flat features: "
+       << flat_reweight * m << " ms/rep" << endl
+       << "Inside:       " << inside * m << " ms/rep" << endl
+       << "Viterbi:      " << viterbi * m << " ms/rep" << endl
+       << "peak RSS:     " << PeakRSSKb() << " kB (" << (rss_built - rss_loaded) / reps
+       << " kB per copy of the forests)" << endl;
+  if (arena)
+    cout << "arenas:       " << arena_bytes / 1024 / reps << " kB per copy of the forests" << endl;
+  cout << "checksum:     " << total << endl;
+  return 0;
+}
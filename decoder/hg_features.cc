@@ -0,0 +1,37 @@
+#include "hg_features.h"
+
+#include <cassert>
+
+#include "hg.h"
+#include "sparse_dot.h"
+
+using namespace std;
+
+FlatEdgeFeatures::FlatEdgeFeatures(const Hypergraph& hg) {
+  start_.reserve(hg.edges_.size() + 1);
+  start_.push_back(0);
+  for (unsigned i = 0; i < hg.edges_.size(); ++i) {
+    const SparseVector<double>& fv = hg.edges_[i].feature_values_;
+    for (SparseVector<double>::const_iterator it = fv.begin(); it != fv.end(); ++it) {
+      ids_.push_back(it->first);
+      values_.push_back(it->second);
+    }
+    start_.push_back(ids_.size());
+  }
+}
+
+void FlatEdgeFeatures::Score(const vector<double>& weights, vector<double>* scores) const {
+  scores->resize(NumEdges());
+  if (scores->empty()) return;
+  SparseDenseDots(&start_[0], NumEdges(), ids_.empty() ? NULL : &ids_[0],
+                  values_.empty() ? NULL : &values_[0],
+                  weights.empty() ? NULL : &weights[0], weights.size(), &(*scores)[0]);
+}
+
+void FlatEdgeFeatures::Reweight(const vector<double>& weights, Hypergraph* hg) const {
+  assert(hg->edges_.size() == NumEdges());
+  vector<double> scores;
+  Score(weights, &scores);
+  for (unsigned i = 0; i < scores.size(); ++i)
+    hg->edges_[i].edge_prob_.logeq(scores[i]);
+}
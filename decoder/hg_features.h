@@ -0,0 +1,40 @@
+#ifndef _HG_FEATURES_H_
+#define _HG_FEATURES_H_
+
+#include <vector>
+
+class Hypergraph;
+
+// the feature vectors of all edges of a hypergraph copied into flat arrays
+// (one row per edge, CSR layout), for scoring the same forest under many
+// different weight vectors. rescoring from the flat arrays avoids walking each
+// edge's (possibly hash map backed) SparseVector and uses SparseDenseDots,
+// which is vectorized on CPUs that support it.
+//
+// this is only worth it when a forest is rescored many times, and its only
+// user is kbest_cut_mira, which rescores the forest after every cutting plane
+// round. flattening costs about two Hypergraph::Reweight calls, so the paths
+// that score each edge once per call (Hypergraph::Reweight, the cube pruning
+// scoring in ModelSet, ViterbiFeatures) keep using SparseVector::dot.
+// the hypergraph's edges must not be added, removed or reordered while this
+// is in use.
+class FlatEdgeFeatures {
+ public:
+  explicit FlatEdgeFeatures(const Hypergraph& hg);
+
+  // like hg->Reweight(weights); the edge scores may differ from it in the
+  // last bits, since the products are added in a different order
+  void Reweight(const std::vector<double>& weights, Hypergraph* hg) const;
+
+  unsigned NumEdges() const { return start_.size() - 1; }
+
+ private:
+  // scores[i] = log score of edge i under weights
+  void Score(const std::vector<double>& weights, std::vector<double>* scores) const;
+
+  std::vector<unsigned> start_;  // features of edge i are in [start_[i], start_[i+1])
+  std::vector<unsigned> ids_;
+  std::vector<double> values_;
+};
+
+#endif
@@ -1,11 +1,19 @@
 #include "hg_io.h"
 
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <cstdint>
+#include <cstring>
 #include <fstream>
 #include <sstream>
 #include <iostream>
 
 #include "fast_lexical_cast.hpp"
 
+#include "fdict.h"
+#include "filelib.h"
 #include "tdict.h"
 #include "json_parse.h"
 #include "hg.h"
@@ -346,11 +354,415 @@ bool HypergraphIO::WriteToJSON(const Hypergraph& hg, bool remove_rules, ostream*
   return true;
 }
 
+// binary forests. all integers are in host byte order and every section
+// starts at a multiple of 8 bytes, so a mapped file is read in place:
+//   "cdecHGB1", uint64 counts: strings, string bytes, rules, rule symbols,
+//               rule features, rule alignment points, nodes, edges, tails,
+//               edge features
+//   uint64 string offsets[strings + 1], string bytes
+//   BinaryRule rules[], int32 symbols[], uint32 rule feature strings[],
+//   double rule feature values[], int16 alignment points[2 * points]
+//   BinaryNode nodes[], BinaryEdge edges[], uint32 tails[],
+//   uint32 edge feature strings[], double edge feature values[]
+// words, categories and feature names are indices into the string table,
+// so they do not depend on the ids TD and FD gave them when the forest was
+// written. in rules a word is +(index + 1), a nonterminal in the source is
+// -(index + 1) of its category and one in the target keeps its <= 0 value.
+// as in JSON, edges are numbered in the order of the nodes they go into, so
+// a node only needs to know how many it has. the symbols, features, tails
+// etc. of rule (edge) i follow those of rule (edge) i - 1.
+namespace {
+
+const char kBinaryMagic[8] = { 'c', 'd', 'e', 'c', 'H', 'G', 'B', '1' };
+enum { kStrings, kStringBytes, kRules, kSymbols, kRuleFeats, kAlignments,
+       kNodes, kEdges, kTails, kEdgeFeats, kNumCounts };
+
+struct BinaryRule {
+  int32_t lhs;  // category + 1, or 0
+  uint16_t f_len;
+  uint16_t e_len;
+  uint16_t num_feats;
+  uint16_t num_als;
+  uint16_t arity;
+  uint16_t unused;
+};
+
+struct BinaryNode {
+  int32_t cat;  // category + 1, or 0
+  uint32_t num_in_edges;
+};
+
+// most edges have all the features of their rule plus a few from stateful
+// models; those only store the extra features
+const uint16_t kHasRuleFeatures = 0x8000;
+
+struct BinaryEdge {
+  uint32_t rule;  // rule + 1, or 0
+  uint16_t num_tails;
+  uint16_t num_feats;  // | kHasRuleFeatures
+  int16_t i, j, prev_i, prev_j;
+};
+
+struct BinaryStrings {
+  BinaryStrings() : offsets(1, 0) {}
+  uint32_t Word(WordID w) {
+    map<WordID, uint32_t>::iterator it = words.find(w);
+    if (it != words.end()) return it->second;
+    return words[w] = Add(TD::Convert(w));
+  }
+  uint32_t Feature(int fid) {
+    map<int, uint32_t>::iterator it = feats.find(fid);
+    if (it != feats.end()) return it->second;
+    return feats[fid] = Add(FD::Convert(fid));
+  }
+  uint32_t Add(const string& s) {
+    data += s;
+    offsets.push_back(data.size());
+    return offsets.size() - 2;
+  }
+  map<WordID, uint32_t> words;
+  map<int, uint32_t> feats;
+  vector<uint64_t> offsets;
+  string data;
+};
+
+// the string table of a forest being read. strings are converted to word
+// and feature ids when they are first used
+struct MappedStrings {
+  MappedStrings(const uint64_t* o, const char* d, uint64_t n) :
+      offsets(o), data(d), words(n, 0), fids(n, -1) {}
+  WordID Word(uint64_t s) {
+    if (!words[s]) words[s] = TD::Convert(String(s));
+    return words[s];
+  }
+  int Feature(uint64_t s) {
+    if (fids[s] < 0) fids[s] = FD::Convert(String(s));
+    return fids[s];
+  }
+  string String(uint64_t s) const {
+    return string(data + offsets[s], offsets[s + 1] - offsets[s]);
+  }
+  const uint64_t* offsets;
+  const char* data;
+  vector<WordID> words;
+  vector<int> fids;
+};
+
+void WritePadded(const void* data, size_t bytes, ostream* out) {
+  static const char zeros[8] = { 0 };
+  if (bytes) out->write(static_cast<const char*>(data), bytes);
+  out->write(zeros, (8 - bytes % 8) % 8);
+}
+
+template <typename T>
+void WriteSection(const vector<T>& v, ostream* out) {
+  WritePadded(v.empty() ? NULL : &v[0], v.size() * sizeof(T), out);
+}
+
+template <typename T>
+bool ReadSection(const char* data, size_t size, size_t* pos, uint64_t n, const T** section) {
+  if (n > size / sizeof(T) || *pos + n * sizeof(T) > size) return false;
+  *section = reinterpret_cast<const T*>(data + *pos);
+  *pos += (n * sizeof(T) + 7) / 8 * 8;
+  return true;
+}
+
+// returns whether the edge has every (nonzero) feature of its rule
+bool HasRuleFeatures(const SparseVector<double>& feats, const TRule* rule) {
+  if (!rule || rule->scores_.empty()) return false;
+  for (SparseVector<double>::const_iterator it = rule->scores_.begin(); it != rule->scores_.end(); ++it)
+    if (!it->first || !it->second || feats.value(it->first) != it->second) return false;
+  return true;
+}
+
+}  // namespace
+
+bool HypergraphIO::WriteToBinary(const Hypergraph& hg, bool remove_rules, ostream* out) {
+  BinaryStrings strings;
+  map<const TRule*, uint32_t> rid;
+  vector<BinaryRule> rules;
+  vector<int32_t> symbols;
+  vector<uint32_t> rule_feats;
+  vector<double> rule_values;
+  vector<int16_t> als;
+  vector<BinaryNode> nodes(hg.nodes_.size());
+  vector<BinaryEdge> edges;
+  vector<uint32_t> tails;
+  vector<uint32_t> edge_feats;
+  vector<double> edge_values;
+  edges.reserve(hg.edges_.size());
+  for (unsigned n = 0; n < hg.nodes_.size(); ++n) {
+    const Hypergraph::Node& node = hg.nodes_[n];
+    nodes[n].cat = node.cat_ < 0 ? strings.Word(-node.cat_) + 1 : 0;
+    nodes[n].num_in_edges = node.in_edges_.size();
+    for (unsigned i = 0; i < node.in_edges_.size(); ++i) {
+      const Hypergraph::Edge& edge = hg.edges_[node.in_edges_[i]];
+      const TRule* r = remove_rules ? NULL : edge.rule_.get();
+      BinaryEdge be;
+      be.rule = 0;
+      if (r) {
+        uint32_t& id = rid[r];
+        if (!id) {
+          if (r->f_.size() > 0xffff || r->e_.size() > 0xffff || r->a_.size() > 0xffff ||
+              r->scores_.size() > 0xffff) {
+            cerr << "WriteToBinary: rule too large: " << r->AsString() << endl;
+            return false;
+          }
+          BinaryRule br;
+          br.lhs = r->lhs_ ? strings.Word(-r->lhs_) + 1 : 0;
+          br.f_len = r->f_.size();
+          br.e_len = r->e_.size();
+          for (unsigned k = 0; k < r->f_.size(); ++k) {
+            const WordID w = r->f_[k];
+            symbols.push_back(w > 0 ? strings.Word(w) + 1 : (w < 0 ? -static_cast<int32_t>(strings.Word(-w)) - 1 : 0));
+          }
+          for (unsigned k = 0; k < r->e_.size(); ++k) {
+            const WordID w = r->e_[k];
+            symbols.push_back(w > 0 ? strings.Word(w) + 1 : w);
+          }
+          br.num_feats = 0;
+          for (SparseVector<double>::const_iterator it = r->scores_.begin(); it != r->scores_.end(); ++it) {
+            if (!it->first) continue;  // if the feature set was frozen this might happen
+            rule_feats.push_back(strings.Feature(it->first));
+            rule_values.push_back(it->second);
+            ++br.num_feats;
+          }
+          br.num_als = r->a_.size();
+          for (unsigned k = 0; k < r->a_.size(); ++k) {
+            als.push_back(r->a_[k].s_);
+            als.push_back(r->a_[k].t_);
+          }
+          br.arity = r->arity_;
+          br.unused = 0;
+          rules.push_back(br);
+          id = rules.size();
+        }
+        be.rule = id;
+      }
+      const bool has_rule_features = HasRuleFeatures(edge.feature_values_, r);
+      unsigned num_feats = 0;
+      for (SparseVector<double>::const_iterator it = edge.feature_values_.begin(); it != edge.feature_values_.end(); ++it) {
+        if (!it->first) continue;
+        if (has_rule_features && r->scores_.value(it->first) == it->second) continue;
+        edge_feats.push_back(strings.Feature(it->first));
+        edge_values.push_back(it->second);
+        ++num_feats;
+      }
+      if (edge.tail_nodes_.size() > 0xffff || num_feats >= kHasRuleFeatures) {
+        cerr << "WriteToBinary: edge " << edge.id_ << " has too many tail nodes or features\n";
+        return false;
+      }
+      be.num_feats = num_feats | (has_rule_features ? kHasRuleFeatures : 0);
+      be.num_tails = edge.tail_nodes_.size();
+      for (unsigned k = 0; k < edge.tail_nodes_.size(); ++k)
+        tails.push_back(edge.tail_nodes_[k]);
+      be.i = edge.i_;
+      be.j = edge.j_;
+      be.prev_i = edge.prev_i_;
+      be.prev_j = edge.prev_j_;
+      edges.push_back(be);
+    }
+  }
+
+  uint64_t counts[kNumCounts];
+  counts[kStrings] = strings.offsets.size() - 1;
+  counts[kStringBytes] = strings.data.size();
+  counts[kRules] = rules.size();
+  counts[kSymbols] = symbols.size();
+  counts[kRuleFeats] = rule_feats.size();
+  counts[kAlignments] = als.size() / 2;
+  counts[kNodes] = nodes.size();
+  counts[kEdges] = edges.size();
+  counts[kTails] = tails.size();
+  counts[kEdgeFeats] = edge_feats.size();
+  out->write(kBinaryMagic, sizeof(kBinaryMagic));
+  out->write(reinterpret_cast<const char*>(counts), sizeof(counts));
+  WriteSection(strings.offsets, out);
+  WritePadded(strings.data.data(), strings.data.size(), out);
+  WriteSection(rules, out);
+  WriteSection(symbols, out);
+  WriteSection(rule_feats, out);
+  WriteSection(rule_values, out);
+  WriteSection(als, out);
+  WriteSection(nodes, out);
+  WriteSection(edges, out);
+  WriteSection(tails, out);
+  WriteSection(edge_feats, out);
+  WriteSection(edge_values, out);
+  return out->good();
+}
+
+bool HypergraphIO::IsBinary(const char* data, size_t size) {
+  return size >= sizeof(kBinaryMagic) && !memcmp(data, kBinaryMagic, sizeof(kBinaryMagic));
+}
+
+#define BAD_FOREST(what) { cerr << "ReadFromBinary: bad " << what << endl; hg->clear(); return false; }
+
+bool HypergraphIO::ReadFromBinary(const char* data, size_t size, Hypergraph* hg) {
+  hg->clear();
+  if (reinterpret_cast<uintptr_t>(data) % 8) {
+    vector<uint64_t> aligned(size / 8 + 1);
+    memcpy(&aligned[0], data, size);
+    return ReadFromBinary(reinterpret_cast<const char*>(&aligned[0]), size, hg);
+  }
+  uint64_t counts[kNumCounts];
+  if (!IsBinary(data, size) || size < sizeof(kBinaryMagic) + sizeof(counts)) {
+    cerr << "ReadFromBinary: not a binary forest\n";
+    return false;
+  }
+  memcpy(counts, data + sizeof(kBinaryMagic), sizeof(counts));
+  size_t pos = sizeof(kBinaryMagic) + sizeof(counts);
+  const uint64_t* offsets;
+  const char* string_data;
+  const BinaryRule* rules;
+  const int32_t* symbols;
+  const uint32_t* rule_feats;
+  const double* rule_values;
+  const int16_t* als;
+  const BinaryNode* nodes;
+  const BinaryEdge* edges;
+  const uint32_t* tails;
+  const uint32_t* edge_feats;
+  const double* edge_values;
+  if (!ReadSection(data, size, &pos, counts[kStrings] + 1, &offsets) ||
+      !ReadSection(data, size, &pos, counts[kStringBytes], &string_data) ||
+      !ReadSection(data, size, &pos, counts[kRules], &rules) ||
+      !ReadSection(data, size, &pos, counts[kSymbols], &symbols) ||
+      !ReadSection(data, size, &pos, counts[kRuleFeats], &rule_feats) ||
+      !ReadSection(data, size, &pos, counts[kRuleFeats], &rule_values) ||
+      !ReadSection(data, size, &pos, counts[kAlignments] * 2, &als) ||
+      !ReadSection(data, size, &pos, counts[kNodes], &nodes) ||
+      !ReadSection(data, size, &pos, counts[kEdges], &edges) ||
+      !ReadSection(data, size, &pos, counts[kTails], &tails) ||
+      !ReadSection(data, size, &pos, counts[kEdgeFeats], &edge_feats) ||
+      !ReadSection(data, size, &pos, counts[kEdgeFeats], &edge_values)) {
+    cerr << "ReadFromBinary: truncated forest\n";
+    return false;
+  }
+  const uint64_t num_strings = counts[kStrings];
+  for (uint64_t i = 0; i < num_strings; ++i)
+    if (offsets[i] > offsets[i + 1] || offsets[i + 1] > counts[kStringBytes])
+      BAD_FOREST("string table");
+  MappedStrings strings(offsets, string_data, num_strings);
+
+  vector<TRulePtr> rule_ptrs(counts[kRules]);
+  vector<WordID> f, e;
+  vector<int> feat_ids;
+  vector<AlignmentPoint> a;
+  uint64_t symbol = 0, feat = 0, al = 0;
+  for (uint64_t i = 0; i < counts[kRules]; ++i) {
+    const BinaryRule& br = rules[i];
+    if (br.lhs < 0 || br.lhs > num_strings || symbol + br.f_len + br.e_len > counts[kSymbols] ||
+        feat + br.num_feats > counts[kRuleFeats] || al + br.num_als > counts[kAlignments])
+      BAD_FOREST("rule " << i);
+    f.resize(br.f_len);
+    e.resize(br.e_len);
+    for (unsigned k = 0; k < br.f_len + br.e_len; ++k, ++symbol) {
+      const int32_t s = symbols[symbol];
+      if (s > static_cast<int64_t>(num_strings) || (k < br.f_len && -s > static_cast<int64_t>(num_strings)))
+        BAD_FOREST("symbol in rule " << i);
+      if (k < br.f_len)
+        f[k] = s > 0 ? strings.Word(s - 1) : (s < 0 ? -strings.Word(-s - 1) : 0);
+      else
+        e[k - br.f_len] = s > 0 ? strings.Word(s - 1) : s;
+    }
+    feat_ids.resize(br.num_feats);
+    for (unsigned k = 0; k < br.num_feats; ++k) {
+      if (rule_feats[feat + k] >= num_strings) BAD_FOREST("feature in rule " << i);
+      feat_ids[k] = strings.Feature(rule_feats[feat + k]);
+    }
+    a.resize(br.num_als);
+    for (unsigned k = 0; k < br.num_als; ++k, ++al)
+      a[k] = AlignmentPoint(als[2 * al], als[2 * al + 1]);
+    rule_ptrs[i].reset(new TRule(br.lhs ? -strings.Word(br.lhs - 1) : 0,
+                                 f.empty() ? NULL : &f[0], f.size(),
+                                 e.empty() ? NULL : &e[0], e.size(),
+                                 feat_ids.empty() ? NULL : &feat_ids[0],
+                                 br.num_feats ? &rule_values[feat] : NULL, br.num_feats,
+                                 br.arity, a.empty() ? NULL : &a[0], a.size()));
+    feat += br.num_feats;
+  }
+
+  hg->ReserveNodes(counts[kNodes], counts[kEdges]);
+  SmallVectorUnsigned tail;
+  uint64_t edge = 0, t = 0;
+  feat = 0;
+  for (uint64_t n = 0; n < counts[kNodes]; ++n) {
+    const BinaryNode& node = nodes[n];
+    if (node.cat < 0 || node.cat > num_strings || edge + node.num_in_edges > counts[kEdges])
+      BAD_FOREST("node " << n);
+    hg->AddNode(node.cat ? -strings.Word(node.cat - 1) : 0);
+    for (unsigned i = 0; i < node.num_in_edges; ++i, ++edge) {
+      const BinaryEdge& be = edges[edge];
+      const unsigned num_feats = be.num_feats & ~kHasRuleFeatures;
+      if (be.rule > counts[kRules] || t + be.num_tails > counts[kTails] ||
+          feat + num_feats > counts[kEdgeFeats] || (!be.rule && (be.num_feats & kHasRuleFeatures)))
+        BAD_FOREST("edge " << edge);
+      tail.resize(be.num_tails);
+      for (unsigned k = 0; k < be.num_tails; ++k, ++t) {
+        tail[k] = tails[t];
+        if (tail[k] >= n) BAD_FOREST("tail node in edge " << edge);
+      }
+      Hypergraph::Edge* new_edge = hg->AddEdge(be.rule ? rule_ptrs[be.rule - 1] : TRulePtr(), tail);
+      if (be.num_feats & kHasRuleFeatures)
+        new_edge->feature_values_ = new_edge->rule_->scores_;
+      for (unsigned k = 0; k < num_feats; ++k, ++feat) {
+        if (edge_feats[feat] >= num_strings) BAD_FOREST("feature in edge " << edge);
+        const int fid = strings.Feature(edge_feats[feat]);
+        if (fid) new_edge->feature_values_.set_value(fid, edge_values[feat]);
+      }
+      new_edge->i_ = be.i;
+      new_edge->j_ = be.j;
+      new_edge->prev_i_ = be.prev_i;
+      new_edge->prev_j_ = be.prev_j;
+      hg->ConnectEdgeToHeadNode(new_edge, n);
+    }
+  }
+  return true;
+}
+
+#undef BAD_FOREST
+
+bool HypergraphIO::ReadFromFile(const string& fname, Hypergraph* hg) {
+  // uncompressed binary forests are mapped instead of copied
+  if (fname != "-" && !(fname.size() > 3 && fname.compare(fname.size() - 3, 3, ".gz") == 0)) {
+    const int fd = open(fname.c_str(), O_RDONLY);
+    struct stat st;
+    if (fd >= 0 && fstat(fd, &st) == 0 && st.st_size >= static_cast<off_t>(sizeof(kBinaryMagic))) {
+      void* data = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+      if (data != MAP_FAILED) {
+        const bool binary = IsBinary(static_cast<const char*>(data), st.st_size);
+        const bool success = binary && ReadFromBinary(static_cast<const char*>(data), st.st_size, hg);
+        munmap(data, st.st_size);
+        if (binary) {
+          close(fd);
+          return success;
+        }
+      }
+    }
+    if (fd >= 0) close(fd);
+  }
+  ReadFile rf(fname);
+  istream& in = *rf.stream();
+  if (in.peek() == kBinaryMagic[0]) {  // JSON forests start with '{'
+    vector<uint64_t> data;
+    size_t size = 0;
+    while (in) {
+      data.resize(data.size() + 1 + data.size() / 2);
+      in.read(reinterpret_cast<char*>(&data[0]) + size, data.size() * sizeof(uint64_t) - size);
+      size += in.gcount();
+    }
+    return ReadFromBinary(reinterpret_cast<const char*>(&data[0]), size, hg);
+  }
+  return ReadFromJSON(&in, hg);
+}
+
 bool needs_escape[128];
-void InitEscapes() {
+bool InitEscapes() {
   memset(needs_escape, false, 128);
   needs_escape[static_cast<size_t>('\'')] = true;
   needs_escape[static_cast<size_t>('\\')] = true;
+  return true;
 }
 
 string HypergraphIO::Escape(const string& s) {
@@ -373,8 +785,8 @@ string HypergraphIO::Escape(const string& s) {
 }
 
 string HypergraphIO::AsPLF(const Hypergraph& hg, bool include_global_parentheses) {
-  static bool first = true;
-  if (first) { InitEscapes(); first = false; }
+  static const bool escapes_ready = InitEscapes();  // thread-safe one-time init
+  (void) escapes_ready;
   if (hg.nodes_.empty()) return "()";
   ostringstream os;
   if (include_global_parentheses) os << '(';
@@ -404,8 +816,8 @@ string HypergraphIO::AsPLF(const Hypergraph& hg, bool include_global_parentheses
 }
 
 string HypergraphIO::AsPLF(const Lattice& lat, bool include_global_parentheses) {
-  static bool first = true;
-  if (first) { InitEscapes(); first = false; }
+  static const bool escapes_ready = InitEscapes();  // thread-safe one-time init
+  (void) escapes_ready;
   if (lat.empty()) return "()";
   ostringstream os;
   if (include_global_parentheses) os << '(';
@@ -22,6 +22,18 @@ struct HypergraphIO {
   // (so it only contains structure and feature information)
   static bool WriteToJSON(const Hypergraph& hg, bool remove_rules, std::ostream* out);
 
+  // compact binary format: a string table (words, categories and feature
+  // names) followed by packed arrays of rules, nodes and edges that are read
+  // in place, without parsing (see hg_io.cc). unlike JSON it keeps nodes
+  // without a category and feature values exactly
+  static bool WriteToBinary(const Hypergraph& hg, bool remove_rules, std::ostream* out);
+  static bool ReadFromBinary(const char* data, size_t size, Hypergraph* out);
+  static bool IsBinary(const char* data, size_t size);
+
+  // reads a forest in either format from a file (or - for STDIN). binary
+  // forests in uncompressed files are memory mapped
+  static bool ReadFromFile(const std::string& fname, Hypergraph* out);
+
   static void WriteAsCFG(const Hypergraph& hg);
 
   // Write only the target size information in bottom-up order.  
@@ -1,15 +1,19 @@
 #define BOOST_TEST_MODULE hg_test
 #include <boost/test/unit_test.hpp>
 #include <boost/test/floating_point_comparison.hpp>
+#include <cstring>
 #include <iostream>
 #include "tdict.h"
 
 #include "json_parse.h"
+#include "hg_features.h"
 #include "hg_intersect.h"
 #include "hg_union.h"
 #include "viterbi.h"
 #include "kbest.h"
+#include "kbest_stream.h"
 #include "inside_outside.h"
+#include "ffset.h"
 
 #include "hg_test.h"
 
@@ -360,6 +364,32 @@ BOOST_AUTO_TEST_CASE(Small) {
   BOOST_CHECK_CLOSE(2.1431036, log(c2), 1e-4);
 }
 
+BOOST_AUTO_TEST_CASE(FlatFeatures) {
+  Hypergraph hg;
+  std::string path(boost::unit_test::framework::master_test_suite().argc == 2 ? boost::unit_test::framework::master_test_suite().argv[1] : TEST_DATA);
+  CreateSmallHG(&hg, path);
+  SparseVector<double> wts;
+  for (int i = 0; i < 8; ++i) {
+    ostringstream os;
+    os << "Model_" << i;
+    wts.set_value(FD::Convert(os.str()), 0.3 * i - 1.0);
+  }
+  vector<double> dense;
+  wts.init_vector(&dense);
+  dense.pop_back();  // features with ids past the end of the weights are skipped
+  Hypergraph hg2(hg);
+  hg.Reweight(dense);
+  FlatEdgeFeatures flat(hg2);
+  BOOST_CHECK_EQUAL(flat.NumEdges(), hg.edges_.size());
+  flat.Reweight(dense, &hg2);
+  for (unsigned i = 0; i < hg.edges_.size(); ++i)
+    BOOST_CHECK_CLOSE(log(hg.edges_[i].edge_prob_), log(hg2.edges_[i].edge_prob_), 1e-9);
+  vector<WordID> t1, t2;
+  ViterbiESentence(hg, &t1);
+  ViterbiESentence(hg2, &t2);
+  BOOST_CHECK_EQUAL(TD::GetString(t1), TD::GetString(t2));
+}
+
 BOOST_AUTO_TEST_CASE(JSONTest) {
   ostringstream os;
   JSONParser::WriteEscapedString("\"I don't know\", she said.", &os);
@@ -405,4 +435,184 @@ BOOST_AUTO_TEST_CASE(TestReadWriteHG) {
   BOOST_CHECK_EQUAL(hg2.edges_.back().prev_i_, 99);
 }
 
+BOOST_AUTO_TEST_CASE(TestReadWriteBinaryHG) {
+  Hypergraph hg, hg2;
+  std::string path(boost::unit_test::framework::master_test_suite().argc == 2 ? boost::unit_test::framework::master_test_suite().argv[1] : TEST_DATA);
+  CreateSmallHG(&hg, path);
+  hg.edges_.front().j_ = 23;
+  hg.edges_.back().prev_i_ = 99;
+  ostringstream os;
+  BOOST_CHECK(HypergraphIO::WriteToBinary(hg, false, &os));
+  const string data = os.str();
+  BOOST_CHECK(HypergraphIO::IsBinary(data.data(), data.size()));
+  BOOST_CHECK(HypergraphIO::ReadFromBinary(data.data(), data.size(), &hg2));
+  BOOST_CHECK_EQUAL(hg2.nodes_.size(), hg.nodes_.size());
+  BOOST_REQUIRE_EQUAL(hg2.edges_.size(), hg.edges_.size());
+  BOOST_CHECK_EQUAL(hg2.NumberOfPaths(), hg.NumberOfPaths());
+  for (unsigned i = 0; i < hg.nodes_.size(); ++i) {
+    BOOST_CHECK_EQUAL(hg2.nodes_[i].cat_, hg.nodes_[i].cat_);
+    BOOST_CHECK(hg2.nodes_[i].in_edges_ == hg.nodes_[i].in_edges_);
+  }
+  for (unsigned i = 0; i < hg.edges_.size(); ++i) {
+    const Hypergraph::Edge& e = hg.edges_[i];
+    const Hypergraph::Edge& e2 = hg2.edges_[i];
+    BOOST_CHECK_EQUAL(e2.head_node_, e.head_node_);
+    BOOST_CHECK(e2.tail_nodes_ == e.tail_nodes_);
+    BOOST_CHECK(e2.feature_values_ == e.feature_values_);
+    BOOST_CHECK_EQUAL(e2.rule_->AsString(), e.rule_->AsString());
+    BOOST_CHECK_EQUAL(e2.i_, e.i_);
+    BOOST_CHECK_EQUAL(e2.j_, e.j_);
+    BOOST_CHECK_EQUAL(e2.prev_i_, e.prev_i_);
+    BOOST_CHECK_EQUAL(e2.prev_j_, e.prev_j_);
+  }
+  // binary data that does not start at an aligned address is copied first
+  string shifted = " " + data;
+  Hypergraph hg3;
+  BOOST_CHECK(HypergraphIO::ReadFromBinary(shifted.data() + 1, data.size(), &hg3));
+  BOOST_CHECK_EQUAL(hg3.edges_.size(), hg.edges_.size());
+  // truncated data is rejected
+  BOOST_CHECK(!HypergraphIO::ReadFromBinary(data.data(), data.size() - 8, &hg3));
+  BOOST_CHECK(hg3.empty());
+}
+
+// checks that StreamingKBest lists the same derivations as KBestDerivations
+template <class Filter>
+static void CheckStreamingKBest(const Hypergraph& hg, unsigned k, bool unique) {
+  KBest::KBestDerivations<vector<WordID>, ESentenceTraversal, Filter> kbest(hg, k);
+  KBest::StreamingKBest<> streaming(hg, k, unique);
+  unsigned i = 0;
+  const unsigned n = streaming.Stream([&](const vector<WordID>& yield, const SparseVector<double>& feats, const prob_t& score) {
+    const typename KBest::KBestDerivations<vector<WordID>, ESentenceTraversal, Filter>::Derivation* d =
+      kbest.LazyKthBest(hg.nodes_.size() - 1, i++);
+    BOOST_REQUIRE(d);
+    BOOST_CHECK(yield == d->yield);
+    BOOST_CHECK(feats == d->feature_values);
+    BOOST_CHECK_EQUAL(log(score), log(d->score));
+    return true;
+  });
+  BOOST_CHECK_EQUAL(n, i);
+  BOOST_CHECK(n == k || !kbest.LazyKthBest(hg.nodes_.size() - 1, n));
+}
+
+BOOST_AUTO_TEST_CASE(TestStreamingKBest) {
+  Hypergraph hg;
+  std::string path(boost::unit_test::framework::master_test_suite().argc == 2 ? boost::unit_test::framework::master_test_suite().argv[1] : TEST_DATA);
+  CreateSmallHG(&hg, path);
+  SparseVector<double> wts;
+  istringstream ws(small_wts);
+  string name;
+  double value;
+  while (ws >> name >> value) wts.set_value(FD::Convert(name), value);
+  hg.Reweight(wts);
+  CheckStreamingKBest<KBest::NoFilter<vector<WordID> > >(hg, 500, false);
+  CheckStreamingKBest<KBest::FilterUnique>(hg, 500, true);
+  CheckStreamingKBest<KBest::FilterUnique>(hg, 3, true);
+  Hypergraph balanced;
+  CreateHGBalanced(&balanced);
+  vector<double> w(1); w[0] = 0;
+  balanced.Reweight(w);
+  CheckStreamingKBest<KBest::NoFilter<vector<WordID> > >(balanced, 100000, false);
+  CheckStreamingKBest<KBest::FilterUnique>(balanced, 100000, true);
+
+  // the callback stops the search
+  KBest::StreamingKBest<> streaming(hg, 500, true);
+  unsigned calls = 0;
+  BOOST_CHECK_EQUAL(streaming.Stream([&](const vector<WordID>&, const SparseVector<double>&, const prob_t&) {
+    return ++calls < 3;
+  }), 3u);
+  BOOST_CHECK_EQUAL(calls, 3u);
+}
+
+// a forest built in arena mode is the same forest, with its edge lists laid
+// out one after another once it is sorted
+BOOST_AUTO_TEST_CASE(TestArena) {
+  Hypergraph hg;
+  std::string path(boost::unit_test::framework::master_test_suite().argc == 2 ? boost::unit_test::framework::master_test_suite().argv[1] : TEST_DATA);
+  CreateSmallHG(&hg, path);
+  SparseVector<double> wts;
+  istringstream ws(small_wts);
+  string name;
+  double value;
+  while (ws >> name >> value) wts.set_value(FD::Convert(name), value);
+  hg.Reweight(wts);
+
+  Hypergraph copy;
+  {
+    Hypergraph arena;
+    arena.UseArena();
+    // nodes in reverse order, so sorting has to move everything
+    vector<int> node_map(hg.nodes_.size());
+    for (int i = hg.nodes_.size() - 1; i >= 0; --i)
+      node_map[i] = arena.AddNode(hg.nodes_[i].cat_)->id_;
+    for (unsigned i = 0; i < hg.edges_.size(); ++i) {
+      const HG::Edge& edge = hg.edges_[i];
+      HG::Edge e(0, edge);
+      e.feature_values_ = edge.feature_values_;
+      e.edge_prob_ = edge.edge_prob_;
+      for (unsigned j = 0; j < edge.tail_nodes_.size(); ++j)
+        e.tail_nodes_.push_back(node_map[edge.tail_nodes_[j]]);
+      arena.ConnectEdgeToHeadNode(arena.AddEdge(std::move(e)), node_map[edge.head_node_]);
+    }
+    BOOST_CHECK(arena.UsesArena());
+    BOOST_CHECK(arena.ArenaBytes() > 0);
+    arena.TopologicallySortNodesAndEdges(node_map[hg.nodes_.size() - 1]);
+    BOOST_REQUIRE_EQUAL(arena.nodes_.size(), hg.nodes_.size());
+    BOOST_REQUIRE_EQUAL(arena.edges_.size(), hg.edges_.size());
+    BOOST_CHECK_CLOSE(log(Inside<prob_t, EdgeProb>(arena)), log(Inside<prob_t, EdgeProb>(hg)), 1e-9);
+    vector<WordID> trans, arena_trans;
+    BOOST_CHECK_CLOSE(log(ViterbiESentence(arena, &arena_trans)), log(ViterbiESentence(hg, &trans)), 1e-9);
+    BOOST_CHECK(trans == arena_trans);
+
+    // CSR layout: all in edge lists, then all out edge lists
+    size_t total = 0;
+    const int* next = NULL;
+    for (unsigned i = 0; i < arena.nodes_.size(); ++i) {
+      const Hypergraph::EdgesVector& in = arena.nodes_[i].in_edges_;
+      if (in.empty()) continue;
+      if (next) BOOST_CHECK(in.data() == next);
+      next = in.data() + in.size();
+      total += in.size() * sizeof(int);
+    }
+    for (unsigned i = 0; i < arena.nodes_.size(); ++i) {
+      const Hypergraph::EdgesVector& out = arena.nodes_[i].out_edges_;
+      if (out.empty()) continue;
+      BOOST_CHECK(out.data() == next);
+      next = out.data() + out.size();
+      total += out.size() * sizeof(int);
+    }
+    BOOST_CHECK_EQUAL(arena.ArenaBytes(), total);
+    copy = arena;
+  }
+  // the copy outlives the forest it was copied from
+  vector<WordID> trans, copy_trans;
+  BOOST_CHECK_CLOSE(log(ViterbiESentence(copy, &copy_trans)), log(ViterbiESentence(hg, &trans)), 1e-9);
+  BOOST_CHECK(trans == copy_trans);
+  copy.clear();
+  BOOST_CHECK(copy.UsesArena());
+  BOOST_CHECK_EQUAL(copy.ArenaBytes(), 0);
+}
+
+
+// states get dense ids again after Clear, also in a table that has grown
+BOOST_AUTO_TEST_CASE(TestFFStateInterner) {
+  FFStateInterner states(sizeof(uint32_t));
+  for (int round = 0; round < 3; ++round) {
+    const uint32_t n = round == 1 ? 1000 : 10;
+    for (uint32_t k = 0; k < n; ++k) {
+      const uint32_t x = k * 7 + round;
+      const uint8_t* bytes = reinterpret_cast<const uint8_t*>(&x);
+      // a poor signature, so that many states share one
+      BOOST_CHECK_EQUAL(states.Intern(bytes, k % 3), k);
+    }
+    BOOST_CHECK_EQUAL(states.size(), n);
+    for (uint32_t k = 0; k < n; ++k) {
+      const uint32_t x = k * 7 + round;
+      BOOST_CHECK_EQUAL(states.Intern(reinterpret_cast<const uint8_t*>(&x), k % 3), k);
+      BOOST_CHECK(!memcmp(states.Get(k), &x, sizeof(x)));
+    }
+    states.Clear();
+    BOOST_CHECK_EQUAL(states.size(), 0);
+  }
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -4,7 +4,7 @@
 #include "fdict.h"
 #include "tdict.h"
 
-#include "lm/enumerate_vocab.hh"
+#include "klm_registry.h"
 #include "lm/model.hh"
 #include "search/applied.hh"
 #include "search/config.hh"
@@ -24,31 +24,12 @@
 
 namespace {
 
-struct MapVocab : public lm::EnumerateVocab {
-  public:
-    MapVocab() {}
-
-    // Do not call after Lookup.  
-    void Add(lm::WordIndex index, const StringPiece &str) {
-      const WordID cdec_id = TD::Convert(str.as_string());
-      if (cdec_id >= out_.size()) out_.resize(cdec_id + 1);
-      out_[cdec_id] = index;
-    }
-
-    // Assumes Add has been called and will never be called again.  
-    lm::WordIndex FromCDec(WordID id) const {
-      return out_[out_.size() > id ? id : 0];
-    }
-
-  private:
-    std::vector<lm::WordIndex> out_;
-};
-
 template <class Model> class Incremental : public IncrementalBase {
   public:
     Incremental(const char *model_file, const std::vector<weight_t> &weights) :
       IncrementalBase(weights), 
-      m_(model_file, GetConfig()),
+      lm_model_(SharedKLM<Model>::Get(model_file, false)),
+      m_(lm_model_->model()),
       lm_(weights[FD::Convert("KLanguageModel")]),
       oov_(weights[FD::Convert("KLanguageModel_OOV")]),
       word_penalty_(weights[FD::Convert("WordPenalty")]) {
@@ -60,15 +41,9 @@ template <class Model> class Incremental : public IncrementalBase {
   private:
     void ConvertEdge(const search::Context<Model> &context, search::Vertex *vertices, const Hypergraph::Edge &in, search::EdgeGenerator &gen) const;
 
-    lm::ngram::Config GetConfig() {
-      lm::ngram::Config ret;
-      ret.enumerate_vocab = &vocab_;
-      return ret;
-    }
-
-    MapVocab vocab_;
-
-    const Model m_;
+    // shared with KLanguageModel features that use the same file
+    const boost::shared_ptr<SharedKLM<Model> > lm_model_;
+    const Model &m_;
 
     const float lm_, oov_, word_penalty_;
 };
@@ -125,7 +100,7 @@ template <class Model> void Incremental<Model>::ConvertEdge(const search::Contex
       words.push_back(lm::kMaxWordIndex);
     } else {
       ++terminals;
-      words.push_back(vocab_.FromCDec(*word));
+      words.push_back(lm_model_->MapWord(*word));
     }
   }
 
@@ -0,0 +1,295 @@
+#ifndef _KBEST_STREAM_H_
+#define _KBEST_STREAM_H_
+
+// lazy k-best extraction of target strings, with the same results as
+// KBest::KBestDerivations<vector<WordID>, ESentenceTraversal> (with
+// FilterUnique if unique is set) but much less memory for large k:
+//  - derivations are kept in one pool and store only their edge, the ranks of
+//    their antecedents and their score. strings and feature vectors are only
+//    put together (by walking the derivation) for the derivations that are
+//    returned
+//  - unique strings are found by comparing 64 bit fingerprints, which are
+//    computed from the fingerprints of the antecedents' strings, so no strings
+//    are built or stored to filter duplicates. two different strings with the
+//    same fingerprint (about 1 in 2^61 per pair) would make the second one be
+//    treated as a duplicate
+//  - derivations are passed to a callback as soon as they are found, and the
+//    callback can stop the search
+//
+//   KBest::StreamingKBest<> kbest(hg, 1500, true);
+//   kbest.Stream([&](const vector<WordID>& yield, const SparseVector<double>& feats,
+//                    const prob_t& score) { ...; return true; });
+
+#include <algorithm>
+#include <cassert>
+#include <vector>
+#include <stdint.h>
+#ifndef HAVE_OLD_CPP
+# include <unordered_set>
+#else
+# include <tr1/unordered_set>
+namespace std { using std::tr1::unordered_set; }
+#endif
+
+#include "hg.h"
+#include "sparse_vector.h"
+#include "wordid.h"
+
+namespace KBest {
+
+template <typename WeightType = prob_t, typename WeightFunction = EdgeProb>
+class StreamingKBest {
+ public:
+  StreamingKBest(const Hypergraph& hg,
+                 const unsigned k,
+                 const bool unique,
+                 const WeightFunction& wf = WeightFunction()) :
+      g_(hg), w_(wf), k_(k), unique_(unique), nodes_(hg.nodes_.size()),
+      seen_(16, RanksHash(this), RanksEquals(this)), powers_(1, 1) {
+    // derivation 0 is only used to look up (edge, ranks) pairs in seen_
+    derivs_.push_back(Derivation());
+  }
+
+  // calls f(yield, features, score) for each of the k best derivations of
+  // the goal node, best first, until f returns false. returns the number of
+  // derivations passed to f
+  template <class Callback>
+  unsigned Stream(Callback f) {
+    if (g_.nodes_.empty()) return 0;
+    std::vector<WordID> yield;
+    for (unsigned i = 0; i < k_; ++i) {
+      const int d = LazyKthBest(g_.nodes_.size() - 1, i);
+      if (d < 0) return i;
+      yield.clear();
+      AppendYield(d, &yield);
+      if (!f(yield, Features(d), derivs_[d].score)) return i + 1;
+    }
+    return k_;
+  }
+
+ private:
+  StreamingKBest(const StreamingKBest&);
+  void operator=(const StreamingKBest&);
+
+  struct Derivation {
+    const HG::Edge* edge;
+    unsigned ranks;        // offset of the ranks of its antecedents in ranks_
+    WeightType score;
+    uint64_t fingerprint;  // of its string, only set if unique_
+    unsigned length;       // of its string, only set if unique_
+  };
+
+  struct NodeState {
+    NodeState() : initialized(false) {}
+    bool initialized;
+    std::vector<unsigned> cand;  // heap of derivations
+    std::vector<unsigned> D;     // derivations found so far, best first
+    std::unordered_set<uint64_t> fingerprints;
+  };
+
+  struct HeapCompare {
+    explicit HeapCompare(const std::vector<Derivation>& d) : derivs(d) {}
+    bool operator()(unsigned a, unsigned b) const { return derivs[a].score < derivs[b].score; }
+    const std::vector<Derivation>& derivs;
+  };
+  struct DerivationCompare {
+    explicit DerivationCompare(const std::vector<Derivation>& d) : derivs(d) {}
+    bool operator()(unsigned a, unsigned b) const { return derivs[a].score > derivs[b].score; }
+    const std::vector<Derivation>& derivs;
+  };
+  struct RanksHash {
+    explicit RanksHash(const StreamingKBest* k) : kb(k) {}
+    size_t operator()(unsigned d) const {
+      const Derivation& x = kb->derivs_[d];
+      size_t h = 5381;
+      h = ((h << 5) + h) ^ x.edge->id_;
+      for (int i = 0; i < x.edge->Arity(); ++i)
+        h = ((h << 5) + h) ^ kb->ranks_[x.ranks + i];
+      return h;
+    }
+    const StreamingKBest* kb;
+  };
+  struct RanksEquals {
+    explicit RanksEquals(const StreamingKBest* k) : kb(k) {}
+    bool operator()(unsigned a, unsigned b) const {
+      const Derivation& x = kb->derivs_[a];
+      const Derivation& y = kb->derivs_[b];
+      return x.edge == y.edge &&
+          std::equal(&kb->ranks_[x.ranks], &kb->ranks_[x.ranks] + x.edge->Arity(), &kb->ranks_[y.ranks]);
+    }
+    const StreamingKBest* kb;
+  };
+
+  // returns the k-th best derivation of node v, or -1 if it has fewer
+  int LazyKthBest(unsigned v, unsigned k) {
+    NodeState& s = GetCandidates(v);
+    bool add_next = true;
+    while (s.D.size() <= k) {
+      if (add_next && !s.D.empty())
+        LazyNext(s.D.back(), &s.cand);
+      add_next = false;
+
+      while (!add_next && !s.cand.empty()) {
+        std::pop_heap(s.cand.begin(), s.cand.end(), HeapCompare(derivs_));
+        const unsigned d = s.cand.back();
+        s.cand.pop_back();
+        if (!unique_ || IsNewString(d, &s)) {
+          s.D.push_back(d);
+          add_next = true;
+        } else {
+          // the successors of a duplicate can still have new strings
+          LazyNext(d, &s.cand);
+        }
+      }
+      if (!add_next)
+        break;
+    }
+    return k < s.D.size() ? static_cast<int>(s.D[k]) : -1;
+  }
+
+  // creates a derivation of e with the antecedent ranks at ranks_[ranks].
+  // returns -1 if an antecedent does not have that many derivations
+  int CreateDerivation(const HG::Edge& e, unsigned ranks) {
+    WeightType score = w_(e);
+    for (int i = 0; i < e.Arity(); ++i) {
+      const int ant = LazyKthBest(e.tail_nodes_[i], ranks_[ranks + i]);
+      if (ant < 0) return -1;
+      score *= derivs_[ant].score;
+    }
+    const Derivation d = { &e, ranks, score, 0, 0 };
+    derivs_.push_back(d);
+    return derivs_.size() - 1;
+  }
+
+  NodeState& GetCandidates(unsigned v) {
+    NodeState& s = nodes_[v];
+    if (s.initialized) return s;
+    s.initialized = true;
+
+    const Hypergraph::Node& node = g_.nodes_[v];
+    for (unsigned i = 0; i < node.in_edges_.size(); ++i) {
+      const HG::Edge& edge = g_.edges_[node.in_edges_[i]];
+      const unsigned ranks = ranks_.size();
+      ranks_.resize(ranks + edge.Arity(), 0);
+      const int d = CreateDerivation(edge, ranks);
+      assert(d >= 0);
+      s.cand.push_back(d);
+    }
+
+    unsigned effective_k = s.cand.size();
+    // without filtering, no more than k candidates of a node can be used
+    if (!unique_) effective_k = std::min<size_t>(k_, s.cand.size());
+    const std::vector<unsigned>::iterator kth = s.cand.begin() + effective_k;
+    std::nth_element(s.cand.begin(), kth, s.cand.end(), DerivationCompare(derivs_));
+    s.cand.resize(effective_k);
+    std::make_heap(s.cand.begin(), s.cand.end(), HeapCompare(derivs_));
+    return s;
+  }
+
+  void LazyNext(unsigned d, std::vector<unsigned>* cand) {
+    const HG::Edge& edge = *derivs_[d].edge;
+    for (int i = 0; i < edge.Arity(); ++i) {
+      const unsigned next_rank = ranks_[derivs_[d].ranks + i] + 1;
+      if (LazyKthBest(edge.tail_nodes_[i], next_rank) < 0) continue;
+      // look the successor up with derivation 0 before creating it
+      const unsigned ranks = ranks_.size();
+      for (int j = 0; j < edge.Arity(); ++j)
+        ranks_.push_back(ranks_[derivs_[d].ranks + j]);
+      ranks_[ranks + i] = next_rank;
+      derivs_[0].edge = &edge;
+      derivs_[0].ranks = ranks;
+      if (seen_.count(0)) {
+        ranks_.resize(ranks);
+        continue;
+      }
+      const int new_d = CreateDerivation(edge, ranks);
+      if (new_d >= 0) {
+        cand->push_back(new_d);
+        std::push_heap(cand->begin(), cand->end(), HeapCompare(derivs_));
+        seen_.insert(new_d);
+      }
+    }
+  }
+
+  // fingerprints are polynomial hashes modulo the prime 2^61 - 1, so the
+  // fingerprint of a concatenation follows from those of its parts
+  static const uint64_t kPrime = (1ull << 61) - 1;
+  static const uint64_t kBase = 1000003;
+
+  static uint64_t MulMod(uint64_t a, uint64_t b) {
+    const unsigned __int128 x = static_cast<unsigned __int128>(a) * b;
+    const uint64_t r = (static_cast<uint64_t>(x) & kPrime) + static_cast<uint64_t>(x >> 61);
+    return r >= kPrime ? r - kPrime : r;
+  }
+
+  static uint64_t AddMod(uint64_t a, uint64_t b) {
+    const uint64_t r = a + b;
+    return r >= kPrime ? r - kPrime : r;
+  }
+
+  uint64_t Power(unsigned n) {
+    while (powers_.size() <= n)
+      powers_.push_back(MulMod(powers_.back(), kBase));
+    return powers_[n];
+  }
+
+  // computes the fingerprint of d's string and returns false if node s
+  // already has a derivation of it
+  bool IsNewString(unsigned d, NodeState* s) {
+    const Derivation& x = derivs_[d];
+    const std::vector<WordID>& e = x.edge->rule_->e_;
+    uint64_t h = 0;
+    unsigned length = 0;
+    for (unsigned i = 0; i < e.size(); ++i) {
+      if (e[i] < 1) {
+        const Derivation& ant = Antecedent(x, -e[i]);
+        h = AddMod(MulMod(h, Power(ant.length)), ant.fingerprint);
+        length += ant.length;
+      } else {
+        h = AddMod(MulMod(h, kBase), e[i]);
+        ++length;
+      }
+    }
+    derivs_[d].fingerprint = h;
+    derivs_[d].length = length;
+    return s->fingerprints.insert(h).second;
+  }
+
+  const Derivation& Antecedent(const Derivation& d, int i) const {
+    return derivs_[nodes_[d.edge->tail_nodes_[i]].D[ranks_[d.ranks + i]]];
+  }
+
+  void AppendYield(unsigned d, std::vector<WordID>* yield) const {
+    const Derivation& x = derivs_[d];
+    const std::vector<WordID>& e = x.edge->rule_->e_;
+    for (unsigned i = 0; i < e.size(); ++i) {
+      if (e[i] < 1)
+        AppendYield(&Antecedent(x, -e[i]) - &derivs_[0], yield);
+      else
+        yield->push_back(e[i]);
+    }
+  }
+
+  // sums the features in the same order as KBestDerivations
+  SparseVector<double> Features(unsigned d) const {
+    const Derivation& x = derivs_[d];
+    SparseVector<double> feats = x.edge->feature_values_;
+    for (int i = 0; i < x.edge->Arity(); ++i)
+      feats += Features(&Antecedent(x, i) - &derivs_[0]);
+    return feats;
+  }
+
+  const Hypergraph& g_;
+  const WeightFunction w_;
+  const unsigned k_;
+  const bool unique_;
+  std::vector<NodeState> nodes_;
+  std::vector<Derivation> derivs_;
+  std::vector<unsigned> ranks_;
+  std::unordered_set<unsigned, RanksHash, RanksEquals> seen_;
+  std::vector<uint64_t> powers_;
+};
+
+}
+
+#endif
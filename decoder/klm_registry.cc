@@ -0,0 +1,32 @@
+#include "klm_registry.h"
+
+#include <limits.h>
+#include <stdlib.h>
+#include <map>
+#include <mutex>
+
+#include <boost/weak_ptr.hpp>
+
+using namespace std;
+
+boost::shared_ptr<void> GetRegisteredKLM(const string& key,
+                                         const boost::function<boost::shared_ptr<void>()>& load) {
+  static mutex registry_mutex;
+  static map<string, boost::weak_ptr<void> > registry;
+  // models are loaded while holding the lock, so a file that is requested by
+  // several threads at once is still loaded only once
+  lock_guard<mutex> lock(registry_mutex);
+  boost::weak_ptr<void>& entry = registry[key];
+  boost::shared_ptr<void> model = entry.lock();
+  if (!model) {
+    model = load();
+    entry = model;
+  }
+  return model;
+}
+
+string CanonicalKLMPath(const string& file) {
+  char path[PATH_MAX];
+  if (realpath(file.c_str(), path)) return path;
+  return file;
+}
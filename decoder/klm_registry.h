@@ -0,0 +1,129 @@
+#ifndef _KLM_REGISTRY_H_
+#define _KLM_REGISTRY_H_
+
+// KenLM models are loaded once per process: every KLanguageModel feature (in
+// any pass, with any -n name, in any Decoder instance) and incremental search
+// that use the same file with the same load configuration (see SharedKLM::Get)
+// share one model and one cdec -> KenLM vocabulary map.
+// a model is freed when the last user goes away.
+
+#include <atomic>
+#include <iostream>
+#include <string>
+#include <typeinfo>
+#include <vector>
+
+#include <boost/bind.hpp>
+#include <boost/function.hpp>
+#include <boost/shared_ptr.hpp>
+
+#include "lm/enumerate_vocab.hh"
+#include "lm/model.hh"
+#include "tdict.h"
+#include "verbose.h"
+#include "wordid.h"
+
+// returns the object registered under key, creating it with load if there is
+// none (or if all its users are gone)
+boost::shared_ptr<void> GetRegisteredKLM(const std::string& key,
+                                         const boost::function<boost::shared_ptr<void>()>& load);
+
+// file name that is the same for every path to a file
+std::string CanonicalKLMPath(const std::string& file);
+
+template <class Model>
+class SharedKLM {
+ public:
+  // with lazy_vocab, LM words get cdec ids when they are first looked up
+  // instead of all being added to TD when the model is loaded. the load
+  // configuration is part of the key, so users that ask for different modes
+  // get different models (and the file is loaded once per mode).
+  static boost::shared_ptr<SharedKLM> Get(const std::string& file, bool lazy_vocab) {
+    const std::string key = std::string(typeid(Model).name()) + '\t' +
+        (lazy_vocab ? "lazy_vocab" : "full_vocab") + '\t' + CanonicalKLMPath(file);
+    return boost::static_pointer_cast<SharedKLM>(
+        GetRegisteredKLM(key, boost::bind(&SharedKLM::Load, file, lazy_vocab)));
+  }
+
+  ~SharedKLM() {
+    if (!chunks_) return;
+    for (unsigned i = 0; i < kMaxChunks; ++i) delete[] chunks_[i].load();
+    delete[] chunks_;
+  }
+
+  const Model& model() const { return *model_; }
+
+  // converts cdec word ids to KenLM's id space, OOVs and <unk> end up at 0.
+  // may be called from several threads at once
+  lm::WordIndex MapWord(WordID w) const {
+    if (!lazy_) return w < map_.size() ? map_[w] : 0;
+    const unsigned c = w >> kChunkBits;
+    if (c >= kMaxChunks) return Lookup(w);
+    std::atomic<lm::WordIndex>* chunk = chunks_[c].load(std::memory_order_acquire);
+    if (!chunk) {
+      std::atomic<lm::WordIndex>* fresh = new std::atomic<lm::WordIndex>[1 << kChunkBits];
+      for (unsigned i = 0; i < (1 << kChunkBits); ++i)
+        fresh[i].store(kNotLookedUp, std::memory_order_relaxed);
+      if (chunks_[c].compare_exchange_strong(chunk, fresh, std::memory_order_acq_rel))
+        chunk = fresh;
+      else
+        delete[] fresh;
+    }
+    std::atomic<lm::WordIndex>& slot = chunk[w & ((1 << kChunkBits) - 1)];
+    lm::WordIndex id = slot.load(std::memory_order_relaxed);
+    if (id == kNotLookedUp) {
+      id = Lookup(w);
+      slot.store(id, std::memory_order_relaxed);
+    }
+    return id;
+  }
+
+ private:
+  // the lazy map is split into chunks that are allocated on first use
+  static const unsigned kChunkBits = 12;
+  static const unsigned kMaxChunks = 1 << 16;
+  static const lm::WordIndex kNotLookedUp = ~0u;
+
+  struct VocabMapper : public lm::EnumerateVocab {
+    explicit VocabMapper(std::vector<lm::WordIndex>* out) : out_(out) {}
+    void Add(lm::WordIndex index, const StringPiece& str) {
+      const WordID cdec_id = TD::Convert(str.as_string());
+      if (cdec_id >= out_->size()) out_->resize(cdec_id + 1, 0);
+      (*out_)[cdec_id] = index;
+    }
+    std::vector<lm::WordIndex>* out_;
+  };
+
+  explicit SharedKLM(bool lazy_vocab) : lazy_(lazy_vocab), chunks_(NULL) {}
+
+  static boost::shared_ptr<void> Load(const std::string& file, bool lazy_vocab) {
+    boost::shared_ptr<SharedKLM> lm(new SharedKLM(lazy_vocab));
+    lm::ngram::Config conf;
+    VocabMapper vm(&lm->map_);
+    if (!lazy_vocab) conf.enumerate_vocab = &vm;
+    lm->model_.reset(new Model(file.c_str(), conf));
+    if (lazy_vocab) {
+      lm->chunks_ = new std::atomic<std::atomic<lm::WordIndex>*>[kMaxChunks];
+      for (unsigned i = 0; i < kMaxChunks; ++i) lm->chunks_[i].store(NULL);
+    }
+    if (!SILENT) {
+      std::cerr << "Loaded " << static_cast<int>(lm->model_->Order()) << "-gram KLM from " << file;
+      if (lazy_vocab)
+        std::cerr << " (lazy vocabulary map)\n";
+      else
+        std::cerr << " (MapSize=" << lm->map_.size() << ")\n";
+    }
+    return lm;
+  }
+
+  lm::WordIndex Lookup(WordID w) const {
+    return model_->GetVocabulary().Index(TD::Convert(w));
+  }
+
+  const bool lazy_;
+  boost::shared_ptr<Model> model_;
+  std::vector<lm::WordIndex> map_;
+  std::atomic<std::atomic<lm::WordIndex>*>* chunks_;
+};
+
+#endif
@@ -216,7 +216,7 @@ public:
     assert(D_v.empty());
     const Hypergraph::Node& v = in.nodes_[vert_index];
     // cerr << "  has " << v.in_edges_.size() << " in-coming edges\n";
-    const vector<int>& in_edges = v.in_edges_;
+    const Hypergraph::EdgesVector& in_edges = v.in_edges_;
     CandidateHeap cand;
     CandidateList freelist;
     cand.reserve(in_edges.size());
@@ -19,6 +19,7 @@
 #include "sentence_metadata.h"
 #include "apply_models.h"
 #include "kbest.h"
+#include "kbest_stream.h"
 #include "timing_stats.h"
 #include "sentences.h"
 
@@ -281,11 +282,33 @@ struct OracleBleu {
     }
   }
 
+  // same output as kbest without show_derivation, using less memory
+  void StreamKBest(int sent_id,Hypergraph const& forest,int k,bool unique,std::ostream &kbest_out) {
+    KBest::StreamingKBest<> kbest(forest,k,unique);
+    const float curr_src_length = doc_src_length + tmp_src_length;
+    kbest.Stream([&](const Sentence& yield, const SparseVector<double>& feats, const prob_t& score) {
+      kbest_out << sent_id << " ||| " << TD::GetString(yield) << " ||| "
+                << feats << " ||| " << log(score);
+      if (!refs.empty()) {
+        ScoreP sentscore = GetScore(yield,sent_id);
+        sentscore->PlusEquals(*doc_score,float(1));
+        float bleu = curr_src_length * sentscore->ComputeScore();
+        kbest_out << " ||| " << bleu;
+      }
+      kbest_out<<std::endl<<std::flush;
+      return true;
+    });
+  }
+
 // TODO decoder output should probably be moved to another file - how about oracle_bleu.h
   void DumpKBest(const int sent_id, const Hypergraph& forest, const int k, const bool unique, std::string const &kbest_out_filename_, std::string const &deriv_out_filename_) {
 
     WriteFile ko(kbest_out_filename_);
     std::cerr << "Output kbest to " << kbest_out_filename_ <<std::endl;
+    DumpKBest(sent_id, forest, k, unique, ko.get(), deriv_out_filename_);
+  }
+
+  void DumpKBest(const int sent_id, const Hypergraph& forest, const int k, const bool unique, std::ostream &kbest_out, std::string const &deriv_out_filename_) {
     std::ostringstream sderiv;
     sderiv << deriv_out_filename_;
     if (show_derivation) {
@@ -294,10 +317,12 @@ struct OracleBleu {
     }
     WriteFile oderiv(sderiv.str());
 
-    if (!unique)
-      kbest<KBest::NoFilter<std::vector<WordID> > >(sent_id,forest,k,ko.get(),oderiv.get());
+    if (!show_derivation)
+      StreamKBest(sent_id,forest,k,unique,kbest_out);
+    else if (!unique)
+      kbest<KBest::NoFilter<std::vector<WordID> > >(sent_id,forest,k,kbest_out,oderiv.get());
     else {
-      kbest<KBest::FilterUnique>(sent_id,forest,k,ko.get(),oderiv.get());
+      kbest<KBest::FilterUnique>(sent_id,forest,k,kbest_out,oderiv.get());
     }
   }
 
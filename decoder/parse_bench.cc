@@ -0,0 +1,209 @@
+// measures how long the bottom-up SCFG parser takes to parse a test set
+// (without rescoring), with the original sequential parser and with the
+// parallel one at several thread counts, and checks that the forests match.
+// with -f, text grammars are frozen (see TextGrammar::Freeze) after loading
+//   usage: parse_bench [-r repetitions] [-S max_span] [-t threads]... [-f] [--goal S]
+//                      [--default_nt X] -g grammar [-g grammar]... input.txt
+// a glue grammar for the goal and default nonterminals is always added
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "bottom_up_parser.h"
+#include "compiled_grammar.h"
+#include "filelib.h"
+#include "grammar.h"
+#include "hg.h"
+#include "hg_io.h"
+#include "lattice.h"
+#include "verbose.h"
+
+using namespace std;
+
+// the glue rules of the decoder's hiero glue grammar, which apply at i = 0
+struct BenchGlueGrammar : public TextGrammar {
+  BenchGlueGrammar(const string& goal, const string& default_nt) {
+    AddRule(TRulePtr(new TRule("[" + goal + "] ||| [" + default_nt + ",1] ||| [1]")));
+    AddRule(TRulePtr(new TRule("[" + goal + "] ||| [" + goal + ",1] [" + default_nt + ",2] ||| [1] [2] ||| Glue=1")));
+  }
+  virtual bool HasRuleForSpan(int i, int, int) const { return i == 0; }
+};
+
+static double Seconds(const chrono::steady_clock::time_point& start) {
+  return chrono::duration<double>(chrono::steady_clock::now() - start).count();
+}
+
+static string AsJSON(const Hypergraph& hg) {
+  ostringstream os;
+  HypergraphIO::WriteToJSON(hg, false, &os);
+  return os.str();
+}
+
+// parses every input reps times and returns the time per repetition in ms.
+// the forests are compared with expected, or stored there if it is empty
+static double Run(const string& goal, const vector<GrammarPtr>& grammars, int threads,
+                  const vector<Lattice>& inputs, int reps, vector<string>* expected,
+                  const string& label, double base = 0) {
+  const ExhaustiveBottomUpParser parser(goal, grammars, threads);
+  const bool first = (*expected)[0].empty();
+  size_t nodes = 0, edges = 0, parsed = 0, mismatches = 0;
+  double seconds = 0;
+  for (int r = 0; r < reps; ++r) {
+    for (unsigned i = 0; i < inputs.size(); ++i) {
+      Hypergraph forest;
+      const chrono::steady_clock::time_point start = chrono::steady_clock::now();
+      const bool ok = parser.Parse(inputs[i], &forest);
+      seconds += Seconds(start);
+      if (r > 0) continue;
+      parsed += ok;
+      nodes += forest.nodes_.size();
+      edges += forest.edges_.size();
+      if (first)
+        (*expected)[i] = AsJSON(forest);
+      else if (AsJSON(forest) != (*expected)[i])
+        ++mismatches;
+    }
+  }
+  const double ms = seconds * 1000 / reps;
+  cout << label << ": " << ms << " ms";
+  if (base > 0) cout << " (x" << base / ms << ")";
+  if (first)
+    cout << "  parsed: " << parsed << "  nodes: " << nodes << "  edges: " << edges;
+  if (mismatches) cout << "  FORESTS DIFFER: " << mismatches;
+  cout << endl;
+  return ms;
+}
+
+// follows every path of terminals (and of X nonterminals between them)
+// through the grammar tries from every position of the inputs, which is
+// what the parser's active items do, and returns the time in ms
+static double Lookups(const vector<GrammarPtr>& grammars, const vector<Lattice>& inputs,
+                      WordID nt, int max_span, int reps, size_t* lookups) {
+  *lookups = 0;
+  vector<pair<const GrammarIter*, int> > stack;
+  const chrono::steady_clock::time_point start = chrono::steady_clock::now();
+  for (int r = 0; r < reps; ++r) {
+    for (unsigned g = 0; g < grammars.size(); ++g) {
+      for (unsigned s = 0; s < inputs.size(); ++s) {
+        const Lattice& in = inputs[s];
+        for (unsigned i = 0; i < in.size(); ++i) {
+          stack.assign(1, make_pair(grammars[g]->GetRoot(), static_cast<int>(i)));
+          while (!stack.empty()) {
+            const GrammarIter* it = stack.back().first;
+            const int j = stack.back().second;
+            stack.pop_back();
+            if (j - static_cast<int>(i) >= max_span || j >= static_cast<int>(in.size())) continue;
+            // a nonterminal covering one word
+            ++*lookups;
+            const GrammarIter* next = it->Extend(nt);
+            if (next) stack.push_back(make_pair(next, j + 1));
+            for (unsigned a = 0; a < in[j].size(); ++a) {
+              ++*lookups;
+              next = it->Extend(in[j][a].label);
+              if (next) stack.push_back(make_pair(next, j + in[j][a].dist2next));
+            }
+          }
+        }
+      }
+    }
+  }
+  *lookups /= reps;
+  return Seconds(start) * 1000 / reps;
+}
+
+int main(int argc, char** argv) {
+  int reps = 3;
+  int max_span = 10;
+  bool freeze = false;
+  string goal = "S", default_nt = "X", input_file;
+  vector<string> grammar_files;
+  vector<int> thread_counts;
+  for (int i = 1; i < argc; ++i) {
+    if (!strcmp(argv[i], "-r") && i + 1 < argc)
+      reps = atoi(argv[++i]);
+    else if (!strcmp(argv[i], "-S") && i + 1 < argc)
+      max_span = atoi(argv[++i]);
+    else if (!strcmp(argv[i], "-t") && i + 1 < argc)
+      thread_counts.push_back(atoi(argv[++i]));
+    else if (!strcmp(argv[i], "-f"))
+      freeze = true;
+    else if (!strcmp(argv[i], "-g") && i + 1 < argc)
+      grammar_files.push_back(argv[++i]);
+    else if (!strcmp(argv[i], "--goal") && i + 1 < argc)
+      goal = argv[++i];
+    else if (!strcmp(argv[i], "--default_nt") && i + 1 < argc)
+      default_nt = argv[++i];
+    else
+      input_file = argv[i];
+  }
+  if (grammar_files.empty() || input_file.empty()) {
+    cerr << "Usage: " << argv[0] << " [-r repetitions] [-S max_span] [-t threads]... [-f] [--goal S] "
+         << "[--default_nt X] -g grammar [-g grammar]... input.txt\n";
+    return 1;
+  }
+  if (thread_counts.empty()) {
+    thread_counts.push_back(1);
+    thread_counts.push_back(4);
+  }
+
+  vector<GrammarPtr> grammars;
+  for (unsigned i = 0; i < grammar_files.size(); ++i) {
+    if (CompiledGrammar::IsCompiledGrammar(grammar_files[i])) {
+      CompiledGrammar* g = new CompiledGrammar(grammar_files[i]);
+      g->SetMaxSpan(max_span);
+      grammars.push_back(GrammarPtr(g));
+    } else {
+      chrono::steady_clock::time_point start = chrono::steady_clock::now();
+      TextGrammar* g = new TextGrammar(grammar_files[i]);
+      g->SetMaxSpan(max_span);
+      grammars.push_back(GrammarPtr(g));
+      cout << "reading " << grammar_files[i] << ": " << Seconds(start) * 1000 << " ms";
+      if (freeze) {
+        start = chrono::steady_clock::now();
+        g->Freeze();
+        cout << ", freezing: " << Seconds(start) * 1000 << " ms";
+      } else {
+        start = chrono::steady_clock::now();
+        g->GetRoot();
+        cout << ", building the trie: " << Seconds(start) * 1000 << " ms";
+      }
+      cout << endl;
+    }
+  }
+  grammars.push_back(GrammarPtr(new BenchGlueGrammar(goal, default_nt)));
+
+  vector<Lattice> inputs;
+  size_t words = 0;
+  ReadFile in(input_file);
+  string line;
+  while (getline(*in.stream(), line)) {
+    inputs.push_back(Lattice());
+    LatticeTools::ConvertTextOrPLF(line, &inputs.back());
+    words += inputs.back().size();
+  }
+  if (inputs.empty()) {
+    cerr << "No sentences in " << input_file << endl;
+    return 1;
+  }
+  SetSilent(true);
+
+  // the first run (sequential parser, text grammars as loaded) gives the
+  // forests that all others must match
+  vector<string> expected(inputs.size());
+  cout << "sentences: " << inputs.size() << "  words: " << words << "  repetitions: " << reps << endl;
+  size_t lookups;
+  const double lookup_ms = Lookups(grammars, inputs, -TD::Convert(default_nt), max_span, reps, &lookups);
+  cout << "grammar lookups: " << lookup_ms << " ms (" << lookups << " lookups)" << endl;
+  const double base = Run(goal, grammars, 0, inputs, reps, &expected, "sequential parser");
+  for (unsigned t = 0; t < thread_counts.size(); ++t) {
+    ostringstream label;
+    label << "parallel, " << thread_counts[t] << " threads";
+    Run(goal, grammars, thread_counts[t], inputs, reps, &expected, label.str(), base);
+  }
+
+  return 0;
+}
@@ -1,8 +1,10 @@
 #define BOOST_TEST_MODULE ParseTest
 #include <boost/test/unit_test.hpp>
 #include <boost/test/floating_point_comparison.hpp>
+#include <sstream>
 #include "lattice.h"
 #include "hg.h"
+#include "hg_io.h"
 #include "trule.h"
 #include "bottom_up_parser.h"
 #include "tdict.h"
@@ -22,3 +24,34 @@ BOOST_AUTO_TEST_CASE(Parse) {
   parser.Parse(lattice, &forest);
 }
 
+
+BOOST_AUTO_TEST_CASE(ParallelParse) {
+  istringstream rules(
+      "[X] ||| a ||| A\n"
+      "[X] ||| b ||| B\n"
+      "[X] ||| a b ||| AB\n"
+      "[X] ||| [X,1] [X,2] ||| [1] [2]\n"
+      "[X] ||| a [X,1] ||| A [1]\n"
+      "[Y] ||| [X,1] ||| [1]\n"
+      "[S] ||| [Y,1] ||| [1]\n"
+      "[S] ||| [S,1] [Y,2] ||| [1] [2]\n");
+  GrammarPtr g(new TextGrammar(&rules));
+  vector<GrammarPtr> grammars(1, g);
+  // a lattice with an arc that skips a word
+  Lattice lattice;
+  LatticeTools::ConvertTextOrPLF("((('a',0,1),),(('b',0,1),),(('a',0,1),('b',0.5,2),),"
+                                 "(('b',0,1),),(('a',0,1),),(('a',0,1),),(('b',0,1),),)", &lattice);
+  Hypergraph forest;
+  BOOST_REQUIRE(ExhaustiveBottomUpParser("S", grammars).Parse(lattice, &forest));
+  ostringstream expected;
+  HypergraphIO::WriteToJSON(forest, false, &expected);
+  for (int threads = 1; threads <= 4; ++threads) {
+    Hypergraph parallel_forest;
+    BOOST_REQUIRE(ExhaustiveBottomUpParser("S", grammars, threads).Parse(lattice, &parallel_forest));
+    BOOST_CHECK_EQUAL(parallel_forest.nodes_.size(), forest.nodes_.size());
+    BOOST_CHECK_EQUAL(parallel_forest.edges_.size(), forest.edges_.size());
+    ostringstream os;
+    HypergraphIO::WriteToJSON(parallel_forest, false, &os);
+    BOOST_CHECK(os.str() == expected.str());
+  }
+}
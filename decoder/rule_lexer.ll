@@ -8,6 +8,7 @@
 #include <cstring>
 #include <cassert>
 #include <stack>
+#include <mutex>
 #include "tdict.h"
 #include "fdict.h"
 #include "trule.h"
@@ -19,6 +20,7 @@ RuleLexer::RuleCallback rule_callback = NULL;
 void* rule_callback_extra = NULL;
 std::vector<int> scfglex_phrase_fnames;
 std::string scfglex_fname;
+std::mutex scfglex_mutex;  // the scanner state is global, so only one reader at a time
 
 #undef YY_INPUT
 #define YY_INPUT(buf, result, max_size) (result = scfglex_stream->read(buf, max_size).gcount())
@@ -300,6 +302,7 @@ NT [^\t \[\],]+
 #include "filelib.h"
 
 void RuleLexer::ReadRules(std::istream* in, RuleLexer::RuleCallback func, const std::string& fname, void* extra) {
+  std::lock_guard<std::mutex> lock(scfglex_mutex);
   if (scfglex_phrase_fnames.empty()) {
     scfglex_phrase_fnames.resize(100);
     for (int i = 0; i < scfglex_phrase_fnames.size(); ++i) {
@@ -1,13 +1,19 @@
 #include <algorithm>
+#include <fstream>
+#include <mutex>
 #include <vector>
 #include <boost/foreach.hpp>
 #include <boost/functional/hash.hpp>
+#include <boost/scoped_ptr.hpp>
+#include <boost/weak_ptr.hpp>
 #include "fast_lexical_cast.hpp"
 #include "hash.h"
+#include "line_socket.h"
 #include "translator.h"
 #include "hg.h"
 #include "grammar.h"
 #include "bottom_up_parser.h"
+#include "compiled_grammar.h"
 #include "sentence_metadata.h"
 #include "stringlib.h"
 #include "tdict.h"
@@ -82,23 +88,116 @@ bool PassThroughGrammar::HasRuleForSpan(int, int, int distance) const {
   return (distance < 4);  // TODO this isn't great, but helps with EPS lattices
 }
 
+// static grammars are read-only once loaded, so decoders that live in the
+// same process (e.g., cdec --threads) share a single copy of each file
+static GrammarPtr LoadSharedGrammar(const string& fname, int max_span_limit) {
+  static std::mutex m;
+  static map<pair<string, int>, boost::weak_ptr<Grammar> > loaded;
+  std::lock_guard<std::mutex> lock(m);
+  boost::weak_ptr<Grammar>& wp = loaded[make_pair(fname, max_span_limit)];
+  GrammarPtr gp = wp.lock();
+  if (!gp) {
+    if (CompiledGrammar::IsCompiledGrammar(fname)) {
+      if (!SILENT) cerr << "Mapping compiled SCFG grammar " << fname << endl;
+      CompiledGrammar* g = new CompiledGrammar(fname);
+      g->SetMaxSpan(max_span_limit);
+      gp.reset(g);
+    } else {
+      if (!SILENT) cerr << "Reading SCFG grammar from " << fname << endl;
+      TextGrammar* g = new TextGrammar(fname);
+      g->SetMaxSpan(max_span_limit);
+      g->Freeze();
+      gp.reset(g);
+    }
+    gp->SetGrammarName(fname);
+    wp = gp;
+  } else if (!SILENT) {
+    cerr << "Sharing already loaded SCFG grammar " << fname << endl;
+  }
+  return gp;
+}
+
+// client for the extractor's grammar server (extract --socket PATH), which
+// sends back the grammar of each sentence as
+//   grammar ID BYTES               followed by BYTES bytes (binary or text rules)
+// or
+//   error ID MESSAGE
+class GrammarServerClient {
+ public:
+  explicit GrammarServerClient(const string& socket_path) : socket_path_(socket_path) {}
+
+  // returns false (and prints the reason) if no grammar could be obtained
+  bool GetGrammar(const string& id, const string& sentence, string* grammar) {
+    if (!conn_) {
+      string error;
+      const int fd = LineSocket::Connect(socket_path_, &error);
+      if (fd < 0) {
+        cerr << "Grammar server: " << error << endl;
+        return false;
+      }
+      conn_.reset(new LineSocket(fd));
+    }
+    string header;
+    if (!conn_->Write("extract " + id + " " + sentence + "\n") || !conn_->ReadLine(&header)) {
+      LostConnection();
+      return false;
+    }
+    istringstream in(header);
+    string answer, answer_id;
+    size_t size = 0;
+    in >> answer >> answer_id;
+    if (answer == "error" && answer_id == id) {
+      cerr << "Grammar server failed on sentence " << id << ": " << header << endl;
+      return false;
+    }
+    if (answer != "grammar" || answer_id != id || !(in >> size)) {
+      // a grammar may follow that is not ours, or of unknown size, so the
+      // rest of the stream cannot be trusted
+      cerr << "Unexpected answer from grammar server for sentence " << id << ": " << header << endl;
+      LostConnection();
+      return false;
+    }
+    if (!conn_->Read(size, grammar)) {
+      LostConnection();
+      return false;
+    }
+    return true;
+  }
+
+ private:
+  // the next request reconnects
+  void LostConnection() {
+    cerr << "Lost connection to grammar server " << socket_path_ << endl;
+    conn_.reset();
+  }
+
+  const string socket_path_;
+  boost::scoped_ptr<LineSocket> conn_;
+};
+
 struct SCFGTranslatorImpl {
   SCFGTranslatorImpl(const boost::program_options::variables_map& conf) :
       max_span_limit(conf["scfg_max_span_limit"].as<int>()),
+      parse_threads(conf["scfg_parse_threads"].as<int>()),
       add_pass_through_rules(conf.count("add_pass_through_rules")),
       goal(conf["goal"].as<string>()),
       default_nt(conf["scfg_default_nt"].as<string>()),
       use_ctf_(conf.count("coarse_to_fine_beam_prune"))
   {
+    if (conf.count("per_sentence_grammar_file")) {
+      const string& psg = conf["per_sentence_grammar_file"].as<string>();
+      psg_file_.reset(new ifstream(psg.c_str(), ios::binary));
+      if (!*psg_file_) {
+        cerr << "Failed to open per sentence grammar file " << psg << endl;
+        abort();
+      }
+    }
+    if (conf.count("grammar_server"))
+      grammar_server_.reset(new GrammarServerClient(conf["grammar_server"].as<string>()));
     if(conf.count("grammar")){
       vector<string> gfiles = conf["grammar"].as<vector<string> >();
-      for (unsigned i = 0; i < gfiles.size(); ++i) {
-        if (!SILENT) cerr << "Reading SCFG grammar from " << gfiles[i] << endl;
-        TextGrammar* g = new TextGrammar(gfiles[i]);
-        g->SetMaxSpan(max_span_limit);
-        g->SetGrammarName(gfiles[i]);
-        grammars.push_back(GrammarPtr(g));
-      }
+      for (unsigned i = 0; i < gfiles.size(); ++i)
+        grammars.push_back(LoadSharedGrammar(gfiles[i], max_span_limit));
       if (!SILENT) cerr << endl;
     }
     if (conf.count("scfg_extra_glue_grammar")) {
@@ -139,6 +238,7 @@ struct SCFGTranslatorImpl {
  }
 
   const int max_span_limit;
+  const int parse_threads;
   const bool add_pass_through_rules;
   const string goal;
   const string default_nt;
@@ -151,6 +251,8 @@ struct SCFGTranslatorImpl {
   unsigned int ctf_iterations_;
   vector<GrammarPtr> grammars;
   set<GrammarPtr> sup_grammars_;
+  boost::shared_ptr<ifstream> psg_file_;  // --per_sentence_grammar_file
+  boost::shared_ptr<GrammarServerClient> grammar_server_;  // --grammar_server
 
   struct ContainedIn {
     ContainedIn(const set<GrammarPtr>& gs) : gs_(gs) {}
@@ -167,6 +269,36 @@ struct SCFGTranslatorImpl {
     AddSupplementalGrammar(GrammarPtr(sent_grammar));
   }
 
+  // reads the grammar starting at offset in the per sentence grammar file
+  GrammarPtr ReadPerSentenceGrammar(unsigned long long offset) {
+    TextGrammar* g = new TextGrammar;
+    GrammarPtr gp(g);
+    g->ReadFromIndexedStream(psg_file_.get(), offset);
+    g->SetMaxSpan(max_span_limit);
+    g->Freeze();
+    g->SetGrammarName("PerSentenceGrammarFile");
+    return gp;
+  }
+
+  // asks the grammar server for the grammar of the sentence. returns an empty
+  // pointer if there is none (the client has printed why)
+  GrammarPtr GetServerGrammar(int sent_id, const string& input) {
+    string data;
+    if (!grammar_server_->GetGrammar(boost::lexical_cast<string>(sent_id), input, &data))
+      return GrammarPtr();
+    TextGrammar* g = new TextGrammar;
+    GrammarPtr gp(g);
+    istringstream in(data);
+    if (!g->ReadFromBinaryStream(&in)) {
+      istringstream text(data);
+      g->ReadFromStream(&text);
+    }
+    g->SetMaxSpan(max_span_limit);
+    g->Freeze();
+    g->SetGrammarName("GrammarServer");
+    return gp;
+  }
+
   void AddSupplementalGrammar(GrammarPtr gp) {
     sup_grammars_.insert(gp);
     grammars.push_back(gp);
@@ -182,6 +314,14 @@ struct SCFGTranslatorImpl {
                  const vector<double>& weights,
                  Hypergraph* forest) {
     vector<GrammarPtr> glist = grammars;
+    if (grammar_server_) {
+      GrammarPtr gp = GetServerGrammar(smeta->GetSentenceID(), input);
+      if (!gp) {
+        cerr << "  no grammar for sentence " << smeta->GetSentenceID() << ", skipping it" << endl;
+        return false;
+      }
+      glist.push_back(gp);
+    }
     Lattice& lattice = smeta->src_lattice_;
     LatticeTools::ConvertTextOrPLF(input, &lattice);
     smeta->SetSourceLength(lattice.size());
@@ -196,7 +336,7 @@ struct SCFGTranslatorImpl {
         cerr << "Using grammar::" << glist[gi]->GetGrammarName() << endl;
     }
     if (!SILENT) cerr << "First pass parse... " << endl;
-    ExhaustiveBottomUpParser parser(goal, glist);
+    ExhaustiveBottomUpParser parser(goal, glist, parse_threads);
     if (!parser.Parse(lattice, forest)){
       if (!SILENT) cerr << "  parse failed." << endl;
       return false;
@@ -378,9 +518,18 @@ void SCFGTranslator::ProcessMarkupHintsImpl(const map<string, string>& kv) {
     loaded.insert(gfile);
     TextGrammar* sentGrammar = new TextGrammar(gfile);
     sentGrammar->SetMaxSpan(pimpl_->max_span_limit);
+    sentGrammar->Freeze();
     sentGrammar->SetGrammarName(gfile);
     pimpl_->AddSupplementalGrammar(GrammarPtr(sentGrammar));
   }
+  if (pimpl_->psg_file_) {
+    map<string,string>::const_iterator it = kv.find("psg");
+    if (it == kv.end() || it->second.size() < 2 || it->second[0] != '@') {
+      cerr << "per_sentence_grammar_file given but sentence doesn't have psg=\"@OFFSET\" markup!\n";
+      abort();
+    }
+    pimpl_->AddSupplementalGrammar(pimpl_->ReadPerSentenceGrammar(strtoull(it->second.c_str() + 1, NULL, 10)));
+  }
 }
 
 void SCFGTranslator::AddSupplementalGrammarFromString(const std::string& grammar) {
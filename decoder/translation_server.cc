@@ -0,0 +1,168 @@
+#include "translation_server.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <sstream>
+
+#include "decoder.h"
+#include "fdict.h"
+#include "line_socket.h"
+
+using namespace std;
+
+// splits "KEYWORD rest" into its two parts
+static bool Field(const string& line, const char* keyword, string* rest) {
+  const size_t n = strlen(keyword);
+  if (line.compare(0, n, keyword) != 0) return false;
+  if (line.size() == n) { rest->clear(); return true; }
+  if (line[n] != ' ') return false;
+  *rest = line.substr(n + 1);
+  return true;
+}
+
+TranslationServer::TranslationServer(const vector<Decoder*>& decoders, int batch_size) :
+    supports_grammars_(decoders.front()->GetConf()["formalism"].as<string>() == "scfg"),
+    batch_size_(max(1, batch_size)),
+    stopping_(false),
+    next_id_() {
+  for (int i = 0; i < decoders.size(); ++i)
+    workers_.push_back(thread(&TranslationServer::DecodeWorker, this, decoders[i]));
+}
+
+TranslationServer::~TranslationServer() {
+  {
+    lock_guard<mutex> lock(mutex_);
+    stopping_ = true;
+  }
+  cv_.notify_all();
+  for (int i = 0; i < workers_.size(); ++i)
+    workers_[i].join();
+}
+
+void TranslationServer::Push(const Request& r) {
+  {
+    lock_guard<mutex> lock(mutex_);
+    queue_.push_back(r);
+  }
+  cv_.notify_one();
+}
+
+bool TranslationServer::Pop(vector<Request>* batch) {
+  batch->clear();
+  unique_lock<mutex> lock(mutex_);
+  while (queue_.empty() && !stopping_) cv_.wait(lock);
+  if (stopping_) return false;
+  const size_t share = (queue_.size() + workers_.size() - 1) / workers_.size();
+  const size_t n = min<size_t>(batch_size_, share);
+  batch->assign(queue_.begin(), queue_.begin() + n);
+  queue_.erase(queue_.begin(), queue_.begin() + n);
+  return true;
+}
+
+void TranslationServer::Serve(int fd) {
+  // the socket is closed when the client has stopped sending and every
+  // result has been written, i.e. when the last reference goes away
+  boost::shared_ptr<LineSocket> connection(new LineSocket(fd));
+  string line, rest;
+  Request r;
+  r.connection = connection;
+  bool in_request = false;
+  while (connection->ReadLine(&line)) {
+    if (line.empty()) continue;
+    if (Field(line, "request", &rest)) {
+      r.id = rest;
+      r.weights.clear();
+      r.grammar.clear();
+      in_request = !r.id.empty() && r.id.find(' ') == string::npos;
+      if (!in_request) connection->Write("error " + r.id + " bad request ID\n");
+    } else if (!in_request) {
+      connection->Write("error - expected 'request ID', got: " + line + "\n");
+    } else if (Field(line, "weight", &rest)) {
+      istringstream is(rest);
+      string name;
+      double value;
+      if (is >> name >> value)
+        r.weights.push_back(make_pair(name, value));
+      else
+        connection->Write("error " + r.id + " bad weight: " + rest + "\n");
+    } else if (Field(line, "grammar", &rest)) {
+      int n = atoi(rest.c_str());
+      for (int i = 0; i < n && connection->ReadLine(&line); ++i)
+        r.grammar += line + '\n';
+    } else if (Field(line, "input", &rest)) {
+      r.input = rest;
+      Push(r);
+      in_request = false;
+    } else {
+      connection->Write("error " + r.id + " unknown field: " + line + "\n");
+    }
+  }
+}
+
+void TranslationServer::DecodeWorker(Decoder* decoder) {
+  vector<Request> batch;
+  while (Pop(&batch)) {
+    for (size_t b = 0; b < batch.size(); ) {
+      size_t e = b + 1;
+      while (e < batch.size() && batch[e].weights == batch[b].weights) ++e;
+      // the overrides apply to the weights of every pass (the first pass
+      // prunes and the last one scores with its own vector)
+      vector<vector<weight_t>*> weights;
+      vector<vector<weight_t> > saved_weights;
+      vector<int> fids(batch[b].weights.size(), 0);
+      if (!fids.empty()) {
+        decoder->WeightVectors(&weights);
+        saved_weights.resize(weights.size());
+        for (int k = 0; k < weights.size(); ++k)
+          saved_weights[k] = *weights[k];
+      }
+      for (size_t i = b; i < e; ++i)
+        Decode(decoder, batch[i], weights, &fids);
+      for (int k = 0; k < weights.size(); ++k)
+        weights[k]->swap(saved_weights[k]);
+      b = e;
+    }
+  }
+}
+
+void TranslationServer::Decode(Decoder* decoder, Request& r, const vector<vector<weight_t>*>& weights,
+                               vector<int>* fids) {
+  chrono::steady_clock::time_point start = chrono::steady_clock::now();
+  if (!r.grammar.empty() && !supports_grammars_) {
+    r.connection->Write("error " + r.id + " per-request grammars need the SCFG formalism\n");
+    r.connection.reset();
+    return;
+  }
+  if (!r.grammar.empty()) decoder->AddSupplementalGrammarFromString(r.grammar);
+  // names are looked up without adding them to FD, so requests cannot grow
+  // it. a feature nothing has fired yet has no weight to override, but the
+  // request's own grammar may have introduced it (it is read first)
+  for (int i = 0; i < fids->size(); ++i) {
+    if ((*fids)[i]) continue;
+    const int fid = (*fids)[i] = FD::Lookup(r.weights[i].first);
+    if (fid == 0) continue;
+    for (int k = 0; k < weights.size(); ++k) {
+      vector<weight_t>& w = *weights[k];
+      if (fid >= w.size()) w.resize(fid + 1);
+      w[fid] = r.weights[i].second;
+    }
+  }
+  {
+    lock_guard<mutex> lock(id_mutex_);
+    decoder->SetId(next_id_++);
+  }
+  ostringstream out;
+  decoder->SetOutputStream(&out);
+  decoder->Decode(r.input);
+  const string result = out.str();
+  int lines = 0;
+  for (size_t i = 0; i < result.size(); ++i)
+    if (result[i] == '\n') ++lines;
+  ostringstream header;
+  header << "result " << r.id << ' ' << lines << ' '
+         << chrono::duration<double>(chrono::steady_clock::now() - start).count() << '\n';
+  r.connection->Write(header.str() + result);  // dropped if the client went away
+  r.connection.reset();
+}
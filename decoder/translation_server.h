@@ -0,0 +1,63 @@
+#ifndef TRANSLATION_SERVER_H_
+#define TRANSLATION_SERVER_H_
+
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+#include <boost/shared_ptr.hpp>
+#include "weights.h"
+
+class Decoder;
+class LineSocket;
+
+// the request loop of cdec_server (see cdec_server.cc for the protocol).
+// requests from all connections go into one queue that one worker thread per
+// decoder takes them from, in batches of up to batch_size requests (but no
+// more than an even share of the queue, so idle workers are not starved).
+// consecutive requests of a batch with the same weight overrides are decoded
+// with one change of the weight vectors
+class TranslationServer {
+ public:
+  // the decoders must outlive the server
+  explicit TranslationServer(const std::vector<Decoder*>& decoders, int batch_size = 1);
+  // finishes the requests that are being decoded, drops the queued ones
+  ~TranslationServer();
+
+  // reads requests from the connected socket fd until the client stops
+  // sending, then returns; fd is closed once every result has been written.
+  // call it on a thread of its own for each client
+  void Serve(int fd);
+
+ private:
+  struct Request {
+    boost::shared_ptr<LineSocket> connection;
+    std::string id;
+    std::vector<std::pair<std::string, double> > weights;
+    std::string grammar;
+    std::string input;
+  };
+
+  void Push(const Request& r);
+  bool Pop(std::vector<Request>* batch);  // false once the server is stopping
+  void DecodeWorker(Decoder* decoder);
+  // decodes r and sends back its result; weights and fids are the weight
+  // vectors of the decoder and the ids of r's overrides (0 if not known yet)
+  void Decode(Decoder* decoder, Request& r, const std::vector<std::vector<weight_t>*>& weights,
+              std::vector<int>* fids);
+
+  bool supports_grammars_;
+  const int batch_size_;
+  bool stopping_;
+  std::deque<Request> queue_;
+  std::mutex mutex_;
+  std::condition_variable cv_;
+  std::mutex id_mutex_;
+  int next_id_;
+  std::vector<std::thread> workers_;
+};
+
+#endif
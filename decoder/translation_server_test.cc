@@ -0,0 +1,133 @@
+#define BOOST_TEST_MODULE TranslationServerTest
+#include <boost/test/unit_test.hpp>
+
+#include <sys/socket.h>
+#include <unistd.h>
+#include <map>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+#include "decoder.h"
+#include "fdict.h"
+#include "tdict.h"
+#include "translation_server.h"
+
+using namespace std;
+
+// writes the requests to a server over a socketpair and returns what it sends
+// back, by request ID
+static map<string, string> Exchange(Decoder* decoder, const string& requests, int batch_size = 1) {
+  int fds[2];
+  BOOST_REQUIRE_EQUAL(socketpair(AF_UNIX, SOCK_STREAM, 0, fds), 0);
+  map<string, string> results;
+  {
+    TranslationServer server(vector<Decoder*>(1, decoder), batch_size);
+    thread serve(&TranslationServer::Serve, &server, fds[0]);
+    BOOST_REQUIRE_EQUAL(write(fds[1], requests.data(), requests.size()), (ssize_t) requests.size());
+    shutdown(fds[1], SHUT_WR);
+    // the server closes its end once every result has been written
+    string received;
+    char buf[4096];
+    ssize_t r;
+    while ((r = read(fds[1], buf, sizeof(buf))) > 0)
+      received.append(buf, r);
+    serve.join();
+    close(fds[1]);
+
+    istringstream in(received);
+    string line;
+    while (getline(in, line)) {
+      istringstream header(line);
+      string kind, id;
+      header >> kind >> id;
+      if (kind == "result") {
+        int n = 0;
+        header >> n;
+        string result;
+        for (int i = 0; i < n && getline(in, line); ++i)
+          result += line + '\n';
+        results[id] = result;
+      } else {
+        results[id] = line;
+      }
+    }
+  }
+  return results;
+}
+
+struct TranslationServerTest {
+  TranslationServerTest() {
+    TD::SetThreadSafe(true);
+    FD::SetThreadSafe(true);
+    string path(boost::unit_test::framework::master_test_suite().argc == 2 ? boost::unit_test::framework::master_test_suite().argv[1] : TEST_DATA);
+    // the first pass keeps only its best derivation, so a weight override
+    // that misses the first pass changes nothing
+    istringstream config("formalism=scfg\n"
+                         "weights=" + path + "/weights.gt\n"
+                         "density_prune=1\n"
+                         "weights2=" + path + "/weights.gt\n");
+    decoder.reset(new Decoder(&config));
+  }
+  boost::shared_ptr<Decoder> decoder;
+};
+
+static const char kGrammar[] =
+    "grammar 2\n"
+    "[X] ||| hola ||| hello ||| Phrase_0=1\n"
+    "[X] ||| hola ||| hi ||| Phrase_1=1\n";
+
+BOOST_FIXTURE_TEST_SUITE( s, TranslationServerTest );
+
+BOOST_AUTO_TEST_CASE(TestRequests) {
+  map<string, string> results = Exchange(decoder.get(),
+      string("request a\n") + kGrammar + "input hola\n"
+      "request b\nweight Phrase_1 2\n" + kGrammar + "input hola\n"
+      "request c\n" + kGrammar + "input hola\n"
+      "request d\nbogus field\n");
+  BOOST_CHECK_EQUAL(results.size(), 4);
+  BOOST_CHECK_EQUAL(results["a"], "hello\n");
+  BOOST_CHECK_EQUAL(results["b"], "hi\n");
+  // the override only applies to its own request
+  BOOST_CHECK_EQUAL(results["c"], "hello\n");
+  BOOST_CHECK_EQUAL(results["d"], "error d unknown field: bogus field");
+}
+
+BOOST_AUTO_TEST_CASE(TestBatches) {
+  map<string, string> results = Exchange(decoder.get(),
+      string("request a\nweight Phrase_1 2\n") + kGrammar + "input hola\n"
+      "request b\nweight Phrase_1 2\n" + kGrammar + "input hola\n"
+      "request c\n" + kGrammar + "input hola\n"
+      "request d\nweight Phrase_1 2\n" + kGrammar + "input hola\n", 8);
+  BOOST_CHECK_EQUAL(results.size(), 4);
+  BOOST_CHECK_EQUAL(results["a"], "hi\n");
+  BOOST_CHECK_EQUAL(results["b"], "hi\n");
+  BOOST_CHECK_EQUAL(results["c"], "hello\n");
+  BOOST_CHECK_EQUAL(results["d"], "hi\n");
+}
+
+BOOST_AUTO_TEST_CASE(TestUnknownWeights) {
+  const int num_feats = FD::NumFeats();
+  map<string, string> results = Exchange(decoder.get(),
+      string("request a\nweight NeverFired 2\n") + kGrammar + "input hola\n"
+      // a feature only the request's grammar has
+      "request b\nweight RequestOnly 5\n"
+      "grammar 2\n"
+      "[X] ||| hola ||| hello ||| Phrase_0=1\n"
+      "[X] ||| hola ||| hi ||| RequestOnly=1\n"
+      "input hola\n");
+  BOOST_CHECK_EQUAL(results["a"], "hello\n");
+  BOOST_CHECK_EQUAL(results["b"], "hi\n");
+  // names of features nothing has fired are not added
+  BOOST_CHECK_EQUAL(FD::Lookup("NeverFired"), 0);
+  BOOST_CHECK_EQUAL(FD::NumFeats(), num_feats + 1);
+}
+
+BOOST_AUTO_TEST_CASE(TestWeightVectors) {
+  vector<vector<weight_t>*> weights;
+  decoder->WeightVectors(&weights);
+  BOOST_CHECK_EQUAL(weights.size(), 2);
+  BOOST_CHECK(weights.back() == &decoder->CurrentWeightVector());
+}
+
+BOOST_AUTO_TEST_SUITE_END()
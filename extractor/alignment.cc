@@ -15,6 +15,7 @@ namespace extractor {
 
 Alignment::Alignment(const string& filename) {
   ifstream infile(filename.c_str());
+  vector<vector<pair<int, int>>> alignments;
   string line;
   while (getline(infile, line)) {
     vector<string> items;
@@ -26,19 +27,43 @@ Alignment::Alignment(const string& filename) {
     }
     alignments.push_back(alignment);
   }
-  alignments.shrink_to_fit();
+  SetAlignments(alignments);
 }
 
 Alignment::Alignment() {}
 
+void Alignment::SetAlignments(
+    const vector<vector<pair<int, int>>>& alignments) {
+  vector<uint64_t> starts(1, 0);
+  vector<pair<int, int>> all_links;
+  for (const auto& alignment: alignments) {
+    all_links.insert(all_links.end(), alignment.begin(), alignment.end());
+    starts.push_back(all_links.size());
+  }
+  sentence_start = move(starts);
+  links = move(all_links);
+}
+
+void Alignment::WriteFlat(FlatWriter& writer) const {
+  writer.Write(sentence_start);
+  writer.Write(links);
+}
+
+void Alignment::ReadFlat(FlatReader& reader) {
+  sentence_start = reader.Read<uint64_t>();
+  links = reader.Read<pair<int, int>>();
+}
+
 Alignment::~Alignment() {}
 
 vector<pair<int, int>> Alignment::GetLinks(int sentence_index) const {
-  return alignments[sentence_index];
+  return vector<pair<int, int>>(
+      links.begin() + sentence_start[sentence_index],
+      links.begin() + sentence_start[sentence_index + 1]);
 }
 
 bool Alignment::operator==(const Alignment& other) const {
-  return alignments == other.alignments;
+  return sentence_start == other.sentence_start && links == other.links;
 }
 
 } // namespace extractor
@@ -9,6 +9,8 @@
 #include <boost/serialization/utility.hpp>
 #include <boost/serialization/vector.hpp>
 
+#include "flat_file.h"
+
 using namespace std;
 
 namespace extractor {
@@ -29,16 +31,41 @@ class Alignment {
 
   virtual ~Alignment();
 
+  // Writes the alignment in the flat file format.
+  void WriteFlat(FlatWriter& writer) const;
+
+  // Reads an alignment written by WriteFlat (the arrays are used in place).
+  void ReadFlat(FlatReader& reader);
+
   bool operator==(const Alignment& alignment) const;
 
  private:
+  // Stores the links of all sentences in a single array.
+  void SetAlignments(const vector<vector<pair<int, int>>>& alignments);
+
   friend class boost::serialization::access;
 
-  template<class Archive> void serialize(Archive& ar, unsigned int) {
-    ar & alignments;
+  template<class Archive> void save(Archive& ar, unsigned int) const {
+    vector<vector<pair<int, int>>> alignments;
+    for (size_t i = 0; i + 1 < sentence_start.size(); ++i) {
+      alignments.push_back(vector<pair<int, int>>(
+          links.begin() + sentence_start[i],
+          links.begin() + sentence_start[i + 1]));
+    }
+    ar << alignments;
   }
 
-  vector<vector<pair<int, int>>> alignments;
+  template<class Archive> void load(Archive& ar, unsigned int) {
+    vector<vector<pair<int, int>>> alignments;
+    ar >> alignments;
+    SetAlignments(alignments);
+  }
+
+  BOOST_SERIALIZATION_SPLIT_MEMBER();
+
+  // The links of sentence i are links[sentence_start[i], sentence_start[i+1]).
+  FlatArray<uint64_t> sentence_start;
+  FlatArray<pair<int, int>> links;
 };
 
 } // namespace extractor
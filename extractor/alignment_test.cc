@@ -1,10 +1,13 @@
 #include <gtest/gtest.h>
 
+#include <cstdlib>
+#include <fstream>
 #include <sstream>
 #include <string>
 
 #include <boost/archive/binary_iarchive.hpp>
 #include <boost/archive/binary_oarchive.hpp>
+#include <unistd.h>
 
 #include "alignment.h"
 
@@ -45,5 +48,23 @@ TEST_F(AlignmentTest, TestSerialization) {
   EXPECT_EQ(alignment, alignment_copy);
 }
 
+TEST_F(AlignmentTest, TestFlatFile) {
+  char filename[] = "/tmp/alignment_testXXXXXX";
+  close(mkstemp(filename));
+  ofstream out(filename, ios::binary);
+  FlatWriter writer(out, FLAT_ALIGNMENT);
+  alignment.WriteFlat(writer);
+  out.close();
+
+  Alignment alignment_copy;
+  FlatReader reader(filename, FLAT_ALIGNMENT);
+  alignment_copy.ReadFlat(reader);
+  unlink(filename);
+
+  EXPECT_EQ(alignment, alignment_copy);
+  vector<pair<int, int>> expected_links = {make_pair(1, 0), make_pair(2, 1)};
+  EXPECT_EQ(expected_links, alignment_copy.GetLinks(1));
+}
+
 } // namespace
 } // namespace extractor
@@ -1,9 +1,11 @@
 #include "data_array.h"
 
+#include <cstring>
 #include <fstream>
 #include <iostream>
 #include <sstream>
 #include <string>
+#include <unordered_map>
 
 using namespace std;
 
@@ -46,13 +48,18 @@ DataArray::DataArray(const string& filename, const Side& side) {
 }
 
 void DataArray::InitializeDataArray() {
+  SetVocabulary({NULL_WORD_STR, END_OF_LINE_STR});
+}
+
+void DataArray::CreateDataArray(const vector<string>& lines) {
+  unordered_map<string, int> word2id;
+  vector<string> id2word;
   word2id[NULL_WORD_STR] = NULL_WORD;
   id2word.push_back(NULL_WORD_STR);
   word2id[END_OF_LINE_STR] = END_OF_LINE;
   id2word.push_back(END_OF_LINE_STR);
-}
 
-void DataArray::CreateDataArray(const vector<string>& lines) {
+  vector<int> data, sentence_id, sentence_start;
   for (size_t i = 0; i < lines.size(); ++i) {
     sentence_start.push_back(data.size());
 
@@ -74,12 +81,48 @@ void DataArray::CreateDataArray(const vector<string>& lines) {
   data.shrink_to_fit();
   sentence_id.shrink_to_fit();
   sentence_start.shrink_to_fit();
+  this->data = move(data);
+  this->sentence_id = move(sentence_id);
+  this->sentence_start = move(sentence_start);
+  SetVocabulary(id2word);
+}
+
+void DataArray::SetVocabulary(const vector<string>& words) {
+  vector<uint64_t> offsets(1, 0);
+  vector<char> chars;
+  vector<uint64_t> hashes;
+  for (const string& word: words) {
+    chars.insert(chars.end(), word.begin(), word.end());
+    offsets.push_back(chars.size());
+    hashes.push_back(FlatHash(word.data(), word.size()));
+  }
+  word_offsets = move(offsets);
+  word_chars = move(chars);
+  word_table = BuildFlatTable(hashes);
+}
+
+void DataArray::WriteFlat(FlatWriter& writer) const {
+  writer.Write(word_offsets);
+  writer.Write(word_chars);
+  writer.Write(word_table);
+  writer.Write(data);
+  writer.Write(sentence_id);
+  writer.Write(sentence_start);
+}
+
+void DataArray::ReadFlat(FlatReader& reader) {
+  word_offsets = reader.Read<uint64_t>();
+  word_chars = reader.Read<char>();
+  word_table = reader.Read<int>();
+  data = reader.Read<int>();
+  sentence_id = reader.Read<int>();
+  sentence_start = reader.Read<int>();
 }
 
 DataArray::~DataArray() {}
 
 vector<int> DataArray::GetData() const {
-  return data;
+  return data.ToVector();
 }
 
 int DataArray::AtIndex(int index) const {
@@ -87,7 +130,7 @@ int DataArray::AtIndex(int index) const {
 }
 
 string DataArray::GetWordAtIndex(int index) const {
-  return id2word[data[index]];
+  return WordOf(data[index]);
 }
 
 vector<int> DataArray::GetWordIds(int index, int size) const {
@@ -97,7 +140,7 @@ vector<int> DataArray::GetWordIds(int index, int size) const {
 vector<string> DataArray::GetWords(int start_index, int size) const {
   vector<string> words;
   for (int word_id: GetWordIds(start_index, size)) {
-    words.push_back(id2word[word_id]);
+    words.push_back(WordOf(word_id));
   }
   return words;
 }
@@ -107,7 +150,7 @@ int DataArray::GetSize() const {
 }
 
 int DataArray::GetVocabularySize() const {
-  return id2word.size();
+  return word_offsets.size() - 1;
 }
 
 int DataArray::GetNumSentences() const {
@@ -128,17 +171,29 @@ int DataArray::GetSentenceId(int position) const {
 }
 
 int DataArray::GetWordId(const string& word) const {
-  auto result = word2id.find(word);
-  return result == word2id.end() ? -1 : result->second;
+  return FindInFlatTable(word_table, FlatHash(word.data(), word.size()),
+      [&](int word_id) {
+        uint64_t start = word_offsets[word_id];
+        return word_offsets[word_id + 1] - start == word.size() &&
+               memcmp(word_chars.begin() + start, word.data(),
+                      word.size()) == 0;
+      });
 }
 
 string DataArray::GetWord(int word_id) const {
-  return id2word[word_id];
+  return WordOf(word_id);
+}
+
+string DataArray::WordOf(int word_id) const {
+  uint64_t start = word_offsets[word_id];
+  return string(word_chars.begin() + start,
+                word_chars.begin() + word_offsets[word_id + 1]);
 }
 
 bool DataArray::operator==(const DataArray& other) const {
-  return word2id == other.word2id && id2word == other.id2word &&
-         data == other.data && sentence_start == other.sentence_start &&
+  return word_offsets == other.word_offsets &&
+         word_chars == other.word_chars && data == other.data &&
+         sentence_start == other.sentence_start &&
          sentence_id == other.sentence_id;
 }
 
@@ -2,7 +2,6 @@
 #define _DATA_ARRAY_H_
 
 #include <string>
-#include <unordered_map>
 #include <vector>
 
 #include <boost/serialization/serialization.hpp>
@@ -10,6 +9,8 @@
 #include <boost/serialization/string.hpp>
 #include <boost/serialization/vector.hpp>
 
+#include "flat_file.h"
+
 using namespace std;
 
 namespace extractor {
@@ -28,6 +29,10 @@ enum Side {
  * index for each sentence and, for each token, the index of the sentence it
  * belongs to.
  *
+ * The arrays (including the hash table used to look up word ids) are stored in
+ * the format used by flat files, so a data array read from a flat file needs
+ * no further processing.
+ *
  * Note: This class has features for both the source and target data arrays.
  * Maybe we can save some memory by having more specific implementations (not
  * likely to save a lot of memory tough).
@@ -92,6 +97,12 @@ class DataArray {
   // Returns the number of the sentence containing the given position.
   virtual int GetSentenceId(int position) const;
 
+  // Writes the data array in the flat file format.
+  void WriteFlat(FlatWriter& writer) const;
+
+  // Reads a data array written by WriteFlat (the arrays are used in place).
+  void ReadFlat(FlatReader& reader);
+
   bool operator==(const DataArray& other) const;
 
  private:
@@ -101,33 +112,49 @@ class DataArray {
   // Constructs the data array.
   void CreateDataArray(const vector<string>& lines);
 
+  // Stores the words (indexed by word id) and the table mapping them to ids.
+  void SetVocabulary(const vector<string>& words);
+
+  // Non-virtual version of GetWord.
+  string WordOf(int word_id) const;
+
   friend class boost::serialization::access;
 
   template<class Archive> void save(Archive& ar, unsigned int) const {
+    vector<string> id2word;
+    for (size_t i = 0; i + 1 < word_offsets.size(); ++i) {
+      id2word.push_back(WordOf(i));
+    }
     ar << id2word;
-    ar << data;
-    ar << sentence_id;
-    ar << sentence_start;
+    ar << data.ToVector();
+    ar << sentence_id.ToVector();
+    ar << sentence_start.ToVector();
   }
 
   template<class Archive> void load(Archive& ar, unsigned int) {
+    vector<string> id2word;
     ar >> id2word;
-    for (size_t i = 0; i < id2word.size(); ++i) {
-      word2id[id2word[i]] = i;
-    }
-
-    ar >> data;
-    ar >> sentence_id;
-    ar >> sentence_start;
+    SetVocabulary(id2word);
+
+    vector<int> values;
+    ar >> values;
+    data = move(values);
+    ar >> values;
+    sentence_id = move(values);
+    ar >> values;
+    sentence_start = move(values);
   }
 
   BOOST_SERIALIZATION_SPLIT_MEMBER();
 
-  unordered_map<string, int> word2id;
-  vector<string> id2word;
-  vector<int> data;
-  vector<int> sentence_id;
-  vector<int> sentence_start;
+  // Word i is stored in word_chars[word_offsets[i], word_offsets[i + 1]).
+  FlatArray<uint64_t> word_offsets;
+  FlatArray<char> word_chars;
+  // Open addressing table of word ids, hashed by FlatHash of the words.
+  FlatArray<int> word_table;
+  FlatArray<int> data;
+  FlatArray<int> sentence_id;
+  FlatArray<int> sentence_start;
 };
 
 } // namespace extractor
@@ -1,5 +1,7 @@
 #include <gtest/gtest.h>
 
+#include <cstdlib>
+#include <fstream>
 #include <memory>
 #include <sstream>
 #include <string>
@@ -7,6 +9,7 @@
 #include <boost/archive/binary_iarchive.hpp>
 #include <boost/archive/binary_oarchive.hpp>
 #include <boost/filesystem.hpp>
+#include <unistd.h>
 
 #include "data_array.h"
 
@@ -119,5 +122,29 @@ TEST_F(DataArrayTest, TestSerialization) {
   EXPECT_EQ(target_data, target_copy);
 }
 
+TEST_F(DataArrayTest, TestFlatFile) {
+  char filename[] = "/tmp/data_array_testXXXXXX";
+  close(mkstemp(filename));
+  ofstream out(filename, ios::binary);
+  FlatWriter writer(out, FLAT_DATA_ARRAY);
+  source_data.WriteFlat(writer);
+  target_data.WriteFlat(writer);
+  out.close();
+
+  DataArray source_copy, target_copy;
+  FlatReader reader(filename, FLAT_DATA_ARRAY);
+  source_copy.ReadFlat(reader);
+  target_copy.ReadFlat(reader);
+  unlink(filename);
+
+  EXPECT_EQ(source_data, source_copy);
+  EXPECT_EQ(target_data, target_copy);
+  EXPECT_EQ(4, source_copy.GetWordId("mere"));
+  EXPECT_EQ(-1, source_copy.GetWordId("apples"));
+  EXPECT_EQ("lapte", source_copy.GetWord(8));
+  EXPECT_EQ(10, target_copy.GetWordId("milk"));
+  EXPECT_EQ(7, target_copy.GetSentenceLength(1));
+}
+
 } // namespace
 } // namespace extractor
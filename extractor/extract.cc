@@ -1,6 +1,7 @@
 #include <fstream>
 #include <iostream>
 #include <memory>
+#include <stdexcept>
 #include <string>
 #include <vector>
 
@@ -24,8 +25,11 @@
 #include "features/max_lex_target_given_source.h"
 #include "features/sample_source_count.h"
 #include "features/target_given_source_coherent.h"
+#include "flat_file.h"
 #include "grammar.h"
 #include "grammar_extractor.h"
+#include "grammar_server.h"
+#include "ordered_pipeline.h"
 #include "precomputation.h"
 #include "rule.h"
 #include "scorer.h"
@@ -41,6 +45,31 @@ using namespace extractor;
 using namespace features;
 using namespace std;
 
+// Reads a data structure written by sacompile. Indexes compiled by older
+// versions of sacompile are boost archives instead of flat files.
+template<typename T>
+void ReadIndex(const string& filename, FlatFileKind kind, T& value) {
+  if (IsFlatFile(filename)) {
+    FlatReader reader(filename, kind);
+    value.ReadFlat(reader);
+  } else {
+    ifstream stream(filename);
+    ar::binary_iarchive archive(stream);
+    archive >> value;
+  }
+}
+
+// Number of input sentences per thread which may be read ahead of the output.
+const int kMaxPendingPerThread = 16;
+
+// Grammar extracted for an input sentence, together with the parts of the input
+// line which are copied to the output.
+struct ExtractedGrammar {
+  string sentence;
+  string suffix;
+  shared_ptr<Grammar> grammar;
+};
+
 // Returns the file path in which a given grammar should be written.
 fs::path GetGrammarFilePath(const fs::path& grammar_path, int file_number) {
   string file_name = "grammar." + to_string(file_number);
@@ -57,7 +86,17 @@ int main(int argc, char** argv) {
   general_options.add_options()
     ("threads,t", po::value<int>()->required()->default_value(1),
      threads_option.c_str())
-    ("grammars,g", po::value<string>()->required(), "Grammars output path")
+    ("grammars,g", po::value<string>(), "Grammars output path")
+    ("binary_grammars", po::value<bool>()->zero_tokens(),
+        "Write the grammars in the binary format that cdec loads without "
+        "parsing")
+    ("socket", po::value<string>(),
+        "Run as a server which extracts grammars for the requests sent to this "
+        "local socket instead of reading sentences from the standard input")
+    ("per_sentence_grammar_file", po::value<string>(),
+        "Write all the grammars (in binary format) to this file instead of "
+        "the grammars path; pass the same file to cdec's "
+        "--per_sentence_grammar_file")
     ("max_rule_span", po::value<int>()->default_value(15),
         "Maximum rule span")
     ("max_rule_symbols", po::value<int>()->default_value(5),
@@ -71,7 +110,11 @@ int main(int argc, char** argv) {
         "False if phrases may be loose (better, but slower)")
     ("leave_one_out", po::value<bool>()->zero_tokens(),
         "Do leave-one-out estimation of grammars "
-        "(e.g. for extracting grammars for the training set");
+        "(e.g. for extracting grammars for the training set")
+    ("online", po::value<bool>()->zero_tokens(),
+        "Online mode: each input line is \"source ||| reference ||| "
+        "alignment\" and the reference is added to the training data after "
+        "extracting the grammar for the source sentence (uses one thread)");
 
   po::options_description cmdline_options("Command line options");
   cmdline_options.add_options()
@@ -110,7 +153,20 @@ int main(int argc, char** argv) {
   po::store(po::parse_config_file(config_stream, config_options), vm);
   po::notify(vm);
 
+  if (!vm.count("grammars") && !vm.count("per_sentence_grammar_file") &&
+      !vm.count("socket")) {
+    cerr << "An output location is required. "
+         << "Use -g (grammars path), --per_sentence_grammar_file or --socket."
+         << endl;
+    return 1;
+  }
+
   int num_threads = vm["threads"].as<int>();
+  bool online = vm.count("online");
+  if (online) {
+    // The grammar of each sentence depends on all the previous sentence pairs.
+    num_threads = 1;
+  }
   cerr << "Grammar extraction will use " << num_threads << " threads." << endl;
 
   Clock::time_point read_start_time = Clock::now();
@@ -118,9 +174,7 @@ int main(int argc, char** argv) {
   Clock::time_point start_time = Clock::now();
   cerr << "Reading target data in binary format..." << endl;
   shared_ptr<DataArray> target_data_array = make_shared<DataArray>();
-  ifstream target_fstream(vm["target"].as<string>());
-  ar::binary_iarchive target_stream(target_fstream);
-  target_stream >> *target_data_array;
+  ReadIndex(vm["target"].as<string>(), FLAT_DATA_ARRAY, *target_data_array);
   Clock::time_point end_time = Clock::now();
   cerr << "Reading target data took " << GetDuration(start_time, end_time)
        << " seconds" << endl;
@@ -128,9 +182,7 @@ int main(int argc, char** argv) {
   start_time = Clock::now();
   cerr << "Reading source suffix array in binary format..." << endl;
   shared_ptr<SuffixArray> source_suffix_array = make_shared<SuffixArray>();
-  ifstream source_fstream(vm["source"].as<string>());
-  ar::binary_iarchive source_stream(source_fstream);
-  source_stream >> *source_suffix_array;
+  ReadIndex(vm["source"].as<string>(), FLAT_SUFFIX_ARRAY, *source_suffix_array);
   end_time = Clock::now();
   cerr << "Reading source suffix array took "
        << GetDuration(start_time, end_time) << " seconds" << endl;
@@ -138,9 +190,7 @@ int main(int argc, char** argv) {
   start_time = Clock::now();
   cerr << "Reading alignment in binary format..." << endl;
   shared_ptr<Alignment> alignment = make_shared<Alignment>();
-  ifstream alignment_fstream(vm["alignment"].as<string>());
-  ar::binary_iarchive alignment_stream(alignment_fstream);
-  alignment_stream >> *alignment;
+  ReadIndex(vm["alignment"].as<string>(), FLAT_ALIGNMENT, *alignment);
   end_time = Clock::now();
   cerr << "Reading alignment took " << GetDuration(start_time, end_time)
        << " seconds" << endl;
@@ -148,9 +198,7 @@ int main(int argc, char** argv) {
   start_time = Clock::now();
   cerr << "Reading precomputation in binary format..." << endl;
   shared_ptr<Precomputation> precomputation = make_shared<Precomputation>();
-  ifstream precomputation_fstream(vm["precomputation"].as<string>());
-  ar::binary_iarchive precomputation_stream(precomputation_fstream);
-  precomputation_stream >> *precomputation;
+  ReadIndex(vm["precomputation"].as<string>(), FLAT_PRECOMPUTATION, *precomputation);
   end_time = Clock::now();
   cerr << "Reading precomputation took " << GetDuration(start_time, end_time)
        << " seconds" << endl;
@@ -168,9 +216,7 @@ int main(int argc, char** argv) {
   start_time = Clock::now();
   cerr << "Reading translation table in binary format..." << endl;
   shared_ptr<TranslationTable> table = make_shared<TranslationTable>();
-  ifstream ttable_fstream(vm["ttable"].as<string>());
-  ar::binary_iarchive ttable_stream(ttable_fstream);
-  ttable_stream >> *table;
+  ReadIndex(vm["ttable"].as<string>(), FLAT_TRANSLATION_TABLE, *table);
   end_time = Clock::now();
   cerr << "Reading translation table took " << GetDuration(start_time, end_time)
        << " seconds" << endl;
@@ -192,7 +238,7 @@ int main(int argc, char** argv) {
   };
   shared_ptr<Scorer> scorer = make_shared<Scorer>(features);
 
-  GrammarExtractor extractor(
+  shared_ptr<GrammarExtractor> extractor = make_shared<GrammarExtractor>(
       source_suffix_array,
       target_data_array,
       alignment,
@@ -206,46 +252,107 @@ int main(int argc, char** argv) {
       vm["max_samples"].as<int>(),
       vm["tight_phrases"].as<bool>());
 
-  // Creates the grammars directory if it doesn't exist.
-  fs::path grammar_path = vm["grammars"].as<string>();
-  if (!fs::is_directory(grammar_path)) {
-    fs::create_directory(grammar_path);
+  bool binary_grammars = vm.count("binary_grammars");
+  if (vm.count("socket")) {
+    GrammarServer server(extractor, num_threads, binary_grammars, online);
+    server.Listen(vm["socket"].as<string>());
+    return 1;
   }
 
-  // Reads all sentences for which we extract grammar rules (the paralellization
-  // is simplified if we read all sentences upfront).
-  string sentence;
-  vector<string> sentences;
-  while (getline(cin, sentence)) {
-    sentences.push_back(sentence);
+  // Creates the grammars directory if it doesn't exist.
+  fs::path grammar_path;
+  ofstream per_sentence_grammars;
+  if (vm.count("per_sentence_grammar_file")) {
+    per_sentence_grammars.open(
+        vm["per_sentence_grammar_file"].as<string>(), ios::binary);
+    if (!per_sentence_grammars) {
+      cerr << "Unable to open "
+           << vm["per_sentence_grammar_file"].as<string>() << endl;
+      return 1;
+    }
+  } else {
+    grammar_path = vm["grammars"].as<string>();
+    if (!fs::is_directory(grammar_path)) {
+      fs::create_directory(grammar_path);
+    }
   }
 
-  // Extracts the grammar for each sentence and saves it to a file.
-  vector<string> suffixes(sentences.size());
-  #pragma omp parallel for schedule(dynamic) num_threads(num_threads)
-  for (size_t i = 0; i < sentences.size(); ++i) {
-    string suffix;
-    int position = sentences[i].find("|||");
-    if (position != sentences[i].npos) {
-      suffix = sentences[i].substr(position);
-      sentences[i] = sentences[i].substr(0, position);
+  // Extracts the grammar for each input sentence and saves it to a file (or
+  // appends it to the per sentence grammar file). The sentences flow through a
+  // bounded pipeline and the output for each sentence is written (in input
+  // order) as soon as its grammar is ready.
+  auto extract_grammar = [&](size_t i, const string& line) {
+    ExtractedGrammar result;
+    result.sentence = line;
+    int position = line.find("|||");
+    if (position != line.npos) {
+      result.suffix = line.substr(position);
+      result.sentence = line.substr(0, position);
+    }
+
+    // In online mode, the suffix starts with the reference and the alignment.
+    string reference, links;
+    if (online) {
+      string& suffix = result.suffix;
+      size_t reference_end = suffix.find("|||", 3);
+      if (position == line.npos || reference_end == suffix.npos) {
+        cerr << "Online mode requires references and alignments. Not adding "
+             << "sentence " << i << " to the training data." << endl;
+      } else {
+        size_t links_end = suffix.find("|||", reference_end + 3);
+        reference = suffix.substr(3, reference_end - 3);
+        links = suffix.substr(reference_end + 3, links_end == suffix.npos ?
+            suffix.npos : links_end - reference_end - 3);
+        suffix = links_end == suffix.npos ? "" : suffix.substr(links_end);
+      }
     }
-    suffixes[i] = suffix;
 
     unordered_set<int> blacklisted_sentence_ids;
     if (vm.count("leave_one_out")) {
       blacklisted_sentence_ids.insert(i);
     }
-    Grammar grammar = extractor.GetGrammar(
-        sentences[i], blacklisted_sentence_ids);
-    ofstream output(GetGrammarFilePath(grammar_path, i).c_str());
-    output << grammar;
-  }
+    result.grammar = make_shared<Grammar>(
+        extractor->GetGrammar(result.sentence, blacklisted_sentence_ids));
+    // Add the sentence pair only after extracting the grammar.
+    if (!reference.empty()) {
+      extractor->AddSentencePair(result.sentence, reference, links);
+    }
 
-  for (size_t i = 0; i < sentences.size(); ++i) {
-    cout << "<seg grammar=" << GetGrammarFilePath(grammar_path, i) << " id=\""
-         << i << "\"> " << sentences[i] << " </seg> " << suffixes[i] << endl;
-  }
+    if (!per_sentence_grammars.is_open()) {
+      fs::path grammar_file = GetGrammarFilePath(grammar_path, i);
+      ofstream output(grammar_file.c_str());
+      if (binary_grammars) {
+        result.grammar->WriteBinary(output);
+      } else {
+        output << *result.grammar;
+      }
+      if (!output) {
+        throw runtime_error("Unable to write " + grammar_file.string());
+      }
+      result.grammar.reset();
+    }
+    return result;
+  };
+
+  auto write_grammar = [&](size_t i, ExtractedGrammar& result) {
+    if (per_sentence_grammars.is_open()) {
+      uint64_t offset = per_sentence_grammars.tellp();
+      result.grammar->WriteBinary(per_sentence_grammars);
+      per_sentence_grammars.flush();
+      if (!per_sentence_grammars) {
+        throw runtime_error("Unable to write " +
+                            vm["per_sentence_grammar_file"].as<string>());
+      }
+      cout << "<seg psg=\"@" << offset << "\" id=\"" << i << "\"> ";
+    } else {
+      cout << "<seg grammar=" << GetGrammarFilePath(grammar_path, i)
+           << " id=\"" << i << "\"> ";
+    }
+    cout << result.sentence << " </seg> " << result.suffix << endl;
+  };
+
+  RunOrderedPipeline<ExtractedGrammar>(cin, num_threads,
+      kMaxPendingPerThread * num_threads, extract_grammar, write_grammar);
 
   Clock::time_point extraction_stop_time = Clock::now();
   cerr << "Overall extraction step took "
@@ -68,7 +68,7 @@ PhraseLocation FastIntersector::ExtendPrefixPhraseLocation(
     PhraseLocation& prefix_location, const Phrase& phrase,
     bool prefix_ends_with_x, int next_symbol) const {
   ExtendPhraseLocation(prefix_location);
-  vector<int> positions = *prefix_location.matchings;
+  const FlatView<int>& positions = prefix_location.matchings;
   int num_subpatterns = prefix_location.num_subpatterns;
 
   vector<int> new_positions;
@@ -114,7 +114,7 @@ PhraseLocation FastIntersector::ExtendSuffixPhraseLocation(
     PhraseLocation& suffix_location, const Phrase& phrase,
     bool suffix_starts_with_x, int prev_symbol) const {
   ExtendPhraseLocation(suffix_location);
-  vector<int> positions = *suffix_location.matchings;
+  const FlatView<int>& positions = suffix_location.matchings;
   int num_subpatterns = suffix_location.num_subpatterns;
 
   vector<int> new_positions;
@@ -154,15 +154,17 @@ PhraseLocation FastIntersector::ExtendSuffixPhraseLocation(
 }
 
 void FastIntersector::ExtendPhraseLocation(PhraseLocation& location) const {
-  if (location.matchings != NULL) {
+  if (location.num_subpatterns > 0) {
     return;
   }
 
-  location.num_subpatterns = 1;
-  location.matchings = make_shared<vector<int>>();
+  vector<int> matchings;
+  matchings.reserve(location.sa_high - location.sa_low);
   for (int i = location.sa_low; i < location.sa_high; ++i) {
-    location.matchings->push_back(suffix_array->GetSuffix(i));
+    matchings.push_back(suffix_array->GetSuffix(i));
   }
+  location.num_subpatterns = 1;
+  location.matchings = FlatView<int>(move(matchings));
   location.sa_low = location.sa_high = 0;
 }
 
@@ -0,0 +1,156 @@
+#include "flat_file.h"
+
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+using namespace std;
+
+namespace extractor {
+
+namespace {
+
+const char kMagic[8] = {'c', 'd', 'e', 'c', 'X', 'I', 'D', 'X'};
+const uint32_t kVersion = 1;
+
+struct FlatHeader {
+  char magic[8];
+  uint32_t version;
+  uint32_t kind;
+};
+
+const char kPadding[8] = {0};
+
+size_t Padded(size_t size) {
+  return (size + 7) & ~static_cast<size_t>(7);
+}
+
+} // namespace
+
+MappedFile::MappedFile(const string& filename) :
+    filename(filename), data(NULL), size(0) {
+  int fd = open(filename.c_str(), O_RDONLY);
+  if (fd < 0) {
+    throw runtime_error("Unable to open " + filename);
+  }
+  struct stat st;
+  if (fstat(fd, &st) != 0) {
+    close(fd);
+    throw runtime_error("Unable to stat " + filename);
+  }
+  size = st.st_size;
+  if (size > 0) {
+    data = mmap(NULL, size, PROT_READ, MAP_SHARED, fd, 0);
+  }
+  close(fd);
+  if (data == MAP_FAILED || data == NULL) {
+    data = NULL;
+    throw runtime_error("Unable to map " + filename);
+  }
+}
+
+MappedFile::~MappedFile() {
+  if (data != NULL) {
+    munmap(data, size);
+  }
+}
+
+const char* MappedFile::GetData() const {
+  return static_cast<const char*>(data);
+}
+
+size_t MappedFile::GetSize() const {
+  return size;
+}
+
+const string& MappedFile::GetFilename() const {
+  return filename;
+}
+
+FlatWriter::FlatWriter(ostream& out, FlatFileKind kind) : out(out) {
+  FlatHeader header;
+  memcpy(header.magic, kMagic, sizeof(kMagic));
+  header.version = kVersion;
+  header.kind = kind;
+  out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+}
+
+void FlatWriter::WriteSection(const void* values, size_t size,
+                              size_t value_size) {
+  uint64_t num_values = size;
+  out.write(reinterpret_cast<const char*>(&num_values), sizeof(num_values));
+  size_t num_bytes = size * value_size;
+  if (num_bytes > 0) {
+    out.write(static_cast<const char*>(values), num_bytes);
+  }
+  out.write(kPadding, Padded(num_bytes) - num_bytes);
+}
+
+FlatReader::FlatReader(const string& filename, FlatFileKind kind) :
+    file(make_shared<MappedFile>(filename)), position(sizeof(FlatHeader)) {
+  if (file->GetSize() < sizeof(FlatHeader)) {
+    throw runtime_error(filename + " is not a flat file");
+  }
+  const FlatHeader* header =
+      reinterpret_cast<const FlatHeader*>(file->GetData());
+  if (memcmp(header->magic, kMagic, sizeof(kMagic)) != 0) {
+    throw runtime_error(filename + " is not a flat file");
+  }
+  if (header->version != kVersion) {
+    throw runtime_error(filename + " has flat file version " +
+                        to_string(header->version) + ", expected " +
+                        to_string(kVersion) + " (rerun sacompile)");
+  }
+  if (header->kind != kind) {
+    throw runtime_error(filename + " stores a different data structure");
+  }
+}
+
+const char* FlatReader::ReadSection(size_t value_size, size_t* size) {
+  uint64_t num_values;
+  if (position + sizeof(num_values) > file->GetSize()) {
+    throw runtime_error(file->GetFilename() + " is truncated");
+  }
+  memcpy(&num_values, file->GetData() + position, sizeof(num_values));
+  position += sizeof(num_values);
+  if (num_values > file->GetSize() / value_size ||
+      position + Padded(num_values * value_size) > file->GetSize()) {
+    throw runtime_error(file->GetFilename() + " is truncated");
+  }
+  size_t num_bytes = Padded(num_values * value_size);
+  const char* values = file->GetData() + position;
+  position += num_bytes;
+  *size = num_values;
+  return values;
+}
+
+bool IsFlatFile(const string& filename) {
+  ifstream in(filename.c_str(), ios::binary);
+  char magic[sizeof(kMagic)];
+  return in.read(magic, sizeof(magic)) &&
+         memcmp(magic, kMagic, sizeof(kMagic)) == 0;
+}
+
+vector<int> BuildFlatTable(const vector<uint64_t>& hashes) {
+  size_t num_slots = 2;
+  while (num_slots < 2 * hashes.size()) {
+    num_slots *= 2;
+  }
+  vector<int> table(num_slots, -1);
+  size_t mask = num_slots - 1;
+  for (size_t entry = 0; entry < hashes.size(); ++entry) {
+    size_t i = hashes[entry] & mask;
+    while (table[i] != -1) {
+      i = (i + 1) & mask;
+    }
+    table[i] = entry;
+  }
+  return table;
+}
+
+} // namespace extractor
@@ -0,0 +1,261 @@
+#ifndef _FLAT_FILE_H_
+#define _FLAT_FILE_H_
+
+#include <algorithm>
+#include <cstdint>
+#include <memory>
+#include <ostream>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+namespace extractor {
+
+/**
+ * Flat on-disk layout for the data structures written by sacompile.
+ *
+ * A flat file starts with a header (magic string, format version and the kind
+ * of data structure stored in the file) followed by a sequence of sections.
+ * Each section is an array: a 64 bit element count followed by the elements,
+ * padded to a multiple of 8 bytes. Loading a flat file only maps it into
+ * memory, the arrays (including the hash tables, which are stored as open
+ * addressing tables) are used in place, so startup time does not depend on
+ * the size of the data and processes reading the same file share its pages.
+ *
+ * The layout uses the byte order of the machine which wrote it.
+ */
+enum FlatFileKind {
+  FLAT_DATA_ARRAY = 1,
+  FLAT_SUFFIX_ARRAY = 2,
+  FLAT_PRECOMPUTATION = 3,
+  FLAT_TRANSLATION_TABLE = 4,
+  FLAT_ALIGNMENT = 5
+};
+
+// Read-only shared memory mapping of a file.
+class MappedFile {
+ public:
+  // Maps the file into memory. Throws runtime_error if it fails.
+  MappedFile(const string& filename);
+
+  ~MappedFile();
+
+  const char* GetData() const;
+
+  size_t GetSize() const;
+
+  const string& GetFilename() const;
+
+ private:
+  MappedFile(const MappedFile&);
+  MappedFile& operator=(const MappedFile&);
+
+  string filename;
+  void* data;
+  size_t size;
+};
+
+/**
+ * Read-only view of an array of values which keeps the memory holding them
+ * alive (an owned vector or a mapped file). Copies share the values.
+ */
+template<typename T>
+class FlatView {
+ public:
+  FlatView() : begin_(NULL), size_(0) {}
+
+  // Takes over the given values.
+  FlatView(vector<T>&& values) {
+    shared_ptr<vector<T>> owned = make_shared<vector<T>>(move(values));
+    begin_ = owned->data();
+    size_ = owned->size();
+    owner_ = owned;
+  }
+
+  // Refers to size values starting at begin, which owner keeps alive.
+  FlatView(const T* begin, size_t size, shared_ptr<const void> owner) :
+      begin_(begin), size_(size), owner_(owner) {}
+
+  const T& operator[](size_t index) const { return begin_[index]; }
+  const T* begin() const { return begin_; }
+  const T* end() const { return begin_ + size_; }
+  size_t size() const { return size_; }
+  bool empty() const { return size_ == 0; }
+
+  vector<T> ToVector() const { return vector<T>(begin(), end()); }
+
+  bool operator==(const FlatView& other) const {
+    return size_ == other.size_ && equal(begin(), end(), other.begin());
+  }
+
+  bool operator!=(const FlatView& other) const { return !(*this == other); }
+
+ private:
+  const T* begin_;
+  size_t size_;
+  shared_ptr<const void> owner_;
+};
+
+/**
+ * Array of trivially copyable values which either owns its values or refers
+ * to a section of a mapped file (which it keeps alive).
+ */
+template<typename T>
+class FlatArray {
+ public:
+  FlatArray() : begin_(NULL), size_(0) {}
+
+  // Takes over the given values.
+  FlatArray(vector<T>&& values) :
+      values_(make_shared<vector<T>>(move(values))),
+      begin_(values_->data()), size_(values_->size()) {}
+
+  // Refers to size values in a mapped file.
+  FlatArray(const T* begin, size_t size, shared_ptr<MappedFile> file) :
+      begin_(begin), size_(size), file_(file) {}
+
+  // Owned values are copied.
+  FlatArray(const FlatArray& other) :
+      begin_(other.begin_), size_(other.size_), file_(other.file_) {
+    if (other.values_) {
+      values_ = make_shared<vector<T>>(*other.values_);
+      begin_ = values_->data();
+    }
+  }
+
+  FlatArray(FlatArray&& other) :
+      values_(move(other.values_)), begin_(other.begin_), size_(other.size_),
+      file_(move(other.file_)) {
+    other.begin_ = NULL;
+    other.size_ = 0;
+  }
+
+  FlatArray& operator=(const FlatArray& other) {
+    return *this = FlatArray(other);
+  }
+
+  FlatArray& operator=(FlatArray&& other) {
+    values_ = move(other.values_);
+    begin_ = other.begin_;
+    size_ = other.size_;
+    file_ = move(other.file_);
+    other.begin_ = NULL;
+    other.size_ = 0;
+    return *this;
+  }
+
+  const T& operator[](size_t index) const { return begin_[index]; }
+  const T* begin() const { return begin_; }
+  const T* end() const { return begin_ + size_; }
+  size_t size() const { return size_; }
+  bool empty() const { return size_ == 0; }
+
+  vector<T> ToVector() const { return vector<T>(begin(), end()); }
+
+  // Returns a view of size values starting at start without copying them.
+  // The view keeps the values alive, even if this array goes away.
+  FlatView<T> View(size_t start, size_t size) const {
+    shared_ptr<const void> owner = values_;
+    if (!owner) {
+      owner = file_;
+    }
+    return FlatView<T>(begin_ + start, size, owner);
+  }
+
+  bool operator==(const FlatArray& other) const {
+    return size_ == other.size_ && equal(begin(), end(), other.begin());
+  }
+
+  bool operator!=(const FlatArray& other) const { return !(*this == other); }
+
+ private:
+  shared_ptr<vector<T>> values_;
+  const T* begin_;
+  size_t size_;
+  shared_ptr<MappedFile> file_;
+};
+
+// Writes a flat file section by section.
+class FlatWriter {
+ public:
+  // Writes the file header.
+  FlatWriter(ostream& out, FlatFileKind kind);
+
+  template<typename T> void Write(const T* values, size_t size) {
+    WriteSection(values, size, sizeof(T));
+  }
+
+  template<typename T> void Write(const vector<T>& values) {
+    Write(values.data(), values.size());
+  }
+
+  template<typename T> void Write(const FlatArray<T>& values) {
+    Write(values.begin(), values.size());
+  }
+
+ private:
+  void WriteSection(const void* values, size_t size, size_t value_size);
+
+  ostream& out;
+};
+
+// Reads the sections of a mapped flat file in the order they were written.
+class FlatReader {
+ public:
+  // Maps the file and checks its header. Throws runtime_error if the file is
+  // not a flat file of the given kind and version.
+  FlatReader(const string& filename, FlatFileKind kind);
+
+  template<typename T> FlatArray<T> Read() {
+    size_t size;
+    const char* values = ReadSection(sizeof(T), &size);
+    return FlatArray<T>(reinterpret_cast<const T*>(values), size, file);
+  }
+
+ private:
+  const char* ReadSection(size_t value_size, size_t* size);
+
+  shared_ptr<MappedFile> file;
+  size_t position;
+};
+
+// Checks if the file starts with the magic string of flat files.
+bool IsFlatFile(const string& filename);
+
+// Hash function used by the tables in flat files (64 bit FNV-1a).
+inline uint64_t FlatHash(const void* data, size_t size) {
+  const unsigned char* bytes = static_cast<const unsigned char*>(data);
+  uint64_t hash = 14695981039346656037ULL;
+  for (size_t i = 0; i < size; ++i) {
+    hash = (hash ^ bytes[i]) * 1099511628211ULL;
+  }
+  return hash;
+}
+
+// Builds an open addressing table for entries with the given hashes. Each slot
+// holds an entry index or -1. The number of slots is a power of 2, at least
+// twice the number of entries. Building the table from the same sequence of
+// hashes always gives the same table.
+vector<int> BuildFlatTable(const vector<uint64_t>& hashes);
+
+// Returns the index of the entry with the given hash for which is_match
+// returns true or -1 if there is no such entry.
+template<typename Predicate>
+int FindInFlatTable(const FlatArray<int>& table, uint64_t hash,
+                    Predicate is_match) {
+  if (table.empty()) {
+    return -1;
+  }
+  size_t mask = table.size() - 1;
+  for (size_t i = hash & mask; ; i = (i + 1) & mask) {
+    int entry = table[i];
+    if (entry == -1 || is_match(entry)) {
+      return entry;
+    }
+  }
+}
+
+} // namespace extractor
+
+#endif
@@ -0,0 +1,134 @@
+#include <gtest/gtest.h>
+
+#include <cstdlib>
+#include <fstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include <unistd.h>
+
+#include "flat_file.h"
+
+using namespace std;
+using namespace ::testing;
+
+namespace extractor {
+namespace {
+
+class FlatFileTest : public Test {
+ protected:
+  virtual void SetUp() {
+    char name[] = "/tmp/flat_file_testXXXXXX";
+    close(mkstemp(name));
+    filename = name;
+  }
+
+  virtual void TearDown() {
+    unlink(filename.c_str());
+  }
+
+  string filename;
+};
+
+TEST_F(FlatFileTest, TestReadWrite) {
+  vector<int> ints = {3, -1, 4, 1, 5};
+  vector<char> chars = {'a', 'b', 'c'};
+  vector<pair<int, int>> pairs = {make_pair(1, 2), make_pair(3, 4)};
+  ofstream out(filename, ios::binary);
+  FlatWriter writer(out, FLAT_ALIGNMENT);
+  writer.Write(ints);
+  writer.Write(chars);
+  writer.Write(vector<double>());
+  writer.Write(pairs);
+  out.close();
+
+  EXPECT_TRUE(IsFlatFile(filename));
+  FlatReader reader(filename, FLAT_ALIGNMENT);
+  FlatArray<int> ints_copy = reader.Read<int>();
+  FlatArray<char> chars_copy = reader.Read<char>();
+  FlatArray<double> doubles_copy = reader.Read<double>();
+  FlatArray<pair<int, int>> pairs_copy = reader.Read<pair<int, int>>();
+  EXPECT_EQ(ints, ints_copy.ToVector());
+  EXPECT_EQ(chars, chars_copy.ToVector());
+  EXPECT_TRUE(doubles_copy.empty());
+  EXPECT_EQ(pairs, pairs_copy.ToVector());
+  EXPECT_EQ(0, reinterpret_cast<size_t>(pairs_copy.begin()) % sizeof(int));
+  EXPECT_THROW(reader.Read<int>(), runtime_error);
+}
+
+TEST_F(FlatFileTest, TestHeader) {
+  ofstream out(filename, ios::binary);
+  out << "not a flat file";
+  out.close();
+  EXPECT_FALSE(IsFlatFile(filename));
+  EXPECT_THROW(FlatReader(filename, FLAT_DATA_ARRAY), runtime_error);
+
+  out.open(filename, ios::binary);
+  FlatWriter writer(out, FLAT_DATA_ARRAY);
+  out.close();
+  EXPECT_TRUE(IsFlatFile(filename));
+  EXPECT_THROW(FlatReader(filename, FLAT_SUFFIX_ARRAY), runtime_error);
+  FlatReader reader(filename, FLAT_DATA_ARRAY);
+  EXPECT_THROW(reader.Read<int>(), runtime_error);
+}
+
+TEST_F(FlatFileTest, TestFlatArray) {
+  FlatArray<int> values(vector<int>{1, 2, 3});
+  FlatArray<int> copy = values;
+  EXPECT_EQ(values, copy);
+  EXPECT_NE(values.begin(), copy.begin());
+
+  FlatArray<int> moved = move(values);
+  EXPECT_TRUE(values.empty());
+  EXPECT_EQ(copy, moved);
+  EXPECT_EQ(2, moved[1]);
+}
+
+TEST_F(FlatFileTest, TestView) {
+  FlatView<int> owned_view, mapped_view;
+  {
+    FlatArray<int> values(vector<int>{1, 2, 3, 4});
+    owned_view = values.View(1, 2);
+    EXPECT_EQ(values.begin() + 1, owned_view.begin());
+
+    ofstream out(filename, ios::binary);
+    FlatWriter writer(out, FLAT_PRECOMPUTATION);
+    writer.Write(values);
+    out.close();
+    FlatReader reader(filename, FLAT_PRECOMPUTATION);
+    FlatArray<int> mapped = reader.Read<int>();
+    mapped_view = mapped.View(2, 2);
+    EXPECT_EQ(mapped.begin() + 2, mapped_view.begin());
+  }
+
+  // The views keep the values alive.
+  EXPECT_EQ(vector<int>({2, 3}), owned_view.ToVector());
+  EXPECT_EQ(vector<int>({3, 4}), mapped_view.ToVector());
+  FlatView<int> copy = owned_view;
+  EXPECT_EQ(owned_view.begin(), copy.begin());
+  EXPECT_TRUE(FlatView<int>().empty());
+}
+
+TEST_F(FlatFileTest, TestTable) {
+  vector<string> words = {"ana", "are", "mere", "", "pere"};
+  vector<uint64_t> hashes;
+  for (const string& word: words) {
+    hashes.push_back(FlatHash(word.data(), word.size()));
+  }
+  FlatArray<int> table(BuildFlatTable(hashes));
+  EXPECT_EQ(16, table.size());
+
+  for (size_t i = 0; i < words.size(); ++i) {
+    EXPECT_EQ(i, FindInFlatTable(table, hashes[i],
+        [&](int entry) { return words[entry] == words[i]; }));
+  }
+  string word = "prune";
+  EXPECT_EQ(-1, FindInFlatTable(table, FlatHash(word.data(), word.size()),
+      [&](int entry) { return words[entry] == word; }));
+  EXPECT_EQ(-1, FindInFlatTable(FlatArray<int>(), 0,
+      [&](int) { return true; }));
+}
+
+} // namespace
+} // namespace extractor
@@ -1,6 +1,8 @@
 #include "grammar.h"
 
+#include <cstdint>
 #include <iomanip>
+#include <unordered_map>
 
 #include "rule.h"
 
@@ -20,6 +22,94 @@ vector<string> Grammar::GetFeatureNames() const {
   return feature_names;
 }
 
+namespace {
+
+template<typename T> void Append(string& buffer, const T& value) {
+  buffer.append(reinterpret_cast<const char*>(&value), sizeof(T));
+}
+
+void AppendString(string& buffer, const string& value) {
+  Append(buffer, static_cast<uint32_t>(value.size()));
+  buffer.append(value);
+}
+
+// Assigns consecutive indexes (starting at 1) to the words of the grammar.
+class WordIndex {
+ public:
+  int32_t Get(const string& word) {
+    auto it = index.find(word);
+    if (it != index.end()) {
+      return it->second;
+    }
+    words.push_back(word);
+    return index[word] = words.size();
+  }
+
+  const vector<string>& GetWords() const {
+    return words;
+  }
+
+ private:
+  unordered_map<string, int32_t> index;
+  vector<string> words;
+};
+
+} // namespace
+
+void Grammar::WriteBinary(ostream& os) const {
+  WordIndex word_index;
+  const int32_t lhs = -word_index.Get("X");
+  string rule_data;
+  for (const Rule& rule: rules) {
+    vector<int> source_symbols = rule.source_phrase.Get();
+    vector<string> source_words = rule.source_phrase.GetWords();
+    vector<int> target_symbols = rule.target_phrase.Get();
+    vector<string> target_words = rule.target_phrase.GetWords();
+    Append(rule_data, lhs);
+    Append(rule_data, static_cast<uint16_t>(source_symbols.size()));
+    Append(rule_data, static_cast<uint16_t>(target_symbols.size()));
+    Append(rule_data, static_cast<uint16_t>(rule.alignment.size()));
+    for (size_t i = 0, word = 0; i < source_symbols.size(); ++i) {
+      if (source_symbols[i] < 0) {
+        Append(rule_data, lhs);
+      } else {
+        Append(rule_data, word_index.Get(source_words[word++]));
+      }
+    }
+    for (size_t i = 0, word = 0; i < target_symbols.size(); ++i) {
+      if (target_symbols[i] < 0) {
+        Append(rule_data, static_cast<int32_t>(1 + target_symbols[i]));
+      } else {
+        Append(rule_data, word_index.Get(target_words[word++]));
+      }
+    }
+    for (double score: rule.scores) {
+      Append(rule_data, score);
+    }
+    for (auto link: rule.alignment) {
+      Append(rule_data, static_cast<int16_t>(link.first));
+      Append(rule_data, static_cast<int16_t>(link.second));
+    }
+  }
+
+  string header;
+  Append(header, static_cast<uint32_t>(word_index.GetWords().size()));
+  Append(header, static_cast<uint32_t>(feature_names.size()));
+  Append(header, static_cast<uint32_t>(rules.size()));
+  for (const string& word: word_index.GetWords()) {
+    AppendString(header, word);
+  }
+  for (const string& feature_name: feature_names) {
+    AppendString(header, feature_name);
+  }
+
+  os.write("cdecPSG1", 8);
+  uint64_t size = header.size() + rule_data.size();
+  os.write(reinterpret_cast<const char*>(&size), sizeof(size));
+  os.write(header.data(), header.size());
+  os.write(rule_data.data(), rule_data.size());
+}
+
 ostream& operator<<(ostream& os, const Grammar& grammar) {
   vector<Rule> rules = grammar.GetRules();
   vector<string> feature_names = grammar.GetFeatureNames();
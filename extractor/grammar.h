@@ -22,6 +22,20 @@ class Grammar {
 
   vector<string> GetFeatureNames() const;
 
+  // Writes the grammar in a binary format that the decoder loads without
+  // parsing any text (TextGrammar::ReadFromBinaryStream). Numbers are
+  // stored in native byte order:
+  //   "cdecPSG1", uint64 number of bytes that follow,
+  //   uint32 number of words, uint32 number of features, uint32 number of
+  //   rules, the words and the feature names (each as uint32 length + bytes),
+  //   then for every rule: int32 lhs, uint16 source length, uint16 target
+  //   length, uint16 number of alignment links, int32 source symbols
+  //   (word index + 1 for terminals, -(category index + 1) for
+  //   nonterminals), int32 target symbols (word index + 1 for terminals,
+  //   1 - k for the k-th nonterminal), one double per feature and
+  //   int16 pairs for the alignment links.
+  void WriteBinary(ostream& os) const;
+
   friend ostream& operator<<(ostream& os, const Grammar& grammar);
 
  private:
@@ -2,6 +2,7 @@
 
 #include <iterator>
 #include <sstream>
+#include <stdexcept>
 #include <vector>
 #include <unordered_set>
 
@@ -43,6 +44,18 @@ Grammar GrammarExtractor::GetGrammar(
   return rule_factory->GetGrammar(word_ids, blacklisted_sentence_ids);
 }
 
+void GrammarExtractor::AddSentencePair(const string& source_sentence,
+                                       const string& target_sentence,
+                                       const string& alignment) {
+  istringstream source_buffer(source_sentence), target_buffer(target_sentence);
+  vector<string> source_words((istream_iterator<string>(source_buffer)),
+                              istream_iterator<string>());
+  vector<string> target_words((istream_iterator<string>(target_buffer)),
+                              istream_iterator<string>());
+  rule_factory->AddSentencePair(source_words, target_words,
+                                ParseLinks(alignment));
+}
+
 vector<string> GrammarExtractor::TokenizeSentence(const string& sentence) {
   vector<string> result;
   result.push_back("<s>");
@@ -56,6 +69,21 @@ vector<string> GrammarExtractor::TokenizeSentence(const string& sentence) {
   return result;
 }
 
+vector<pair<int, int>> GrammarExtractor::ParseLinks(const string& alignment) {
+  vector<pair<int, int>> links;
+  istringstream buffer(alignment);
+  string link;
+  while (buffer >> link) {
+    size_t separator = link.find('-');
+    if (separator == string::npos) {
+      throw runtime_error("Invalid alignment link: " + link);
+    }
+    links.push_back(make_pair(stoi(link.substr(0, separator)),
+                              stoi(link.substr(separator + 1))));
+  }
+  return links;
+}
+
 vector<int> GrammarExtractor::AnnotateWords(const vector<string>& words) {
   vector<int> result;
   for (string word: words) {
@@ -49,10 +49,20 @@ class GrammarExtractor {
       const string& sentence,
       const unordered_set<int>& blacklisted_sentence_ids);
 
+  // Adds a sentence pair (e.g. a post-edited translation) to the data used for
+  // extracting the grammars of the following sentences. The alignment is given
+  // in the same format as the alignment file (e.g. "0-0 1-2 2-1").
+  void AddSentencePair(const string& source_sentence,
+                       const string& target_sentence,
+                       const string& alignment);
+
  private:
   // Splits the sentence in a vector of words.
   vector<string> TokenizeSentence(const string& sentence);
 
+  // Parses the word alignment links of a sentence pair.
+  vector<pair<int, int>> ParseLinks(const string& alignment);
+
   // Maps the words to word ids.
   vector<int> AnnotateWords(const vector<string>& words);
 
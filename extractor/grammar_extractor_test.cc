@@ -1,6 +1,7 @@
 #include <gtest/gtest.h>
 
 #include <memory>
+#include <stdexcept>
 #include <string>
 #include <vector>
 
@@ -50,5 +51,22 @@ TEST(GrammarExtractorTest, TestAnnotatingWords) {
   extractor.GetGrammar(sentence, blacklisted_sentence_ids);
 }
 
+TEST(GrammarExtractorTest, TestAddSentencePair) {
+  shared_ptr<MockVocabulary> vocabulary = make_shared<MockVocabulary>();
+  shared_ptr<MockHieroCachingRuleFactory> factory =
+      make_shared<MockHieroCachingRuleFactory>();
+  vector<string> source_words = {"Anna", "has", "apples"};
+  vector<string> target_words = {"Anna", "are", "mere"};
+  vector<pair<int, int>> links = {make_pair(0, 0), make_pair(1, 1),
+                                  make_pair(2, 2), make_pair(2, 1)};
+  EXPECT_CALL(*factory, AddSentencePair(source_words, target_words, links));
+
+  GrammarExtractor extractor(vocabulary, factory);
+  extractor.AddSentencePair("Anna has apples", " Anna are  mere ",
+                            "0-0 1-1 2-2 2-1");
+  EXPECT_THROW(extractor.AddSentencePair("Anna", "Anna", "0:0"),
+               runtime_error);
+}
+
 } // namespace
 } // namespace extractor
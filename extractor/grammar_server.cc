@@ -0,0 +1,158 @@
+#include "grammar_server.h"
+
+#include <cerrno>
+#include <cstring>
+#include <iostream>
+#include <sstream>
+#include <stdexcept>
+#include <unordered_set>
+
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "grammar.h"
+#include "grammar_extractor.h"
+#include "rule.h"
+#include "utils/line_socket.h"
+
+using namespace std;
+
+namespace extractor {
+
+GrammarServer::GrammarServer(shared_ptr<GrammarExtractor> extractor,
+                             int num_threads, bool binary_grammars,
+                             bool online) :
+    extractor(extractor), binary_grammars(binary_grammars), online(online),
+    stopped(false) {
+  // Sentence pairs added online must not be added while other grammars are
+  // extracted and must be seen by the requests that follow them.
+  if (online) {
+    num_threads = 1;
+  }
+  for (int i = 0; i < max(1, num_threads); ++i) {
+    workers.push_back(thread(&GrammarServer::ProcessRequests, this));
+  }
+}
+
+GrammarServer::~GrammarServer() {
+  {
+    lock_guard<mutex> lock(requests_mutex);
+    stopped = true;
+  }
+  request_added.notify_all();
+  for (thread& worker: workers) {
+    worker.join();
+  }
+}
+
+void GrammarServer::Listen(const string& socket_path) {
+  string error;
+  int listen_fd = LineSocket::Listen(socket_path, &error);
+  if (listen_fd < 0) {
+    throw runtime_error(error);
+  }
+
+  cerr << "Listening on " << socket_path << endl;
+  while (true) {
+    int fd = accept(listen_fd, NULL, NULL);
+    if (fd < 0) {
+      if (errno == EINTR || errno == ECONNABORTED) {
+        continue;
+      }
+      cerr << "accept failed: " << strerror(errno) << endl;
+      break;
+    }
+    thread(&GrammarServer::Serve, this, fd).detach();
+  }
+  close(listen_fd);
+  unlink(socket_path.c_str());
+}
+
+void GrammarServer::Serve(int fd) {
+  // The socket is closed when the last reference goes away, i.e. when the
+  // client has stopped sending and every answer has been written.
+  shared_ptr<LineSocket> connection = make_shared<LineSocket>(fd);
+  string line;
+  while (connection->ReadLine(&line)) {
+    if (line.empty()) {
+      continue;
+    }
+
+    istringstream buffer(line);
+    Request request;
+    request.connection = connection;
+    buffer >> request.command >> request.id;
+    getline(buffer >> ws, request.input);
+    if (request.id.empty()) {
+      connection->Write("error - expected 'COMMAND ID ...', got: " + line +
+                        "\n");
+    } else if (request.command != "extract" && request.command != "add") {
+      connection->Write("error " + request.id + " unknown command " +
+                        request.command + "\n");
+    } else if (request.command == "add" && !online) {
+      connection->Write("error " + request.id +
+                        " sentence pairs can only be added in online mode\n");
+    } else {
+      {
+        lock_guard<mutex> lock(requests_mutex);
+        requests.push_back(request);
+      }
+      request_added.notify_one();
+    }
+  }
+}
+
+void GrammarServer::ProcessRequests() {
+  while (true) {
+    Request request;
+    {
+      unique_lock<mutex> lock(requests_mutex);
+      while (requests.empty() && !stopped) {
+        request_added.wait(lock);
+      }
+      if (requests.empty()) {
+        return;
+      }
+      request = move(requests.front());
+      requests.pop_front();
+    }
+
+    string answer;
+    try {
+      answer = Answer(request);
+    } catch (exception& e) {
+      answer = "error " + request.id + " " + e.what() + "\n";
+    }
+    // A client that went away just loses its answers.
+    request.connection->Write(answer);
+  }
+}
+
+string GrammarServer::Answer(const Request& request) {
+  if (request.command == "add") {
+    size_t source_end = request.input.find("|||");
+    size_t target_end = source_end == string::npos ?
+        string::npos : request.input.find("|||", source_end + 3);
+    if (target_end == string::npos) {
+      return "error " + request.id +
+             " expected 'SOURCE ||| TARGET ||| ALIGNMENT'\n";
+    }
+    extractor->AddSentencePair(
+        request.input.substr(0, source_end),
+        request.input.substr(source_end + 3, target_end - source_end - 3),
+        request.input.substr(target_end + 3));
+    return "added " + request.id + "\n";
+  }
+
+  Grammar grammar = extractor->GetGrammar(request.input, unordered_set<int>());
+  ostringstream output;
+  if (binary_grammars) {
+    grammar.WriteBinary(output);
+  } else {
+    output << grammar;
+  }
+  string data = output.str();
+  return "grammar " + request.id + " " + to_string(data.size()) + "\n" + data;
+}
+
+} // namespace extractor
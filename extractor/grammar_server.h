@@ -0,0 +1,84 @@
+#ifndef _GRAMMAR_SERVER_H_
+#define _GRAMMAR_SERVER_H_
+
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace std;
+
+class LineSocket;
+
+namespace extractor {
+
+class GrammarExtractor;
+
+/**
+ * Long-lived grammar extraction service listening on a local (UNIX domain)
+ * socket, so the data structures are loaded once and the decoder (cdec
+ * --grammar_server) can ask for the grammar of each sentence when it needs it.
+ *
+ * A connection carries any number of requests, one per line:
+ *   extract ID SENTENCE            extracts the grammar for the sentence
+ *   add ID SOURCE ||| TARGET ||| ALIGNMENT
+ *                                  adds a sentence pair to the online data
+ *                                  (only if the server runs in online mode)
+ * where ID is any string without spaces. For each request the server sends
+ * back one of:
+ *   grammar ID BYTES               followed by BYTES bytes holding the grammar
+ *                                  (in text or binary format)
+ *   added ID
+ *   error ID MESSAGE
+ * Requests from all the connections go into one queue and are processed by a
+ * pool of threads, so the answers to different requests may arrive in any
+ * order. In online mode, a single thread processes the requests in the order
+ * they were received.
+ */
+class GrammarServer {
+ public:
+  GrammarServer(shared_ptr<GrammarExtractor> extractor, int num_threads,
+                bool binary_grammars, bool online);
+
+  // Stops the worker threads once the queued requests are processed.
+  virtual ~GrammarServer();
+
+  // Accepts connections on the socket and serves each of them on a separate
+  // thread. Returns only if the socket cannot be set up or accept fails.
+  void Listen(const string& socket_path);
+
+  // Serves the requests sent over a connected socket until the client stops
+  // sending. The socket is closed after all the answers have been sent.
+  void Serve(int fd);
+
+ private:
+  struct Request {
+    shared_ptr<LineSocket> connection;
+    string command;
+    string id;
+    string input;
+  };
+
+  // Takes requests from the queue until the server is stopped.
+  void ProcessRequests();
+
+  // Extracts the grammar or adds the sentence pair for a request and returns
+  // the answer.
+  string Answer(const Request& request);
+
+  shared_ptr<GrammarExtractor> extractor;
+  bool binary_grammars;
+  bool online;
+  deque<Request> requests;
+  bool stopped;
+  mutex requests_mutex;
+  condition_variable request_added;
+  vector<thread> workers;
+};
+
+} // namespace extractor
+
+#endif
@@ -0,0 +1,116 @@
+#include <gtest/gtest.h>
+
+#include <memory>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "grammar.h"
+#include "grammar_extractor.h"
+#include "grammar_server.h"
+#include "mocks/mock_rule_factory.h"
+#include "mocks/mock_vocabulary.h"
+#include "phrase.h"
+#include "phrase_builder.h"
+#include "rule.h"
+
+using namespace std;
+using namespace ::testing;
+
+namespace extractor {
+namespace {
+
+class GrammarServerTest : public Test {
+ protected:
+  virtual void SetUp() {
+    vocabulary = make_shared<MockVocabulary>();
+    EXPECT_CALL(*vocabulary, GetTerminalValue(1)).WillRepeatedly(Return("a"));
+    EXPECT_CALL(*vocabulary, GetTerminalValue(2)).WillRepeatedly(Return("A"));
+    EXPECT_CALL(*vocabulary, GetTerminalIndex(_)).WillRepeatedly(Return(1));
+    PhraseBuilder phrase_builder(vocabulary);
+    Phrase source = phrase_builder.Build(vector<int>{1});
+    Phrase target = phrase_builder.Build(vector<int>{2});
+    vector<Rule> rules = {Rule(source, target, vector<double>{0.5},
+                               vector<pair<int, int>>{make_pair(0, 0)})};
+    grammar = make_shared<Grammar>(rules, vector<string>{"f"});
+
+    factory = make_shared<MockHieroCachingRuleFactory>();
+    extractor = make_shared<GrammarExtractor>(vocabulary, factory);
+  }
+
+  // Sends the requests to the server and returns its answers.
+  string Send(GrammarServer& server, const string& requests) {
+    int fds[2];
+    EXPECT_EQ(0, socketpair(AF_UNIX, SOCK_STREAM, 0, fds));
+    EXPECT_EQ(requests.size(), write(fds[1], requests.data(), requests.size()));
+    shutdown(fds[1], SHUT_WR);
+    thread serve(&GrammarServer::Serve, &server, fds[0]);
+
+    string answers;
+    char buffer[1024];
+    ssize_t num_read;
+    while ((num_read = read(fds[1], buffer, sizeof(buffer))) > 0) {
+      answers.append(buffer, num_read);
+    }
+    serve.join();
+    close(fds[1]);
+    return answers;
+  }
+
+  shared_ptr<MockVocabulary> vocabulary;
+  shared_ptr<MockHieroCachingRuleFactory> factory;
+  shared_ptr<GrammarExtractor> extractor;
+  shared_ptr<Grammar> grammar;
+};
+
+TEST_F(GrammarServerTest, TestExtract) {
+  EXPECT_CALL(*factory, GetGrammar(vector<int>{1, 1, 1}, _))
+      .WillOnce(Return(*grammar));
+  ostringstream text;
+  text << *grammar;
+
+  GrammarServer server(extractor, 2, false, false);
+  EXPECT_EQ("grammar 7 " + to_string(text.str().size()) + "\n" + text.str(),
+            Send(server, "extract 7 a\n"));
+}
+
+TEST_F(GrammarServerTest, TestBinaryGrammars) {
+  EXPECT_CALL(*factory, GetGrammar(_, _)).WillOnce(Return(*grammar));
+  ostringstream binary;
+  grammar->WriteBinary(binary);
+
+  GrammarServer server(extractor, 1, true, false);
+  EXPECT_EQ("grammar x " + to_string(binary.str().size()) + "\n" +
+            binary.str(), Send(server, "extract x a\n"));
+}
+
+TEST_F(GrammarServerTest, TestErrors) {
+  GrammarServer server(extractor, 1, false, false);
+  EXPECT_EQ("error 1 unknown command translate\n"
+            "error 2 sentence pairs can only be added in online mode\n"
+            "error - expected 'COMMAND ID ...', got: extract\n",
+            Send(server, "translate 1 a\n\nadd 2 a ||| A ||| 0-0\nextract\n"));
+}
+
+TEST_F(GrammarServerTest, TestOnline) {
+  vector<string> source_words = {"a"}, target_words = {"A"};
+  vector<pair<int, int>> links = {make_pair(0, 0)};
+  InSequence sequence;
+  EXPECT_CALL(*factory, AddSentencePair(source_words, target_words, links));
+  EXPECT_CALL(*factory, GetGrammar(_, _)).WillOnce(Return(*grammar));
+  ostringstream text;
+  text << *grammar;
+
+  GrammarServer server(extractor, 4, false, true);
+  EXPECT_EQ("added 1\ngrammar 2 " + to_string(text.str().size()) + "\n" +
+            text.str() + "error 3 expected 'SOURCE ||| TARGET ||| ALIGNMENT'\n",
+            Send(server, "add 1 a ||| A ||| 0-0\nextract 2 a\n"
+                         "add 3 a ||| A\n"));
+}
+
+} // namespace
+} // namespace extractor
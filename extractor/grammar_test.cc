@@ -0,0 +1,120 @@
+#include <gtest/gtest.h>
+
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "grammar.h"
+#include "mocks/mock_vocabulary.h"
+#include "phrase.h"
+#include "phrase_builder.h"
+#include "rule.h"
+
+using namespace std;
+using namespace ::testing;
+
+namespace extractor {
+namespace {
+
+class GrammarTest : public Test {
+ protected:
+  virtual void SetUp() {
+    shared_ptr<MockVocabulary> vocabulary = make_shared<MockVocabulary>();
+    vector<string> words = {"a", "b", "A", "B"};
+    for (size_t i = 0; i < words.size(); ++i) {
+      EXPECT_CALL(*vocabulary, GetTerminalValue(i + 1))
+          .WillRepeatedly(Return(words[i]));
+    }
+    PhraseBuilder phrase_builder(vocabulary);
+    Phrase source = phrase_builder.Build(vector<int>{1, -1, 2});
+    Phrase target = phrase_builder.Build(vector<int>{-1, 3, 4});
+    vector<pair<int, int>> alignment = {make_pair(0, 1), make_pair(2, 2)};
+    rules.push_back(Rule(source, target, vector<double>{0.5, 2}, alignment));
+    feature_names = {"f1", "f2"};
+  }
+
+  template<typename T> T Read(const string& data, size_t* offset) {
+    T value;
+    memcpy(&value, data.data() + *offset, sizeof(T));
+    *offset += sizeof(T);
+    return value;
+  }
+
+  string ReadString(const string& data, size_t* offset) {
+    uint32_t len = Read<uint32_t>(data, offset);
+    string value = data.substr(*offset, len);
+    *offset += len;
+    return value;
+  }
+
+  vector<Rule> rules;
+  vector<string> feature_names;
+};
+
+TEST_F(GrammarTest, TestText) {
+  Grammar grammar(rules, feature_names);
+  ostringstream os;
+  os << grammar;
+  EXPECT_EQ("[X] ||| a [X,1] b ||| [X,1] A B ||| f1=0.5 f2=2 ||| 0-1 2-2\n",
+            os.str());
+}
+
+TEST_F(GrammarTest, TestBinary) {
+  Grammar grammar(rules, feature_names);
+  ostringstream os;
+  grammar.WriteBinary(os);
+  string data = os.str();
+
+  ASSERT_EQ("cdecPSG1", data.substr(0, 8));
+  size_t offset = 8;
+  EXPECT_EQ(data.size() - 16, Read<uint64_t>(data, &offset));
+  EXPECT_EQ(5, Read<uint32_t>(data, &offset));
+  EXPECT_EQ(2, Read<uint32_t>(data, &offset));
+  EXPECT_EQ(1, Read<uint32_t>(data, &offset));
+  vector<string> words;
+  for (int i = 0; i < 5; ++i) {
+    words.push_back(ReadString(data, &offset));
+  }
+  EXPECT_EQ(vector<string>({"X", "a", "b", "A", "B"}), words);
+  EXPECT_EQ("f1", ReadString(data, &offset));
+  EXPECT_EQ("f2", ReadString(data, &offset));
+
+  EXPECT_EQ(-1, Read<int32_t>(data, &offset));
+  EXPECT_EQ(3, Read<uint16_t>(data, &offset));
+  EXPECT_EQ(3, Read<uint16_t>(data, &offset));
+  EXPECT_EQ(2, Read<uint16_t>(data, &offset));
+  EXPECT_EQ(2, Read<int32_t>(data, &offset));
+  EXPECT_EQ(-1, Read<int32_t>(data, &offset));
+  EXPECT_EQ(3, Read<int32_t>(data, &offset));
+  EXPECT_EQ(0, Read<int32_t>(data, &offset));
+  EXPECT_EQ(4, Read<int32_t>(data, &offset));
+  EXPECT_EQ(5, Read<int32_t>(data, &offset));
+  EXPECT_EQ(0.5, Read<double>(data, &offset));
+  EXPECT_EQ(2, Read<double>(data, &offset));
+  EXPECT_EQ(0, Read<int16_t>(data, &offset));
+  EXPECT_EQ(1, Read<int16_t>(data, &offset));
+  EXPECT_EQ(2, Read<int16_t>(data, &offset));
+  EXPECT_EQ(2, Read<int16_t>(data, &offset));
+  EXPECT_EQ(data.size(), offset);
+}
+
+// The decoder's grammar_test reads this file with
+// TextGrammar::ReadFromBinaryStream, so the two stay in sync.
+TEST_F(GrammarTest, TestBinaryDecoderTestData) {
+  Grammar grammar(rules, feature_names);
+  ostringstream os;
+  grammar.WriteBinary(os);
+
+  ifstream in("../decoder/test_data/extractor_grammar.bin", ios::binary);
+  ASSERT_TRUE(in.good());
+  string expected((istreambuf_iterator<char>(in)), istreambuf_iterator<char>());
+  EXPECT_EQ(expected, os.str());
+}
+
+} // namespace
+} // namespace extractor
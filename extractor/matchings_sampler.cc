@@ -20,19 +20,19 @@ int MatchingsSampler::GetRangeLow(const PhraseLocation&) const {
 }
 
 int MatchingsSampler::GetRangeHigh(const PhraseLocation& location) const {
-  return location.matchings->size() / location.num_subpatterns;
+  return location.matchings.size() / location.num_subpatterns;
 }
 
 int MatchingsSampler::GetPosition(const PhraseLocation& location,
                                   int index) const {
-  return (*location.matchings)[index * location.num_subpatterns];
+  return location.matchings[index * location.num_subpatterns];
 }
 
 void MatchingsSampler::AppendMatching(vector<int>& samples, int index,
                                       const PhraseLocation& location) const {
   int start = index * location.num_subpatterns;
-  copy(location.matchings->begin() + start,
-       location.matchings->begin() + start + location.num_subpatterns,
+  copy(location.matchings.begin() + start,
+       location.matchings.begin() + start + location.num_subpatterns,
        back_inserter(samples));
 }
 
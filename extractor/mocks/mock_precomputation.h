@@ -7,7 +7,7 @@ namespace extractor {
 class MockPrecomputation : public Precomputation {
  public:
   MOCK_CONST_METHOD1(Contains, bool(const vector<int>&));
-  MOCK_CONST_METHOD1(GetCollocations, shared_ptr<vector<int>>(const vector<int>&));
+  MOCK_CONST_METHOD1(GetCollocations, FlatView<int>(const vector<int>&));
 };
 
 } // namespace extractor
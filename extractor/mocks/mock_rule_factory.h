@@ -10,6 +10,10 @@ class MockHieroCachingRuleFactory : public HieroCachingRuleFactory {
   MOCK_METHOD2(GetGrammar, Grammar(
       const vector<int>& word_ids,
       const unordered_set<int>& blacklisted_sentence_ids));
+  MOCK_METHOD3(AddSentencePair, void(
+      const vector<string>& source_words,
+      const vector<string>& target_words,
+      const vector<pair<int, int>>& links));
 };
 
 } // namespace extractor
@@ -0,0 +1,182 @@
+#include "online_index.h"
+
+#include <algorithm>
+#include <unordered_set>
+
+#include "matchings_sampler.h"
+#include "phrase.h"
+#include "phrase_location.h"
+#include "rule_extractor.h"
+#include "vocabulary.h"
+
+using namespace std;
+
+namespace extractor {
+
+OnlineDataArray::OnlineDataArray(shared_ptr<Vocabulary> vocabulary) :
+    vocabulary(vocabulary), sentence_start(1, 0) {}
+
+void OnlineDataArray::AddSentence(const vector<string>& sentence) {
+  int id = sentence_start.size() - 1;
+  for (const string& word: sentence) {
+    data.push_back(vocabulary->GetTerminalIndex(word));
+    words.push_back(word);
+    sentence_id.push_back(id);
+  }
+  data.push_back(-1);
+  words.push_back(END_OF_LINE_STR);
+  sentence_id.push_back(id);
+  sentence_start.push_back(data.size());
+}
+
+vector<int> OnlineDataArray::GetData() const {
+  return data;
+}
+
+int OnlineDataArray::AtIndex(int index) const {
+  return data[index];
+}
+
+string OnlineDataArray::GetWordAtIndex(int index) const {
+  return words[index];
+}
+
+int OnlineDataArray::GetSize() const {
+  return data.size();
+}
+
+int OnlineDataArray::GetNumSentences() const {
+  return sentence_start.size() - 1;
+}
+
+int OnlineDataArray::GetSentenceStart(int sentence_id) const {
+  return sentence_start[sentence_id];
+}
+
+int OnlineDataArray::GetSentenceLength(int sentence_id) const {
+  // Ignore end of line markers.
+  return sentence_start[sentence_id + 1] - sentence_start[sentence_id] - 1;
+}
+
+int OnlineDataArray::GetSentenceId(int position) const {
+  return sentence_id[position];
+}
+
+void OnlineAlignment::AddLinks(const vector<pair<int, int>>& links) {
+  alignments.push_back(links);
+}
+
+vector<pair<int, int>> OnlineAlignment::GetLinks(int sentence_index) const {
+  return alignments[sentence_index];
+}
+
+OnlineIndex::OnlineIndex(
+    shared_ptr<Vocabulary> vocabulary,
+    shared_ptr<PhraseBuilder> phrase_builder,
+    shared_ptr<Scorer> scorer,
+    int min_gap_size,
+    int max_rule_span,
+    int max_nonterminals,
+    int max_rule_symbols,
+    int max_samples,
+    bool require_tight_phrases) :
+    min_gap_size(min_gap_size),
+    max_rule_span(max_rule_span),
+    max_rule_symbols(max_rule_symbols) {
+  source_data_array = make_shared<OnlineDataArray>(vocabulary);
+  target_data_array = make_shared<OnlineDataArray>(vocabulary);
+  alignment = make_shared<OnlineAlignment>();
+  rule_extractor = make_shared<RuleExtractor>(source_data_array,
+      target_data_array, alignment, phrase_builder, scorer, vocabulary,
+      max_rule_span, min_gap_size, max_nonterminals, max_rule_symbols, true,
+      false, require_tight_phrases);
+  sampler = make_shared<MatchingsSampler>(source_data_array, max_samples);
+}
+
+OnlineIndex::~OnlineIndex() {}
+
+void OnlineIndex::AddSentencePair(const vector<string>& source_words,
+                                  const vector<string>& target_words,
+                                  const vector<pair<int, int>>& links) {
+  int start = source_data_array->GetSize();
+  source_data_array->AddSentence(source_words);
+  target_data_array->AddSentence(target_words);
+  alignment->AddLinks(links);
+
+  // Index all the n-grams which may form a chunk of a source phrase.
+  int end = source_data_array->GetSize() - 1;
+  for (int i = start; i < end; ++i) {
+    vector<int> ngram;
+    for (int j = i; j < end && j - i < max_rule_symbols; ++j) {
+      ngram.push_back(source_data_array->AtIndex(j));
+      ngram_positions[ngram].push_back(i);
+    }
+  }
+}
+
+int OnlineIndex::GetNumSentences() const {
+  return source_data_array->GetNumSentences();
+}
+
+PhraseLocation OnlineIndex::Find(const Phrase& phrase) const {
+  vector<int> symbols = phrase.Get();
+  vector<vector<int>> chunks;
+  for (int i = 0, position = 0; i <= phrase.Arity(); ++i) {
+    int chunk_len = phrase.GetChunkLen(i);
+    chunks.push_back(vector<int>(symbols.begin() + position,
+                                 symbols.begin() + position + chunk_len));
+    // Skip the nonterminal following the chunk.
+    position += chunk_len + 1;
+  }
+
+  vector<int> matchings;
+  auto it = ngram_positions.find(chunks.front());
+  if (it != ngram_positions.end()) {
+    vector<int> matching;
+    for (int position: it->second) {
+      matching.push_back(position);
+      ExtendMatching(chunks, matching, matchings);
+      matching.pop_back();
+    }
+  }
+  return PhraseLocation(matchings, chunks.size());
+}
+
+void OnlineIndex::ExtendMatching(const vector<vector<int>>& chunks,
+                                 vector<int>& matching,
+                                 vector<int>& matchings) const {
+  size_t index = matching.size();
+  if (index == chunks.size()) {
+    matchings.insert(matchings.end(), matching.begin(), matching.end());
+    return;
+  }
+
+  // The next chunk must start at least min_gap_size words after the previous
+  // one, in the same sentence and without exceeding the maximum rule span.
+  int sentence_id = source_data_array->GetSentenceId(matching.front());
+  int sentence_end = source_data_array->GetSentenceStart(sentence_id + 1) - 1;
+  int chunk_len = chunks[index].size();
+  int position = matching.back() + chunks[index - 1].size() + min_gap_size;
+  for (; position + chunk_len <= sentence_end &&
+         position + chunk_len - matching.front() <= max_rule_span;
+       ++position) {
+    bool found = true;
+    for (int i = 0; i < chunk_len && found; ++i) {
+      found = source_data_array->AtIndex(position + i) == chunks[index][i];
+    }
+    if (found) {
+      matching.push_back(position);
+      ExtendMatching(chunks, matching, matchings);
+      matching.pop_back();
+    }
+  }
+}
+
+void OnlineIndex::CountExtracts(const Phrase& phrase,
+                                const PhraseLocation& location,
+                                ExtractCounts& counts) const {
+  PhraseLocation sample = sampler->Sample(location, unordered_set<int>());
+  rule_extractor->CountExtracts(phrase, sample, counts);
+}
+
+} // namespace extractor
@@ -0,0 +1,146 @@
+#ifndef _ONLINE_INDEX_H_
+#define _ONLINE_INDEX_H_
+
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include <boost/functional/hash.hpp>
+
+#include "alignment.h"
+#include "data_array.h"
+
+using namespace std;
+
+namespace extractor {
+
+typedef boost::hash<vector<int>> VectorHash;
+
+class MatchingsSampler;
+class Phrase;
+class PhraseBuilder;
+class PhraseLocation;
+class RuleExtractor;
+class Scorer;
+class Vocabulary;
+struct ExtractCounts;
+
+/**
+ * Data array holding the sentences added at extraction time. The words are
+ * stored with their ids from the shared vocabulary, so the phrases built by the
+ * rule factory can be matched against the data directly.
+ */
+class OnlineDataArray : public DataArray {
+ public:
+  OnlineDataArray(shared_ptr<Vocabulary> vocabulary);
+
+  // Appends a sentence (followed by an end of line marker) to the data.
+  void AddSentence(const vector<string>& sentence);
+
+  vector<int> GetData() const;
+
+  int AtIndex(int index) const;
+
+  string GetWordAtIndex(int index) const;
+
+  int GetSize() const;
+
+  int GetNumSentences() const;
+
+  int GetSentenceStart(int sentence_id) const;
+
+  int GetSentenceLength(int sentence_id) const;
+
+  int GetSentenceId(int position) const;
+
+ private:
+  shared_ptr<Vocabulary> vocabulary;
+  vector<int> data;
+  vector<string> words;
+  vector<int> sentence_id;
+  vector<int> sentence_start;
+};
+
+/**
+ * Word alignments for the sentence pairs added at extraction time.
+ */
+class OnlineAlignment : public Alignment {
+ public:
+  // Appends the links of a sentence pair.
+  void AddLinks(const vector<pair<int, int>>& links);
+
+  vector<pair<int, int>> GetLinks(int sentence_index) const;
+
+ private:
+  vector<vector<pair<int, int>>> alignments;
+};
+
+/**
+ * Small dynamic index over the sentence pairs added while extracting grammars
+ * (e.g. post-edited translations), the C++ counterpart of the online mode of
+ * the Python extractor.
+ *
+ * The static suffix array is never rebuilt. Instead, the index maps every
+ * contiguous n-gram of the added source sentences (up to the maximum number of
+ * symbols in a rule) to the positions where it occurs. The occurrences of a
+ * phrase with nonterminals are found by matching the remaining chunks after
+ * each occurrence of the first chunk, with the same gap and span constraints
+ * used for the suffix array. Phrase pairs are extracted from the online data
+ * with the same rule extraction heuristics and their counts are added to the
+ * counts from the suffix array sample before the rules are scored.
+ *
+ * Adding sentence pairs is not thread safe with respect to grammar extraction.
+ */
+class OnlineIndex {
+ public:
+  OnlineIndex(shared_ptr<Vocabulary> vocabulary,
+              shared_ptr<PhraseBuilder> phrase_builder,
+              shared_ptr<Scorer> scorer,
+              int min_gap_size,
+              int max_rule_span,
+              int max_nonterminals,
+              int max_rule_symbols,
+              int max_samples,
+              bool require_tight_phrases);
+
+  virtual ~OnlineIndex();
+
+  // Adds a sentence pair and the word alignment links between them.
+  void AddSentencePair(const vector<string>& source_words,
+                       const vector<string>& target_words,
+                       const vector<pair<int, int>>& links);
+
+  // Returns the number of sentence pairs added so far.
+  int GetNumSentences() const;
+
+  // Finds all the occurrences of a phrase starting and ending with terminals in
+  // the added source sentences.
+  PhraseLocation Find(const Phrase& phrase) const;
+
+  // Samples the given occurrences of the phrase (up to max_samples of them,
+  // independently of the suffix array sample) and adds the statistics for the
+  // phrase pairs extracted from them to counts.
+  void CountExtracts(const Phrase& phrase, const PhraseLocation& location,
+                     ExtractCounts& counts) const;
+
+ private:
+  // Recursively appends the occurrences of the chunks that follow the partial
+  // matching.
+  void ExtendMatching(const vector<vector<int>>& chunks, vector<int>& matching,
+                      vector<int>& matchings) const;
+
+  shared_ptr<OnlineDataArray> source_data_array;
+  shared_ptr<OnlineDataArray> target_data_array;
+  shared_ptr<OnlineAlignment> alignment;
+  shared_ptr<RuleExtractor> rule_extractor;
+  shared_ptr<MatchingsSampler> sampler;
+  unordered_map<vector<int>, vector<int>, VectorHash> ngram_positions;
+  int min_gap_size;
+  int max_rule_span;
+  int max_rule_symbols;
+};
+
+} // namespace extractor
+
+#endif
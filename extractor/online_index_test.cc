@@ -0,0 +1,97 @@
+#include <gtest/gtest.h>
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "online_index.h"
+#include "phrase.h"
+#include "phrase_builder.h"
+#include "phrase_location.h"
+#include "rule_extractor.h"
+#include "scorer.h"
+#include "vocabulary.h"
+
+using namespace std;
+using namespace ::testing;
+
+namespace extractor {
+namespace {
+
+class OnlineIndexTest : public Test {
+ protected:
+  virtual void SetUp() {
+    vocabulary = make_shared<Vocabulary>();
+    phrase_builder = make_shared<PhraseBuilder>(vocabulary);
+    scorer = make_shared<Scorer>(vector<shared_ptr<features::Feature>>());
+    index = make_shared<OnlineIndex>(vocabulary, phrase_builder, scorer, 1, 10,
+                                     2, 5, 100, true);
+    index->AddSentencePair({"a", "b", "c", "a", "d"},
+                           {"A", "B", "C", "A", "D"},
+                           {make_pair(0, 0), make_pair(1, 1), make_pair(2, 2),
+                            make_pair(3, 3), make_pair(4, 4)});
+    index->AddSentencePair({"a", "x", "c"}, {"A", "X", "C"},
+                           {make_pair(0, 0), make_pair(1, 1), make_pair(2, 2)});
+  }
+
+  Phrase Build(const vector<string>& words) {
+    vector<int> symbols;
+    int arity = 0;
+    for (const string& word: words) {
+      if (word == "X") {
+        symbols.push_back(vocabulary->GetNonterminalIndex(++arity));
+      } else {
+        symbols.push_back(vocabulary->GetTerminalIndex(word));
+      }
+    }
+    return phrase_builder->Build(symbols);
+  }
+
+  shared_ptr<Vocabulary> vocabulary;
+  shared_ptr<PhraseBuilder> phrase_builder;
+  shared_ptr<Scorer> scorer;
+  shared_ptr<OnlineIndex> index;
+};
+
+TEST_F(OnlineIndexTest, TestFind) {
+  EXPECT_EQ(2, index->GetNumSentences());
+  EXPECT_EQ(PhraseLocation(vector<int>{0, 3, 6}, 1),
+            index->Find(Build({"a"})));
+  EXPECT_EQ(PhraseLocation(vector<int>{2}, 1), index->Find(Build({"c", "a"})));
+  EXPECT_EQ(PhraseLocation(vector<int>{0, 2, 6, 8}, 2),
+            index->Find(Build({"a", "X", "c"})));
+  EXPECT_EQ(PhraseLocation(vector<int>{0, 4}, 2),
+            index->Find(Build({"a", "X", "d"})));
+  EXPECT_EQ(PhraseLocation(vector<int>{0, 2, 4}, 3),
+            index->Find(Build({"a", "X", "c", "X", "d"})));
+  EXPECT_TRUE(index->Find(Build({"c", "X", "a"})).IsEmpty());
+  EXPECT_TRUE(index->Find(Build({"d", "a"})).IsEmpty());
+  EXPECT_TRUE(index->Find(Build({"z"})).IsEmpty());
+}
+
+TEST_F(OnlineIndexTest, TestMaxRuleSpan) {
+  index = make_shared<OnlineIndex>(vocabulary, phrase_builder, scorer, 1, 4,
+                                   2, 5, 100, true);
+  index->AddSentencePair({"a", "b", "c", "a", "d"},
+                         {"A", "B", "C", "A", "D"}, {make_pair(0, 0)});
+  EXPECT_EQ(PhraseLocation(vector<int>{0, 2}, 2),
+            index->Find(Build({"a", "X", "c"})));
+  EXPECT_TRUE(index->Find(Build({"a", "X", "d"})).IsEmpty());
+}
+
+TEST_F(OnlineIndexTest, TestCountExtracts) {
+  Phrase source_phrase = Build({"a", "X", "c"});
+  Phrase target_phrase = Build({"A", "X", "C"});
+  ExtractCounts counts;
+  counts.num_samples = 3;
+  index->CountExtracts(source_phrase, index->Find(source_phrase), counts);
+
+  EXPECT_EQ(5, counts.num_samples);
+  EXPECT_EQ(2, counts.source_phrase_counter[source_phrase]);
+  PhraseAlignment alignment = {make_pair(0, 0), make_pair(2, 2)};
+  EXPECT_EQ(2, counts.alignments_counter[source_phrase][target_phrase]
+                                        [alignment]);
+}
+
+} // namespace
+} // namespace extractor
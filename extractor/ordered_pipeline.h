@@ -0,0 +1,125 @@
+#ifndef _ORDERED_PIPELINE_H_
+#define _ORDERED_PIPELINE_H_
+
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <istream>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace std;
+
+namespace extractor {
+
+/**
+ * Bounded pipeline for extracting the grammars of a stream of sentences.
+ *
+ * The calling thread reads the input lines, num_threads workers call
+ * process(index, line) on them and write(index, result) is called on the
+ * results in input order, as soon as the results for all the previous lines
+ * are available. The writer runs on one of the workers, never concurrently
+ * with itself. At most max_pending lines are read ahead of the writer, so
+ * memory use does not depend on the size of the input and the output for the
+ * first sentences is available before the input ends.
+ *
+ * If process or write throws, no further lines are read or processed and the
+ * first exception is rethrown to the caller once the workers have stopped.
+ */
+template<typename Result>
+void RunOrderedPipeline(istream& input, int num_threads, int max_pending,
+                        function<Result(size_t, const string&)> process,
+                        function<void(size_t, Result&)> write) {
+  mutex pipeline_mutex;
+  condition_variable line_read, line_written;
+  deque<pair<size_t, string>> lines;
+  map<size_t, Result> results;
+  size_t num_read = 0, num_written = 0;
+  bool writing = false, end_of_input = false;
+  exception_ptr error;
+
+  auto worker = [&]() {
+    unique_lock<mutex> lock(pipeline_mutex);
+    while (true) {
+      while (lines.empty() && !end_of_input && !error) {
+        line_read.wait(lock);
+      }
+      if (lines.empty() || error) {
+        return;
+      }
+      pair<size_t, string> line = move(lines.front());
+      lines.pop_front();
+
+      try {
+        lock.unlock();
+        Result result = process(line.first, line.second);
+        lock.lock();
+        results.emplace(line.first, move(result));
+
+        // Writes all the results which are next in input order, unless
+        // another worker is already doing it.
+        while (!writing && !error && !results.empty() &&
+               results.begin()->first == num_written) {
+          writing = true;
+          Result next = move(results.begin()->second);
+          results.erase(results.begin());
+          lock.unlock();
+          write(num_written, next);
+          lock.lock();
+          writing = false;
+          ++num_written;
+          line_written.notify_one();
+        }
+      } catch (...) {
+        if (!lock.owns_lock()) {
+          lock.lock();
+        }
+        if (!error) {
+          error = current_exception();
+        }
+        line_read.notify_all();
+        line_written.notify_all();
+        return;
+      }
+    }
+  };
+
+  vector<thread> workers;
+  for (int i = 0; i < max(1, num_threads); ++i) {
+    workers.push_back(thread(worker));
+  }
+
+  string line;
+  while (getline(input, line)) {
+    unique_lock<mutex> lock(pipeline_mutex);
+    while (num_read - num_written >= static_cast<size_t>(max_pending) &&
+           !error) {
+      line_written.wait(lock);
+    }
+    if (error) {
+      break;
+    }
+    lines.push_back(make_pair(num_read++, move(line)));
+    line_read.notify_one();
+  }
+
+  {
+    lock_guard<mutex> lock(pipeline_mutex);
+    end_of_input = true;
+  }
+  line_read.notify_all();
+  for (thread& worker_thread: workers) {
+    worker_thread.join();
+  }
+  if (error) {
+    rethrow_exception(error);
+  }
+}
+
+} // namespace extractor
+
+#endif
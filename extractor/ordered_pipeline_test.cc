@@ -0,0 +1,113 @@
+#include <gtest/gtest.h>
+
+#include <atomic>
+#include <chrono>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "ordered_pipeline.h"
+
+using namespace std;
+using namespace ::testing;
+
+namespace extractor {
+namespace {
+
+TEST(OrderedPipelineTest, TestInputOrder) {
+  stringstream input;
+  for (int i = 0; i < 100; ++i) {
+    input << "line " << i << endl;
+  }
+
+  vector<pair<size_t, string>> output;
+  RunOrderedPipeline<string>(input, 4, 8,
+      [](size_t index, const string& line) {
+        // Later lines finish first.
+        this_thread::sleep_for(chrono::microseconds(100 * (index % 7)));
+        return line + "!";
+      },
+      [&](size_t index, string& result) {
+        output.push_back(make_pair(index, result));
+      });
+
+  ASSERT_EQ(100, output.size());
+  for (size_t i = 0; i < output.size(); ++i) {
+    EXPECT_EQ(i, output[i].first);
+    EXPECT_EQ("line " + to_string(i) + "!", output[i].second);
+  }
+}
+
+TEST(OrderedPipelineTest, TestMaxPending) {
+  stringstream input;
+  for (int i = 0; i < 50; ++i) {
+    input << i << endl;
+  }
+
+  atomic<int> num_processed(0);
+  int max_ahead = 0;
+  RunOrderedPipeline<int>(input, 3, 5,
+      [&](size_t, const string& line) {
+        ++num_processed;
+        return stoi(line);
+      },
+      [&](size_t index, int& result) {
+        EXPECT_EQ(index, result);
+        max_ahead = max(max_ahead, num_processed - static_cast<int>(index));
+      });
+
+  EXPECT_EQ(50, num_processed);
+  EXPECT_LE(max_ahead, 5);
+}
+
+TEST(OrderedPipelineTest, TestEmptyInput) {
+  stringstream input;
+  int num_written = 0;
+  RunOrderedPipeline<string>(input, 2, 4,
+      [](size_t, const string& line) { return line; },
+      [&](size_t, string&) { ++num_written; });
+  EXPECT_EQ(0, num_written);
+}
+
+TEST(OrderedPipelineTest, TestErrors) {
+  stringstream input;
+  for (int i = 0; i < 1000; ++i) {
+    input << i << endl;
+  }
+
+  atomic<int> num_processed(0);
+  vector<size_t> written;
+  EXPECT_THROW(RunOrderedPipeline<int>(input, 4, 8,
+      [&](size_t index, const string&) {
+        ++num_processed;
+        if (index == 20) {
+          throw runtime_error("failed");
+        }
+        return 0;
+      },
+      [&](size_t index, int&) { written.push_back(index); }),
+      runtime_error);
+
+  // The input is not read to the end and nothing after the failed line is
+  // written.
+  EXPECT_LT(num_processed, 100);
+  ASSERT_LE(written.size(), 20);
+  for (size_t i = 0; i < written.size(); ++i) {
+    EXPECT_EQ(i, written[i]);
+  }
+
+  stringstream more_input("a\nb\nc\n");
+  EXPECT_THROW(RunOrderedPipeline<int>(more_input, 2, 4,
+      [](size_t, const string&) { return 0; },
+      [](size_t index, int&) {
+        if (index == 1) {
+          throw runtime_error("failed");
+        }
+      }),
+      runtime_error);
+}
+
+} // namespace
+} // namespace extractor
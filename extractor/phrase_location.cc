@@ -10,11 +10,11 @@ PhraseLocation::PhraseLocation(int sa_low, int sa_high) :
 PhraseLocation::PhraseLocation(const vector<int>& matchings,
                                int num_subpatterns) :
     sa_low(0), sa_high(0),
-    matchings(make_shared<vector<int>>(matchings)),
+    matchings(vector<int>(matchings)),
     num_subpatterns(num_subpatterns) {}
 
 PhraseLocation::PhraseLocation(
-    const shared_ptr<vector<int>>& matchings,
+    const FlatView<int>& matchings,
     int num_subpatterns) :
     sa_low(0), sa_high(0),
     matchings(matchings), num_subpatterns(num_subpatterns) {}
@@ -25,7 +25,7 @@ bool PhraseLocation::IsEmpty() const {
 
 int PhraseLocation::GetSize() const {
   if (num_subpatterns > 0) {
-    return matchings->size();
+    return matchings.size();
   } else {
     return sa_high - sa_low;
   }
@@ -37,15 +37,7 @@ bool operator==(const PhraseLocation& a, const PhraseLocation& b) {
     return false;
   }
 
-  if (a.matchings == NULL && b.matchings == NULL) {
-    return true;
-  }
-
-  if (a.matchings == NULL || b.matchings == NULL) {
-    return false;
-  }
-
-  return *a.matchings == *b.matchings;
+  return a.matchings == b.matchings;
 }
 
 } // namespace extractor
@@ -1,9 +1,10 @@
 #ifndef _PHRASE_LOCATION_H_
 #define _PHRASE_LOCATION_H_
 
-#include <memory>
 #include <vector>
 
+#include "flat_file.h"
+
 using namespace std;
 
 namespace extractor {
@@ -16,14 +17,15 @@ namespace extractor {
  * vector encodes an occurrence of the phrase. The i-th entry of a group
  * represents the start of the i-th subpattern of the phrase. If the phrase
  * doesn't contain any nonterminals, then it may also be represented as the
- * range in the suffix array which matches the phrase.
+ * range in the suffix array which matches the phrase. The matchings may be a
+ * view into the precomputed collocations, so copies of a location share them.
  */
 struct PhraseLocation {
   PhraseLocation(int sa_low = -1, int sa_high = -1);
 
   PhraseLocation(const vector<int>& matchings, int num_subpatterns);
 
-  PhraseLocation(const shared_ptr<vector<int>>& matchings, int num_subpatterns);
+  PhraseLocation(const FlatView<int>& matchings, int num_subpatterns);
 
   // Checks if a phrase has any occurrences in the source data.
   bool IsEmpty() const;
@@ -34,7 +36,7 @@ struct PhraseLocation {
   friend bool operator==(const PhraseLocation& a, const PhraseLocation& b);
 
   int sa_low, sa_high;
-  shared_ptr<vector<int>> matchings;
+  FlatView<int> matchings;
   int num_subpatterns;
 };
 
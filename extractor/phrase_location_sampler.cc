@@ -24,7 +24,7 @@ PhraseLocationSampler::PhraseLocationSampler(
 PhraseLocation PhraseLocationSampler::Sample(
     const PhraseLocation& location,
     const unordered_set<int>& blacklisted_sentence_ids) const {
-  if (location.matchings == NULL) {
+  if (location.num_subpatterns == 0) {
     return suffix_array_sampler->Sample(location, blacklisted_sentence_ids);
   } else {
     return matchings_sampler->Sample(location, blacklisted_sentence_ids);
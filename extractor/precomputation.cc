@@ -1,7 +1,13 @@
 #include "precomputation.h"
 
+#include <algorithm>
+#include <cstring>
 #include <iostream>
 #include <queue>
+#include <stdexcept>
+#ifdef _OPENMP
+ #include <omp.h>
+#endif
 
 #include "data_array.h"
 #include "suffix_array.h"
@@ -12,6 +18,7 @@ using namespace std;
 
 namespace extractor {
 
+
 Precomputation::Precomputation(
     shared_ptr<Vocabulary> vocabulary, shared_ptr<SuffixArray> suffix_array,
     int num_frequent_patterns, int num_super_frequent_patterns,
@@ -36,33 +43,56 @@ Precomputation::Precomputation(
   }
 
   start_time = Clock::now();
-  vector<tuple<int, int, int>> matchings;
-  vector<vector<int>> annotations;
+  // Split the source data into one shard of whole sentences per thread.
+  int num_shards = 1;
+#ifdef _OPENMP
+  num_shards = omp_get_max_threads();
+#endif
+  vector<int> shard_starts(1, 0);
+  int shard_size = max<int>(1, data.size() / num_shards);
   for (size_t i = 0; i < data.size(); ++i) {
-    // If the sentence is over, add all the discontiguous frequent patterns to
-    // the index.
-    if (data[i] == DataArray::END_OF_LINE) {
-      UpdateIndex(matchings, annotations, max_rule_span, min_gap_size,
-                  max_rule_symbols);
-      matchings.clear();
-      annotations.clear();
-      continue;
+    if (data[i] == DataArray::END_OF_LINE &&
+        i + 1 - shard_starts.back() >= shard_size) {
+      shard_starts.push_back(i + 1);
     }
-    // Find all the contiguous frequent patterns starting at position i.
-    vector<int> pattern;
-    for (int j = 1; j <= max_frequent_phrase_len && i + j <= data.size(); ++j) {
-      pattern.push_back(data[i + j - 1]);
-      auto it = frequent_patterns_index.find(pattern);
-      if (it == frequent_patterns_index.end()) {
-        // If the current pattern is not frequent, any longer pattern having the
-        // current pattern as prefix will not be frequent.
-        break;
+  }
+  if (shard_starts.back() < data.size()) {
+    shard_starts.push_back(data.size());
+  }
+
+  vector<PartialIndex> partial_indexes(shard_starts.size() - 1);
+  #pragma omp parallel for schedule(dynamic)
+  for (size_t shard = 0; shard < partial_indexes.size(); ++shard) {
+    vector<tuple<int, int, int>> matchings;
+    vector<vector<int>> annotations;
+    for (int i = shard_starts[shard]; i < shard_starts[shard + 1]; ++i) {
+      // If the sentence is over, add all the discontiguous frequent patterns
+      // to the index.
+      if (data[i] == DataArray::END_OF_LINE) {
+        UpdateIndex(matchings, annotations, max_rule_span, min_gap_size,
+                    max_rule_symbols, partial_indexes[shard]);
+        matchings.clear();
+        annotations.clear();
+        continue;
+      }
+      // Find all the contiguous frequent patterns starting at position i.
+      vector<int> pattern;
+      for (int j = 1; j <= max_frequent_phrase_len && i + j <= data.size();
+           ++j) {
+        pattern.push_back(data[i + j - 1]);
+        auto it = frequent_patterns_index.find(pattern);
+        if (it == frequent_patterns_index.end()) {
+          // If the current pattern is not frequent, any longer pattern having
+          // the current pattern as prefix will not be frequent.
+          break;
+        }
+        int is_super_frequent = it->second < num_super_frequent_patterns;
+        matchings.push_back(make_tuple(i, j, is_super_frequent));
+        annotations.push_back(pattern_annotations[it->second]);
       }
-      int is_super_frequent = it->second < num_super_frequent_patterns;
-      matchings.push_back(make_tuple(i, j, is_super_frequent));
-      annotations.push_back(pattern_annotations[it->second]);
     }
   }
+  MergeIndexes(partial_indexes);
   end_time = Clock::now();
   cerr << "Constructing collocations index took "
        << GetDuration(start_time, end_time) << " seconds..." << endl;
@@ -121,7 +151,8 @@ vector<int> Precomputation::AnnotatePattern(
 void Precomputation::UpdateIndex(
     const vector<tuple<int, int, int>>& matchings,
     const vector<vector<int>>& annotations,
-    int max_rule_span, int min_gap_size, int max_rule_symbols) {
+    int max_rule_span, int min_gap_size, int max_rule_symbols,
+    PartialIndex& index) {
   // Select the leftmost subpattern.
   for (size_t i = 0; i < matchings.size(); ++i) {
     int start1, size1, is_super1;
@@ -176,46 +207,125 @@ void Precomputation::AppendSubpattern(
 }
 
 void Precomputation::AppendCollocation(
-    shared_ptr<vector<int>>& collocations, int pos1, int pos2) {
-  if (collocations == nullptr) {
-    collocations = make_shared<vector<int>>();
-  }
-  collocations->push_back(pos1);
-  collocations->push_back(pos2);
+    vector<int>& collocations, int pos1, int pos2) {
+  collocations.push_back(pos1);
+  collocations.push_back(pos2);
 }
 
 void Precomputation::AppendCollocation(
-    shared_ptr<vector<int>>& collocations, int pos1, int pos2, int pos3) {
-  if (collocations == nullptr) {
-    collocations = make_shared<vector<int>>();
+    vector<int>& collocations, int pos1, int pos2, int pos3) {
+  collocations.push_back(pos1);
+  collocations.push_back(pos2);
+  collocations.push_back(pos3);
+}
+
+void Precomputation::MergeIndexes(const vector<PartialIndex>& partial_indexes) {
+  // Sort the entries of all the shards by pattern and then by shard, so that
+  // the collocations of each pattern are concatenated in corpus order.
+  typedef pair<const vector<int>*, const vector<int>*> Entry;
+  vector<Entry> entries;
+  for (const PartialIndex& partial_index: partial_indexes) {
+    for (const auto& entry: partial_index) {
+      entries.push_back(make_pair(&entry.first, &entry.second));
+    }
+  }
+  stable_sort(entries.begin(), entries.end(),
+      [](const Entry& entry1, const Entry& entry2) {
+        return *entry1.first < *entry2.first;
+      });
+
+  vector<uint64_t> pattern_starts(1, 0), collocation_starts(1, 0), hashes;
+  vector<uint64_t> entry_starts;
+  vector<int> all_patterns;
+  uint64_t num_collocations = 0;
+  for (size_t i = 0; i < entries.size(); ++i) {
+    const vector<int>& pattern = *entries[i].first;
+    if (i == 0 || pattern != *entries[i - 1].first) {
+      if (i > 0) {
+        collocation_starts.push_back(num_collocations);
+      }
+      hashes.push_back(FlatHash(pattern.data(), pattern.size() * sizeof(int)));
+      all_patterns.insert(all_patterns.end(), pattern.begin(), pattern.end());
+      pattern_starts.push_back(all_patterns.size());
+    }
+    entry_starts.push_back(num_collocations);
+    num_collocations += entries[i].second->size();
   }
-  collocations->push_back(pos1);
-  collocations->push_back(pos2);
-  collocations->push_back(pos3);
+  if (!entries.empty()) {
+    collocation_starts.push_back(num_collocations);
+  }
+
+  vector<int> all_collocations(num_collocations);
+  #pragma omp parallel for schedule(dynamic, 1024)
+  for (size_t i = 0; i < entries.size(); ++i) {
+    copy(entries[i].second->begin(), entries[i].second->end(),
+         all_collocations.begin() + entry_starts[i]);
+  }
+
+  pattern_start = move(pattern_starts);
+  patterns = move(all_patterns);
+  collocation_start = move(collocation_starts);
+  collocations = move(all_collocations);
+  pattern_table = BuildFlatTable(hashes);
 }
 
 bool Precomputation::Contains(const vector<int>& pattern) const {
-  return index.count(pattern);
+  return FindPattern(pattern) != -1;
 }
 
-shared_ptr<vector<int>> Precomputation::GetCollocations(
+FlatView<int> Precomputation::GetCollocations(
     const vector<int>& pattern) const {
-  return index.at(pattern);
+  int i = FindPattern(pattern);
+  if (i == -1) {
+    throw out_of_range("Pattern not found in precomputation");
+  }
+  return collocations.View(collocation_start[i],
+                           collocation_start[i + 1] - collocation_start[i]);
 }
 
-bool Precomputation::operator==(const Precomputation& other) const {
-  if (index.size() != other.index.size()) {
-    return false;
-  }
+int Precomputation::FindPattern(const vector<int>& pattern) const {
+  size_t num_bytes = pattern.size() * sizeof(int);
+  return FindInFlatTable(pattern_table, FlatHash(pattern.data(), num_bytes),
+      [&](int i) {
+        return pattern_start[i + 1] - pattern_start[i] == pattern.size() &&
+               memcmp(patterns.begin() + pattern_start[i], pattern.data(),
+                      num_bytes) == 0;
+      });
+}
 
-  for (const auto& entry: index) {
-    auto it = other.index.find(entry.first);
-    if (it == other.index.end() || *entry.second != *it->second) {
-      return false;
-    }
+map<vector<int>, vector<int>> Precomputation::GetEntries() const {
+  map<vector<int>, vector<int>> entries;
+  for (size_t i = 0; i + 1 < pattern_start.size(); ++i) {
+    vector<int> pattern(patterns.begin() + pattern_start[i],
+                        patterns.begin() + pattern_start[i + 1]);
+    entries[pattern] = vector<int>(
+        collocations.begin() + collocation_start[i],
+        collocations.begin() + collocation_start[i + 1]);
   }
+  return entries;
+}
+
+void Precomputation::WriteFlat(FlatWriter& writer) const {
+  writer.Write(pattern_start);
+  writer.Write(patterns);
+  writer.Write(collocation_start);
+  writer.Write(collocations);
+  writer.Write(pattern_table);
+}
 
-  return true;
+void Precomputation::ReadFlat(FlatReader& reader) {
+  pattern_start = reader.Read<uint64_t>();
+  patterns = reader.Read<int>();
+  collocation_start = reader.Read<uint64_t>();
+  collocations = reader.Read<int>();
+  pattern_table = reader.Read<int>();
+}
+
+bool Precomputation::operator==(const Precomputation& other) const {
+  return pattern_start == other.pattern_start &&
+         patterns == other.patterns &&
+         collocation_start == other.collocation_start &&
+         collocations == other.collocations;
 }
 
 } // namespace extractor
@@ -1,6 +1,7 @@
 #ifndef _PRECOMPUTATION_H_
 #define _PRECOMPUTATION_H_
 
+#include <map>
 #include <memory>
 #include <unordered_map>
 #include <unordered_set>
@@ -12,12 +13,14 @@
 #include <boost/serialization/utility.hpp>
 #include <boost/serialization/vector.hpp>
 
+#include "flat_file.h"
+
 using namespace std;
 
 namespace extractor {
 
 typedef boost::hash<vector<int>> VectorHash;
-typedef unordered_map<vector<int>, shared_ptr<vector<int>>, VectorHash> Index;
+typedef unordered_map<vector<int>, vector<int>, VectorHash> PartialIndex;
 
 class DataArray;
 class SuffixArray;
@@ -32,6 +35,10 @@ class Vocabulary;
  * - aXb, where a and b are frequent
  * - aXbXc, where a and b are super-frequent and c is frequent or
  *                b and c are super-frequent and a is frequent.
+ *
+ * The index is built in parallel over shards of the source data. It is stored
+ * as flat arrays (a pattern table over one contiguous array of collocations),
+ * which are either owned or mapped from a flat file.
  */
 class Precomputation {
  public:
@@ -50,8 +57,15 @@ class Precomputation {
   // Returns whether a pattern is contained in the index of collocations.
   virtual bool Contains(const vector<int>& pattern) const;
 
-  // Returns the list of collocations for a given pattern.
-  virtual shared_ptr<vector<int>> GetCollocations(const vector<int>& pattern) const;
+  // Returns the list of collocations for a given pattern. The list is not
+  // copied, it refers to the index (which it keeps alive).
+  virtual FlatView<int> GetCollocations(const vector<int>& pattern) const;
+
+  // Writes the index in the flat file format.
+  void WriteFlat(FlatWriter& writer) const;
+
+  // Reads an index written by WriteFlat (the arrays are used in place).
+  void ReadFlat(FlatReader& reader);
 
   bool operator==(const Precomputation& other) const;
 
@@ -72,39 +86,62 @@ class Precomputation {
   void UpdateIndex(
       const vector<tuple<int, int, int>>& matchings,
       const vector<vector<int>>& annotations,
-      int max_rule_span, int min_gap_size, int max_rule_symbols);
+      int max_rule_span, int min_gap_size, int max_rule_symbols,
+      PartialIndex& index);
 
   void AppendSubpattern(vector<int>& pattern, const vector<int>& subpattern);
 
   // Adds an occurrence of a binary collocation.
-  void AppendCollocation(shared_ptr<vector<int>>& collocations, int pos1, int pos2);
+  void AppendCollocation(vector<int>& collocations, int pos1, int pos2);
 
   // Adds an occurrence of a ternary collocation.
-  void AppendCollocation(shared_ptr<vector<int>>& collocations, int pos1, int pos2, int pos3);
+  void AppendCollocation(vector<int>& collocations, int pos1, int pos2,
+                         int pos3);
+
+  // Builds the flat index from the indexes of consecutive shards of the
+  // source data.
+  void MergeIndexes(const vector<PartialIndex>& partial_indexes);
+
+  // Returns the index of the pattern in the flat arrays or -1.
+  int FindPattern(const vector<int>& pattern) const;
+
+  // Returns all the entries in the index, sorted by pattern.
+  map<vector<int>, vector<int>> GetEntries() const;
 
   friend class boost::serialization::access;
 
   template<class Archive> void save(Archive& ar, unsigned int) const {
-    int num_entries = index.size();
+    map<vector<int>, vector<int>> entries = GetEntries();
+    int num_entries = entries.size();
     ar << num_entries;
-    for (const auto& entry: index) {
-      ar << entry.first << *entry.second;
+    for (const auto& entry: entries) {
+      ar << entry.first << entry.second;
     }
   }
 
   template<class Archive> void load(Archive& ar, unsigned int) {
     int num_entries;
     ar >> num_entries;
+    vector<PartialIndex> partial_indexes(1);
     for (size_t i = 0; i < num_entries; ++i) {
       vector<int> key, value;
       ar >> key >> value;
-      index[key] = make_shared<vector<int>>(value);
+      partial_indexes[0][key] = value;
     }
+    MergeIndexes(partial_indexes);
   }
 
   BOOST_SERIALIZATION_SPLIT_MEMBER();
 
-  Index index;
+  // The i-th pattern is patterns[pattern_start[i], pattern_start[i + 1]) and
+  // its collocations are collocations[collocation_start[i],
+  // collocation_start[i + 1]). The patterns are sorted and indexed by an open
+  // addressing table hashed by FlatHash of the pattern.
+  FlatArray<uint64_t> pattern_start;
+  FlatArray<int> patterns;
+  FlatArray<uint64_t> collocation_start;
+  FlatArray<int> collocations;
+  FlatArray<int> pattern_table;
 };
 
 } // namespace extractor
@@ -1,16 +1,20 @@
 #include <gtest/gtest.h>
 
+#include <cstdlib>
+#include <fstream>
 #include <memory>
 #include <sstream>
 #include <vector>
 
 #include <boost/archive/text_iarchive.hpp>
 #include <boost/archive/text_oarchive.hpp>
+#include <unistd.h>
 
 #include "mocks/mock_data_array.h"
 #include "mocks/mock_suffix_array.h"
 #include "mocks/mock_vocabulary.h"
 #include "precomputation.h"
+#include "suffix_array.h"
 
 using namespace std;
 using namespace ::testing;
@@ -60,72 +64,72 @@ TEST_F(PrecomputationTest, TestCollocations) {
   vector<int> key = {2, 3, -1, 2};
   vector<int> expected_value = {1, 5, 1, 8, 5, 8, 5, 11, 8, 11};
   EXPECT_TRUE(precomputation.Contains(key));
-  EXPECT_EQ(expected_value, *precomputation.GetCollocations(key));
+  EXPECT_EQ(expected_value, precomputation.GetCollocations(key).ToVector());
   key = {2, 3, -1, 2, 3};
   expected_value = {1, 5, 1, 8, 5, 8};
   EXPECT_TRUE(precomputation.Contains(key));
-  EXPECT_EQ(expected_value, *precomputation.GetCollocations(key));
+  EXPECT_EQ(expected_value, precomputation.GetCollocations(key).ToVector());
   key = {2, 3, -1, 3};
   expected_value = {1, 6, 1, 9, 5, 9};
   EXPECT_TRUE(precomputation.Contains(key));
-  EXPECT_EQ(expected_value, *precomputation.GetCollocations(key));
+  EXPECT_EQ(expected_value, precomputation.GetCollocations(key).ToVector());
   key = {3, -1, 2};
   expected_value = {2, 5, 2, 8, 2, 11, 6, 8, 6, 11, 9, 11};
   EXPECT_TRUE(precomputation.Contains(key));
-  EXPECT_EQ(expected_value, *precomputation.GetCollocations(key));
+  EXPECT_EQ(expected_value, precomputation.GetCollocations(key).ToVector());
   key = {3, -1, 3};
   expected_value = {2, 6, 2, 9, 6, 9};
   EXPECT_TRUE(precomputation.Contains(key));
-  EXPECT_EQ(expected_value, *precomputation.GetCollocations(key));
+  EXPECT_EQ(expected_value, precomputation.GetCollocations(key).ToVector());
   key = {3, -1, 2, 3};
   expected_value = {2, 5, 2, 8, 6, 8};
   EXPECT_TRUE(precomputation.Contains(key));
-  EXPECT_EQ(expected_value, *precomputation.GetCollocations(key));
+  EXPECT_EQ(expected_value, precomputation.GetCollocations(key).ToVector());
   key = {2, -1, 2};
   expected_value = {1, 5, 1, 8, 5, 8, 5, 11, 8, 11};
   EXPECT_TRUE(precomputation.Contains(key));
-  EXPECT_EQ(expected_value, *precomputation.GetCollocations(key));
+  EXPECT_EQ(expected_value, precomputation.GetCollocations(key).ToVector());
   key = {2, -1, 2, 3};
   expected_value = {1, 5, 1, 8, 5, 8};
   EXPECT_TRUE(precomputation.Contains(key));
-  EXPECT_EQ(expected_value, *precomputation.GetCollocations(key));
+  EXPECT_EQ(expected_value, precomputation.GetCollocations(key).ToVector());
   key = {2, -1, 3};
   expected_value = {1, 6, 1, 9, 5, 9};
   EXPECT_TRUE(precomputation.Contains(key));
-  EXPECT_EQ(expected_value, *precomputation.GetCollocations(key));
+  EXPECT_EQ(expected_value, precomputation.GetCollocations(key).ToVector());
 
   key = {2, -1, 2, -2, 2};
   expected_value = {1, 5, 8, 5, 8, 11};
   EXPECT_TRUE(precomputation.Contains(key));
-  EXPECT_EQ(expected_value, *precomputation.GetCollocations(key));
+  EXPECT_EQ(expected_value, precomputation.GetCollocations(key).ToVector());
   key = {2, -1, 2, -2, 3};
   expected_value = {1, 5, 9};
   EXPECT_TRUE(precomputation.Contains(key));
-  EXPECT_EQ(expected_value, *precomputation.GetCollocations(key));
+  EXPECT_EQ(expected_value, precomputation.GetCollocations(key).ToVector());
   key = {2, -1, 3, -2, 2};
   expected_value = {1, 6, 8, 5, 9, 11};
   EXPECT_TRUE(precomputation.Contains(key));
-  EXPECT_EQ(expected_value, *precomputation.GetCollocations(key));
+  EXPECT_EQ(expected_value, precomputation.GetCollocations(key).ToVector());
   key = {2, -1, 3, -2, 3};
   expected_value = {1, 6, 9};
   EXPECT_TRUE(precomputation.Contains(key));
-  EXPECT_EQ(expected_value, *precomputation.GetCollocations(key));
+  EXPECT_EQ(expected_value, precomputation.GetCollocations(key).ToVector());
   key = {3, -1, 2, -2, 2};
   expected_value = {2, 5, 8, 2, 5, 11, 2, 8, 11, 6, 8, 11};
   EXPECT_TRUE(precomputation.Contains(key));
-  EXPECT_EQ(expected_value, *precomputation.GetCollocations(key));
+  EXPECT_EQ(expected_value, precomputation.GetCollocations(key).ToVector());
   key = {3, -1, 2, -2, 3};
   expected_value = {2, 5, 9};
   EXPECT_TRUE(precomputation.Contains(key));
-  EXPECT_EQ(expected_value, *precomputation.GetCollocations(key));
+  EXPECT_EQ(expected_value, precomputation.GetCollocations(key).ToVector());
   key = {3, -1, 3, -2, 2};
   expected_value = {2, 6, 8, 2, 6, 11, 2, 9, 11, 6, 9, 11};
   EXPECT_TRUE(precomputation.Contains(key));
-  EXPECT_EQ(expected_value, *precomputation.GetCollocations(key));
+  EXPECT_EQ(expected_value, precomputation.GetCollocations(key).ToVector());
   key = {3, -1, 3, -2, 3};
   expected_value = {2, 6, 9};
   EXPECT_TRUE(precomputation.Contains(key));
-  EXPECT_EQ(expected_value, *precomputation.GetCollocations(key));
+  EXPECT_EQ(expected_value, precomputation.GetCollocations(key).ToVector());
 
   // Exceeds max_rule_symbols.
   key = {2, -1, 2, -2, 2, 3};
@@ -135,6 +139,40 @@ TEST_F(PrecomputationTest, TestCollocations) {
   EXPECT_FALSE(precomputation.Contains(key));
 }
 
+TEST_F(PrecomputationTest, TestMultipleSentences) {
+  // With several threads, the sentences are indexed in separate shards.
+  vector<int> sentence = data;
+  vector<int> corpus;
+  for (int i = 0; i < 100; ++i) {
+    corpus.insert(corpus.end(), sentence.begin(), sentence.end());
+  }
+  shared_ptr<MockDataArray> corpus_data_array = make_shared<MockDataArray>();
+  EXPECT_CALL(*corpus_data_array, GetData()).WillRepeatedly(Return(corpus));
+  EXPECT_CALL(*corpus_data_array, GetVocabularySize())
+      .WillRepeatedly(Return(8));
+  EXPECT_CALL(*corpus_data_array, GetWord(2)).WillRepeatedly(Return("2"));
+  EXPECT_CALL(*corpus_data_array, GetWord(3)).WillRepeatedly(Return("3"));
+  shared_ptr<SuffixArray> corpus_suffix_array =
+      make_shared<SuffixArray>(corpus_data_array);
+  Precomputation corpus_precomputation(vocabulary, corpus_suffix_array,
+                                       3, 3, 10, 5, 1, 4, 2);
+
+  // The collocations are those of the first sentence repeated in every
+  // sentence, in corpus order.
+  for (vector<int> key: {vector<int>{2, -1, 2}, vector<int>{3, -1, 2, -2, 2},
+                         vector<int>{2, 3, -1, 2}}) {
+    vector<int> expected_value;
+    vector<int> sentence_value = precomputation.GetCollocations(key).ToVector();
+    for (int i = 0; i < 100; ++i) {
+      for (int position: sentence_value) {
+        expected_value.push_back(position + i * sentence.size());
+      }
+    }
+    EXPECT_TRUE(corpus_precomputation.Contains(key));
+    EXPECT_EQ(expected_value, corpus_precomputation.GetCollocations(key).ToVector());
+  }
+}
+
 TEST_F(PrecomputationTest, TestSerialization) {
   stringstream stream(ios_base::out | ios_base::in);
   ar::text_oarchive output_stream(stream, ar::no_header);
@@ -147,6 +185,28 @@ TEST_F(PrecomputationTest, TestSerialization) {
   EXPECT_EQ(precomputation, precomputation_copy);
 }
 
+TEST_F(PrecomputationTest, TestFlatFile) {
+  char filename[] = "/tmp/precomputation_testXXXXXX";
+  close(mkstemp(filename));
+  ofstream out(filename, ios::binary);
+  FlatWriter writer(out, FLAT_PRECOMPUTATION);
+  precomputation.WriteFlat(writer);
+  out.close();
+
+  Precomputation precomputation_copy;
+  FlatReader reader(filename, FLAT_PRECOMPUTATION);
+  precomputation_copy.ReadFlat(reader);
+  unlink(filename);
+
+  EXPECT_EQ(precomputation, precomputation_copy);
+  vector<int> key = {3, -1, 2, -2, 2};
+  vector<int> expected_value = {2, 5, 8, 2, 5, 11, 2, 8, 11, 6, 8, 11};
+  EXPECT_TRUE(precomputation_copy.Contains(key));
+  EXPECT_EQ(expected_value, precomputation_copy.GetCollocations(key).ToVector());
+  key = {2, -1, 5};
+  EXPECT_FALSE(precomputation_copy.Contains(key));
+}
+
 } // namespace
 } // namespace extractor
 
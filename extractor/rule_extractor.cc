@@ -76,34 +76,43 @@ RuleExtractor::~RuleExtractor() {}
 
 vector<Rule> RuleExtractor::ExtractRules(const Phrase& phrase,
                                          const PhraseLocation& location) const {
+  ExtractCounts counts;
+  CountExtracts(phrase, location, counts);
+  return ScoreRules(counts);
+}
+
+void RuleExtractor::CountExtracts(const Phrase& phrase,
+                                  const PhraseLocation& location,
+                                  ExtractCounts& counts) const {
   int num_subpatterns = location.num_subpatterns;
-  vector<int> matchings = *location.matchings;
+  const FlatView<int>& matchings = location.matchings;
 
   // Calculate statistics for the (sampled) occurrences of the source phrase.
-  map<Phrase, double> source_phrase_counter;
-  map<Phrase, map<Phrase, map<PhraseAlignment, int>>> alignments_counter;
   for (auto i = matchings.begin(); i != matchings.end(); i += num_subpatterns) {
     vector<int> matching(i, i + num_subpatterns);
     vector<Extract> extracts = ExtractAlignments(phrase, matching);
 
     for (Extract e: extracts) {
-      source_phrase_counter[e.source_phrase] += e.pairs_count;
-      alignments_counter[e.source_phrase][e.target_phrase][e.alignment] += 1;
+      counts.source_phrase_counter[e.source_phrase] += e.pairs_count;
+      counts.alignments_counter[e.source_phrase][e.target_phrase]
+          [e.alignment] += 1;
     }
   }
+  counts.num_samples += matchings.size() / num_subpatterns;
+}
 
-  // Compute the feature scores and find the most likely (frequent) alignment
-  // for each pair of source-target phrases.
-  int num_samples = matchings.size() / num_subpatterns;
+vector<Rule> RuleExtractor::ScoreRules(const ExtractCounts& counts) const {
   vector<Rule> rules;
-  for (auto source_phrase_entry: alignments_counter) {
-    Phrase source_phrase = source_phrase_entry.first;
-    for (auto target_phrase_entry: source_phrase_entry.second) {
-      Phrase target_phrase = target_phrase_entry.first;
+  for (const auto& source_phrase_entry: counts.alignments_counter) {
+    const Phrase& source_phrase = source_phrase_entry.first;
+    double source_phrase_count =
+        counts.source_phrase_counter.find(source_phrase)->second;
+    for (const auto& target_phrase_entry: source_phrase_entry.second) {
+      const Phrase& target_phrase = target_phrase_entry.first;
 
       int max_locations = 0, num_locations = 0;
       PhraseAlignment most_frequent_alignment;
-      for (auto alignment_entry: target_phrase_entry.second) {
+      for (const auto& alignment_entry: target_phrase_entry.second) {
         num_locations += alignment_entry.second;
         if (alignment_entry.second > max_locations) {
           most_frequent_alignment = alignment_entry.first;
@@ -112,7 +121,7 @@ vector<Rule> RuleExtractor::ExtractRules(const Phrase& phrase,
       }
 
       features::FeatureContext context(source_phrase, target_phrase,
-          source_phrase_counter[source_phrase], num_locations, num_samples);
+          source_phrase_count, num_locations, counts.num_samples);
       vector<double> scores = scorer->Score(context);
       rules.push_back(Rule(source_phrase, target_phrase, scores,
                            most_frequent_alignment));
@@ -1,6 +1,7 @@
 #ifndef _RULE_EXTRACTOR_H_
 #define _RULE_EXTRACTOR_H_
 
+#include <map>
 #include <memory>
 #include <unordered_map>
 #include <vector>
@@ -38,6 +39,20 @@ struct Extract {
   PhraseAlignment alignment;
 };
 
+/**
+ * Statistics about the source-target phrase pairs extracted from a sample of
+ * occurrences of a source phrase. Statistics gathered from several samples
+ * (e.g. from the suffix array and from the online data) are added up before
+ * the rules are scored.
+ */
+struct ExtractCounts {
+  ExtractCounts() : num_samples(0) {}
+
+  map<Phrase, double> source_phrase_counter;
+  map<Phrase, map<Phrase, map<PhraseAlignment, int>>> alignments_counter;
+  int num_samples;
+};
+
 /**
  * Component for extracting SCFG rules.
  */
@@ -76,6 +91,16 @@ class RuleExtractor {
   virtual vector<Rule> ExtractRules(const Phrase& phrase,
                                     const PhraseLocation& location) const;
 
+  // Adds the statistics for the phrase pairs extracted from the given
+  // occurrences of the source phrase to counts.
+  virtual void CountExtracts(const Phrase& phrase,
+                             const PhraseLocation& location,
+                             ExtractCounts& counts) const;
+
+  // Computes the feature scores and finds the most likely (frequent) alignment
+  // for each pair of source-target phrases.
+  virtual vector<Rule> ScoreRules(const ExtractCounts& counts) const;
+
  protected:
   RuleExtractor();
 
@@ -8,6 +8,7 @@
 #include "grammar.h"
 #include "fast_intersector.h"
 #include "matchings_finder.h"
+#include "online_index.h"
 #include "phrase.h"
 #include "phrase_builder.h"
 #include "rule.h"
@@ -71,6 +72,9 @@ HieroCachingRuleFactory::HieroCachingRuleFactory(
       false, require_tight_phrases);
   sampler = make_shared<PhraseLocationSampler>(
       source_suffix_array, max_samples);
+  online_index = make_shared<OnlineIndex>(vocabulary, phrase_builder, scorer,
+      min_gap_size, max_rule_span, max_nonterminals, max_rule_symbols,
+      max_samples, require_tight_phrases);
 }
 
 HieroCachingRuleFactory::HieroCachingRuleFactory(
@@ -138,6 +142,7 @@ Grammar HieroCachingRuleFactory::GetGrammar(
     phrase.push_back(word_id);
     Phrase next_phrase = phrase_builder->Build(phrase);
     shared_ptr<TrieNode> next_node;
+    PhraseLocation online_location;
 
     if (CannotHaveMatchings(node, word_id)) {
       if (!node->HasChild(word_id)) {
@@ -178,7 +183,13 @@ Grammar HieroCachingRuleFactory::GetGrammar(
           total_lookup_time += GetDuration(lookup_start, lookup_stop);
         }
 
-        if (phrase_location.IsEmpty()) {
+        // Phrases which only occur in the sentence pairs added online keep
+        // an empty suffix array location.
+        if (online_index != NULL && online_index->GetNumSentences() > 0) {
+          online_location = online_index->Find(next_phrase);
+        }
+
+        if (phrase_location.IsEmpty() && online_location.IsEmpty()) {
           continue;
         }
 
@@ -199,8 +210,15 @@ Grammar HieroCachingRuleFactory::GetGrammar(
         // Extract rules for the sampled set of occurrences.
         PhraseLocation sample = sampler->Sample(
             next_node->matchings, blacklisted_sentence_ids);
-        vector<Rule> new_rules =
-            rule_extractor->ExtractRules(next_phrase, sample);
+        vector<Rule> new_rules;
+        if (online_location.IsEmpty()) {
+          new_rules = rule_extractor->ExtractRules(next_phrase, sample);
+        } else {
+          ExtractCounts counts;
+          rule_extractor->CountExtracts(next_phrase, sample, counts);
+          online_index->CountExtracts(next_phrase, online_location, counts);
+          new_rules = rule_extractor->ScoreRules(counts);
+        }
         rules.insert(rules.end(), new_rules.begin(), new_rules.end());
       }
       Clock::time_point extract_stop = Clock::now();
@@ -229,6 +247,13 @@ Grammar HieroCachingRuleFactory::GetGrammar(
   return Grammar(rules, scorer->GetFeatureNames());
 }
 
+void HieroCachingRuleFactory::AddSentencePair(
+    const vector<string>& source_words,
+    const vector<string>& target_words,
+    const vector<pair<int, int>>& links) {
+  online_index->AddSentencePair(source_words, target_words, links);
+}
+
 bool HieroCachingRuleFactory::CannotHaveMatchings(
     shared_ptr<TrieNode> node, int word_id) {
   if (node->HasChild(word_id) && node->GetChild(word_id) == NULL) {
@@ -2,6 +2,7 @@
 #define _RULE_FACTORY_H_
 
 #include <memory>
+#include <string>
 #include <vector>
 #include <unordered_set>
 
@@ -16,6 +17,7 @@ class DataArray;
 class FastIntersector;
 class Grammar;
 class MatchingsFinder;
+class OnlineIndex;
 class PhraseBuilder;
 class Precomputation;
 class Rule;
@@ -36,6 +38,19 @@ class Vocabulary;
  * occurrences to extract aligned source-target phrase pairs. A trie cache is
  * used to avoid unnecessary computations if a source phrase can be constructed
  * more than once (e.g. some words occur more than once in the sentence).
+ *
+ * Sentence pairs added after the suffix array was compiled are kept in an
+ * online index. Their occurrences are looked up in the online index and the
+ * phrase pairs extracted from them are counted together with the ones extracted
+ * from the suffix array sample.
+ *
+ * The two sets of occurrences are sampled separately, each up to max_samples,
+ * so the sample size seen by SampleSourceCount and the other count-based
+ * features can reach twice max_samples. The online occurrences are added on
+ * top of the suffix array sample instead of competing with it, as in the online
+ * mode of the Python extractor, which however counts every online occurrence
+ * without sampling. The two only differ for phrases occurring more than
+ * max_samples times in the sentence pairs added online.
  */
 class HieroCachingRuleFactory {
  public:
@@ -76,6 +91,11 @@ class HieroCachingRuleFactory {
       const vector<int>& word_ids,
       const unordered_set<int>& blacklisted_sentence_ids);
 
+  // Adds a sentence pair to the online index.
+  virtual void AddSentencePair(const vector<string>& source_words,
+                               const vector<string>& target_words,
+                               const vector<pair<int, int>>& links);
+
  protected:
   HieroCachingRuleFactory();
 
@@ -109,6 +129,7 @@ class HieroCachingRuleFactory {
   shared_ptr<Vocabulary> vocabulary;
   shared_ptr<Sampler> sampler;
   shared_ptr<Scorer> scorer;
+  shared_ptr<OnlineIndex> online_index;
   int min_gap_size;
   int max_rule_span;
   int max_nonterminals;
@@ -1,9 +1,19 @@
 #include <gtest/gtest.h>
 
+#include <cmath>
+#include <cstdlib>
+#include <fstream>
+#include <map>
 #include <memory>
 #include <string>
 #include <vector>
 
+#include <unistd.h>
+
+#include "alignment.h"
+#include "data_array.h"
+#include "features/count_source_target.h"
+#include "features/sample_source_count.h"
 #include "grammar.h"
 #include "mocks/mock_fast_intersector.h"
 #include "mocks/mock_matchings_finder.h"
@@ -13,7 +23,12 @@
 #include "mocks/mock_vocabulary.h"
 #include "phrase_builder.h"
 #include "phrase_location.h"
+#include "precomputation.h"
+#include "rule.h"
 #include "rule_factory.h"
+#include "scorer.h"
+#include "suffix_array.h"
+#include "vocabulary.h"
 
 using namespace std;
 using namespace ::testing;
@@ -101,5 +116,94 @@ TEST_F(RuleFactoryTest, TestGetGrammarRepeatingWords) {
   EXPECT_EQ(28, grammar.GetRules().size());
 }
 
+class OnlineRuleFactoryTest : public Test {
+ protected:
+  virtual void SetUp() {
+    char bitext_file[] = "/tmp/rule_factory_testXXXXXX";
+    close(mkstemp(bitext_file));
+    ofstream bitext(bitext_file);
+    bitext << "a b ||| A B\nb c ||| B C\n";
+    bitext.close();
+    char alignment_file[] = "/tmp/rule_factory_testXXXXXX";
+    close(mkstemp(alignment_file));
+    ofstream links(alignment_file);
+    links << "0-0 1-1\n0-0 1-1\n";
+    links.close();
+
+    shared_ptr<DataArray> source_data_array =
+        make_shared<DataArray>(bitext_file, SOURCE);
+    shared_ptr<DataArray> target_data_array =
+        make_shared<DataArray>(bitext_file, TARGET);
+    shared_ptr<Alignment> alignment = make_shared<Alignment>(alignment_file);
+    unlink(bitext_file);
+    unlink(alignment_file);
+
+    shared_ptr<SuffixArray> suffix_array =
+        make_shared<SuffixArray>(source_data_array);
+    vocabulary = make_shared<Vocabulary>();
+    shared_ptr<Precomputation> precomputation = make_shared<Precomputation>(
+        vocabulary, suffix_array, 0, 0, 10, 5, 1, 5, 1);
+    vector<shared_ptr<features::Feature>> features = {
+        make_shared<features::SampleSourceCount>(),
+        make_shared<features::CountSourceTarget>()};
+    shared_ptr<Scorer> scorer = make_shared<Scorer>(features);
+    factory = make_shared<HieroCachingRuleFactory>(suffix_array,
+        target_data_array, alignment, vocabulary, precomputation, scorer, 1,
+        10, 2, 5, 100, true);
+  }
+
+  // Returns the scores of the rules in the grammar for the given sentence,
+  // indexed by "source ||| target".
+  map<string, vector<double>> GetRules(const vector<string>& words) {
+    vector<int> word_ids;
+    for (const string& word: words) {
+      word_ids.push_back(vocabulary->GetTerminalIndex(word));
+    }
+    Grammar grammar = factory->GetGrammar(word_ids, unordered_set<int>());
+    map<string, vector<double>> rules;
+    for (const Rule& rule: grammar.GetRules()) {
+      string key;
+      for (const string& word: rule.source_phrase.GetWords()) {
+        key += word + " ";
+      }
+      key += "|||";
+      for (const string& word: rule.target_phrase.GetWords()) {
+        key += " " + word;
+      }
+      rules[key] = rule.scores;
+    }
+    return rules;
+  }
+
+  shared_ptr<Vocabulary> vocabulary;
+  shared_ptr<HieroCachingRuleFactory> factory;
+};
+
+TEST_F(OnlineRuleFactoryTest, TestOutOfCorpusWord) {
+  map<string, vector<double>> rules = GetRules({"a", "z"});
+  ASSERT_EQ(1, rules.count("a ||| A"));
+  EXPECT_EQ(0, rules.count("z ||| Z"));
+  EXPECT_EQ(0, rules.count("a z ||| A Z"));
+  // SampleCountF and CountEF of a single occurrence.
+  EXPECT_DOUBLE_EQ(log10(2), rules["a ||| A"][0]);
+  EXPECT_DOUBLE_EQ(log10(2), rules["a ||| A"][1]);
+
+  factory->AddSentencePair({"a", "z"}, {"A", "Z"},
+                           {make_pair(0, 0), make_pair(1, 1)});
+  rules = GetRules({"a", "z"});
+
+  // Phrases with the new word only occur in the online data.
+  ASSERT_EQ(1, rules.count("z ||| Z"));
+  EXPECT_DOUBLE_EQ(log10(2), rules["z ||| Z"][0]);
+  EXPECT_DOUBLE_EQ(log10(2), rules["z ||| Z"][1]);
+  ASSERT_EQ(1, rules.count("a z ||| A Z"));
+  EXPECT_DOUBLE_EQ(log10(2), rules["a z ||| A Z"][0]);
+  EXPECT_DOUBLE_EQ(log10(2), rules["a z ||| A Z"][1]);
+  // The counts of a phrase in both add up.
+  ASSERT_EQ(1, rules.count("a ||| A"));
+  EXPECT_DOUBLE_EQ(log10(3), rules["a ||| A"][0]);
+  EXPECT_DOUBLE_EQ(log10(3), rules["a ||| A"][1]);
+}
+
 } // namespace
 } // namespace extractor
@@ -2,6 +2,7 @@
 #include <fstream>
 #include <iostream>
 #include <memory>
+#include <stdexcept>
 #include <string>
 #include <vector>
 
@@ -26,6 +27,7 @@
 #include "features/target_given_source_coherent.h"
 #include "grammar.h"
 #include "grammar_extractor.h"
+#include "ordered_pipeline.h"
 #include "precomputation.h"
 #include "rule.h"
 #include "scorer.h"
@@ -40,6 +42,17 @@ using namespace std;
 using namespace extractor;
 using namespace features;
 
+// Number of input sentences per thread which may be read ahead of the output.
+const int kMaxPendingPerThread = 16;
+
+// Grammar extracted for an input sentence, together with the parts of the input
+// line which are copied to the output.
+struct ExtractedGrammar {
+  string sentence;
+  string suffix;
+  shared_ptr<Grammar> grammar;
+};
+
 // Returns the file path in which a given grammar should be written.
 fs::path GetGrammarFilePath(const fs::path& grammar_path, int file_number) {
   string file_name = "grammar." + to_string(file_number);
@@ -60,7 +73,14 @@ int main(int argc, char** argv) {
     ("target,e", po::value<string>(), "Target language corpus")
     ("bitext,b", po::value<string>(), "Parallel text (source ||| target)")
     ("alignment,a", po::value<string>()->required(), "Bitext word alignment")
-    ("grammars,g", po::value<string>()->required(), "Grammars output path")
+    ("grammars,g", po::value<string>(), "Grammars output path")
+    ("binary_grammars", po::value<bool>()->zero_tokens(),
+        "Write the grammars in the binary format that cdec loads without "
+        "parsing")
+    ("per_sentence_grammar_file", po::value<string>(),
+        "Write all the grammars (in binary format) to this file instead of "
+        "the grammars path; pass the same file to cdec's "
+        "--per_sentence_grammar_file")
     ("threads,t", po::value<int>()->default_value(1), threads_option.c_str())
     ("frequent", po::value<int>()->default_value(100),
         "Number of precomputed frequent patterns")
@@ -104,6 +124,13 @@ int main(int argc, char** argv) {
     return 1;
   }
 
+  if (!vm.count("grammars") && !vm.count("per_sentence_grammar_file")) {
+    cerr << "An output location is required. "
+         << "Use -g (grammars path) or --per_sentence_grammar_file."
+         << endl;
+    return 1;
+  }
+
   int num_threads = vm["threads"].as<int>();
   cerr << "Grammar extraction will use " << num_threads << " threads." << endl;
 
@@ -207,45 +234,79 @@ int main(int argc, char** argv) {
       vm["tight_phrases"].as<bool>());
 
   // Creates the grammars directory if it doesn't exist.
-  fs::path grammar_path = vm["grammars"].as<string>();
-  if (!fs::is_directory(grammar_path)) {
-    fs::create_directory(grammar_path);
-  }
-
-  // Reads all sentences for which we extract grammar rules (the paralellization
-  // is simplified if we read all sentences upfront).
-  string sentence;
-  vector<string> sentences;
-  while (getline(cin, sentence)) {
-    sentences.push_back(sentence);
+  fs::path grammar_path;
+  ofstream per_sentence_grammars;
+  if (vm.count("per_sentence_grammar_file")) {
+    per_sentence_grammars.open(
+        vm["per_sentence_grammar_file"].as<string>(), ios::binary);
+    if (!per_sentence_grammars) {
+      cerr << "Unable to open "
+           << vm["per_sentence_grammar_file"].as<string>() << endl;
+      return 1;
+    }
+  } else {
+    grammar_path = vm["grammars"].as<string>();
+    if (!fs::is_directory(grammar_path)) {
+      fs::create_directory(grammar_path);
+    }
   }
+  bool binary_grammars = vm.count("binary_grammars");
 
-  // Extracts the grammar for each sentence and saves it to a file.
-  vector<string> suffixes(sentences.size());
-  #pragma omp parallel for schedule(dynamic) num_threads(num_threads)
-  for (size_t i = 0; i < sentences.size(); ++i) {
-    string suffix;
-    int position = sentences[i].find("|||");
-    if (position != sentences[i].npos) {
-      suffix = sentences[i].substr(position);
-      sentences[i] = sentences[i].substr(0, position);
+  // Extracts the grammar for each input sentence and saves it to a file (or
+  // appends it to the per sentence grammar file). The sentences flow through a
+  // bounded pipeline and the output for each sentence is written (in input
+  // order) as soon as its grammar is ready.
+  auto extract_grammar = [&](size_t i, const string& line) {
+    ExtractedGrammar result;
+    result.sentence = line;
+    int position = line.find("|||");
+    if (position != line.npos) {
+      result.suffix = line.substr(position);
+      result.sentence = line.substr(0, position);
     }
-    suffixes[i] = suffix;
 
     unordered_set<int> blacklisted_sentence_ids;
     if (vm.count("leave_one_out")) {
       blacklisted_sentence_ids.insert(i);
     }
-    Grammar grammar = extractor.GetGrammar(
-        sentences[i], blacklisted_sentence_ids);
-    ofstream output(GetGrammarFilePath(grammar_path, i).c_str());
-    output << grammar;
-  }
+    result.grammar = make_shared<Grammar>(
+        extractor.GetGrammar(result.sentence, blacklisted_sentence_ids));
 
-  for (size_t i = 0; i < sentences.size(); ++i) {
-    cout << "<seg grammar=" << GetGrammarFilePath(grammar_path, i) << " id=\""
-         << i << "\"> " << sentences[i] << " </seg> " << suffixes[i] << endl;
-  }
+    if (!per_sentence_grammars.is_open()) {
+      fs::path grammar_file = GetGrammarFilePath(grammar_path, i);
+      ofstream output(grammar_file.c_str());
+      if (binary_grammars) {
+        result.grammar->WriteBinary(output);
+      } else {
+        output << *result.grammar;
+      }
+      if (!output) {
+        throw runtime_error("Unable to write " + grammar_file.string());
+      }
+      result.grammar.reset();
+    }
+    return result;
+  };
+
+  auto write_grammar = [&](size_t i, ExtractedGrammar& result) {
+    if (per_sentence_grammars.is_open()) {
+      uint64_t offset = per_sentence_grammars.tellp();
+      result.grammar->WriteBinary(per_sentence_grammars);
+      per_sentence_grammars.flush();
+      if (!per_sentence_grammars) {
+        throw runtime_error("Unable to write " +
+                            vm["per_sentence_grammar_file"].as<string>());
+      }
+      cout << "<seg psg=\"@" << offset << "\" id=\"" << i << "\"> ";
+    } else {
+      cout << "<seg grammar=" << GetGrammarFilePath(grammar_path, i)
+           << " id=\"" << i << "\"> ";
+    }
+    cout << result.sentence << " </seg> " << result.suffix << endl;
+  };
+
+  RunOrderedPipeline<ExtractedGrammar>(cin, num_threads,
+      kMaxPendingPerThread * num_threads, extract_grammar, write_grammar);
 
   Clock::time_point extraction_stop_time = Clock::now();
   cerr << "Overall extraction step took "
@@ -9,6 +9,7 @@
 
 #include "alignment.h"
 #include "data_array.h"
+#include "flat_file.h"
 #include "precomputation.h"
 #include "suffix_array.h"
 #include "time_util.h"
@@ -44,7 +45,10 @@ int main(int argc, char** argv) {
     ("max_phrase_len,p", po::value<int>()->default_value(4),
         "Maximum frequent phrase length")
     ("min_frequency", po::value<int>()->default_value(1000),
-        "Minimum number of occurrences for a pharse to be considered frequent");
+        "Minimum number of occurrences for a pharse to be considered frequent")
+    ("prefix_doubling",
+        "Construct the suffix array with prefix doubling instead of the "
+        "(faster) induced sorting algorithm");
 
   po::variables_map vm;
   po::store(po::parse_command_line(argc, argv, desc), vm);
@@ -89,9 +93,9 @@ int main(int argc, char** argv) {
   Clock::time_point start_write = Clock::now();
   string target_path = (output_dir / fs::path("target.bin")).string();
   config_stream << "target = " << target_path << endl;
-  ofstream target_fstream(target_path);
-  ar::binary_oarchive target_stream(target_fstream);
-  target_stream << *target_data_array;
+  ofstream target_fstream(target_path, ios::binary);
+  FlatWriter target_writer(target_fstream, FLAT_DATA_ARRAY);
+  target_data_array->WriteFlat(target_writer);
   Clock::time_point stop_write = Clock::now();
   double write_duration = GetDuration(start_write, stop_write);
 
@@ -103,14 +107,15 @@ int main(int argc, char** argv) {
   start_time = Clock::now();
   cerr << "Constructing source suffix array..." << endl;
   shared_ptr<SuffixArray> source_suffix_array =
-      make_shared<SuffixArray>(source_data_array);
+      make_shared<SuffixArray>(source_data_array,
+          vm.count("prefix_doubling") ? PREFIX_DOUBLING : INDUCED_SORTING);
 
   start_write = Clock::now();
   string source_path = (output_dir / fs::path("source.bin")).string();
   config_stream << "source = " << source_path << endl;
-  ofstream source_fstream(source_path);
-  ar::binary_oarchive output_stream(source_fstream);
-  output_stream << *source_suffix_array;
+  ofstream source_fstream(source_path, ios::binary);
+  FlatWriter source_writer(source_fstream, FLAT_SUFFIX_ARRAY);
+  source_suffix_array->WriteFlat(source_writer);
   stop_write = Clock::now();
   write_duration += GetDuration(start_write, stop_write);
 
@@ -127,9 +132,9 @@ int main(int argc, char** argv) {
   start_write = Clock::now();
   string alignment_path = (output_dir / fs::path("alignment.bin")).string();
   config_stream << "alignment = " << alignment_path << endl;
-  ofstream alignment_fstream(alignment_path);
-  ar::binary_oarchive alignment_stream(alignment_fstream);
-  alignment_stream << *alignment;
+  ofstream alignment_fstream(alignment_path, ios::binary);
+  FlatWriter alignment_writer(alignment_fstream, FLAT_ALIGNMENT);
+  alignment->WriteFlat(alignment_writer);
   stop_write = Clock::now();
   write_duration += GetDuration(start_write, stop_write);
 
@@ -155,10 +160,11 @@ int main(int argc, char** argv) {
   start_write = Clock::now();
   string precomputation_path = (output_dir / fs::path("precomp.bin")).string();
   config_stream << "precomputation = " << precomputation_path << endl;
-  ofstream precomp_fstream(precomputation_path);
-  ar::binary_oarchive precomp_stream(precomp_fstream);
-  precomp_stream << precomputation;
+  ofstream precomp_fstream(precomputation_path, ios::binary);
+  FlatWriter precomp_writer(precomp_fstream, FLAT_PRECOMPUTATION);
+  precomputation.WriteFlat(precomp_writer);
 
+  // The vocabulary grows during extraction, so it is not a flat file.
   string vocabulary_path = (output_dir / fs::path("vocab.bin")).string();
   config_stream << "vocabulary = " << vocabulary_path << endl;
   ofstream vocab_fstream(vocabulary_path);
@@ -178,9 +184,9 @@ int main(int argc, char** argv) {
   start_write = Clock::now();
   string table_path = (output_dir / fs::path("bilex.bin")).string();
   config_stream << "ttable = " << table_path << endl;
-  ofstream table_fstream(table_path);
-  ar::binary_oarchive table_stream(table_fstream);
-  table_stream << table;
+  ofstream table_fstream(table_path, ios::binary);
+  FlatWriter table_writer(table_fstream, FLAT_TRANSLATION_TABLE);
+  table.WriteFlat(table_writer);
   stop_write = Clock::now();
   write_duration += GetDuration(start_write, stop_write);
 
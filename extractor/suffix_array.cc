@@ -1,5 +1,6 @@
 #include "suffix_array.h"
 
+#include <algorithm>
 #include <cassert>
 #include <chrono>
 #include <iostream>
@@ -15,9 +16,205 @@ using namespace chrono;
 
 namespace extractor {
 
-SuffixArray::SuffixArray(shared_ptr<DataArray> data_array) :
+namespace {
+
+// Counts the occurrences of each symbol in text[0, n). Each thread counts a
+// part of the text.
+void CountSymbols(const int* text, int n, int alphabet_size,
+                  vector<int>& counts) {
+  counts.assign(alphabet_size, 0);
+  #pragma omp parallel
+  {
+    vector<int> thread_counts(alphabet_size);
+    #pragma omp for schedule(static) nowait
+    for (int i = 0; i < n; ++i) {
+      ++thread_counts[text[i]];
+    }
+    #pragma omp critical
+    for (int symbol = 0; symbol < alphabet_size; ++symbol) {
+      counts[symbol] += thread_counts[symbol];
+    }
+  }
+}
+
+void GetBucketStarts(const vector<int>& counts, vector<int>& buckets) {
+  int sum = 0;
+  for (size_t i = 0; i < counts.size(); ++i) {
+    buckets[i] = sum;
+    sum += counts[i];
+  }
+}
+
+void GetBucketEnds(const vector<int>& counts, vector<int>& buckets) {
+  int sum = 0;
+  for (size_t i = 0; i < counts.size(); ++i) {
+    sum += counts[i];
+    buckets[i] = sum;
+  }
+}
+
+// The induced sorting and the LCP construction access the text in the order
+// of the suffix array and spend most of their time waiting for memory, so they
+// prefetch the text for the suffixes a few positions ahead.
+const int kPrefetchDistance = 32;
+
+// The induced sorting works on texts where the symbols at S-type positions are
+// complemented (~symbol) and those at L-type positions are stored as they are,
+// so that the type of a suffix is read together with its first symbol. Two
+// encoded symbols are equal iff both the symbols and the types are equal.
+inline int DecodeSymbol(int value) {
+  return value < 0 ? ~value : value;
+}
+
+inline bool IsLMS(const int* text, int i) {
+  return i > 0 && text[i] < 0 && text[i - 1] >= 0;
+}
+
+// Sorts the L-type suffixes given the sorted LMS suffixes, then the S-type
+// suffixes given the sorted L-type suffixes.
+void InduceSort(const int* text, int* suffixes, int n,
+                const vector<int>& counts, vector<int>& buckets) {
+  GetBucketStarts(counts, buckets);
+  for (int i = 0; i < n; ++i) {
+    if (i + kPrefetchDistance < n && suffixes[i + kPrefetchDistance] > 0) {
+      __builtin_prefetch(&text[suffixes[i + kPrefetchDistance] - 1]);
+    }
+    int j = suffixes[i] - 1;
+    if (j >= 0 && text[j] >= 0) {
+      suffixes[buckets[text[j]]++] = j;
+    }
+  }
+
+  GetBucketEnds(counts, buckets);
+  for (int i = n - 1; i >= 0; --i) {
+    if (i >= kPrefetchDistance && suffixes[i - kPrefetchDistance] > 0) {
+      __builtin_prefetch(&text[suffixes[i - kPrefetchDistance] - 1]);
+    }
+    int j = suffixes[i] - 1;
+    if (j >= 0 && text[j] < 0) {
+      suffixes[--buckets[~text[j]]] = j;
+    }
+  }
+}
+
+// Computes the suffix array of text[0, n) with symbols in [0, alphabet_size).
+// The last symbol must be a sentinel smaller than all the other symbols. The
+// sorted LMS suffixes are computed recursively on a reduced text stored in the
+// second half of the suffixes array (Nong, Zhang and Chan, 2009). The text is
+// overwritten with its encoding by suffix type.
+void InducedSortingSuffixArray(int* text, int* suffixes, int n,
+                               int alphabet_size) {
+  if (n == 1) {
+    suffixes[0] = 0;
+    return;
+  }
+
+  vector<int> counts, buckets(alphabet_size);
+  CountSymbols(text, n, alphabet_size, counts);
+
+  text[n - 1] = ~text[n - 1];
+  for (int i = n - 2; i >= 0; --i) {
+    int next = DecodeSymbol(text[i + 1]);
+    if (text[i] < next || (text[i] == next && text[i + 1] < 0)) {
+      text[i] = ~text[i];
+    }
+  }
+
+  // Sort the LMS substrings.
+  GetBucketEnds(counts, buckets);
+  fill(suffixes, suffixes + n, -1);
+  for (int i = 1; i < n; ++i) {
+    if (IsLMS(text, i)) {
+      suffixes[--buckets[~text[i]]] = i;
+    }
+  }
+  InduceSort(text, suffixes, n, counts, buckets);
+
+  // Move the sorted LMS substrings to the front and name them. Two LMS
+  // substrings get the same name if they are equal. No two LMS positions are
+  // adjacent, so the names fit in the second half of the array.
+  int num_lms = 0;
+  for (int i = 0; i < n; ++i) {
+    if (i + kPrefetchDistance < n && suffixes[i + kPrefetchDistance] > 0) {
+      __builtin_prefetch(&text[suffixes[i + kPrefetchDistance] - 1]);
+    }
+    if (IsLMS(text, suffixes[i])) {
+      suffixes[num_lms++] = suffixes[i];
+    }
+  }
+  fill(suffixes + num_lms, suffixes + n, -1);
+  int num_names = 0, prev = -1;
+  for (int i = 0; i < num_lms; ++i) {
+    if (i + kPrefetchDistance < num_lms) {
+      __builtin_prefetch(&text[suffixes[i + kPrefetchDistance]]);
+    }
+    int pos = suffixes[i];
+    bool diff = prev == -1;
+    for (int d = 0; !diff; ++d) {
+      if (text[pos + d] != text[prev + d]) {
+        diff = true;
+      } else if (d > 0 && (IsLMS(text, pos + d) || IsLMS(text, prev + d))) {
+        break;
+      }
+    }
+    if (diff) {
+      ++num_names;
+      prev = pos;
+    }
+    suffixes[num_lms + pos / 2] = num_names - 1;
+  }
+  for (int i = n - 1, j = n - 1; i >= num_lms; --i) {
+    if (suffixes[i] >= 0) {
+      suffixes[j--] = suffixes[i];
+    }
+  }
+
+  // Sort the LMS suffixes by sorting the suffixes of the reduced text.
+  int* reduced_suffixes = suffixes;
+  int* reduced_text = suffixes + n - num_lms;
+  if (num_names < num_lms) {
+    InducedSortingSuffixArray(reduced_text, reduced_suffixes, num_lms,
+                              num_names);
+  } else {
+    for (int i = 0; i < num_lms; ++i) {
+      reduced_suffixes[reduced_text[i]] = i;
+    }
+  }
+
+  // Map the sorted reduced suffixes back to LMS positions in the text and
+  // induce the order of all the suffixes from them.
+  for (int i = 1, j = 0; i < n; ++i) {
+    if (IsLMS(text, i)) {
+      reduced_text[j++] = i;
+    }
+  }
+  #pragma omp parallel for schedule(static)
+  for (int i = 0; i < num_lms; ++i) {
+    reduced_suffixes[i] = reduced_text[reduced_suffixes[i]];
+  }
+  fill(suffixes + num_lms, suffixes + n, -1);
+  GetBucketEnds(counts, buckets);
+  for (int i = num_lms - 1; i >= 0; --i) {
+    if (i >= kPrefetchDistance) {
+      __builtin_prefetch(&text[suffixes[i - kPrefetchDistance]]);
+    }
+    int j = suffixes[i];
+    suffixes[i] = -1;
+    suffixes[--buckets[~text[j]]] = j;
+  }
+  InduceSort(text, suffixes, n, counts, buckets);
+}
+
+} // namespace
+
+SuffixArray::SuffixArray(shared_ptr<DataArray> data_array,
+                         SuffixArrayAlgorithm algorithm) :
     data_array(data_array) {
-  BuildSuffixArray();
+  if (algorithm == INDUCED_SORTING) {
+    BuildSuffixArrayInducedSorting();
+  } else {
+    BuildSuffixArray();
+  }
 }
 
 SuffixArray::SuffixArray() {}
@@ -28,67 +225,93 @@ void SuffixArray::BuildSuffixArray() {
   vector<int> groups = data_array->GetData();
   groups.reserve(groups.size() + 1);
   groups.push_back(DataArray::NULL_WORD);
-  suffix_array.resize(groups.size());
-  word_start.resize(data_array->GetVocabularySize() + 1);
+  vector<int> suffixes(groups.size());
+  vector<int> word_starts(data_array->GetVocabularySize() + 1);
 
-  InitialBucketSort(groups);
+  InitialBucketSort(groups, suffixes, word_starts);
 
   int combined_group_size = 0;
-  for (size_t i = 1; i < word_start.size(); ++i) {
-    if (word_start[i] - word_start[i - 1] == 1) {
+  for (size_t i = 1; i < word_starts.size(); ++i) {
+    if (word_starts[i] - word_starts[i - 1] == 1) {
       ++combined_group_size;
-      suffix_array[word_start[i] - combined_group_size] = -combined_group_size;
+      suffixes[word_starts[i] - combined_group_size] = -combined_group_size;
     } else {
       combined_group_size = 0;
     }
   }
 
-  PrefixDoublingSort(groups);
+  PrefixDoublingSort(groups, suffixes);
   cerr << "\tFinalizing sort..." << endl;
 
   for (size_t i = 0; i < groups.size(); ++i) {
-    suffix_array[groups[i]] = i;
+    suffixes[groups[i]] = i;
   }
+  suffix_array = move(suffixes);
+  word_start = move(word_starts);
 }
 
-void SuffixArray::InitialBucketSort(vector<int>& groups) {
+void SuffixArray::BuildSuffixArrayInducedSorting() {
+  Clock::time_point start_time = Clock::now();
+  vector<int> text = data_array->GetData();
+  text.reserve(text.size() + 1);
+  text.push_back(DataArray::NULL_WORD);
+  int vocabulary_size = data_array->GetVocabularySize();
+
+  vector<int> counts, word_starts(vocabulary_size + 1);
+  CountSymbols(text.data(), text.size(), vocabulary_size + 1, counts);
+  GetBucketStarts(counts, word_starts);
+
+  vector<int> suffixes(text.size());
+  InducedSortingSuffixArray(text.data(), suffixes.data(), text.size(),
+                            vocabulary_size);
+  suffix_array = move(suffixes);
+  word_start = move(word_starts);
+  Clock::time_point stop_time = Clock::now();
+  cerr << "\tInduced sorting took " << GetDuration(start_time, stop_time)
+       << " seconds" << endl;
+}
+
+void SuffixArray::InitialBucketSort(vector<int>& groups,
+                                    vector<int>& suffixes,
+                                    vector<int>& word_starts) {
   Clock::time_point start_time = Clock::now();
   for (size_t i = 0; i < groups.size(); ++i) {
-    ++word_start[groups[i]];
+    ++word_starts[groups[i]];
   }
 
-  for (size_t i = 1; i < word_start.size(); ++i) {
-    word_start[i] += word_start[i - 1];
+  for (size_t i = 1; i < word_starts.size(); ++i) {
+    word_starts[i] += word_starts[i - 1];
   }
 
   for (size_t i = 0; i < groups.size(); ++i) {
-    --word_start[groups[i]];
-    suffix_array[word_start[groups[i]]] = i;
+    --word_starts[groups[i]];
+    suffixes[word_starts[groups[i]]] = i;
   }
 
-  for (size_t i = 0; i < suffix_array.size(); ++i) {
-    groups[i] = word_start[groups[i] + 1] - 1;
+  for (size_t i = 0; i < suffixes.size(); ++i) {
+    groups[i] = word_starts[groups[i] + 1] - 1;
   }
   Clock::time_point stop_time = Clock::now();
   cerr << "\tBucket sort took " << GetDuration(start_time, stop_time)
        << " seconds" << endl;
 }
 
-void SuffixArray::PrefixDoublingSort(vector<int>& groups) {
+void SuffixArray::PrefixDoublingSort(vector<int>& groups,
+                                     vector<int>& suffixes) {
   int step = 1;
-  while (suffix_array[0] != -suffix_array.size()) {
+  while (suffixes[0] != -suffixes.size()) {
     int combined_group_size = 0;
     int i = 0;
-    while (i < suffix_array.size()) {
-      if (suffix_array[i] < 0) {
-        int skip = -suffix_array[i];
+    while (i < suffixes.size()) {
+      if (suffixes[i] < 0) {
+        int skip = -suffixes[i];
         combined_group_size += skip;
         i += skip;
-        suffix_array[i - combined_group_size] = -combined_group_size;
+        suffixes[i - combined_group_size] = -combined_group_size;
       } else {
         combined_group_size = 0;
-        int j = groups[suffix_array[i]];
-        TernaryQuicksort(i, j, step, groups);
+        int j = groups[suffixes[i]];
+        TernaryQuicksort(i, j, step, groups, suffixes);
         i = j + 1;
       }
     }
@@ -97,43 +320,43 @@ void SuffixArray::PrefixDoublingSort(vector<int>& groups) {
 }
 
 void SuffixArray::TernaryQuicksort(int left, int right, int step,
-    vector<int>& groups) {
+    vector<int>& groups, vector<int>& suffixes) {
   if (left > right) {
     return;
   }
 
   int pivot = left + rand() % (right - left + 1);
-  int pivot_value = groups[suffix_array[pivot] + step];
-  swap(suffix_array[pivot], suffix_array[left]);
+  int pivot_value = groups[suffixes[pivot] + step];
+  swap(suffixes[pivot], suffixes[left]);
   int mid_left = left, mid_right = left;
   for (int i = left + 1; i <= right; ++i) {
-    if (groups[suffix_array[i] + step] < pivot_value) {
+    if (groups[suffixes[i] + step] < pivot_value) {
       ++mid_right;
-      int temp = suffix_array[i];
-      suffix_array[i] = suffix_array[mid_right];
-      suffix_array[mid_right] = suffix_array[mid_left];
-      suffix_array[mid_left] = temp;
+      int temp = suffixes[i];
+      suffixes[i] = suffixes[mid_right];
+      suffixes[mid_right] = suffixes[mid_left];
+      suffixes[mid_left] = temp;
       ++mid_left;
-    } else if (groups[suffix_array[i] + step] == pivot_value) {
+    } else if (groups[suffixes[i] + step] == pivot_value) {
       ++mid_right;
-      int temp = suffix_array[i];
-      suffix_array[i] = suffix_array[mid_right];
-      suffix_array[mid_right] = temp;
+      int temp = suffixes[i];
+      suffixes[i] = suffixes[mid_right];
+      suffixes[mid_right] = temp;
     }
   }
 
-  TernaryQuicksort(left, mid_left - 1, step, groups);
+  TernaryQuicksort(left, mid_left - 1, step, groups, suffixes);
 
   if (mid_left == mid_right) {
-    groups[suffix_array[mid_left]] = mid_left;
-    suffix_array[mid_left] = -1;
+    groups[suffixes[mid_left]] = mid_left;
+    suffixes[mid_left] = -1;
   } else {
     for (int i = mid_left; i <= mid_right; ++i) {
-      groups[suffix_array[i]] = mid_right;
+      groups[suffixes[i]] = mid_right;
     }
   }
 
-  TernaryQuicksort(mid_right + 1, right, step, groups);
+  TernaryQuicksort(mid_right + 1, right, step, groups, suffixes);
 }
 
 vector<int> SuffixArray::BuildLCPArray() const {
@@ -144,25 +367,41 @@ vector<int> SuffixArray::BuildLCPArray() const {
   vector<int> rank(suffix_array.size());
   const vector<int>& data = data_array->GetData();
 
-  for (size_t i = 0; i < suffix_array.size(); ++i) {
+  int size = suffix_array.size();
+  #pragma omp parallel for schedule(static)
+  for (int i = 0; i < size; ++i) {
     rank[suffix_array[i]] = i;
   }
 
-  int prefix_len = 0;
-  for (size_t i = 0; i < suffix_array.size(); ++i) {
-    if (rank[i] == 0) {
-      lcp[rank[i]] = -1;
-    } else {
-      int j = suffix_array[rank[i] - 1];
-      while (i + prefix_len < data.size() && j + prefix_len < data.size()
-          && data[i + prefix_len] == data[j + prefix_len]) {
-        ++prefix_len;
+  // The common prefix computed for a suffix only speeds up the next one, so
+  // each block of the text can start from an empty prefix.
+  const int block_size = 1 << 20;
+  #pragma omp parallel for schedule(dynamic)
+  for (int block_start = 0; block_start < size; block_start += block_size) {
+    int block_end = min(size, block_start + block_size);
+    size_t prefix_len = 0;
+    for (int i = block_start; i < block_end; ++i) {
+      if (i + 2 * kPrefetchDistance < size) {
+        __builtin_prefetch(&suffix_array[rank[i + 2 * kPrefetchDistance]]);
+      }
+      if (i + kPrefetchDistance < size && rank[i + kPrefetchDistance] > 0) {
+        __builtin_prefetch(
+            data.data() + suffix_array[rank[i + kPrefetchDistance] - 1]);
+      }
+      if (rank[i] == 0) {
+        lcp[rank[i]] = -1;
+      } else {
+        size_t j = suffix_array[rank[i] - 1];
+        while (i + prefix_len < data.size() && j + prefix_len < data.size()
+            && data[i + prefix_len] == data[j + prefix_len]) {
+          ++prefix_len;
+        }
+        lcp[rank[i]] = prefix_len;
       }
-      lcp[rank[i]] = prefix_len;
-    }
 
-    if (prefix_len > 0) {
-      --prefix_len;
+      if (prefix_len > 0) {
+        --prefix_len;
+      }
     }
   }
 
@@ -217,6 +456,19 @@ int SuffixArray::LookupRangeStart(int low, int high, int word_id,
   return result;
 }
 
+void SuffixArray::WriteFlat(FlatWriter& writer) const {
+  data_array->WriteFlat(writer);
+  writer.Write(suffix_array);
+  writer.Write(word_start);
+}
+
+void SuffixArray::ReadFlat(FlatReader& reader) {
+  data_array = make_shared<DataArray>();
+  data_array->ReadFlat(reader);
+  suffix_array = reader.Read<int>();
+  word_start = reader.Read<int>();
+}
+
 bool SuffixArray::operator==(const SuffixArray& other) const {
   return *data_array == *other.data_array &&
          suffix_array == other.suffix_array &&
@@ -9,6 +9,8 @@
 #include <boost/serialization/split_member.hpp>
 #include <boost/serialization/vector.hpp>
 
+#include "flat_file.h"
+
 using namespace std;
 
 namespace extractor {
@@ -16,10 +18,19 @@ namespace extractor {
 class DataArray;
 class PhraseLocation;
 
+// Algorithms for constructing suffix arrays. Both give the same suffix array.
+enum SuffixArrayAlgorithm {
+  // Linear time induced sorting (SA-IS) of Nong, Zhang and Chan (2009).
+  INDUCED_SORTING,
+  // Prefix doubling of Larsson and Sadakane (1999).
+  PREFIX_DOUBLING
+};
+
 class SuffixArray {
  public:
   // Creates a suffix array from a data array.
-  SuffixArray(shared_ptr<DataArray> data_array);
+  SuffixArray(shared_ptr<DataArray> data_array,
+              SuffixArrayAlgorithm algorithm = INDUCED_SORTING);
 
   // Creates empty suffix array.
   SuffixArray();
@@ -33,7 +44,7 @@ class SuffixArray {
   virtual shared_ptr<DataArray> GetData() const;
 
   // Constructs the longest-common-prefix array using the algorithm of Kasai et
-  // al. (2001).
+  // al. (2001). The text is split into blocks which are processed in parallel.
   virtual vector<int> BuildLCPArray() const;
 
   // Returns the i-th suffix.
@@ -44,6 +55,12 @@ class SuffixArray {
   virtual PhraseLocation Lookup(int low, int high, const string& word,
                                 int offset) const;
 
+  // Writes the suffix array (and its data array) in the flat file format.
+  void WriteFlat(FlatWriter& writer) const;
+
+  // Reads a suffix array written by WriteFlat (the arrays are used in place).
+  void ReadFlat(FlatReader& reader);
+
   bool operator==(const SuffixArray& other) const;
 
  private:
@@ -51,15 +68,20 @@ class SuffixArray {
   // (1999).
   void BuildSuffixArray();
 
+  // Constructs the suffix array in linear time using induced sorting.
+  void BuildSuffixArrayInducedSorting();
+
   // Bucket sort on the data array (used for initializing the construction of
   // the suffix array.)
-  void InitialBucketSort(vector<int>& groups);
+  void InitialBucketSort(vector<int>& groups, vector<int>& suffixes,
+                         vector<int>& word_starts);
 
-  void TernaryQuicksort(int left, int right, int step, vector<int>& groups);
+  void TernaryQuicksort(int left, int right, int step, vector<int>& groups,
+                        vector<int>& suffixes);
 
   // Constructs the suffix array in log(n) steps by doubling the length of the
   // suffixes at each step.
-  void PrefixDoublingSort(vector<int>& groups);
+  void PrefixDoublingSort(vector<int>& groups, vector<int>& suffixes);
 
   // Given a [low, high) range in the suffix array in which all elements have
   // the first offset-1 values the same, it returns the first position where the
@@ -70,22 +92,25 @@ class SuffixArray {
 
   template<class Archive> void save(Archive& ar, unsigned int) const {
     ar << *data_array;
-    ar << suffix_array;
-    ar << word_start;
+    ar << suffix_array.ToVector();
+    ar << word_start.ToVector();
   }
 
   template<class Archive> void load(Archive& ar, unsigned int) {
     data_array = make_shared<DataArray>();
     ar >> *data_array;
-    ar >> suffix_array;
-    ar >> word_start;
+    vector<int> values;
+    ar >> values;
+    suffix_array = move(values);
+    ar >> values;
+    word_start = move(values);
   }
 
   BOOST_SERIALIZATION_SPLIT_MEMBER();
 
   shared_ptr<DataArray> data_array;
-  vector<int> suffix_array;
-  vector<int> word_start;
+  FlatArray<int> suffix_array;
+  FlatArray<int> word_start;
 };
 
 } // namespace extractor
@@ -0,0 +1,149 @@
+// Measures how long it takes to construct the suffix array and the LCP array
+// of synthetic corpora with prefix doubling and with induced sorting, and
+// checks that both algorithms give the same suffix array. The corpora have a
+// Zipfian word distribution and a small fraction of repeated sentences, like
+// real parallel corpora.
+//   usage: suffix_array_bench [--no_prefix_doubling] [num_tokens ...]
+// The default sizes are 1M, 10M and 100M tokens. The number of threads used
+// for the parallel steps is set with OMP_NUM_THREADS.
+#include <sys/resource.h>
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <random>
+#include <vector>
+
+#include "data_array.h"
+#include "suffix_array.h"
+#include "time_util.h"
+
+using namespace std;
+using namespace extractor;
+
+namespace {
+
+const int kVocabularySize = 100000;
+
+class SyntheticDataArray : public DataArray {
+ public:
+  SyntheticDataArray(const vector<int>& data, int vocabulary_size) :
+      data(data), vocabulary_size(vocabulary_size) {}
+
+  vector<int> GetData() const { return data; }
+
+  int GetSize() const { return data.size(); }
+
+  int GetVocabularySize() const { return vocabulary_size; }
+
+ private:
+  vector<int> data;
+  int vocabulary_size;
+};
+
+// Generates sentences of 5 to 45 words followed by END_OF_LINE. Word ids start
+// after END_OF_LINE and follow a Zipfian distribution. Every 20th sentence
+// repeats an earlier one.
+vector<int> GenerateCorpus(int num_tokens) {
+  mt19937 generator(num_tokens);
+  vector<double> cumulative(kVocabularySize);
+  double sum = 0;
+  for (int i = 0; i < kVocabularySize; ++i) {
+    sum += 1.0 / (i + 1);
+    cumulative[i] = sum;
+  }
+  uniform_real_distribution<double> word_distribution(0, sum);
+  uniform_int_distribution<int> length_distribution(5, 45);
+
+  vector<int> data;
+  data.reserve(num_tokens);
+  vector<int> sentence_starts;
+  while (data.size() < static_cast<size_t>(num_tokens)) {
+    int start = data.size();
+    if (sentence_starts.size() % 20 == 19) {
+      int other = sentence_starts[generator() % sentence_starts.size()];
+      for (int i = other; data[i] != DataArray::END_OF_LINE; ++i) {
+        data.push_back(data[i]);
+      }
+    } else {
+      int length = length_distribution(generator);
+      for (int i = 0; i < length; ++i) {
+        double value = word_distribution(generator);
+        int rank = lower_bound(cumulative.begin(), cumulative.end(), value) -
+            cumulative.begin();
+        data.push_back(DataArray::END_OF_LINE + 1 +
+                       min(rank, kVocabularySize - 1));
+      }
+    }
+    data.push_back(DataArray::END_OF_LINE);
+    sentence_starts.push_back(start);
+  }
+  data.resize(num_tokens);
+  data.back() = DataArray::END_OF_LINE;
+  return data;
+}
+
+long PeakRSSMb() {
+  struct rusage r;
+  getrusage(RUSAGE_SELF, &r);
+  return r.ru_maxrss / 1024;
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+  bool prefix_doubling = true;
+  vector<int> sizes;
+  for (int i = 1; i < argc; ++i) {
+    if (strcmp(argv[i], "--no_prefix_doubling") == 0) {
+      prefix_doubling = false;
+    } else if (atoi(argv[i]) > 0) {
+      sizes.push_back(atoi(argv[i]));
+    } else {
+      cerr << "usage: suffix_array_bench [--no_prefix_doubling] "
+           << "[num_tokens ...]" << endl;
+      return 1;
+    }
+  }
+  if (sizes.empty()) {
+    sizes = {1000000, 10000000, 100000000};
+  }
+
+  cout << setw(12) << "tokens" << setw(12) << "doubling" << setw(12)
+       << "induced" << setw(10) << "speedup" << setw(10) << "lcp"
+       << setw(11) << "identical" << setw(12) << "peak MB" << endl;
+  cout << fixed << setprecision(2);
+  for (int num_tokens: sizes) {
+    shared_ptr<DataArray> data_array = make_shared<SyntheticDataArray>(
+        GenerateCorpus(num_tokens),
+        DataArray::END_OF_LINE + 1 + kVocabularySize);
+
+    Clock::time_point start_time = Clock::now();
+    SuffixArray induced_sorting(data_array, INDUCED_SORTING);
+    double induced_sorting_duration = GetDuration(start_time, Clock::now());
+
+    start_time = Clock::now();
+    induced_sorting.BuildLCPArray();
+    double lcp_duration = GetDuration(start_time, Clock::now());
+
+    cout << setw(12) << num_tokens;
+    if (prefix_doubling) {
+      start_time = Clock::now();
+      SuffixArray doubling(data_array, PREFIX_DOUBLING);
+      double prefix_doubling_duration = GetDuration(start_time, Clock::now());
+      cout << setw(12) << prefix_doubling_duration << setw(12)
+           << induced_sorting_duration << setw(10)
+           << prefix_doubling_duration / induced_sorting_duration
+           << setw(10) << lcp_duration << setw(11)
+           << (doubling == induced_sorting ? "yes" : "NO");
+    } else {
+      cout << setw(12) << "-" << setw(12) << induced_sorting_duration
+           << setw(10) << "-" << setw(10) << lcp_duration << setw(11) << "-";
+    }
+    cout << setw(12) << PeakRSSMb() << endl;
+  }
+  return 0;
+}
@@ -1,9 +1,12 @@
 #include <gtest/gtest.h>
 
+#include <cstdlib>
+#include <fstream>
 #include <vector>
 
 #include <boost/archive/binary_iarchive.hpp>
 #include <boost/archive/binary_oarchive.hpp>
+#include <unistd.h>
 
 #include "mocks/mock_data_array.h"
 #include "phrase_location.h"
@@ -45,6 +48,32 @@ TEST_F(SuffixArrayTest, TestBuildSuffixArray) {
   }
 }
 
+TEST_F(SuffixArrayTest, TestPrefixDoubling) {
+  EXPECT_EQ(suffix_array, SuffixArray(data_array, PREFIX_DOUBLING));
+}
+
+TEST_F(SuffixArrayTest, TestRandomData) {
+  srand(1);
+  for (int vocabulary_size: {3, 10, 1000}) {
+    vector<int> random_data(5000);
+    for (size_t i = 0; i < random_data.size(); ++i) {
+      // Long repeats exercise the recursion of induced sorting.
+      random_data[i] = i >= 1000 && rand() % 4 != 0 ?
+          random_data[i - 1000] : 1 + rand() % (vocabulary_size - 1);
+    }
+    shared_ptr<MockDataArray> random_data_array = make_shared<MockDataArray>();
+    EXPECT_CALL(*random_data_array, GetData())
+        .WillRepeatedly(Return(random_data));
+    EXPECT_CALL(*random_data_array, GetVocabularySize())
+        .WillRepeatedly(Return(vocabulary_size));
+
+    SuffixArray induced_sorting(random_data_array, INDUCED_SORTING);
+    SuffixArray prefix_doubling(random_data_array, PREFIX_DOUBLING);
+    EXPECT_EQ(prefix_doubling, induced_sorting);
+    EXPECT_EQ(prefix_doubling.BuildLCPArray(), induced_sorting.BuildLCPArray());
+  }
+}
+
 TEST_F(SuffixArrayTest, TestBuildLCP) {
   vector<int> expected_lcp = {-1, 0, 2, 0, 1, 0, 0, 3, 1, 1, 0, 0, 4, 1};
   EXPECT_EQ(expected_lcp, suffix_array.BuildLCPArray());
@@ -86,5 +115,21 @@ TEST_F(SuffixArrayTest, TestSerialization) {
   EXPECT_EQ(suffix_array, suffix_array_copy);
 }
 
+TEST_F(SuffixArrayTest, TestFlatFile) {
+  char filename[] = "/tmp/suffix_array_testXXXXXX";
+  close(mkstemp(filename));
+  ofstream out(filename, ios::binary);
+  FlatWriter writer(out, FLAT_SUFFIX_ARRAY);
+  suffix_array.WriteFlat(writer);
+  out.close();
+
+  SuffixArray suffix_array_copy;
+  FlatReader reader(filename, FLAT_SUFFIX_ARRAY);
+  suffix_array_copy.ReadFlat(reader);
+  unlink(filename);
+
+  EXPECT_EQ(suffix_array, suffix_array_copy);
+}
+
 } // namespace
 } // namespace extractor
@@ -1,5 +1,6 @@
 #include "translation_table.h"
 
+#include <algorithm>
 #include <string>
 #include <vector>
 
@@ -64,13 +65,15 @@ TranslationTable::TranslationTable(shared_ptr<DataArray> source_data_array,
   // Calculating:
   //   p(e | f) = count(e, f) / count(f)
   //   p(f | e) = count(e, f) / count(e)
+  vector<pair<pair<int, int>, pair<double, double>>> entries;
   for (pair<pair<int, int>, int> link_count: links_count) {
     int source_word = link_count.first.first;
     int target_word = link_count.first.second;
     double score1 = 1.0 * link_count.second / source_links_count[source_word];
     double score2 = 1.0 * link_count.second / target_links_count[target_word];
-    translation_probabilities[link_count.first] = make_pair(score1, score2);
+    entries.push_back(make_pair(link_count.first, make_pair(score1, score2)));
   }
+  SetProbabilities(entries);
 }
 
 TranslationTable::TranslationTable() {}
@@ -88,6 +91,30 @@ void TranslationTable::IncrementLinksCount(
   ++links_count[make_pair(source_word_id, target_word_id)];
 }
 
+void TranslationTable::SetProbabilities(
+    vector<pair<pair<int, int>, pair<double, double>>>& entries) {
+  // Sorting makes the layout independent of the order of the entries.
+  sort(entries.begin(), entries.end());
+  vector<pair<int, int>> pairs;
+  vector<pair<double, double>> scores;
+  vector<uint64_t> hashes;
+  for (const auto& entry: entries) {
+    pairs.push_back(entry.first);
+    scores.push_back(entry.second);
+    hashes.push_back(FlatHash(&entry.first, sizeof(entry.first)));
+  }
+  word_pairs = move(pairs);
+  probabilities = move(scores);
+  word_pair_table = BuildFlatTable(hashes);
+}
+
+int TranslationTable::FindEntry(int source_id, int target_id) const {
+  auto word_pair = make_pair(source_id, target_id);
+  return FindInFlatTable(word_pair_table,
+      FlatHash(&word_pair, sizeof(word_pair)),
+      [&](int entry) { return word_pairs[entry] == word_pair; });
+}
+
 double TranslationTable::GetTargetGivenSourceScore(
     const string& source_word, const string& target_word) {
   int source_id = source_data_array->GetWordId(source_word);
@@ -96,12 +123,8 @@ double TranslationTable::GetTargetGivenSourceScore(
     return -1;
   }
 
-  auto entry = make_pair(source_id, target_id);
-  auto it = translation_probabilities.find(entry);
-  if (it == translation_probabilities.end()) {
-    return 0;
-  }
-  return it->second.first;
+  int entry = FindEntry(source_id, target_id);
+  return entry == -1 ? 0 : probabilities[entry].first;
 }
 
 double TranslationTable::GetSourceGivenTargetScore(
@@ -112,18 +135,33 @@ double TranslationTable::GetSourceGivenTargetScore(
     return -1;
   }
 
-  auto entry = make_pair(source_id, target_id);
-  auto it = translation_probabilities.find(entry);
-  if (it == translation_probabilities.end()) {
-    return 0;
-  }
-  return it->second.second;
+  int entry = FindEntry(source_id, target_id);
+  return entry == -1 ? 0 : probabilities[entry].second;
+}
+
+void TranslationTable::WriteFlat(FlatWriter& writer) const {
+  source_data_array->WriteFlat(writer);
+  target_data_array->WriteFlat(writer);
+  writer.Write(word_pairs);
+  writer.Write(probabilities);
+  writer.Write(word_pair_table);
+}
+
+void TranslationTable::ReadFlat(FlatReader& reader) {
+  source_data_array = make_shared<DataArray>();
+  source_data_array->ReadFlat(reader);
+  target_data_array = make_shared<DataArray>();
+  target_data_array->ReadFlat(reader);
+  word_pairs = reader.Read<pair<int, int>>();
+  probabilities = reader.Read<pair<double, double>>();
+  word_pair_table = reader.Read<int>();
 }
 
 bool TranslationTable::operator==(const TranslationTable& other) const {
   return *source_data_array == *other.source_data_array &&
          *target_data_array == *other.target_data_array &&
-         translation_probabilities == other.translation_probabilities;
+         word_pairs == other.word_pairs &&
+         probabilities == other.probabilities;
 }
 
 } // namespace extractor
@@ -4,12 +4,15 @@
 #include <memory>
 #include <string>
 #include <unordered_map>
+#include <vector>
 
 #include <boost/functional/hash.hpp>
 #include <boost/serialization/serialization.hpp>
 #include <boost/serialization/split_member.hpp>
 #include <boost/serialization/utility.hpp>
 
+#include "flat_file.h"
+
 using namespace std;
 
 namespace extractor {
@@ -21,6 +24,10 @@ class DataArray;
 
 /**
  * Bilexical table with conditional probabilities.
+ *
+ * The probabilities are stored in the format used by flat files: the word
+ * pairs in sorted order, their probabilities and an open addressing table
+ * indexing the pairs.
  */
 class TranslationTable {
  public:
@@ -44,6 +51,14 @@ class TranslationTable {
   virtual double GetSourceGivenTargetScore(const string& source_word,
                                            const string& target_word);
 
+  // Writes the translation table (and its data arrays) in the flat file
+  // format.
+  void WriteFlat(FlatWriter& writer) const;
+
+  // Reads a translation table written by WriteFlat (the arrays are used in
+  // place).
+  void ReadFlat(FlatReader& reader);
+
   bool operator==(const TranslationTable& other) const;
 
  private:
@@ -55,15 +70,22 @@ class TranslationTable {
       int source_word_id,
       int target_word_id) const;
 
+  // Stores the probabilities of the (source word id, target word id) pairs.
+  void SetProbabilities(
+      vector<pair<pair<int, int>, pair<double, double>>>& probabilities);
+
+  // Returns the index of the entry for the given pair of word ids or -1.
+  int FindEntry(int source_id, int target_id) const;
+
   friend class boost::serialization::access;
 
   template<class Archive> void save(Archive& ar, unsigned int) const {
     ar << *source_data_array << *target_data_array;
 
-    int num_entries = translation_probabilities.size();
+    int num_entries = word_pairs.size();
     ar << num_entries;
-    for (auto entry: translation_probabilities) {
-      ar << entry;
+    for (size_t i = 0; i < word_pairs.size(); ++i) {
+      ar << make_pair(word_pairs[i], probabilities[i]);
     }
   }
 
@@ -75,19 +97,23 @@ class TranslationTable {
 
     int num_entries;
     ar >> num_entries;
+    vector<pair<pair<int, int>, pair<double, double>>> entries(num_entries);
     for (size_t i = 0; i < num_entries; ++i) {
-      pair<pair<int, int>, pair<double, double>> entry;
-      ar >> entry;
-      translation_probabilities.insert(entry);
+      ar >> entries[i];
     }
+    SetProbabilities(entries);
   }
 
   BOOST_SERIALIZATION_SPLIT_MEMBER();
 
   shared_ptr<DataArray> source_data_array;
   shared_ptr<DataArray> target_data_array;
-  unordered_map<pair<int, int>, pair<double, double>, PairHash>
-      translation_probabilities;
+  FlatArray<pair<int, int>> word_pairs;
+  // p(e | f) and p(f | e) for each word pair.
+  FlatArray<pair<double, double>> probabilities;
+  // Open addressing table of word pair indexes, hashed by FlatHash of the
+  // pairs.
+  FlatArray<int> word_pair_table;
 };
 
 } // namespace extractor
@@ -1,5 +1,7 @@
 #include <gtest/gtest.h>
 
+#include <cstdlib>
+#include <fstream>
 #include <memory>
 #include <sstream>
 #include <string>
@@ -7,6 +9,7 @@
 
 #include <boost/archive/binary_iarchive.hpp>
 #include <boost/archive/binary_oarchive.hpp>
+#include <unistd.h>
 
 #include "mocks/mock_alignment.h"
 #include "mocks/mock_data_array.h"
@@ -97,5 +100,21 @@ TEST_F(TranslationTableTest, TestSerialization) {
   EXPECT_EQ(table, table_copy);
 }
 
+TEST_F(TranslationTableTest, TestFlatFile) {
+  char filename[] = "/tmp/translation_table_testXXXXXX";
+  close(mkstemp(filename));
+  ofstream out(filename, ios::binary);
+  FlatWriter writer(out, FLAT_TRANSLATION_TABLE);
+  table.WriteFlat(writer);
+  out.close();
+
+  TranslationTable table_copy;
+  FlatReader reader(filename, FLAT_TRANSLATION_TABLE);
+  table_copy.ReadFlat(reader);
+  unlink(filename);
+
+  EXPECT_EQ(table, table_copy);
+}
+
 } // namespace
 } // namespace extractor
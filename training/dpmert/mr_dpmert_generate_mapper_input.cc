@@ -1,4 +1,5 @@
 #include <iostream>
+#include <sstream>
 #include <vector>
 
 #include <boost/program_options.hpp>
@@ -69,8 +70,15 @@ int main(int argc, char** argv) {
      &directions);
   unsigned dev_set_size = conf["dev_set_size"].as<unsigned>();
   for (unsigned i = 0; i < dev_set_size; ++i) {
+    // forests written with --forest_format binary are named i.hg
+    ostringstream forest;
+    forest << forest_repository << '/' << i << ".hg";
+    if (!FileExists(forest.str())) {
+      forest.str("");
+      forest << forest_repository << '/' << i << ".json.gz";
+    }
     for (unsigned j = 0; j < directions.size(); ++j) {
-      cout << forest_repository << '/' << i << ".json.gz " << i << ' ';
+      cout << forest.str() << ' ' << i << ' ';
       print(cout, origin, "=", ";");
       cout << ' ';
       print(cout, directions[j], "=", ";");
@@ -92,8 +92,7 @@ int main(int argc, char** argv) {
     // cerr << "File: " << file << "\nDir: " << direction << "\n   X: " << origin << endl;
     if (last_file != file) {
       last_file = file;
-      ReadFile rf(file);
-      HypergraphIO::ReadFromJSON(rf.stream(), &hg);
+      HypergraphIO::ReadFromFile(file, &hg);
     }
     const ConvexHullWeightFunction wf(origin, direction);
     const ConvexHull hull = Inside<ConvexHull, ConvexHullWeightFunction>(hg, NULL, wf);
@@ -175,10 +175,9 @@ int main(int argc, char** argv) {
         curkbest.ReadFromFile(kbest_file);
     }
     is >> file >> sent_id;
-    ReadFile rf(file);
     if (kis.size() % 5 == 0) { cerr << '.'; }
     if (kis.size() % 200 == 0) { cerr << " [" << kis.size() << "]\n"; }
-    HypergraphIO::ReadFromJSON(rf.stream(), &hg);
+    HypergraphIO::ReadFromFile(file, &hg);
     hg.Reweight(weights);
     curkbest.AddKBestCandidates(hg, kbest_size, ds[sent_id]);
     if (kbest_file.size())
@@ -17,6 +17,7 @@
 #include "verbose.h"
 #include "viterbi.h"
 #include "hg.h"
+#include "hg_features.h"
 #include "prob.h"
 #include "kbest.h"
 #include "ff_register.h"
@@ -876,6 +877,14 @@ int main(int argc, char** argv) {
 	    cur_constraint.push_back(cur_good_v[0]); //add oracle to constraint set
 	    bool optimize_again = true;
 	    int cut_plane_calls = 0;
+	    // the forest may be rescored after every round, so its features are
+	    // flattened once
+	    Hypergraph hg;
+	    boost::shared_ptr<FlatEdgeFeatures> hg_features;
+	    if (optimizer == 3 && !no_reweight) {
+	      hg = observer.GetCurrentForest();
+	      hg_features.reset(new FlatEdgeFeatures(hg));
+	    }
 	    while (optimize_again)
 	      { 
 		if(DEBUG_SMO) cerr<< "optimize again: " << optimize_again << endl;
@@ -954,8 +963,7 @@ int main(int argc, char** argv) {
 			if(!no_reweight) //reweight the forest and select a new k-best
 			  {
 			    if(DEBUG_SMO) cerr<< "Decoding with new weights -- now orac are " << oracles[cur_sent].good.size() << endl;
-			    Hypergraph hg = observer.GetCurrentForest();
-			    hg.Reweight(dense_weights);
+			    hg_features->Reweight(dense_weights, &hg);
 			    if(unique_kbest)
                               observer.UpdateOracles<KBest::FilterUnique>(cur_sent, hg);
                             else
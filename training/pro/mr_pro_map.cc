@@ -174,16 +174,15 @@ int main(int argc, char** argv) {
     istringstream is(line);
     int sent_id;
     string file;
-    // path-to-file (JSON) sent_id
+    // path-to-file (JSON or binary) sent_id
     is >> file >> sent_id;
-    ReadFile rf(file);
     ostringstream os;
     training::CandidateSet J_i;
     os << kbest_repo << "/kbest." << sent_id << ".txt.gz";
     const string kbest_file = os.str();
     if (FileExists(kbest_file))
       J_i.ReadFromFile(kbest_file);
-    HypergraphIO::ReadFromJSON(rf.stream(), &hg);
+    HypergraphIO::ReadFromFile(file, &hg);
     hg.Reweight(weights);
     J_i.AddKBestCandidates(hg, kbest_size, ds[sent_id]);
     J_i.WriteToFile(kbest_file);
@@ -15,7 +15,7 @@ namespace std { using std::tr1::unordered_set; }
 #include "wordid.h"
 #include "tdict.h"
 #include "hg.h"
-#include "kbest.h"
+#include "kbest_stream.h"
 #include "viterbi.h"
 
 using namespace std;
@@ -158,31 +158,21 @@ void CandidateSet::Dedup() {
 }
 
 void CandidateSet::AddKBestCandidates(const Hypergraph& hg, size_t kbest_size, const SegmentEvaluator* scorer) {
-  KBest::KBestDerivations<vector<WordID>, ESentenceTraversal> kbest(hg, kbest_size);
-
-  for (unsigned i = 0; i < kbest_size; ++i) {
-    const KBest::KBestDerivations<vector<WordID>, ESentenceTraversal>::Derivation* d =
-      kbest.LazyKthBest(hg.nodes_.size() - 1, i);
-    if (!d) break;
-    cs.push_back(Candidate(d->yield, d->feature_values));
-    if (scorer)
-      scorer->Evaluate(d->yield, &cs.back().eval_feats);
-  }
-  Dedup();
+  AddKBest(hg, kbest_size, false, scorer);
 }
 
 void CandidateSet::AddUniqueKBestCandidates(const Hypergraph& hg, size_t kbest_size, const SegmentEvaluator* scorer) {
-  typedef KBest::KBestDerivations<vector<WordID>, ESentenceTraversal, KBest::FilterUnique> K;
-  K kbest(hg, kbest_size);
-
-  for (unsigned i = 0; i < kbest_size; ++i) {
-    const K::Derivation* d =
-      kbest.LazyKthBest(hg.nodes_.size() - 1, i);
-    if (!d) break;
-    cs.push_back(Candidate(d->yield, d->feature_values));
+  AddKBest(hg, kbest_size, true, scorer);
+}
+
+void CandidateSet::AddKBest(const Hypergraph& hg, size_t kbest_size, bool unique, const SegmentEvaluator* scorer) {
+  KBest::StreamingKBest<> kbest(hg, kbest_size, unique);
+  kbest.Stream([&](const vector<WordID>& yield, const SparseVector<double>& feats, const prob_t&) {
+    cs.push_back(Candidate(yield, feats));
     if (scorer)
-      scorer->Evaluate(d->yield, &cs.back().eval_feats);
-  }
+      scorer->Evaluate(yield, &cs.back().eval_feats);
+    return true;
+  });
   Dedup();
 }
 
@@ -51,6 +51,7 @@ class CandidateSet {
   // TODO add code to draw k samples
 
  private:
+  void AddKBest(const Hypergraph& hg, size_t kbest_size, bool unique, const SegmentEvaluator* scorer);
   void Dedup();
   std::vector<Candidate> cs;
 };
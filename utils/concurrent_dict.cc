@@ -0,0 +1,128 @@
+#include "concurrent_dict.h"
+
+#include <cstdlib>
+#include <iostream>
+#include <thread>
+
+#include "murmur_hash.h"
+
+using namespace std;
+
+static inline uint64_t HashWord(const string& word) {
+  return MurmurHash64(word.data(), word.size());
+}
+
+// the upper 32 bits of the hash are kept in the slot next to the id, so
+// most probes that hit a different word don't need a string compare
+static inline uint64_t Tag(uint64_t hash) { return hash & 0xffffffff00000000ULL; }
+static inline WordID IdOf(uint64_t slot) { return static_cast<WordID>(slot & 0xffffffffULL); }
+
+ConcurrentDict::Index::Index(int b) : bits(b), mask((1u << b) - 1), size(0) {
+  slots = new atomic<uint64_t>[mask + 1];
+  for (unsigned i = 0; i <= mask; ++i)
+    slots[i].store(0, memory_order_relaxed);
+}
+
+ConcurrentDict::ConcurrentDict() : next_id_(1), published_(0) {
+  for (int i = 0; i < kNumBlocks; ++i)
+    blocks_[i].store(NULL, memory_order_relaxed);
+  for (int i = 0; i < kNumShards; ++i)
+    shards_[i].index.store(new Index(kInitialIndexBits), memory_order_release);
+}
+
+ConcurrentDict::~ConcurrentDict() {
+  clear();
+  for (int i = 0; i < kNumShards; ++i)
+    delete shards_[i].index.load(memory_order_relaxed);
+}
+
+void ConcurrentDict::clear() {
+  for (int i = 0; i < kNumBlocks; ++i) {
+    delete[] blocks_[i].load(memory_order_relaxed);
+    blocks_[i].store(NULL, memory_order_relaxed);
+  }
+  for (int i = 0; i < kNumShards; ++i) {
+    Shard& s = shards_[i];
+    for (unsigned j = 0; j < s.retired.size(); ++j)
+      delete s.retired[j];
+    s.retired.clear();
+    delete s.index.load(memory_order_relaxed);
+    s.index.store(new Index(kInitialIndexBits), memory_order_release);
+  }
+  next_id_.store(1, memory_order_release);
+  published_.store(0, memory_order_release);
+}
+
+WordID ConcurrentDict::Find(const Index& index, uint64_t hash, const string& word) const {
+  const uint64_t tag = Tag(hash);
+  for (unsigned p = Probe(hash) & index.mask; ; p = (p + 1) & index.mask) {
+    const uint64_t e = index.slots[p].load(memory_order_acquire);
+    if (!e) return 0;
+    if (Tag(e) == tag && Convert(IdOf(e)) == word) return IdOf(e);
+  }
+}
+
+void ConcurrentDict::Insert(Index* index, uint64_t hash, WordID id) {
+  unsigned p = Probe(hash) & index->mask;
+  while (index->slots[p].load(memory_order_relaxed))
+    p = (p + 1) & index->mask;
+  index->slots[p].store(Tag(hash) | static_cast<uint32_t>(id), memory_order_release);
+  ++index->size;
+}
+
+void ConcurrentDict::Store(WordID id, const string& word) {
+  const unsigned i = id - 1 + kFirstBlockSize;
+  const int b = HighestBit(i) - kFirstBlockBits;
+  if (b >= kNumBlocks) {
+    cerr << "ConcurrentDict: too many entries\n";
+    abort();
+  }
+  string* block = blocks_[b].load(memory_order_acquire);
+  if (!block) {
+    // several shards may need the same block at the same time
+    string* fresh = new string[kFirstBlockSize << b];
+    if (blocks_[b].compare_exchange_strong(block, fresh, memory_order_acq_rel)) {
+      block = fresh;
+    } else {
+      delete[] fresh;
+    }
+  }
+  block[i - (kFirstBlockSize << b)] = word;
+}
+
+void ConcurrentDict::Publish(WordID id) {
+  // only the thread holding id can move the count past id - 1.  the threads
+  // holding smaller ids are storing a string (in other shards, whose locks
+  // they already hold), so the wait is short and cannot deadlock
+  while (published_.load(memory_order_acquire) != id - 1)
+    this_thread::yield();
+  published_.store(id, memory_order_release);
+}
+
+WordID ConcurrentDict::Convert(const string& word, bool frozen) {
+  const uint64_t hash = HashWord(word);
+  Shard& s = shards_[ShardOf(hash)];
+  WordID id = Find(*s.index.load(memory_order_acquire), hash, word);
+  if (id || frozen) return id;
+
+  lock_guard<mutex> lock(s.mutex);
+  Index* index = s.index.load(memory_order_relaxed);
+  id = Find(*index, hash, word);  // someone may have added it meanwhile
+  if (id) return id;
+  id = next_id_.fetch_add(1, memory_order_acq_rel);
+  Store(id, word);
+  Publish(id);
+  if (2 * (index->size + 1) > index->mask + 1) {
+    Index* bigger = new Index(index->bits + 1);
+    for (unsigned p = 0; p <= index->mask; ++p) {
+      const uint64_t e = index->slots[p].load(memory_order_relaxed);
+      if (e) Insert(bigger, HashWord(Convert(IdOf(e))), IdOf(e));
+    }
+    Insert(bigger, hash, id);
+    s.index.store(bigger, memory_order_release);
+    s.retired.push_back(index);  // readers may still be probing it
+  } else {
+    Insert(index, hash, id);
+  }
+  return id;
+}
@@ -0,0 +1,100 @@
+#ifndef CONCURRENT_DICT_H_
+#define CONCURRENT_DICT_H_
+
+#include <atomic>
+#include <stdint.h>
+#include <mutex>
+#include <string>
+#include <vector>
+#include "wordid.h"
+
+// string <-> id map that may be used from several threads at once (this is
+// what Dict switches to when SetThreadSafe(true) is called).
+//  * lookups of words that are already present never take a lock: strings
+//    are stored in blocks that never move, and the string -> id index of each
+//    shard is an open-addressing table that is copied (not modified in place)
+//    when it needs to grow; replaced tables are kept until the dictionary is
+//    destroyed, so a reader can never see freed memory
+//  * new words are added under a per-shard lock; ids come from a single
+//    atomic counter, so they are dense (1, 2, 3, ...) and never change.
+//    an id is published (counted by max(), put in the index) only once its
+//    string is stored and every smaller id is published, so any id a reader
+//    can get is safe to Convert
+class ConcurrentDict {
+ public:
+  ConcurrentDict();
+  ~ConcurrentDict();
+
+  // returns 0 if word is not present and frozen is true
+  WordID Convert(const std::string& word, bool frozen = false);
+
+  // id must be in [1, max()]
+  const std::string& Convert(WordID id) const {
+    const unsigned i = id - 1 + kFirstBlockSize;
+    const int b = HighestBit(i) - kFirstBlockBits;
+    return blocks_[b].load(std::memory_order_acquire)[i - (kFirstBlockSize << b)];
+  }
+
+  // number of ids published so far; the strings of ids 1 to max() are stored
+  int max() const { return published_.load(std::memory_order_acquire); }
+
+  // not thread safe
+  void clear();
+
+ private:
+  // block b holds kFirstBlockSize << b strings
+  static const int kFirstBlockBits = 10;
+  static const unsigned kFirstBlockSize = 1u << kFirstBlockBits;
+  static const int kNumBlocks = 22;
+  static const int kShardBits = 6;
+  static const int kNumShards = 1 << kShardBits;
+  static const int kInitialIndexBits = 6;
+
+  // each slot is (hash tag << 32 | id), 0 if empty
+  struct Index {
+    explicit Index(int bits);
+    ~Index() { delete[] slots; }
+    int bits;
+    unsigned mask;
+    unsigned size;  // only read/written with the shard lock held
+    std::atomic<uint64_t>* slots;
+  };
+
+  struct Shard {
+    Shard() : index(NULL) {}
+    std::atomic<Index*> index;
+    std::mutex mutex;
+    std::vector<Index*> retired;
+    char pad[64];  // keep shards on different cache lines
+  };
+
+  // the shard is picked by the low bits of the hash, the first probe
+  // position within the shard's index by the ones above them
+  static unsigned ShardOf(uint64_t hash) { return hash & (kNumShards - 1); }
+  static unsigned Probe(uint64_t hash) { return static_cast<unsigned>(hash >> kShardBits); }
+
+  static int HighestBit(unsigned x) {
+#ifdef __GNUC__
+    return 31 - __builtin_clz(x);
+#else
+    int b = 0;
+    while (x >>= 1) ++b;
+    return b;
+#endif
+  }
+
+  WordID Find(const Index& index, uint64_t hash, const std::string& word) const;
+  static void Insert(Index* index, uint64_t hash, WordID id);
+  void Store(WordID id, const std::string& word);
+  void Publish(WordID id);
+
+  std::atomic<std::string*> blocks_[kNumBlocks];
+  std::atomic<int> next_id_;    // the next id to hand out
+  std::atomic<int> published_;  // ids up to this one are published
+  Shard shards_[kNumShards];
+
+  ConcurrentDict(const ConcurrentDict&);
+  void operator=(const ConcurrentDict&);
+};
+
+#endif
@@ -25,3 +25,21 @@ void Dict::AsVector(const WordID& id, std::vector<std::string>* results) const {
   TokenizeStringSeparator(Convert(id), " ||| ", results);
 }
 
+
+void Dict::SetThreadSafe(bool ts) {
+  if (ts == (concurrent_ != NULL)) return;
+  if (ts) {
+    concurrent_ = new ConcurrentDict;
+    for (unsigned i = 0; i < words_.size(); ++i)
+      concurrent_->Convert(words_[i]);  // ids are handed out in order
+    words_.clear();
+    d_.clear();
+  } else {
+    for (int id = 1; id <= concurrent_->max(); ++id) {
+      words_.push_back(concurrent_->Convert(id));
+      d_[words_.back()] = id;
+    }
+    delete concurrent_;
+    concurrent_ = NULL;
+  }
+}
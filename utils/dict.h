@@ -7,6 +7,7 @@
 
 #include <string>
 #include <vector>
+#include "concurrent_dict.h"
 #include "hash.h"
 #include "wordid.h"
 
@@ -15,12 +16,22 @@ class Dict {
  //HASH_MAP<std::string, WordID, boost::hash<std::string> > Map;
  HASH_MAP<std::string, WordID> Map;
  public:
-  Dict() : b0_("<bad0>") {
+  Dict() : b0_("<bad0>"), concurrent_(NULL) {
     HASH_MAP_EMPTY(d_,"<bad1>");
     words_.reserve(1000);
   }
+  ~Dict() { delete concurrent_; }
 
-  inline int max() const { return words_.size(); }
+  // when set, Convert may be called concurrently from several threads:
+  // the entries are moved to a ConcurrentDict, which never locks to look
+  // up existing words or ids (ids are unchanged). Switching modes is itself
+  // not thread safe
+  void SetThreadSafe(bool ts);
+
+  inline int max() const {
+    if (concurrent_) return concurrent_->max();
+    return words_.size();
+  }
 
   static bool is_ws(char x) {
     return (x == ' ' || x == '\t');
@@ -47,6 +58,7 @@ class Dict {
   }
 
   inline WordID Convert(const std::string& word, bool frozen = false) {
+    if (concurrent_) return concurrent_->Convert(word, frozen);
     Map::iterator i = d_.find(word);
     if (i == d_.end()) {
       if (frozen)
@@ -74,18 +86,29 @@ class Dict {
 
   inline const std::string& Convert(const WordID& id) const {
     if (id == 0) return b0_;
+    if (concurrent_) {
+      assert(id <= concurrent_->max());
+      return concurrent_->Convert(id);
+    }
     assert(id <= (int)words_.size());
     return words_[id-1];
   }
 
   void AsVector(const WordID& id, std::vector<std::string>* results) const;
 
-  void clear() { words_.clear(); d_.clear(); }
+  void clear() {
+    words_.clear(); d_.clear();
+    if (concurrent_) concurrent_->clear();
+  }
 
  private:
   const std::string b0_;
   std::vector<std::string> words_;
   Map d_;
+  ConcurrentDict* concurrent_;
+
+  Dict(const Dict&);
+  void operator=(const Dict&);
 };
 
 #endif
@@ -0,0 +1,96 @@
+// measures Dict lookup throughput with several threads, comparing the
+// thread-safe mode (ConcurrentDict) with a Dict guarded by a single mutex
+//   usage: dict_bench [vocab_size] [lookups_per_thread] [new_words_per_1000]
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "dict.h"
+
+using namespace std;
+
+struct LockedDict {
+  WordID Convert(const string& w) { lock_guard<mutex> l(m); return d.Convert(w); }
+  const string& Convert(WordID id) { lock_guard<mutex> l(m); return d.Convert(id); }
+  Dict d;
+  mutex m;
+};
+
+struct PlainDict {
+  WordID Convert(const string& w) { return d.Convert(w); }
+  const string& Convert(WordID id) { return d.Convert(id); }
+  Dict d;
+};
+
+static string Word(unsigned i) {
+  ostringstream os;
+  os << "word_" << i;
+  return os.str();
+}
+
+// each lookup is a string -> id conversion followed by id -> string;
+// new_per_1000 of them are for words that are not yet in the dictionary
+template <class D>
+static void Lookups(D* d, const vector<string>* words, int n, int new_per_1000,
+                    unsigned seed, size_t* checksum) {
+  size_t sum = 0;
+  for (int i = 0; i < n; ++i) {
+    seed = seed * 1103515245u + 12345u;
+    const unsigned r = seed >> 8;
+    WordID id;
+    if (static_cast<int>(r % 1000) < new_per_1000) {
+      ostringstream os;
+      os << "new_" << seed;
+      id = d->Convert(os.str());
+    } else {
+      id = d->Convert((*words)[r % words->size()]);
+    }
+    sum += id + d->Convert(id).size();
+  }
+  *checksum = sum;
+}
+
+template <class D>
+static double Run(D* d, const vector<string>& words, int threads, int n, int new_per_1000) {
+  for (unsigned i = 0; i < words.size(); ++i) d->Convert(words[i]);
+  vector<size_t> sums(threads);
+  vector<thread> workers;
+  const chrono::steady_clock::time_point start = chrono::steady_clock::now();
+  for (int i = 0; i < threads; ++i)
+    workers.push_back(thread(Lookups<D>, d, &words, n, new_per_1000, 17u * i + 1, &sums[i]));
+  for (int i = 0; i < threads; ++i)
+    workers[i].join();
+  const double secs = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+  return threads * static_cast<double>(n) / secs / 1e6;
+}
+
+int main(int argc, char** argv) {
+  const int vocab = argc > 1 ? atoi(argv[1]) : 100000;
+  const int n = argc > 2 ? atoi(argv[2]) : 1000000;
+  const int new_per_1000 = argc > 3 ? atoi(argv[3]) : 1;
+  vector<string> words(vocab);
+  for (int i = 0; i < vocab; ++i) words[i] = Word(i);
+
+  cout << "vocabulary: " << vocab << "  lookups/thread: " << n
+       << "  new words/1000 lookups: " << new_per_1000 << endl;
+  {
+    PlainDict d;
+    cout << "Dict (unsynchronized), 1 thread: " << Run(&d, words, 1, n, new_per_1000) << " M lookups/s" << endl;
+  }
+  const int threads[] = { 1, 8, 32 };
+  for (int i = 0; i < 3; ++i) {
+    LockedDict locked;
+    const double l = Run(&locked, words, threads[i], n, new_per_1000);
+    PlainDict concurrent;
+    concurrent.d.SetThreadSafe(true);
+    const double c = Run(&concurrent, words, threads[i], n, new_per_1000);
+    cout << threads[i] << " threads:  Dict+mutex " << l << " M lookups/s   thread-safe Dict "
+         << c << " M lookups/s" << endl;
+  }
+  return 0;
+}
@@ -3,6 +3,8 @@
 #include "fdict.h"
 
 #include <iostream>
+#include <thread>
+#include <vector>
 #define BOOST_TEST_MODULE CrpTest
 #include <boost/test/unit_test.hpp>
 #include <boost/test/floating_point_comparison.hpp>
@@ -34,3 +36,45 @@ BOOST_AUTO_TEST_CASE(FDictTest) {
   assert(x != ";");
 }
 
+
+BOOST_AUTO_TEST_CASE(ThreadSafe) {
+  Dict d;
+  const WordID a = d.Convert("foo");
+  d.SetThreadSafe(true);
+  BOOST_CHECK_EQUAL(d.Convert("foo"), a);
+  BOOST_CHECK_EQUAL(d.Convert("bar", true), 0);
+  // every thread adds the same words, in a different order
+  vector<thread> threads;
+  vector<vector<WordID> > ids(8, vector<WordID>(5000));
+  for (int t = 0; t < 8; ++t)
+    threads.push_back(thread([&d, &ids, t]() {
+      for (int i = 0; i < 5000; ++i) {
+        const int w = (i * 7 + t * 613) % 5000;
+        ids[t][w] = d.Convert("w" + to_string(w));
+      }
+    }));
+  // every id up to max() has its string, even while words are being added
+  bool reader_ok = true;
+  thread reader([&d, &reader_ok]() {
+    for (int n = 0; n < 20000 && d.max() < 5001; ++n) {
+      const WordID id = d.max();
+      if (id > 1 && d.Convert(d.Convert(id), true) != id) reader_ok = false;
+    }
+  });
+  for (int t = 0; t < 8; ++t) threads[t].join();
+  reader.join();
+  BOOST_CHECK(reader_ok);
+  BOOST_CHECK_EQUAL(d.max(), 5001);
+  vector<bool> seen(d.max() + 1);
+  for (int w = 0; w < 5000; ++w) {
+    for (int t = 1; t < 8; ++t)
+      BOOST_CHECK_EQUAL(ids[t][w], ids[0][w]);
+    BOOST_CHECK_EQUAL(d.Convert(ids[0][w]), "w" + to_string(w));
+    BOOST_CHECK(!seen[ids[0][w]]);
+    seen[ids[0][w]] = true;
+  }
+  d.SetThreadSafe(false);
+  BOOST_CHECK_EQUAL(d.Convert("foo"), a);
+  BOOST_CHECK_EQUAL(d.Convert("w42"), ids[0][42]);
+  BOOST_CHECK_EQUAL(d.Convert(ids[0][4999]), "w4999");
+}
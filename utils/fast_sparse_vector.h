@@ -184,6 +184,12 @@ class FastSparseVector {
     std::memcpy(this, &other, sizeof(FastSparseVector));
     if (is_remote_) data_.rbmap = new SPARSE_HASH_MAP<unsigned, T>(*data_.rbmap);
   }
+  // takes other's storage (including the remote map) and leaves it empty
+  FastSparseVector(FastSparseVector&& other) noexcept {
+    std::memcpy(this, &other, sizeof(FastSparseVector));
+    other.is_remote_ = false;
+    other.local_size_ = 0;
+  }
   FastSparseVector(std::pair<unsigned, T>* first, std::pair<unsigned, T>* last) {
     const ptrdiff_t n = last - first;
     if (n <= LOCAL_MAX) {
@@ -222,6 +228,14 @@ class FastSparseVector {
     }
     return *this;
   }
+  FastSparseVector<T>& operator=(FastSparseVector<T>&& other) noexcept {
+    if (&other == this) return *this;
+    clear();
+    std::memcpy(this, &other, sizeof(FastSparseVector));
+    other.is_remote_ = false;
+    other.local_size_ = 0;
+    return *this;
+  }
   T const& get_singleton() const {
     assert(size()==1);
     return begin()->second;
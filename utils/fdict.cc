@@ -1,18 +1,68 @@
 #include "fdict.h"
 #include "stdlib.h"
 //for malloc (need on cygwin); todo <cstdlib> and std::malloc
+#include <cassert>
 #include <string>
 #include <sstream>
+#include <mutex>
+#include <unordered_map>
 
 using namespace std;
 
 Dict FD::dict_;
 bool FD::frozen_ = false;
+int FD::hash_bits_ = 0;
+bool FD::keep_names_ = false;
 
 #ifdef HAVE_CMPH
 PerfectHashFunction* FD::hash_ = NULL;
 #endif
 
+static mutex hashed_names_mutex;
+static unordered_map<WordID, string> hashed_names;
+
+void FD::EnableFeatureHashing(int bits, bool keep_names) {
+  if (bits < 1 || bits > 30) {
+    cerr << "Feature hashing needs between 1 and 30 bits, got " << bits << endl;
+    abort();
+  }
+  assert(dict_.max() == 0);
+  hash_bits_ = bits;
+  keep_names_ = keep_names;
+}
+
+WordID FD::HashedConvert(const string& s, bool remember) {
+  if (s.size() > 1 && s[0] == '@') {
+    char* end;
+    const long id = strtol(s.c_str() + 1, &end, 10);
+    if (*end == 0 && id > 0 && id < NumFeats()) return id;
+  }
+  uint64_t h = kNameHashInit;
+  for (unsigned i = 0; i < s.size(); ++i) h = HashNameChar(h, s[i]);
+  const WordID id = HashedId(h);
+  if (remember) RememberHashedName(id, s);
+  return id;
+}
+
+void FD::RememberHashedName(WordID id, const string& name) {
+  lock_guard<mutex> lock(hashed_names_mutex);
+  // if several names share an id, the first one is kept
+  if (hashed_names.find(id) == hashed_names.end()) hashed_names[id] = name;
+}
+
+const string& FD::HashedName(WordID w) {
+  {
+    lock_guard<mutex> lock(hashed_names_mutex);
+    unordered_map<WordID, string>::const_iterator it = hashed_names.find(w);
+    if (it != hashed_names.end()) return it->second;
+  }
+  static thread_local string tls;
+  ostringstream os;
+  os << '@' << w;
+  tls = os.str();
+  return tls;
+}
+
 std::string FD::Convert(std::vector<WordID> const& v) {
     return Convert(&*v.begin(),&*v.end());
 }
@@ -5,6 +5,8 @@
 #include "config.h"
 #endif
 
+#include <stdint.h>
+#include <cstdio>
 #include <iostream>
 #include <string>
 #include <vector>
@@ -21,6 +23,10 @@ struct FD {
   static void Freeze() {
     frozen_ = true;
   }
+  // allow Convert to be called concurrently (e.g., by a multi-threaded decoder)
+  static void SetThreadSafe(bool ts) {
+    dict_.SetThreadSafe(ts);
+  }
   static bool UsingPerfectHashFunction() {
 #ifdef HAVE_CMPH
     return hash_;
@@ -37,22 +43,54 @@ struct FD {
     (void) cmph_file;
 #endif
   }
+  // feature hashing: instead of growing a dictionary, every feature name is
+  // mapped to one of 2^bits ids by a 64-bit hash of its characters (so
+  // different names may share an id). the ids only depend on the names, not
+  // on the order in which they are seen. names given to Convert are
+  // remembered so that Convert(id) can return them (e.g. when weights are
+  // written); names built with FeatureName only are if keep_names is set.
+  // ids without a name are written as "@id", which Convert maps back to id
+  static void EnableFeatureHashing(int bits, bool keep_names);
+  static bool UsingFeatureHashing() {
+    return hash_bits_ > 0;
+  }
+  static bool KeepingHashedNames() {
+    return keep_names_;
+  }
+  // the hash of a name is computed one character at a time (FNV-1a), so a
+  // name given in pieces hashes the same as the whole string
+  static const uint64_t kNameHashInit = 14695981039346656037ULL;
+  static inline uint64_t HashNameChar(uint64_t h, char c) {
+    return (h ^ static_cast<unsigned char>(c)) * 1099511628211ULL;
+  }
+  // the id of a name whose hash is h
+  static inline WordID HashedId(uint64_t h) {
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdULL;
+    h ^= h >> 33;
+    h *= 0xc4ceb9fe1a85ec53ULL;
+    h ^= h >> 33;
+    return 1 + static_cast<WordID>(h & ((uint64_t(1) << hash_bits_) - 1));
+  }
   static inline int NumFeats() {
+    if (hash_bits_) return (1 << hash_bits_) + 1;
 #ifdef HAVE_CMPH
     if (hash_) return hash_->number_of_keys();
 #endif
     return dict_.max() + 1;
   }
   static inline WordID Convert(const std::string& s) {
+    if (hash_bits_) return HashedConvert(s);
 #ifdef HAVE_CMPH
     if (hash_) return (*hash_)(s);
 #endif
     return dict_.Convert(s, frozen_);
   }
   static inline const std::string& Convert(const WordID& w) {
+    if (hash_bits_) return HashedName(w);
 #ifdef HAVE_CMPH
     if (hash_) {
-      static std::string tls;
+      static thread_local std::string tls;
       std::ostringstream os;
       os << w;
       tls = os.str();
@@ -61,6 +99,15 @@ struct FD {
 #endif
     return dict_.Convert(w);
   }
+  // the id of s if it is already known (with feature hashing, the id s
+  // hashes to), else 0. unlike Convert, s is never added
+  static inline WordID Lookup(const std::string& s) {
+    if (hash_bits_) return HashedConvert(s, false);
+#ifdef HAVE_CMPH
+    if (hash_) return (*hash_)(s);
+#endif
+    return dict_.Convert(s, true);
+  }
   static std::string Convert(WordID const *i,WordID const* e);
   static std::string Convert(std::vector<WordID> const& v);
 
@@ -69,10 +116,62 @@ struct FD {
   static std::string Escape(const std::string& s);
   static Dict dict_;
  private:
+  friend class FeatureName;
+  static WordID HashedConvert(const std::string& s, bool remember = true);
+  static const std::string& HashedName(WordID w);
+  static void RememberHashedName(WordID id, const std::string& name);
   static bool frozen_;
+  static int hash_bits_;
+  static bool keep_names_;
 #ifdef HAVE_CMPH
   static PerfectHashFunction* hash_;
 #endif
 };
 
+// the id of a feature whose name is put together from several pieces, e.g.
+//   FeatureName name; name << "RBS:" << TD::Convert(w1) << '_' << TD::Convert(w2);
+//   const int fid = name.Id();
+// gives the same id as FD::Convert of the whole name. with feature hashing
+// (unless names are kept) the pieces are only hashed and the name is never
+// built
+class FeatureName {
+ public:
+  FeatureName() : build_(!FD::UsingFeatureHashing() || FD::KeepingHashedNames()),
+                  hash_(FD::kNameHashInit) {}
+  FeatureName& operator<<(char c) {
+    hash_ = FD::HashNameChar(hash_, c);
+    if (build_) name_ += c;
+    return *this;
+  }
+  FeatureName& operator<<(const char* s) {
+    for (; *s; ++s) *this << *s;
+    return *this;
+  }
+  FeatureName& operator<<(const std::string& s) {
+    for (unsigned i = 0; i < s.size(); ++i) hash_ = FD::HashNameChar(hash_, s[i]);
+    if (build_) name_ += s;
+    return *this;
+  }
+  FeatureName& operator<<(int n) {
+    char buf[16];
+    snprintf(buf, sizeof(buf), "%d", n);
+    return *this << static_cast<const char*>(buf);
+  }
+  WordID Id() const {
+    if (!FD::UsingFeatureHashing()) return FD::Convert(name_);
+    const WordID id = FD::HashedId(hash_);
+    if (build_) FD::RememberHashedName(id, name_);
+    return id;
+  }
+  void Clear() {
+    hash_ = FD::kNameHashInit;
+    name_.clear();
+  }
+
+ private:
+  bool build_;
+  uint64_t hash_;
+  std::string name_;
+};
+
 #endif
@@ -0,0 +1,38 @@
+#include "fdict.h"
+
+#define BOOST_TEST_MODULE FDictTest
+#include <boost/test/unit_test.hpp>
+
+using namespace std;
+
+// feature hashing cannot be turned off again, so it has its own test program
+BOOST_AUTO_TEST_CASE(FeatureHashing) {
+  FD::EnableFeatureHashing(20, true);
+  BOOST_CHECK(FD::UsingFeatureHashing());
+  BOOST_CHECK_EQUAL(FD::NumFeats(), (1 << 20) + 1);
+  const WordID a = FD::Convert("RBS:le_chat");
+  BOOST_CHECK(a > 0 && a < FD::NumFeats());
+  BOOST_CHECK_EQUAL(FD::Convert("RBS:le_chat"), a);
+  BOOST_CHECK(FD::Convert("RBS:le_chien") != a);
+  BOOST_CHECK_EQUAL(FD::Convert(a), "RBS:le_chat");
+  // a lookup gives the same id, without remembering the name
+  BOOST_CHECK_EQUAL(FD::Lookup("RBS:le_chat"), a);
+  const WordID looked_up = FD::Lookup("RBS:le_lapin");
+  BOOST_CHECK(looked_up > 0 && looked_up < FD::NumFeats());
+  BOOST_CHECK_EQUAL(FD::Convert(looked_up)[0], '@');
+
+  // a name built from pieces has the id of the whole name
+  FeatureName name;
+  const string le = "le";
+  name << "RBS:" << le << '_' << "chat";
+  BOOST_CHECK_EQUAL(name.Id(), a);
+  name.Clear();
+  name << "R:" << 'N' << 12;
+  BOOST_CHECK_EQUAL(name.Id(), FD::Convert("R:N12"));
+  BOOST_CHECK_EQUAL(FD::Convert(name.Id()), "R:N12");
+
+  // ids without a known name are written as @id and read back
+  int unnamed = 1;
+  while (FD::Convert(unnamed)[0] != '@') ++unnamed;
+  BOOST_CHECK_EQUAL(FD::Convert(FD::Convert(unnamed)), unnamed);
+}
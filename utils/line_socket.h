@@ -0,0 +1,130 @@
+#ifndef LINE_SOCKET_H_
+#define LINE_SOCKET_H_
+
+// line-oriented I/O over a connected UNIX domain stream socket, as used by
+// cdec_server, the extractor's grammar server and the decoder's grammar
+// server client (header only, so the extractor can use it without libutils)
+
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <mutex>
+#include <string>
+
+class LineSocket {
+ public:
+  // takes over the connected socket fd, which is closed with the object
+  explicit LineSocket(int fd) : fd_(fd), used_(), size_() {}
+  ~LineSocket() { if (fd_ >= 0) close(fd_); }
+
+  // returns a socket connected to the socket at path, or -1 (and the reason
+  // in *error)
+  static int Connect(const std::string& path, std::string* error) {
+    sockaddr_un addr;
+    if (!MakeAddress(path, &addr, error)) return -1;
+    const int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0 || connect(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) < 0) {
+      *error = "Cannot connect to " + path + ": " + strerror(errno);
+      if (fd >= 0) close(fd);
+      return -1;
+    }
+    return fd;
+  }
+
+  // returns a socket listening at path (a file left there is replaced), or
+  // -1 (and the reason in *error)
+  static int Listen(const std::string& path, std::string* error) {
+    sockaddr_un addr;
+    if (!MakeAddress(path, &addr, error)) return -1;
+    const int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0) {
+      *error = "Cannot create socket " + path + ": " + strerror(errno);
+      return -1;
+    }
+    unlink(path.c_str());
+    if (bind(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) < 0 || listen(fd, 64) < 0) {
+      *error = "Cannot listen on " + path + ": " + strerror(errno);
+      close(fd);
+      return -1;
+    }
+    return fd;
+  }
+
+  // reads the next line, without its "\n" or "\r\n". returns false at the
+  // end of the input
+  bool ReadLine(std::string* line) {
+    line->clear();
+    while (true) {
+      for (; used_ < size_; ++used_) {
+        if (buf_[used_] == '\n') {
+          ++used_;
+          if (!line->empty() && (*line)[line->size() - 1] == '\r') line->resize(line->size() - 1);
+          return true;
+        }
+        line->push_back(buf_[used_]);
+      }
+      if (!Fill()) return false;
+    }
+  }
+
+  // reads exactly n bytes. returns false if the input ends before
+  bool Read(size_t n, std::string* data) {
+    data->resize(n);
+    for (size_t done = 0; done < n; ) {
+      if (used_ == size_ && !Fill()) return false;
+      const size_t k = std::min(n - done, size_ - used_);
+      memcpy(&(*data)[done], buf_ + used_, k);
+      done += k;
+      used_ += k;
+    }
+    return true;
+  }
+
+  // writes all of data; writes from different threads are not interleaved.
+  // returns false if the peer went away
+  bool Write(const std::string& data) {
+    std::lock_guard<std::mutex> lock(write_mutex_);
+    for (size_t done = 0; done < data.size(); ) {
+      const ssize_t w = send(fd_, data.data() + done, data.size() - done, MSG_NOSIGNAL);
+      if (w < 0 && errno == EINTR) continue;
+      if (w <= 0) return false;
+      done += w;
+    }
+    return true;
+  }
+
+ private:
+  LineSocket(const LineSocket&);
+  void operator=(const LineSocket&);
+
+  static bool MakeAddress(const std::string& path, sockaddr_un* addr, std::string* error) {
+    memset(addr, 0, sizeof(*addr));
+    addr->sun_family = AF_UNIX;
+    if (path.size() >= sizeof(addr->sun_path)) {
+      *error = "Socket path is too long: " + path;
+      return false;
+    }
+    strcpy(addr->sun_path, path.c_str());
+    return true;
+  }
+
+  bool Fill() {
+    ssize_t r;
+    do { r = read(fd_, buf_, sizeof(buf_)); } while (r < 0 && errno == EINTR);
+    if (r <= 0) return false;
+    used_ = 0;
+    size_ = r;
+    return true;
+  }
+
+  const int fd_;
+  char buf_[65536];
+  size_t used_;
+  size_t size_;
+  std::mutex write_mutex_;
+};
+
+#endif
@@ -84,6 +84,22 @@ class SmallVector {
     }
   }
 
+  // leaves o empty.  noexcept so that std::vector moves (rather than copies)
+  // elements holding SmallVectors when it grows
+  SmallVector(Self&& o) noexcept {
+    std::memcpy(static_cast<void*>(this), static_cast<void*>(&o), sizeof(Self));
+    o.size_ = 0;
+  }
+
+  Self& operator=(Self&& o) noexcept {
+    if (&o != this) {
+      if (size_ > SV_MAX) delete[] data_.ptr;
+      std::memcpy(static_cast<void*>(this), static_cast<void*>(&o), sizeof(Self));
+      o.size_ = 0;
+    }
+    return *this;
+  }
+
   //TODO: test.  this invalidates more iterators than std::vector since resize may move from ptr to vals.
   T *erase(T *b) {
     return erase(b,b+1);
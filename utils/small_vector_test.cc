@@ -94,6 +94,22 @@ BOOST_AUTO_TEST_CASE(SwapSV) {
   BOOST_CHECK(v4 == v2);
 }
 
+BOOST_AUTO_TEST_CASE(MoveSV) {
+  SmallVectorInt v;
+  for (int i = 0; i < 5; ++i) v.push_back(i);
+  SmallVectorInt v2(std::move(v));
+  BOOST_CHECK(v.empty());
+  BOOST_CHECK_EQUAL(v2.size(), 5);
+  BOOST_CHECK_EQUAL(v2[4], 4);
+  SmallVectorInt v3(2, 10);
+  v3 = std::move(v2);
+  BOOST_CHECK(v2.empty());
+  BOOST_CHECK_EQUAL(v3.size(), 5);
+  BOOST_CHECK_EQUAL(v3[0], 0);
+  v2 = std::move(v3);
+  BOOST_CHECK_EQUAL(v2.size(), 5);
+}
+
 BOOST_AUTO_TEST_CASE(Small) {
   SmallVectorInt v;
   SmallVectorInt v1(1,0);
@@ -0,0 +1,75 @@
+#include "sparse_dot.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#include <immintrin.h>
+#define SPARSE_DOT_X86 1
+#endif
+
+typedef void (*DotsFn)(const unsigned*, unsigned, const unsigned*, const double*,
+                       const double*, unsigned, double*);
+
+static inline double DotScalar(const unsigned* ids, const double* values, unsigned n,
+                               const double* w, unsigned num_weights) {
+  double s[4] = { 0, 0, 0, 0 };
+  for (unsigned i = 0; i < n; ++i)
+    if (ids[i] < num_weights) s[i & 3] += values[i] * w[ids[i]];
+  return (s[0] + s[1]) + (s[2] + s[3]);
+}
+
+#if SPARSE_DOT_X86
+__attribute__((target("avx2")))
+static inline double DotAVX2(const unsigned* ids, const double* values, unsigned n,
+                             const double* w, unsigned num_weights) {
+  // ids are unsigned, so they are compared as signed ints after flipping
+  // the top bit. out of range lanes gather nothing and add 0
+  const __m128i flip = _mm_set1_epi32(0x80000000);
+  const __m128i limit = _mm_xor_si128(_mm_set1_epi32(num_weights), flip);
+  __m256d sum = _mm256_setzero_pd();
+  unsigned i = 0;
+  for (; i + 4 <= n; i += 4) {
+    const __m128i id = _mm_loadu_si128(reinterpret_cast<const __m128i*>(ids + i));
+    const __m256d in_range = _mm256_castsi256_pd(_mm256_cvtepi32_epi64(
+        _mm_cmplt_epi32(_mm_xor_si128(id, flip), limit)));
+    const __m256d wv = _mm256_mask_i32gather_pd(_mm256_setzero_pd(), w, id, in_range, 8);
+    sum = _mm256_add_pd(sum, _mm256_and_pd(_mm256_mul_pd(_mm256_loadu_pd(values + i), wv), in_range));
+  }
+  double s[4];
+  _mm256_storeu_pd(s, sum);
+  for (; i < n; ++i)
+    if (ids[i] < num_weights) s[i & 3] += values[i] * w[ids[i]];
+  return (s[0] + s[1]) + (s[2] + s[3]);
+}
+#endif
+
+static void DotsScalar(const unsigned* start, unsigned rows,
+                       const unsigned* ids, const double* values,
+                       const double* w, unsigned num_weights, double* result) {
+  for (unsigned r = 0; r < rows; ++r)
+    result[r] = DotScalar(ids + start[r], values + start[r], start[r + 1] - start[r], w, num_weights);
+}
+
+#if SPARSE_DOT_X86
+__attribute__((target("avx2")))
+static void DotsAVX2(const unsigned* start, unsigned rows,
+                     const unsigned* ids, const double* values,
+                     const double* w, unsigned num_weights, double* result) {
+  for (unsigned r = 0; r < rows; ++r)
+    result[r] = DotAVX2(ids + start[r], values + start[r], start[r + 1] - start[r], w, num_weights);
+}
+#endif
+
+static DotsFn SelectDots() {
+#if SPARSE_DOT_X86
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx2")) return DotsAVX2;
+#endif
+  return DotsScalar;
+}
+
+void SparseDenseDots(const unsigned* start, unsigned rows,
+                     const unsigned* ids, const double* values,
+                     const double* w, unsigned num_weights,
+                     double* result) {
+  static const DotsFn dots = SelectDots();
+  dots(start, rows, ids, values, w, num_weights, result);
+}
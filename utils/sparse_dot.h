@@ -0,0 +1,23 @@
+#ifndef _SPARSE_DOT_H_
+#define _SPARSE_DOT_H_
+
+// dot products of the rows of a sparse matrix in CSR form with a dense
+// vector: row r has the features ids[start[r]..start[r+1]) with values
+// values[start[r]..start[r+1]), and result[r] = sum values[i] * w[ids[i]]
+// (ids >= num_weights are skipped).
+//
+// on CPUs with AVX2 (detected at run time) four weights are gathered and
+// multiplied at once. feature i of a row is added to partial sum i % 4 and
+// the row's result is (s0 + s1) + (s2 + s3) whichever version runs, so scores
+// do not depend on the machine (but may differ in the last bits from a
+// sequential sum like FastSparseVector::dot).
+//
+// this is the kernel behind FlatEdgeFeatures (decoder/hg_features.h), i.e.
+// repeated rescoring of a fixed forest; single sparse vectors are still
+// scored with FastSparseVector::dot.
+void SparseDenseDots(const unsigned* start, unsigned rows,
+                     const unsigned* ids, const double* values,
+                     const double* w, unsigned num_weights,
+                     double* result);
+
+#endif
@@ -22,3 +22,16 @@ BOOST_AUTO_TEST_CASE(Division) {
   x /= -1;
   BOOST_CHECK(x == y);
 }
+
+BOOST_AUTO_TEST_CASE(Move) {
+  SparseVector<double> x;
+  for (int i = 1; i <= 20; ++i) x.set_value(i, i);
+  SparseVector<double> y(x);
+  SparseVector<double> z(std::move(y));
+  BOOST_CHECK(z == x);
+  BOOST_CHECK(y.empty());
+  y.set_value(1, 2);
+  y = std::move(z);
+  BOOST_CHECK(y == x);
+  BOOST_CHECK(z.empty());
+}
@@ -14,6 +14,10 @@ struct TD {
   static std::string GetString(const std::vector<WordID>& str);
   static std::string GetString(WordID const* i,WordID const* e);
   static int AppendString(const WordID& w, int pos, int bufsize, char* buffer);
+  // allow Convert to be called concurrently (e.g., by a multi-threaded decoder)
+  static void SetThreadSafe(bool ts) {
+    dict_.SetThreadSafe(ts);
+  }
   static unsigned int NumWords() {
     return dict_.max();
   }
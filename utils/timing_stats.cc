@@ -1,21 +1,33 @@
 #include "timing_stats.h"
 
 #include <iostream>
-#include "time.h" //cygwin needs
+#include <mutex>
+#include <vector>
 
 #include "verbose.h"
 
 using namespace std;
 
-map<string, TimerInfo> Timer::stats;
+thread_local map<string, TimerInfo> Timer::stats;
 
-Timer::Timer(const string& timername) : start_t(clock()), cur(stats[timername]) {}
+static mutex counters_mutex;
+static vector<Counter*>& Counters() {
+  static vector<Counter*> counters;
+  return counters;
+}
+
+Counter::Counter(const string& name) : name_(name), count_(0) {
+  lock_guard<mutex> lock(counters_mutex);
+  Counters().push_back(this);
+}
+
+// wall time: clock() would charge every thread with the CPU time of all the
+// worker threads in --threads mode
+Timer::Timer(const string& timername) : start_t(chrono::steady_clock::now()), cur(stats[timername]) {}
 
 Timer::~Timer() {
   ++cur.calls;
-  const clock_t end_t = clock();
-  const double elapsed = (end_t - start_t) / 1000000.0;
-  cur.total_time += elapsed;
+  cur.total_time += chrono::duration<double>(chrono::steady_clock::now() - start_t).count();
 }
 
 void Timer::Summarize() {
@@ -25,5 +37,11 @@ void Timer::Summarize() {
     }
   }
   stats.clear();
+  lock_guard<mutex> lock(counters_mutex);
+  const vector<Counter*>& counters = Counters();
+  for (unsigned i = 0; i < counters.size(); ++i) {
+    const unsigned long count = counters[i]->count_.exchange(0);
+    if (count && !SILENT) cerr << counters[i]->name_ << ": " << count << endl;
+  }
 }
 
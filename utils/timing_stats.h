@@ -1,6 +1,8 @@
 #ifndef _TIMING_STATS_H_
 #define _TIMING_STATS_H_
 
+#include <atomic>
+#include <chrono>
 #include <string>
 #include <map>
 
@@ -10,13 +12,27 @@ struct TimerInfo {
   TimerInfo() : calls(), total_time() {}
 };
 
+// counts events (e.g. cache hits) from any thread; Timer::Summarize reports
+// and resets all counters. counters must live as long as the program
+// (e.g. be static), since they cannot be unregistered
+struct Counter {
+  explicit Counter(const std::string& name);
+  void Add(unsigned long n = 1) { count_.fetch_add(n, std::memory_order_relaxed); }
+ private:
+  friend struct Timer;
+  const std::string name_;
+  std::atomic<unsigned long> count_;
+  Counter(const Counter& other);
+  const Counter& operator=(const Counter& other);
+};
+
 struct Timer {
   Timer(const std::string& info);
   ~Timer();
   static void Summarize();
  private:
-  static std::map<std::string, TimerInfo> stats;
-  clock_t start_t;
+  static thread_local std::map<std::string, TimerInfo> stats;  // per thread
+  std::chrono::steady_clock::time_point start_t;  // wall time, not process CPU time
   TimerInfo& cur;
   Timer(const Timer& other);
   const Timer& operator=(const Timer& other);
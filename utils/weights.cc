@@ -104,6 +104,8 @@ void Weights::WriteToFile(const string& fname,
     if (extra) { o << "# " << *extra << endl; }
     o.precision(17);
     const unsigned num_feats = FD::NumFeats();
+    // with feature hashing most of the id space is unused
+    if (FD::UsingFeatureHashing()) hide_zero_value_features = true;
     for (unsigned i = 1; i < num_feats; ++i) {
       const weight_t val = (i < weights.size() ? weights[i] : 0.0);
       if (hide_zero_value_features && val == 0.0) continue;